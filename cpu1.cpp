@@ -45,30 +45,27 @@ bool load_binary(const char* filename) {
     return true;
 }
 
-// Function to read a 32-bit word from memory (little-endian)
+// Function to read a 32-bit word from memory (big-endian, as on the PowerPC)
 inline uint32_t read_word(uint32_t address) {
     if (address > MEMORY_SIZE - 4) {
         std::cerr << "Error: Memory read out of bounds at address 0x" 
                   << std::hex << address << std::endl;
         return 0;
     }
-    return static_cast<uint32_t>(memory[address]) |
-           (static_cast<uint32_t>(memory[address + 1]) << 8) |
-           (static_cast<uint32_t>(memory[address + 2]) << 16) |
-           (static_cast<uint32_t>(memory[address + 3]) << 24);
+    uint32_t value;
+    std::memcpy(&value, &memory[address], sizeof(value));
+    return __builtin_bswap32(value);
 }
 
-// Function to write a 32-bit word to memory (little-endian)
+// Function to write a 32-bit word to memory (big-endian, as on the PowerPC)
 inline void write_word(uint32_t address, uint32_t value) {
     if (address > MEMORY_SIZE - 4) {
         std::cerr << "Error: Memory write out of bounds at address 0x" 
                   << std::hex << address << std::endl;
         return;
     }
-    memory[address]     = value & 0xFF;
-    memory[address + 1] = (value >> 8) & 0xFF;
-    memory[address + 2] = (value >> 16) & 0xFF;
-    memory[address + 3] = (value >> 24) & 0xFF;
+    value = __builtin_bswap32(value);
+    std::memcpy(&memory[address], &value, sizeof(value));
 }
 
 // Fetch the next instruction from memory
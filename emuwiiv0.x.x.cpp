@@ -11,289 +11,11312 @@
 #include <unordered_map>
 #include <memory>
 #include <stdexcept>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <chrono>
+#include <array>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <filesystem>
+#include <future>
 #include <SDL2/SDL.h>
 
 // Constants
-constexpr uint32_t kMemorySize = (24 + 64) * 1024 * 1024;  // 88 MB
+constexpr uint32_t kMem1Size = 24 * 1024 * 1024;           // 24 MB MEM1
+constexpr uint32_t kMem2Size = 64 * 1024 * 1024;           // 64 MB MEM2
+constexpr uint32_t kMemorySize = kMem1Size + kMem2Size;    // 88 MB backing store
+constexpr uint32_t kMem1PhysBase = 0x00000000;
+constexpr uint32_t kMem2PhysBase = 0x10000000;
+constexpr uint32_t kPageShift = 12;                        // 4 KB pages
+constexpr uint32_t kPageSize = 1u << kPageShift;
+constexpr uint32_t kPageMask = kPageSize - 1;
+constexpr uint32_t kNumPages = 1u << (32 - kPageShift);
+constexpr uint32_t kRamPages = kMemorySize / kPageSize;
 constexpr int kScreenWidth = 640;
 constexpr int kScreenHeight = 480;
+constexpr uint64_t kCpuClockHz = 729000000;                // Broadway
+constexpr int kMaxRunAhead = 8;                            // Frames run ahead per shown frame
 
-// Forward Declarations for Kernel Functions
-void HandleSystemCall(uint32_t syscall_number, class CPUState& state);
-void InitializeKernelFunctions();
+// CPU State Structure - PowerPC Architecture
+struct FPR {
+    float ps0;
+    float ps1;
+};
+
+constexpr uint32_t kSprLR = 8;       // Link Register
+
+class CPUState {
+public:
+    uint32_t pc;                      // Program Counter
+    uint32_t gpr[32];                 // General Purpose Registers
+    FPR fpr[32];                      // Floating Point Registers (paired singles)
+    uint32_t spr[1024];               // Special Purpose Registers
+    bool running;                     // Emulation loop control
+    bool interrupts_enabled;         // Interrupt management
+    bool kernel_mode;                 // Kernel mode flag
+
+    CPUState() : pc(0), running(true), interrupts_enabled(false), kernel_mode(false) {
+        std::memset(gpr, 0, sizeof(gpr));
+        std::memset(fpr, 0, sizeof(fpr));
+        std::memset(spr, 0, sizeof(spr));
+    }
+};
+
+// Big-Endian Access Helpers
+// Guest memory is big-endian. Values are moved with memcpy (no alignment
+// requirement, compiles to a single load/store) and swapped with the compiler
+// builtins, so every width below reduces to one mov + bswap.
+template <size_t Size> struct UnsignedOfSize;
+template <> struct UnsignedOfSize<1> { using Type = uint8_t; };
+template <> struct UnsignedOfSize<2> { using Type = uint16_t; };
+template <> struct UnsignedOfSize<4> { using Type = uint32_t; };
+template <> struct UnsignedOfSize<8> { using Type = uint64_t; };
+
+inline uint8_t ByteSwap(uint8_t value) { return value; }
+inline uint16_t ByteSwap(uint16_t value) { return __builtin_bswap16(value); }
+inline uint32_t ByteSwap(uint32_t value) { return __builtin_bswap32(value); }
+inline uint64_t ByteSwap(uint64_t value) { return __builtin_bswap64(value); }
+
+template <typename T>
+inline T LoadBigEndian(const uint8_t* ptr) {
+    static_assert(std::is_arithmetic<T>::value, "Guest loads must be integral or floating point");
+    typename UnsignedOfSize<sizeof(T)>::Type raw;
+    std::memcpy(&raw, ptr, sizeof(raw));
+    raw = ByteSwap(raw);
+    T value;
+    std::memcpy(&value, &raw, sizeof(value));
+    return value;
+}
+
+template <typename T>
+inline void StoreBigEndian(uint8_t* ptr, T value) {
+    static_assert(std::is_arithmetic<T>::value, "Guest stores must be integral or floating point");
+    typename UnsignedOfSize<sizeof(T)>::Type raw;
+    std::memcpy(&raw, &value, sizeof(raw));
+    raw = ByteSwap(raw);
+    std::memcpy(ptr, &raw, sizeof(raw));
+}
+
+// Content Hashing
+// XXH64 over host bytes, used to key caches of guest data. Reads are
+// little-endian as the reference implementation specifies, so hashes match
+// other xxHash tools on x86.
+constexpr uint64_t kXXPrime1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t kXXPrime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t kXXPrime3 = 0x165667B19E3779F9ull;
+constexpr uint64_t kXXPrime4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t kXXPrime5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t RotateLeft64(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+inline uint64_t XXHashRound(uint64_t accumulator, uint64_t input) {
+    return RotateLeft64(accumulator + input * kXXPrime2, 31) * kXXPrime1;
+}
+
+inline uint64_t XXHashMerge(uint64_t hash, uint64_t accumulator) {
+    return (hash ^ XXHashRound(0, accumulator)) * kXXPrime1 + kXXPrime4;
+}
+
+inline uint64_t XXHash64(const void* data, size_t size, uint64_t seed = 0) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    auto read64 = [](const uint8_t* q) { uint64_t v; std::memcpy(&v, q, 8); return v; };
+    auto read32 = [](const uint8_t* q) { uint32_t v; std::memcpy(&v, q, 4); return v; };
+    uint64_t hash;
+    if (size >= 32) {
+        uint64_t v1 = seed + kXXPrime1 + kXXPrime2, v2 = seed + kXXPrime2, v3 = seed, v4 = seed - kXXPrime1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = XXHashRound(v1, read64(p));
+            v2 = XXHashRound(v2, read64(p + 8));
+            v3 = XXHashRound(v3, read64(p + 16));
+            v4 = XXHashRound(v4, read64(p + 24));
+        }
+        hash = RotateLeft64(v1, 1) + RotateLeft64(v2, 7) + RotateLeft64(v3, 12) + RotateLeft64(v4, 18);
+        hash = XXHashMerge(XXHashMerge(XXHashMerge(XXHashMerge(hash, v1), v2), v3), v4);
+    } else {
+        hash = seed + kXXPrime5;
+    }
+    hash += size;
+    for (; p + 8 <= end; p += 8) {
+        hash = RotateLeft64(hash ^ XXHashRound(0, read64(p)), 27) * kXXPrime1 + kXXPrime4;
+    }
+    if (p + 4 <= end) {
+        hash = RotateLeft64(hash ^ (read32(p) * kXXPrime1), 23) * kXXPrime2 + kXXPrime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        hash = RotateLeft64(hash ^ (*p * kXXPrime5), 11) * kXXPrime1;
+    }
+    hash ^= hash >> 33;
+    hash *= kXXPrime2;
+    hash ^= hash >> 29;
+    hash *= kXXPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Write-Gather Pipe
+// Broadway collects stores to the gather pipe address (0xCC008000) in a
+// 32-byte buffer and sends them on to the GP FIFO only as whole bursts. There
+// is one pipe per CPU core. Memory routes stores on the pipe's page here
+// directly rather than through a device handler, and a JIT can append inline:
+// the buffer sits at offset 0 and the fill count right after it.
+constexpr uint32_t kGatherPipeAddress = 0x0C008000;
+constexpr uint32_t kGatherPipeBurst = 32;
+
+class GatherPipe {
+public:
+    using BurstHandler = std::function<void(const uint8_t* burst)>;
+
+    struct Stats {
+        uint64_t bursts = 0;
+        uint64_t bytes = 0;
+    };
+
+    void SetBurstHandler(BurstHandler handler) { on_burst = std::move(handler); }
+
+    template <typename T>
+    void Write(T value) {
+        StoreBigEndian<T>(buffer + count, value);
+        count += sizeof(T);
+        if (count >= kGatherPipeBurst) {
+            SendBursts();
+        }
+    }
+
+    // Closes the per-frame counters; GetFrameStats reports the frame just ended
+    void EndFrame() {
+        last_frame = frame;
+        total.bursts += frame.bursts;
+        total.bytes += frame.bytes;
+        frame = Stats{};
+    }
+
+    uint32_t GetPendingBytes() const { return count; }
+
+    // The bytes written since the last burst, for savestates
+    struct Pending {
+        uint8_t bytes[kGatherPipeBurst] = {};
+        uint32_t count = 0;
+    };
+    void SavePending(Pending& pending) const {
+        std::memcpy(pending.bytes, buffer, count);
+        pending.count = count;
+    }
+    void LoadPending(const Pending& pending) {
+        std::memcpy(buffer, pending.bytes, pending.count);
+        count = pending.count;
+    }
+
+    const Stats& GetFrameStats() const { return last_frame; }
+    const Stats& GetTotalStats() const { return total; }
+
+private:
+    uint8_t buffer[kGatherPipeBurst + 8] = {};  // Room for a 64-bit store past a burst
+    uint32_t count = 0;
+    BurstHandler on_burst;
+    Stats frame;
+    Stats last_frame;
+    Stats total;
+
+    void SendBursts() {
+        while (count >= kGatherPipeBurst) {
+            if (on_burst) on_burst(buffer);
+            ++frame.bursts;
+            frame.bytes += kGatherPipeBurst;
+            count -= kGatherPipeBurst;
+            std::memmove(buffer, buffer + kGatherPipeBurst, count);
+        }
+    }
+};
+
+// Physical Memory Map
+// MEM1 (24 MB 1T-SRAM) and MEM2 (64 MB GDDR3) share one host allocation so a
+// RAM offset can index per-page side tables directly. Guest addresses are
+// resolved through a flat table with one entry per 4 KB page covering the whole
+// 32-bit space, so the physical ranges and the default BAT mirrors
+// (0x80000000/0xC0000000 MEM1, 0x90000000/0xD0000000 MEM2, 0xCC/0xCD MMIO) are
+// just additional entries pointing at the same backing store.
+//
+// Every RAM page also carries a write version that only ever increases.
+// Caches derived from RAM contents (textures, display lists, snapshots)
+// remember the versions they were built from instead of re-hashing memory.
+// Guest stores do not bump it themselves: Write only marks the page on its
+// first store, and PublishWrites folds the marked pages into their versions.
+//
+// Threading: Write, its marks and PublishWrites belong to the CPU thread,
+// which publishes before handing FIFO data to the GPU thread and before
+// checking versions itself. Versions are atomic and are only bumped with
+// fetch_add, so MarkDirty and RangeVersion may run on either thread; RAM
+// contents are ordered by whatever hands the work over (the FIFO ring).
+//
+// RAM pages can be protected: every mapping of the page takes the slow path,
+// where the first access runs the fault handler before retrying. Host-side
+// accessors (GetPointer and friends) fault the same way; RangeVersion and
+// MarkDirty do not.
+enum PageHandler : uint8_t {
+    kPageRam = 0,        // host[] holds a direct pointer; never reaches a handler
+    kPageUnmapped = 1,   // Bus error
+    kPageGatherPipe = 2, // Stores go to the attached GatherPipe, reads return 0
+    kPageProtected = 3,  // RAM whose contents the fault handler must supply first
+    kFirstDeviceHandler = 4
+};
+
+struct PageTable {
+    // host[page] points at the first byte of the page, or nullptr when the
+    // access must take the slow path through handler[page]. The JIT emits
+    //   mov rax, [table + (ea >> kPageShift) * 8]; test rax, rax; jz slow
+    //   mov eax, [rax + (ea & kPageMask)]; bswap eax
+    // so this layout must stay a plain array at offset 0; Memory itself
+    // reads and writes entries atomically (see Memory::StoreEntry). Stores
+    // must also set written[page] when it is clear (see Memory::Write).
+    uint8_t* host[kNumPages];
+    uint8_t handler[kNumPages];
+    uint8_t written[kNumPages];     // CPU thread: stored to since Memory::PublishWrites
+};
+
+// Handler for address ranges that are not plain RAM (MMIO blocks). Accesses
+// are 1, 2 or 4 bytes wide; 8-byte accesses are split by Memory.
+struct MMIOCallbacks {
+    std::function<uint32_t(uint32_t address, uint32_t size)> read;
+    std::function<void(uint32_t address, uint32_t value, uint32_t size)> write;
+};
+
+// Page-aligned allocation for guest RAM so SIMD copies never split cache lines
+struct PageAlignedDelete {
+    void operator()(uint8_t* ptr) const { ::operator delete[](ptr, std::align_val_t(kPageSize)); }
+};
+
+// Emulator Memory (Using Smart Pointers for Memory Management)
+class Memory {
+public:
+    Memory() {
+        ram.reset(new (std::align_val_t(kPageSize)) uint8_t[kMemorySize]);
+        std::memset(ram.get(), 0, kMemorySize);
+        page_versions = std::make_unique<std::atomic<uint32_t>[]>(kRamPages);
+        page_table = std::make_unique<PageTable>();
+        std::fill(std::begin(page_table->host), std::end(page_table->host), nullptr);
+        std::fill(std::begin(page_table->written), std::end(page_table->written), 0);
+        std::fill(std::begin(page_table->handler), std::end(page_table->handler),
+                  static_cast<uint8_t>(kPageUnmapped));
+        handlers.resize(kFirstDeviceHandler);
+
+        // Physical view
+        MapRam(kMem1PhysBase, 0, kMem1Size);
+        MapRam(kMem2PhysBase, kMem1Size, kMem2Size);
+        // Default BAT mirrors used by games and the SDK
+        MapRam(0x80000000, 0, kMem1Size);
+        MapRam(0xC0000000, 0, kMem1Size);
+        MapRam(0x90000000, kMem1Size, kMem2Size);
+        MapRam(0xD0000000, kMem1Size, kMem2Size);
+    }
+
+    // Typed big-endian access: uint8/16/32/64_t, float and double
+    template <typename T>
+    T Read(uint32_t address) const {
+        const uint8_t* page = LoadHost(address >> kPageShift);
+        uint32_t offset = address & kPageMask;
+        if (page && offset <= kPageSize - sizeof(T)) {
+            return LoadBigEndian<T>(page + offset);
+        }
+        return ReadSlow<T>(address);
+    }
+
+    template <typename T>
+    void Write(uint32_t address, T value) {
+        bool written = page_table->written[address >> kPageShift];     // Before the store, which may alias it
+        uint8_t* page = LoadHost(address >> kPageShift);
+        uint32_t offset = address & kPageMask;
+        if (page && offset <= kPageSize - sizeof(T)) {
+            StoreBigEndian<T>(page + offset, value);
+            if (!written) MarkWritten(address >> kPageShift);
+            return;
+        }
+        if (LoadHandler(address >> kPageShift) == kPageGatherPipe && gather_pipe) {
+            gather_pipe->Write<T>(value);
+            return;
+        }
+        WriteSlow<T>(address, value);
+    }
+
+    uint32_t ReadWord(uint32_t address) const { return Read<uint32_t>(address); }
+    void WriteWord(uint32_t address, uint32_t value) { Write<uint32_t>(address, value); }
+
+    // Registers a device handler and returns its page handler index
+    uint8_t RegisterHandler(MMIOCallbacks callbacks) {
+        if (handlers.size() > 0xFF) {
+            throw std::runtime_error("Too many memory handlers registered.");
+        }
+        handlers.push_back(std::move(callbacks));
+        return static_cast<uint8_t>(handlers.size() - 1);
+    }
+
+    // Routes every page in [address, address + size) to a device handler
+    void MapHandler(uint32_t address, uint32_t size, uint8_t handler) {
+        for (uint32_t page = address >> kPageShift; page < (address + size - 1) / kPageSize + 1; ++page) {
+            StoreEntry(page, nullptr, handler);
+        }
+    }
+
+    // Host pointer for a guest address, or nullptr if it is not RAM
+    uint8_t* GetPointer(uint32_t address) const {
+        uint8_t* page = HostPage(address >> kPageShift);
+        return page ? page + (address & kPageMask) : nullptr;
+    }
+
+    // Host pointer for [address, address + size) if the whole range is RAM
+    // backed by one contiguous host run, otherwise nullptr
+    uint8_t* GetContiguousRange(uint32_t address, uint32_t size) const {
+        uint8_t* start = GetPointer(address);
+        if (!start || size == 0) return start;
+        uint32_t first = address >> kPageShift;
+        uint32_t last = (address + size - 1) >> kPageShift;
+        if (last < first) return nullptr;
+        uint8_t* base = start - (address & kPageMask);
+        for (uint32_t page = first + 1; page <= last; ++page) {
+            if (HostPage(page) != base + (page - first) * kPageSize) {
+                return nullptr;
+            }
+        }
+        return start;
+    }
+
+    // Bytes from address onward, at most max_bytes, that lie in one
+    // contiguous host run (what GetContiguousRange would accept)
+    uint32_t ContiguousBytes(uint32_t address, uint32_t max_bytes) const {
+        uint32_t first = address >> kPageShift;
+        uint8_t* base = HostPage(first);
+        if (!base) return 0;
+        uint32_t bytes = kPageSize - (address & kPageMask);
+        for (uint32_t page = first + 1; bytes < max_bytes && page < kNumPages; ++page) {
+            if (HostPage(page) != base + (page - first) * kPageSize) break;
+            bytes += kPageSize;
+        }
+        return std::min(bytes, max_bytes);
+    }
+
+    // Bumps the write version of every RAM page touched by the guest range
+    void MarkDirty(uint32_t address, uint32_t size) {
+        if (size == 0) return;
+        for (uint32_t page = address >> kPageShift; page <= (address + size - 1) >> kPageShift; ++page) {
+            int64_t ram_page = RamPage(page);
+            if (ram_page >= 0) {
+                page_versions[ram_page].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Sum of the write versions over a guest range; changes whenever any page
+    // in the range has been written since the last call
+    uint64_t RangeVersion(uint32_t address, uint32_t size) const {
+        uint64_t version = 0;
+        if (size == 0) return version;
+        for (uint32_t page = address >> kPageShift; page <= (address + size - 1) >> kPageShift; ++page) {
+            int64_t ram_page = RamPage(page);
+            if (ram_page >= 0) {
+                version += page_versions[ram_page].load(std::memory_order_relaxed);
+            }
+        }
+        return version;
+    }
+
+    // Offset into RAM of a guest range that is one contiguous run of RAM,
+    // protected or not, or -1. Never faults.
+    int64_t RamOffset(uint32_t address, uint32_t size) const {
+        for (const RamMapping& mapping : ram_mappings) {
+            if (address - mapping.address < mapping.size && size <= mapping.size - (address - mapping.address)) {
+                return static_cast<int64_t>(mapping.ram_offset) + (address - mapping.address);
+            }
+        }
+        return -1;
+    }
+
+    // Routes every mapping of the RAM pages in [ram_offset, ram_offset + size)
+    // to the fault handler, or back to RAM
+    void ProtectRam(uint32_t ram_offset, uint32_t size) { SetRamProtection(ram_offset, size, true); }
+    void UnprotectRam(uint32_t ram_offset, uint32_t size) { SetRamProtection(ram_offset, size, false); }
+
+    // Called with the guest address of the first access to a protected page;
+    // it must unprotect that page before returning
+    void SetFaultHandler(std::function<void(uint32_t address)> handler) { fault_handler = std::move(handler); }
+
+    uint32_t GetPageVersion(uint32_t ram_page) const {
+        return page_versions[ram_page].load(std::memory_order_relaxed);
+    }
+
+    // MarkDirty for a RAM page written through GetRam()
+    void MarkRamPageDirty(uint32_t ram_page) { page_versions[ram_page].fetch_add(1, std::memory_order_relaxed); }
+
+    // CPU thread: bumps the version of every page Write has stored to since
+    // the last call
+    void PublishWrites() {
+        for (uint32_t page : written_pages) {
+            int64_t ram_page = RamPage(page);
+            if (ram_page >= 0) {
+                page_versions[ram_page].fetch_add(1, std::memory_order_relaxed);
+            }
+            page_table->written[page] = 0;
+        }
+        written_pages.clear();
+    }
+
+    uint8_t* GetRam() const { return ram.get(); }
+    uint8_t* GetMem1() const { return ram.get(); }
+    uint8_t* GetMem2() const { return ram.get() + kMem1Size; }
+    const PageTable* GetPageTable() const { return page_table.get(); }
+
+    // Receives stores to kPageGatherPipe pages; null drops them
+    void AttachGatherPipe(GatherPipe* pipe) { gather_pipe = pipe; }
+
+private:
+    std::unique_ptr<uint8_t[], PageAlignedDelete> ram;
+    GatherPipe* gather_pipe = nullptr;
+    std::unique_ptr<std::atomic<uint32_t>[]> page_versions;
+    std::vector<uint32_t> written_pages;        // CPU thread: the pages marked in PageTable::written
+    std::unique_ptr<PageTable> page_table;
+    std::vector<MMIOCallbacks> handlers;
+
+    struct RamMapping {
+        uint32_t address;
+        uint32_t ram_offset;
+        uint32_t size;
+    };
+    std::vector<RamMapping> ram_mappings;
+    std::function<void(uint32_t address)> fault_handler;
+
+    // Page-table entries change while the GPU thread reads them through the
+    // host accessors, so every access is atomic. A page is released by
+    // storing host before handler and protected by storing handler before
+    // host: a reader that sees host null also sees why, and one that sees
+    // the pointer also sees the RAM contents written before the release.
+    uint8_t* LoadHost(uint32_t page) const { return __atomic_load_n(&page_table->host[page], __ATOMIC_ACQUIRE); }
+    uint8_t LoadHandler(uint32_t page) const { return __atomic_load_n(&page_table->handler[page], __ATOMIC_ACQUIRE); }
+
+    void StoreEntry(uint32_t page, uint8_t* host, uint8_t handler) {
+        if (host) {
+            __atomic_store_n(&page_table->host[page], host, __ATOMIC_RELEASE);
+            __atomic_store_n(&page_table->handler[page], handler, __ATOMIC_RELEASE);
+        } else {
+            __atomic_store_n(&page_table->handler[page], handler, __ATOMIC_RELEASE);
+            __atomic_store_n(&page_table->host[page], host, __ATOMIC_RELEASE);
+        }
+    }
+
+    __attribute__((noinline)) void MarkWritten(uint32_t page) {
+        page_table->written[page] = 1;
+        written_pages.push_back(page);
+    }
+
+    // host[page], after running the fault handler while the page is protected
+    uint8_t* HostPage(uint32_t page) const {
+        uint8_t* host = LoadHost(page);
+        while (!host) {
+            if (LoadHandler(page) != kPageProtected) {
+                return LoadHost(page);   // Released after the first load, or not RAM
+            }
+            Fault(page << kPageShift);
+            host = LoadHost(page);
+        }
+        return host;
+    }
+
+    // RAM page behind a guest page, protected or not, or -1
+    int64_t RamPage(uint32_t page) const {
+        if (uint8_t* host = LoadHost(page)) {
+            return (host - ram.get()) >> kPageShift;
+        }
+        int64_t offset = LoadHandler(page) == kPageProtected ? RamOffset(page << kPageShift, 1) : -1;
+        return offset >= 0 ? offset >> kPageShift : -1;
+    }
+
+    // Another thread may protect the page again as soon as the handler has
+    // released it, so callers retry the access rather than check the page
+    void Fault(uint32_t address) const {
+        if (!fault_handler) {
+            throw std::logic_error("Protected page without a fault handler at address: " + ToHex(address));
+        }
+        fault_handler(address);
+    }
+
+    void SetRamProtection(uint32_t ram_offset, uint32_t size, bool enabled) {
+        if (size == 0) return;
+        uint32_t first = ram_offset >> kPageShift, last = (ram_offset + size - 1) >> kPageShift;
+        for (const RamMapping& mapping : ram_mappings) {
+            uint32_t mapped_first = mapping.ram_offset >> kPageShift;
+            uint32_t mapped_last = (mapping.ram_offset + mapping.size - 1) >> kPageShift;
+            for (uint32_t ram_page = std::max(first, mapped_first); ram_page <= std::min(last, mapped_last);
+                 ++ram_page) {
+                uint32_t page = (mapping.address >> kPageShift) + (ram_page - mapped_first);
+                StoreEntry(page, enabled ? nullptr : ram.get() + static_cast<size_t>(ram_page) * kPageSize,
+                           enabled ? kPageProtected : kPageRam);
+            }
+        }
+    }
+
+    void MapRam(uint32_t address, uint32_t ram_offset, uint32_t size) {
+        ram_mappings.push_back({address, ram_offset, size});
+        for (uint32_t i = 0; i < size / kPageSize; ++i) {
+            StoreEntry((address >> kPageShift) + i, ram.get() + ram_offset + i * kPageSize, kPageRam);
+        }
+    }
+
+    template <typename T>
+    __attribute__((noinline)) T ReadSlow(uint32_t address) const {
+        using U = typename UnsignedOfSize<sizeof(T)>::Type;
+        uint8_t handler = LoadHandler(address >> kPageShift);
+        U raw = 0;
+        if (handler >= kFirstDeviceHandler && handlers[handler].read) {
+            if constexpr (sizeof(T) == 8) {
+                raw = (static_cast<uint64_t>(handlers[handler].read(address, 4)) << 32) |
+                      handlers[handler].read(address + 4, 4);
+            } else {
+                raw = static_cast<U>(handlers[handler].read(address, sizeof(T)));
+            }
+        } else if (handler == kPageGatherPipe) {
+            raw = 0;
+        } else if (handler == kPageProtected) {
+            Fault(address);
+            return Read<T>(address);
+        } else if (handler == kPageRam) {
+            // Access straddles two pages
+            for (uint32_t i = 0; i < sizeof(T); ++i) {
+                const uint8_t* byte = GetPointer(address + i);
+                if (!byte) {
+                    throw std::out_of_range("Memory read out of bounds at address: " + ToHex(address));
+                }
+                raw = static_cast<U>((raw << 8) | *byte);
+            }
+        } else {
+            throw std::out_of_range("Memory read out of bounds at address: " + ToHex(address));
+        }
+        T value;
+        std::memcpy(&value, &raw, sizeof(value));
+        return value;
+    }
+
+    template <typename T>
+    __attribute__((noinline)) void WriteSlow(uint32_t address, T value) {
+        using U = typename UnsignedOfSize<sizeof(T)>::Type;
+        U raw;
+        std::memcpy(&raw, &value, sizeof(raw));
+        uint8_t handler = LoadHandler(address >> kPageShift);
+        if (handler == kPageGatherPipe) {
+            if (gather_pipe) gather_pipe->Write<T>(value);
+            return;
+        }
+        if (handler == kPageProtected) {
+            Fault(address);
+            Write<T>(address, value);
+            return;
+        }
+        if (handler >= kFirstDeviceHandler && handlers[handler].write) {
+            if constexpr (sizeof(T) == 8) {
+                handlers[handler].write(address, static_cast<uint32_t>(raw >> 32), 4);
+                handlers[handler].write(address + 4, static_cast<uint32_t>(raw), 4);
+            } else {
+                handlers[handler].write(address, raw, sizeof(T));
+            }
+            return;
+        }
+        if (handler == kPageRam) {
+            for (uint32_t i = 0; i < sizeof(T); ++i) {
+                if (!GetPointer(address + i)) {
+                    throw std::out_of_range("Memory write out of bounds at address: " + ToHex(address));
+                }
+            }
+            for (uint32_t i = 0; i < sizeof(T); ++i) {
+                *GetPointer(address + i) = static_cast<uint8_t>(raw >> (8 * (sizeof(T) - 1 - i)));
+            }
+            MarkDirty(address, sizeof(T));
+            return;
+        }
+        throw std::out_of_range("Memory write out of bounds at address: " + ToHex(address));
+    }
+
+    // Helper function to convert address to hex string
+    std::string ToHex(uint32_t address) const {
+        std::ostringstream oss;
+        oss << "0x" << std::hex << address;
+        return oss.str();
+    }
+};
+
+// SIMD Byte Swapping
+// Bulk big-endian conversion shared by DMA and the graphics upload paths.
+// Kernels are compiled per instruction set with target attributes and one
+// set is picked at startup from the host CPU's feature bits, so the binary
+// itself does not require AVX2.
+#if defined(__x86_64__) || defined(__i386__)
+#define EMUWII_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+enum class SimdLevel : uint8_t { kScalar, kSSSE3, kAVX2 };
+
+inline SimdLevel DetectSimdLevel() {
+#ifdef EMUWII_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SimdLevel::kAVX2;
+    if (__builtin_cpu_supports("ssse3")) return SimdLevel::kSSSE3;
+#endif
+    return SimdLevel::kScalar;
+}
+
+inline const char* SimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::kAVX2:  return "AVX2";
+        case SimdLevel::kSSSE3: return "SSSE3";
+        default:                return "scalar";
+    }
+}
+
+// Host SIMD level, detected once
+inline SimdLevel HostSimdLevel() {
+    static const SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+enum class SwapWidth : uint8_t { kNone = 1, kSwap16 = 2, kSwap32 = 4, kSwap64 = 8 };
+
+// Copies size bytes from src to dst, byte-swapping each Width-byte unit. A
+// tail shorter than one unit is copied unchanged. src may equal dst.
+using SwapCopyKernel = void (*)(uint8_t* dst, const uint8_t* src, size_t size);
+
+template <size_t Width>
+void SwapCopyScalar(uint8_t* dst, const uint8_t* src, size_t size) {
+    using U = typename UnsignedOfSize<Width>::Type;
+    size_t i = 0;
+    for (; i + Width <= size; i += Width) {
+        U value;
+        std::memcpy(&value, src + i, Width);
+        value = ByteSwap(value);
+        std::memcpy(dst + i, &value, Width);
+    }
+    std::memmove(dst + i, src + i, size - i);
+}
+
+#ifdef EMUWII_X86_SIMD
+// pshufb control that reverses every Width-byte group of a 16-byte lane
+template <size_t Width>
+inline void FillSwapShuffle(uint8_t (&mask)[16]) {
+    for (size_t i = 0; i < 16; ++i) {
+        mask[i] = static_cast<uint8_t>((i / Width) * Width + (Width - 1 - i % Width));
+    }
+}
+
+template <size_t Width>
+__attribute__((target("ssse3")))
+void SwapCopySSSE3(uint8_t* dst, const uint8_t* src, size_t size) {
+    alignas(16) uint8_t mask_bytes[16];
+    FillSwapShuffle<Width>(mask_bytes);
+    const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(mask_bytes));
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 48));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(a, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 16), _mm_shuffle_epi8(b, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 32), _mm_shuffle_epi8(c, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 48), _mm_shuffle_epi8(d, mask));
+    }
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(a, mask));
+    }
+    SwapCopyScalar<Width>(dst + i, src + i, size - i);
+}
+
+template <size_t Width>
+__attribute__((target("avx2")))
+void SwapCopyAVX2(uint8_t* dst, const uint8_t* src, size_t size) {
+    alignas(16) uint8_t mask_bytes[16];
+    FillSwapShuffle<Width>(mask_bytes);
+    const __m256i mask = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(mask_bytes)));
+    size_t i = 0;
+    for (; i + 128 <= size; i += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 96));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), _mm256_shuffle_epi8(b, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 64), _mm256_shuffle_epi8(c, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 96), _mm256_shuffle_epi8(d, mask));
+    }
+    for (; i + 32 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(a, mask));
+    }
+    SwapCopyScalar<Width>(dst + i, src + i, size - i);
+}
+#endif
+
+struct SwapKernels {
+    SwapCopyKernel swap16;
+    SwapCopyKernel swap32;
+    SwapCopyKernel swap64;
+
+    SwapCopyKernel For(SwapWidth width) const {
+        switch (width) {
+            case SwapWidth::kSwap16: return swap16;
+            case SwapWidth::kSwap32: return swap32;
+            case SwapWidth::kSwap64: return swap64;
+            default:                 return nullptr;
+        }
+    }
+};
+
+inline SwapKernels SwapKernelsFor(SimdLevel level) {
+#ifdef EMUWII_X86_SIMD
+    if (level == SimdLevel::kAVX2) return {SwapCopyAVX2<2>, SwapCopyAVX2<4>, SwapCopyAVX2<8>};
+    if (level == SimdLevel::kSSSE3) return {SwapCopySSSE3<2>, SwapCopySSSE3<4>, SwapCopySSSE3<8>};
+#endif
+    (void)level;
+    return {SwapCopyScalar<2>, SwapCopyScalar<4>, SwapCopyScalar<8>};
+}
+
+// DMA Engine
+// Block transfers between guest RAM and host-side device buffers (DSP, AI,
+// DI, EXI, GX texture loads). Guest ranges are walked as contiguous host
+// runs, converted with the selected SIMD kernels, and every written guest
+// page has its version bumped so RAM-derived caches see the change.
+// Addresses are expected to be aligned to the swap width; hardware DMA is
+// 32-byte aligned.
+class DMAEngine {
+public:
+    explicit DMAEngine(Memory& memory)
+        : memory(memory), kernels(SwapKernelsFor(HostSimdLevel())) {}
+
+    // Guest RAM -> host buffer
+    void ReadFromGuest(uint8_t* dst, uint32_t address, uint32_t size, SwapWidth swap) {
+        size_t done = 0;
+        ForEachRun(address, size, [&](uint8_t* host, uint32_t length) {
+            Transfer(dst + done, host, length, swap);
+            done += length;
+        });
+        Account(size);
+    }
+
+    // Host buffer -> guest RAM
+    void WriteToGuest(uint32_t address, const uint8_t* src, uint32_t size, SwapWidth swap) {
+        size_t done = 0;
+        ForEachRun(address, size, [&](uint8_t* host, uint32_t length) {
+            Transfer(host, src + done, length, swap);
+            done += length;
+        });
+        memory.MarkDirty(address, size);
+        Account(size);
+    }
+
+    // Guest RAM -> guest RAM, no conversion
+    void CopyGuest(uint32_t dst_address, uint32_t src_address, uint32_t size) {
+        uint32_t done = 0;
+        ForEachRun(src_address, size, [&](uint8_t* host, uint32_t length) {
+            uint32_t dst_done = 0;
+            ForEachRun(dst_address + done, length, [&](uint8_t* dst_host, uint32_t dst_length) {
+                std::memmove(dst_host, host + dst_done, dst_length);
+                dst_done += dst_length;
+            });
+            done += length;
+        });
+        memory.MarkDirty(dst_address, size);
+        Account(size);
+    }
+
+    // Fills a guest RAM range with one byte value
+    void FillGuest(uint32_t address, uint8_t value, uint32_t size) {
+        ForEachRun(address, size, [&](uint8_t* host, uint32_t length) {
+            std::memset(host, value, length);
+        });
+        memory.MarkDirty(address, size);
+        Account(size);
+    }
+
+    uint64_t GetTransferCount() const { return transfer_count; }
+    uint64_t GetByteCount() const { return byte_count; }
+    void SetSimdLevel(SimdLevel level) { kernels = SwapKernelsFor(level); }
+
+private:
+    Memory& memory;
+    SwapKernels kernels;
+    uint64_t transfer_count = 0;
+    uint64_t byte_count = 0;
+
+    void Transfer(uint8_t* dst, const uint8_t* src, size_t size, SwapWidth swap) {
+        if (SwapCopyKernel kernel = kernels.For(swap)) {
+            kernel(dst, src, size);
+        } else {
+            std::memmove(dst, src, size);
+        }
+    }
+
+    void Account(uint32_t size) {
+        ++transfer_count;
+        byte_count += size;
+    }
+
+    // Calls fn(host, length) for each maximal run of host-contiguous RAM
+    template <typename Fn>
+    void ForEachRun(uint32_t address, uint32_t size, Fn&& fn) {
+        if (uint8_t* host = memory.GetContiguousRange(address, size)) {
+            if (size) fn(host, size);
+            return;
+        }
+        while (size > 0) {
+            uint8_t* host = memory.GetPointer(address);
+            if (!host) {
+                std::ostringstream oss;
+                oss << "DMA to unmapped address 0x" << std::hex << address;
+                throw std::out_of_range(oss.str());
+            }
+            uint32_t length = std::min(size, kPageSize - (address & kPageMask));
+            while (length < size && memory.GetPointer(address + length) == host + length) {
+                length += std::min(size - length, kPageSize);
+            }
+            fn(host, length);
+            address += length;
+            size -= length;
+        }
+    }
+};
+
+// MMIO Register Dispatch
+// Hollywood exposes two 64 KB register blocks: the Flipper-era devices at
+// 0x0C000000 (CP, PE, VI, PI, MI, DSP) and the Hollywood devices at 0x0D000000
+// (IPC, GPIO, DI, SI, EXI, AI; mirrored at 0x0D800000). Each block is split
+// into 16-bit slots, and each slot holds a compact index into a per-width
+// handler pool. Handlers are built from small templates so that the common
+// cases (constant, plain storage) never go through std::function.
+constexpr uint32_t kFlipperMMIOBase = 0x0C000000;
+constexpr uint32_t kHollywoodMMIOBase = 0x0D000000;
+constexpr uint32_t kMMIOBlockSize = 0x10000;
+constexpr uint32_t kMMIOSlots = 2 * kMMIOBlockSize / 2;
+
+template <typename T>
+struct MMIOReadHandler {
+    enum class Kind : uint8_t { kInvalid, kConstant, kDirect, kComplex };
+
+    T Read(uint32_t address) const {
+        switch (kind) {
+            case Kind::kConstant: return constant;
+            case Kind::kDirect:   return *direct & mask;
+            case Kind::kComplex:  return complex(address);
+            default:
+                std::cerr << "MMIO: Unhandled " << sizeof(T) * 8 << "-bit read at 0x"
+                          << std::hex << address << std::dec << "\n";
+                return 0;
+        }
+    }
+
+    Kind kind = Kind::kInvalid;
+    T constant = 0;
+    const T* direct = nullptr;
+    T mask = static_cast<T>(~T(0));
+    std::function<T(uint32_t)> complex;
+};
+
+template <typename T>
+struct MMIOWriteHandler {
+    enum class Kind : uint8_t { kInvalid, kNop, kDirect, kComplex };
+
+    void Write(uint32_t address, T value) const {
+        switch (kind) {
+            case Kind::kNop:     break;
+            case Kind::kDirect:  *direct = (*direct & ~mask) | (value & mask); break;
+            case Kind::kComplex: complex(address, value); break;
+            default:
+                std::cerr << "MMIO: Unhandled " << sizeof(T) * 8 << "-bit write of 0x" << std::hex
+                          << value << " at 0x" << address << std::dec << "\n";
+                break;
+        }
+    }
+
+    Kind kind = Kind::kInvalid;
+    T* direct = nullptr;
+    T mask = static_cast<T>(~T(0));
+    std::function<void(uint32_t, T)> complex;
+};
+
+// Handler factories
+template <typename T>
+MMIOReadHandler<T> MMIOConstant(T value) {
+    MMIOReadHandler<T> handler;
+    handler.kind = MMIOReadHandler<T>::Kind::kConstant;
+    handler.constant = value;
+    return handler;
+}
+
+template <typename T>
+MMIOReadHandler<T> MMIODirectRead(const T* storage, T mask = static_cast<T>(~T(0))) {
+    MMIOReadHandler<T> handler;
+    handler.kind = MMIOReadHandler<T>::Kind::kDirect;
+    handler.direct = storage;
+    handler.mask = mask;
+    return handler;
+}
+
+template <typename T>
+MMIOWriteHandler<T> MMIODirectWrite(T* storage, T mask = static_cast<T>(~T(0))) {
+    MMIOWriteHandler<T> handler;
+    handler.kind = MMIOWriteHandler<T>::Kind::kDirect;
+    handler.direct = storage;
+    handler.mask = mask;
+    return handler;
+}
+
+template <typename T>
+MMIOReadHandler<T> MMIOComplexRead(std::function<T(uint32_t)> fn) {
+    MMIOReadHandler<T> handler;
+    handler.kind = MMIOReadHandler<T>::Kind::kComplex;
+    handler.complex = std::move(fn);
+    return handler;
+}
+
+template <typename T>
+MMIOWriteHandler<T> MMIOComplexWrite(std::function<void(uint32_t, T)> fn) {
+    MMIOWriteHandler<T> handler;
+    handler.kind = MMIOWriteHandler<T>::Kind::kComplex;
+    handler.complex = std::move(fn);
+    return handler;
+}
+
+template <typename T>
+MMIOWriteHandler<T> MMIONop() {
+    MMIOWriteHandler<T> handler;
+    handler.kind = MMIOWriteHandler<T>::Kind::kNop;
+    return handler;
+}
+
+template <typename T>
+MMIOWriteHandler<T> MMIOInvalidWrite() {
+    return MMIOWriteHandler<T>();
+}
+
+class MMIO {
+public:
+    MMIO() {
+        read_counts = std::make_unique<uint32_t[]>(kMMIOSlots);
+        write_counts = std::make_unique<uint32_t[]>(kMMIOSlots);
+        InitTables(tables16);
+        InitTables(tables32);
+        // Unregistered 32-bit slots are split into two 16-bit accesses, which
+        // covers the 16-bit register files (VI, MI, DSP) without extra entries.
+        tables32.reads[0] = MMIOComplexRead<uint32_t>([this](uint32_t address) {
+            return (static_cast<uint32_t>(ReadSlot<uint16_t>(address)) << 16) |
+                   ReadSlot<uint16_t>(address + 2);
+        });
+        tables32.writes[0] = MMIOComplexWrite<uint32_t>([this](uint32_t address, uint32_t value) {
+            WriteSlot<uint16_t>(address, static_cast<uint16_t>(value >> 16));
+            WriteSlot<uint16_t>(address + 2, static_cast<uint16_t>(value));
+        });
+    }
+
+    MMIO(const MMIO&) = delete;
+    MMIO& operator=(const MMIO&) = delete;
+
+    // Registers a 16- or 32-bit register. A 32-bit register also answers
+    // 16-bit accesses to either half.
+    template <typename T>
+    void Register(uint32_t address, const char* name, MMIOReadHandler<T> read, MMIOWriteHandler<T> write) {
+        static_assert(std::is_same<T, uint16_t>::value || std::is_same<T, uint32_t>::value,
+                      "MMIO registers are 16 or 32 bits wide");
+        uint32_t slot = SlotIndex(address);
+        names[slot] = name;
+        Tables<T>& tables = GetTables<T>();
+        tables.read_slot[slot] = AddHandler(tables.reads, std::move(read));
+        tables.write_slot[slot] = AddHandler(tables.writes, std::move(write));
+
+        if constexpr (std::is_same<T, uint32_t>::value) {
+            names[slot + 1] = name;
+            uint16_t read32 = tables.read_slot[slot];
+            uint16_t write32 = tables.write_slot[slot];
+            for (uint32_t half = 0; half < 2; ++half) {
+                uint32_t shift = half ? 0 : 16;
+                tables16.read_slot[slot + half] = AddHandler(tables16.reads, MMIOComplexRead<uint16_t>(
+                    [this, read32, shift](uint32_t addr) {
+                        return static_cast<uint16_t>(tables32.reads[read32].Read(addr & ~3u) >> shift);
+                    }));
+                tables16.write_slot[slot + half] = AddHandler(tables16.writes, MMIOComplexWrite<uint16_t>(
+                    [this, read32, write32, shift](uint32_t addr, uint16_t value) {
+                        uint32_t word = tables32.reads[read32].Read(addr & ~3u);
+                        word = (word & ~(0xFFFFu << shift)) | (static_cast<uint32_t>(value) << shift);
+                        tables32.writes[write32].Write(addr & ~3u, word);
+                    }));
+            }
+        }
+    }
+
+    template <typename T>
+    T Read(uint32_t address) {
+        ++read_counts[SlotIndex(address)];
+        if constexpr (sizeof(T) == 1) {
+            uint16_t half = ReadSlot<uint16_t>(address & ~1u);
+            return static_cast<T>((address & 1) ? half : half >> 8);
+        } else {
+            return ReadSlot<T>(address);
+        }
+    }
+
+    template <typename T>
+    void Write(uint32_t address, T value) {
+        ++write_counts[SlotIndex(address)];
+        if constexpr (sizeof(T) == 1) {
+            uint16_t half = ReadSlot<uint16_t>(address & ~1u);
+            half = (address & 1) ? ((half & 0xFF00) | value) : ((half & 0x00FF) | (value << 8));
+            WriteSlot<uint16_t>(address & ~1u, half);
+        } else {
+            WriteSlot<T>(address, value);
+        }
+    }
+
+    // Prints the most frequently accessed registers
+    void DumpAccessCounts(std::ostream& out, size_t max_entries) const {
+        std::vector<uint32_t> slots;
+        for (uint32_t slot = 0; slot < kMMIOSlots; ++slot) {
+            if (read_counts[slot] || write_counts[slot]) slots.push_back(slot);
+        }
+        std::sort(slots.begin(), slots.end(), [this](uint32_t a, uint32_t b) {
+            return read_counts[a] + write_counts[a] > read_counts[b] + write_counts[b];
+        });
+        if (slots.size() > max_entries) slots.resize(max_entries);
+        for (uint32_t slot : slots) {
+            auto it = names.find(slot);
+            out << "  " << (it != names.end() ? it->second : "?") << " (0x" << std::hex
+                << SlotAddress(slot) << std::dec << "): " << read_counts[slot] << " reads, "
+                << write_counts[slot] << " writes\n";
+        }
+    }
+
+private:
+    template <typename T>
+    struct Tables {
+        std::vector<MMIOReadHandler<T>> reads;
+        std::vector<MMIOWriteHandler<T>> writes;
+        std::unique_ptr<uint16_t[]> read_slot;
+        std::unique_ptr<uint16_t[]> write_slot;
+    };
+
+    Tables<uint16_t> tables16;
+    Tables<uint32_t> tables32;
+    std::unique_ptr<uint32_t[]> read_counts;
+    std::unique_ptr<uint32_t[]> write_counts;
+    std::unordered_map<uint32_t, std::string> names;
+
+    // 0x0C/0xCC block -> slots [0, 0x8000), 0x0D/0xCD/0xCD8 block -> [0x8000, 0x10000)
+    static uint32_t SlotIndex(uint32_t address) {
+        return (((address >> 24) & 1) << 15) | ((address & 0xFFFF) >> 1);
+    }
+
+    static uint32_t SlotAddress(uint32_t slot) {
+        return (slot >> 15 ? kHollywoodMMIOBase : kFlipperMMIOBase) | ((slot & 0x7FFF) << 1);
+    }
+
+    template <typename T>
+    Tables<T>& GetTables() {
+        if constexpr (std::is_same<T, uint16_t>::value) return tables16;
+        else return tables32;
+    }
+
+    template <typename T>
+    static void InitTables(Tables<T>& tables) {
+        tables.reads.resize(1);
+        tables.writes.resize(1);
+        tables.read_slot = std::make_unique<uint16_t[]>(kMMIOSlots);
+        tables.write_slot = std::make_unique<uint16_t[]>(kMMIOSlots);
+    }
+
+    template <typename Handler>
+    static uint16_t AddHandler(std::vector<Handler>& pool, Handler handler) {
+        if (pool.size() > 0xFFFF) {
+            throw std::runtime_error("MMIO handler pool exhausted.");
+        }
+        pool.push_back(std::move(handler));
+        return static_cast<uint16_t>(pool.size() - 1);
+    }
+
+    template <typename T>
+    T ReadSlot(uint32_t address) {
+        Tables<T>& tables = GetTables<T>();
+        return tables.reads[tables.read_slot[SlotIndex(address)]].Read(address);
+    }
+
+    template <typename T>
+    void WriteSlot(uint32_t address, T value) {
+        Tables<T>& tables = GetTables<T>();
+        tables.writes[tables.write_slot[SlotIndex(address)]].Write(address, value);
+    }
+};
+
+// Registers a block of plain storage-backed registers
+template <typename T, size_t N>
+void RegisterRegisterFile(MMIO& mmio, uint32_t base, const char* name, T (&regs)[N]) {
+    for (size_t i = 0; i < N; ++i) {
+        mmio.Register<T>(base + static_cast<uint32_t>(i * sizeof(T)), name,
+                         MMIODirectRead<T>(&regs[i]), MMIODirectWrite<T>(&regs[i]));
+    }
+}
+
+// Write-one-to-clear helper for interrupt status bits
+template <typename T>
+MMIOWriteHandler<T> MMIOClearBits(T* storage, T clearable) {
+    return MMIOComplexWrite<T>([storage, clearable](uint32_t, T value) {
+        *storage &= ~(value & clearable);
+    });
+}
+
+// Processor Interface (0x0C003000) - interrupt routing to Broadway
+class ProcessorInterface {
+public:
+    enum InterruptCause : uint32_t {
+        kIntGPError = 1u << 0,
+        kIntReset   = 1u << 1,
+        kIntDI      = 1u << 2,
+        kIntSI      = 1u << 3,
+        kIntEXI     = 1u << 4,
+        kIntAI      = 1u << 5,
+        kIntDSP     = 1u << 6,
+        kIntMEM     = 1u << 7,
+        kIntVI      = 1u << 8,
+        kIntPEToken = 1u << 9,
+        kIntPEFinish = 1u << 10,
+        kIntCP      = 1u << 11,
+        kIntDebug   = 1u << 12,
+        kIntHSP     = 1u << 13,
+        kIntIPC     = 1u << 14,
+    };
+
+    uint32_t intsr = 0;       // Interrupt cause
+    uint32_t intmr = 0;       // Interrupt mask
+    uint32_t fifo_base = 0;
+    uint32_t fifo_end = 0;
+    uint32_t fifo_write = 0;
+    uint32_t reset_code = 0;
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        mmio.Register<uint32_t>(base + 0x00, "PI_INTSR", MMIODirectRead(&intsr),
+                                MMIOClearBits<uint32_t>(&intsr, kIntReset | kIntGPError | kIntDebug));
+        mmio.Register<uint32_t>(base + 0x04, "PI_INTMR", MMIODirectRead(&intmr), MMIODirectWrite(&intmr));
+        mmio.Register<uint32_t>(base + 0x0C, "PI_FIFO_BASE", MMIODirectRead(&fifo_base),
+                                MMIODirectWrite<uint32_t>(&fifo_base, 0x03FFFFE0));
+        mmio.Register<uint32_t>(base + 0x10, "PI_FIFO_END", MMIODirectRead(&fifo_end),
+                                MMIODirectWrite<uint32_t>(&fifo_end, 0x03FFFFE0));
+        mmio.Register<uint32_t>(base + 0x14, "PI_FIFO_WPTR", MMIODirectRead(&fifo_write),
+                                MMIODirectWrite<uint32_t>(&fifo_write, 0x07FFFFE0));
+        mmio.Register<uint32_t>(base + 0x24, "PI_RESET", MMIODirectRead(&reset_code), MMIODirectWrite(&reset_code));
+        mmio.Register<uint32_t>(base + 0x2C, "PI_FLIPPER_REV", MMIOConstant<uint32_t>(0x246500B1), MMIONop<uint32_t>());
+    }
+
+    void SetInterrupt(uint32_t cause, bool set) {
+        if (set) intsr |= cause;
+        else intsr &= ~cause;
+    }
+
+    bool HasPendingInterrupt() const { return (intsr & intmr) != 0; }
+};
+
+// Command Processor (0x0C000000) - GP FIFO pointers and watermarks. 32-bit
+// values are split into LO/HI 16-bit registers, low half first. The FIFO
+// itself is run by GXCommandProcessor, which keeps these up to date.
+struct CommandProcessorInterface {
+    enum StatusBits : uint16_t {
+        kSROverflow = 1u << 0,      // Distance above the high watermark
+        kSRUnderflow = 1u << 1,     // Distance below the low watermark
+        kSRReadIdle = 1u << 2,
+        kSRCommandIdle = 1u << 3,
+        kSRBreakpoint = 1u << 4,
+    };
+    enum ControlBits : uint16_t {
+        kCRReadEnable = 1u << 0,
+        kCRBreakpointEnable = 1u << 1,
+        kCROverflowIntEnable = 1u << 2,
+        kCRUnderflowIntEnable = 1u << 3,
+        kCRLinkEnable = 1u << 4,    // Gather pipe writes feed the GP
+        kCRBreakpointIntEnable = 1u << 5,
+    };
+
+    uint16_t sr = kSRReadIdle | kSRCommandIdle;
+    uint16_t cr = 0;
+    uint32_t fifo_base = 0, fifo_end = 0;
+    uint32_t hi_watermark = 0, lo_watermark = 0;
+    uint32_t distance = 0, write_ptr = 0, read_ptr = 0, breakpoint = 0;
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        mmio.Register<uint16_t>(base + 0x00, "CP_SR", MMIODirectRead(&sr), MMIONop<uint16_t>());
+        mmio.Register<uint16_t>(base + 0x02, "CP_CR", MMIODirectRead(&cr), MMIODirectWrite(&cr));
+        mmio.Register<uint16_t>(base + 0x04, "CP_CLEAR", MMIOConstant<uint16_t>(0),
+                                MMIOClearBits<uint16_t>(&sr, kSROverflow | kSRUnderflow));
+        RegisterSplit(mmio, base + 0x20, "CP_FIFO_BASE", &fifo_base);
+        RegisterSplit(mmio, base + 0x24, "CP_FIFO_END", &fifo_end);
+        RegisterSplit(mmio, base + 0x28, "CP_FIFO_HI_WATERMARK", &hi_watermark);
+        RegisterSplit(mmio, base + 0x2C, "CP_FIFO_LO_WATERMARK", &lo_watermark);
+        RegisterSplit(mmio, base + 0x30, "CP_FIFO_RW_DISTANCE", &distance);
+        RegisterSplit(mmio, base + 0x34, "CP_FIFO_WRITE_PTR", &write_ptr);
+        RegisterSplit(mmio, base + 0x38, "CP_FIFO_READ_PTR", &read_ptr);
+        RegisterSplit(mmio, base + 0x3C, "CP_FIFO_BREAKPOINT", &breakpoint);
+    }
+
+    static void RegisterSplit(MMIO& mmio, uint32_t address, const char* name, uint32_t* value) {
+        for (uint32_t half = 0; half < 2; ++half) {
+            uint32_t shift = half * 16;
+            mmio.Register<uint16_t>(address + half * 2, name, MMIOComplexRead<uint16_t>([value, shift](uint32_t) {
+                return static_cast<uint16_t>(*value >> shift);
+            }), MMIOComplexWrite<uint16_t>([value, shift](uint32_t, uint16_t part) {
+                *value = (*value & ~(0xFFFFu << shift)) | (static_cast<uint32_t>(part) << shift);
+            }));
+        }
+    }
+};
+
+// Pixel Engine (0x0C001000) - EFB configuration, draw-done and token interrupts
+struct PixelEngineInterface {
+    enum CtrlBits : uint16_t {
+        kCtrlTokenEnable = 1u << 0,
+        kCtrlFinishEnable = 1u << 1,
+        kCtrlTokenFlag = 1u << 2,
+        kCtrlFinishFlag = 1u << 3,
+    };
+
+    uint16_t config[0x0A / 2] = {};     // Z, alpha, dest alpha, alpha mode, alpha read
+    uint16_t ctrl = 0;
+    uint16_t token = 0;
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        RegisterRegisterFile(mmio, base, "PE", config);
+        mmio.Register<uint16_t>(base + 0x0A, "PE_CTRL", MMIODirectRead(&ctrl), MMIOComplexWrite<uint16_t>(
+            [this](uint32_t, uint16_t value) {
+                uint16_t flags = kCtrlTokenFlag | kCtrlFinishFlag;
+                ctrl = static_cast<uint16_t>((value & ~flags & 0xF) | (ctrl & flags & ~value));
+            }));
+        mmio.Register<uint16_t>(base + 0x0E, "PE_TOKEN", MMIODirectRead(&token), MMIONop<uint16_t>());
+    }
+};
+
+// Video Interface (0x0C002000) - 16-bit register file
+// Scanout runs on the scheduler one line at a time: AdvanceLine moves
+// VI_VCOUNT on and latches the display interrupts whose line has come up.
+// Line rate and field length follow the video format in DCR: NTSC and MPAL
+// scan 525 lines per frame at 15734 Hz, PAL 625 at 15625 Hz; interlaced
+// modes split the frame into two fields, progressive ones double the rate.
+// Horizontal positions are not modelled: a display interrupt fires at the
+// start of its line.
+struct VideoInterface {
+    // Register indices (byte offset / 2)
+    enum : uint8_t {
+        kVTR = 0x00 / 2,            // Vertical timing: active lines per field in bits 4-13
+        kDCR = 0x02 / 2,            // Display configuration: bit 2 non-interlaced, bits 8-9 format
+        kTFBLHi = 0x1C / 2,         // Top field base, high then low half
+        kTFBLLo = 0x1E / 2,
+        kVCount = 0x2C / 2,         // Current line of the field, from 1
+        kDisplayInt0 = 0x30 / 2,    // DI0-DI3 high halves, 4 bytes apart: status bit 15,
+                                    // enable bit 12, line in bits 0-9
+        kPictureConfig = 0x48 / 2,  // Line stride (16-byte units) in bits 0-7, width (16 pixels) in 8-14
+    };
+    enum VideoFormat : uint8_t { kNTSC = 0, kPAL = 1, kMPAL = 2, kDebug = 3 };
+
+    static constexpr int kDisplayInterrupts = 4;
+    static constexpr uint16_t kDIStatus = 1u << 15;
+    static constexpr uint16_t kDIEnable = 1u << 12;
+
+    uint16_t regs[0x80 / 2] = {};
+    uint64_t fields = 0;        // Fields scanned since power-on
+
+    // XFB the frame is read from: the top field base, which holds address >> 5
+    // when its page-offset bit (28) is set
+    uint32_t GetXFBAddress() const {
+        uint32_t tfbl = static_cast<uint32_t>(regs[kTFBLHi]) << 16 | regs[kTFBLLo];
+        return tfbl & (1u << 28) ? (tfbl & 0xFFFFFF) << 5 : tfbl & 0xFFFFFF;
+    }
+
+    bool IsInterlaced() const { return !(regs[kDCR] & 4); }
+    int GetXFBWidth() const { return ((regs[kPictureConfig] >> 8) & 0x7F) * 16; }
+
+    // An interlaced field reads every other XFB line, so its stride spans two
+    size_t GetXFBStride() const {
+        size_t stride = static_cast<size_t>(regs[kPictureConfig] & 0xFF) * 16;
+        return IsInterlaced() ? stride / 2 : stride;
+    }
+
+    int GetXFBHeight() const {
+        int lines = (regs[kVTR] >> 4) & 0x3FF;
+        return IsInterlaced() ? lines * 2 : lines;
+    }
+
+    bool IsPAL() const { return ((regs[kDCR] >> 8) & 3) == kPAL; }
+
+    // Second field of an interlaced frame; progressive fields are all top fields
+    bool IsBottomField() const { return IsInterlaced() && (fields & 1); }
+
+    // Broadway cycles per line: 729 MHz over the 15734 Hz NTSC (15625 Hz PAL)
+    // line rate, which progressive scan doubles
+    uint64_t GetCyclesPerLine() const {
+        uint64_t cycles = IsPAL() ? 46656 : 46332;
+        return IsInterlaced() ? cycles : cycles / 2;
+    }
+
+    // Lines in the current field: a 525 (625) line frame splits 263/262 (313/312)
+    int GetLinesInField() const {
+        int frame_lines = IsPAL() ? 625 : 525;
+        if (!IsInterlaced()) return frame_lines;
+        return IsBottomField() ? frame_lines / 2 : frame_lines / 2 + 1;
+    }
+
+    // Frames (field pairs when interlaced) per second, to pace the host against
+    double GetFrameRate() const {
+        return static_cast<double>(kCpuClockHz) / (static_cast<double>(GetCyclesPerLine()) * (IsPAL() ? 625 : 525));
+    }
+
+    // Moves scanout on by one line and latches the display interrupts set
+    // for it. Returns true when the line starts a new field.
+    bool AdvanceLine() {
+        bool new_field = regs[kVCount] == 0 || regs[kVCount] >= GetLinesInField();
+        if (new_field) {
+            fields += regs[kVCount] != 0;
+            regs[kVCount] = 1;
+        } else {
+            ++regs[kVCount];
+        }
+        for (int i = 0; i < kDisplayInterrupts; ++i) {
+            uint16_t& di = regs[kDisplayInt0 + i * 2];
+            if ((di & kDIEnable) && (di & 0x3FF) == regs[kVCount]) {
+                di |= kDIStatus;
+            }
+        }
+        return new_field;
+    }
+
+    // An enabled display interrupt has fired and not been acknowledged
+    bool IsInterruptPending() const {
+        for (int i = 0; i < kDisplayInterrupts; ++i) {
+            uint16_t di = regs[kDisplayInt0 + i * 2];
+            if ((di & kDIStatus) && (di & kDIEnable)) return true;
+        }
+        return false;
+    }
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        RegisterRegisterFile(mmio, base, "VI", regs);
+    }
+};
+
+// Memory Interface (0x0C004000) - protection ranges, 16-bit register file
+struct MemoryInterface {
+    uint16_t regs[0x80 / 2] = {};
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        RegisterRegisterFile(mmio, base, "MI", regs);
+    }
+};
+
+// DSP Interface (0x0C005000) - mailboxes, control/status and ARAM DMA
+struct DSPInterface {
+    enum CSRBits : uint16_t { kCSRAIInt = 1u << 3, kCSRARInt = 1u << 5, kCSRDSPInt = 1u << 7 };
+
+    uint16_t dsp_mbox_hi = 0, dsp_mbox_lo = 0;   // CPU -> DSP
+    uint16_t cpu_mbox_hi = 0, cpu_mbox_lo = 0;   // DSP -> CPU
+    uint16_t csr = 0;
+    uint16_t dma_regs[0x20 / 2] = {};            // 0x20 - 0x3F: ARAM and AI DMA
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        mmio.Register<uint16_t>(base + 0x00, "DSP_MBOX_HI", MMIODirectRead(&dsp_mbox_hi), MMIODirectWrite(&dsp_mbox_hi));
+        mmio.Register<uint16_t>(base + 0x02, "DSP_MBOX_LO", MMIODirectRead(&dsp_mbox_lo), MMIODirectWrite(&dsp_mbox_lo));
+        mmio.Register<uint16_t>(base + 0x04, "CPU_MBOX_HI", MMIODirectRead(&cpu_mbox_hi), MMIONop<uint16_t>());
+        mmio.Register<uint16_t>(base + 0x06, "CPU_MBOX_LO", MMIODirectRead(&cpu_mbox_lo), MMIONop<uint16_t>());
+        mmio.Register<uint16_t>(base + 0x0A, "DSP_CSR", MMIODirectRead(&csr), MMIOComplexWrite<uint16_t>(
+            [this](uint32_t, uint16_t value) {
+                uint16_t ints = kCSRAIInt | kCSRARInt | kCSRDSPInt;
+                csr = static_cast<uint16_t>((value & ~ints) | (csr & ints & ~value));
+            }));
+        RegisterRegisterFile(mmio, base + 0x20, "DSP_DMA", dma_regs);
+    }
+};
+
+// DVD Interface (0x0D006000)
+struct DVDInterface {
+    enum SRBits : uint32_t { kSRDEInt = 1u << 2, kSRTCInt = 1u << 4, kSRBrkInt = 1u << 6 };
+
+    uint32_t sr = 0, cvr = 0;
+    uint32_t cmdbuf[3] = {};
+    uint32_t mar = 0, length = 0, cr = 0, immbuf = 0;
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        mmio.Register<uint32_t>(base + 0x00, "DISR", MMIODirectRead(&sr),
+                                MMIOComplexWrite<uint32_t>([this](uint32_t, uint32_t value) {
+            uint32_t ints = kSRDEInt | kSRTCInt | kSRBrkInt;
+            sr = (value & ~ints) | (sr & ints & ~value);
+        }));
+        mmio.Register<uint32_t>(base + 0x04, "DICVR", MMIODirectRead(&cvr), MMIODirectWrite(&cvr));
+        RegisterRegisterFile(mmio, base + 0x08, "DICMDBUF", cmdbuf);
+        mmio.Register<uint32_t>(base + 0x14, "DIMAR", MMIODirectRead(&mar), MMIODirectWrite<uint32_t>(&mar, 0xFFFFFFE0));
+        mmio.Register<uint32_t>(base + 0x18, "DILENGTH", MMIODirectRead(&length), MMIODirectWrite<uint32_t>(&length, 0xFFFFFFE0));
+        mmio.Register<uint32_t>(base + 0x1C, "DICR", MMIODirectRead(&cr), MMIODirectWrite(&cr));
+        mmio.Register<uint32_t>(base + 0x20, "DIIMMBUF", MMIODirectRead(&immbuf), MMIODirectWrite(&immbuf));
+        mmio.Register<uint32_t>(base + 0x24, "DICFG", MMIOConstant<uint32_t>(0), MMIONop<uint32_t>());
+    }
+};
+
+// Serial Interface (0x0D006400) - controller channels, poll/status and I/O buffer
+struct SerialInterface {
+    uint32_t regs[0x40 / 4] = {};
+    uint32_t buffer[0x80 / 4] = {};
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        RegisterRegisterFile(mmio, base, "SI", regs);
+        RegisterRegisterFile(mmio, base + 0x80, "SI_BUFFER", buffer);
+    }
+};
+
+// External Interface (0x0D006800) - three channels of CSR/MAR/LENGTH/CR/DATA
+struct ExternalInterface {
+    uint32_t channels[3][5] = {};
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        for (int channel = 0; channel < 3; ++channel) {
+            RegisterRegisterFile(mmio, base + channel * 0x14, "EXI", channels[channel]);
+        }
+    }
+};
+
+// Audio Interface (0x0D006C00)
+struct AudioInterface {
+    uint32_t control = 0, volume = 0, sample_counter = 0, interrupt_timing = 0;
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        mmio.Register<uint32_t>(base + 0x00, "AICR", MMIODirectRead(&control), MMIODirectWrite(&control));
+        mmio.Register<uint32_t>(base + 0x04, "AIVR", MMIODirectRead(&volume), MMIODirectWrite(&volume));
+        mmio.Register<uint32_t>(base + 0x08, "AISCNT", MMIODirectRead(&sample_counter), MMIONop<uint32_t>());
+        mmio.Register<uint32_t>(base + 0x0C, "AIIT", MMIODirectRead(&interrupt_timing), MMIODirectWrite(&interrupt_timing));
+    }
+};
+
+// Inter-Processor Communication with Starlet (0x0D000000)
+struct IPCInterface {
+    enum CtrlBits : uint32_t {
+        kCtrlX1 = 1u << 0,    // PPC -> ARM: message in PPCMSG
+        kCtrlY2 = 1u << 1,    // ARM acknowledged the message
+        kCtrlY1 = 1u << 2,    // ARM -> PPC: reply in ARMMSG
+        kCtrlX2 = 1u << 3,    // PPC relaunch / ack
+        kCtrlIY1 = 1u << 4,   // Interrupt enable for Y1
+        kCtrlIY2 = 1u << 5,   // Interrupt enable for Y2
+    };
+    static constexpr uint32_t kIrqIPC = 1u << 30;
+
+    uint32_t ppcmsg = 0;
+    uint32_t ppcctrl = 0;
+    uint32_t armmsg = 0;
+    uint32_t irq_flag = 0;
+    uint32_t irq_mask = 0;
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        mmio.Register<uint32_t>(base + 0x00, "HW_IPC_PPCMSG", MMIODirectRead(&ppcmsg), MMIODirectWrite(&ppcmsg));
+        mmio.Register<uint32_t>(base + 0x04, "HW_IPC_PPCCTRL", MMIODirectRead(&ppcctrl),
+                                MMIOComplexWrite<uint32_t>([this](uint32_t, uint32_t value) {
+            // Y1/Y2 are write-one-to-clear acks, X1/X2 are set by the PPC
+            ppcctrl &= ~(value & (kCtrlY1 | kCtrlY2));
+            ppcctrl = (ppcctrl & ~(kCtrlIY1 | kCtrlIY2)) | (value & (kCtrlIY1 | kCtrlIY2));
+            ppcctrl |= value & (kCtrlX1 | kCtrlX2);
+        }));
+        mmio.Register<uint32_t>(base + 0x08, "HW_IPC_ARMMSG", MMIODirectRead(&armmsg), MMIONop<uint32_t>());
+        mmio.Register<uint32_t>(base + 0x30, "HW_PPCIRQFLAG", MMIODirectRead(&irq_flag),
+                                MMIOClearBits<uint32_t>(&irq_flag, 0xFFFFFFFF));
+        mmio.Register<uint32_t>(base + 0x34, "HW_PPCIRQMASK", MMIODirectRead(&irq_mask), MMIODirectWrite(&irq_mask));
+    }
+};
+
+// Hollywood GPIO bank B (0x0D0000C0) - PPC-accessible pins
+struct GPIOInterface {
+    uint32_t out = 0, dir = 0, in = 0, int_level = 0, int_flag = 0, int_mask = 0, in_mirror = 0;
+
+    void RegisterMMIO(MMIO& mmio, uint32_t base) {
+        mmio.Register<uint32_t>(base + 0x00, "HW_GPIOB_OUT", MMIODirectRead(&out), MMIODirectWrite(&out));
+        mmio.Register<uint32_t>(base + 0x04, "HW_GPIOB_DIR", MMIODirectRead(&dir), MMIODirectWrite(&dir));
+        mmio.Register<uint32_t>(base + 0x08, "HW_GPIOB_IN", MMIODirectRead(&in), MMIONop<uint32_t>());
+        mmio.Register<uint32_t>(base + 0x0C, "HW_GPIOB_INTLVL", MMIODirectRead(&int_level), MMIODirectWrite(&int_level));
+        mmio.Register<uint32_t>(base + 0x10, "HW_GPIOB_INTFLAG", MMIODirectRead(&int_flag),
+                                MMIOClearBits<uint32_t>(&int_flag, 0xFFFFFFFF));
+        mmio.Register<uint32_t>(base + 0x14, "HW_GPIOB_INTMASK", MMIODirectRead(&int_mask), MMIODirectWrite(&int_mask));
+        mmio.Register<uint32_t>(base + 0x18, "HW_GPIOB_INMIR", MMIODirectRead(&in_mirror), MMIONop<uint32_t>());
+    }
+};
+
+// Hollywood Hardware Blocks
+// Owns the MMIO dispatcher and every device, and routes the register pages
+// (physical and 0xCC/0xCD mirrors) of the memory map to it.
+class Hardware {
+public:
+    explicit Hardware(Memory& memory) : memory(memory), dma(memory) {
+        cp.RegisterMMIO(mmio, kFlipperMMIOBase + 0x0000);
+        pe.RegisterMMIO(mmio, kFlipperMMIOBase + 0x1000);
+        vi.RegisterMMIO(mmio, kFlipperMMIOBase + 0x2000);
+        pi.RegisterMMIO(mmio, kFlipperMMIOBase + 0x3000);
+        mi.RegisterMMIO(mmio, kFlipperMMIOBase + 0x4000);
+        dsp.RegisterMMIO(mmio, kFlipperMMIOBase + 0x5000);
+        ipc.RegisterMMIO(mmio, kHollywoodMMIOBase + 0x0000);
+        gpio.RegisterMMIO(mmio, kHollywoodMMIOBase + 0x00C0);
+        di.RegisterMMIO(mmio, kHollywoodMMIOBase + 0x6000);
+        si.RegisterMMIO(mmio, kHollywoodMMIOBase + 0x6400);
+        exi.RegisterMMIO(mmio, kHollywoodMMIOBase + 0x6800);
+        ai.RegisterMMIO(mmio, kHollywoodMMIOBase + 0x6C00);
+
+        MMIOCallbacks callbacks;
+        callbacks.read = [this](uint32_t address, uint32_t size) -> uint32_t {
+            switch (size) {
+                case 1:  return mmio.Read<uint8_t>(address);
+                case 2:  return mmio.Read<uint16_t>(address);
+                default: return mmio.Read<uint32_t>(address);
+            }
+        };
+        callbacks.write = [this](uint32_t address, uint32_t value, uint32_t size) {
+            switch (size) {
+                case 1:  mmio.Write<uint8_t>(address, static_cast<uint8_t>(value)); break;
+                case 2:  mmio.Write<uint16_t>(address, static_cast<uint16_t>(value)); break;
+                default: mmio.Write<uint32_t>(address, value); break;
+            }
+        };
+        uint8_t handler = memory.RegisterHandler(std::move(callbacks));
+        for (uint32_t base : {kFlipperMMIOBase, kHollywoodMMIOBase, kHollywoodMMIOBase + 0x800000}) {
+            memory.MapHandler(base, kMMIOBlockSize, handler);
+            memory.MapHandler(base | 0xC0000000, kMMIOBlockSize, handler);
+        }
+
+        // The gather pipe page bypasses MMIO dispatch entirely
+        memory.MapHandler(kGatherPipeAddress, kPageSize, kPageGatherPipe);
+        memory.MapHandler(kGatherPipeAddress | 0xC0000000, kPageSize, kPageGatherPipe);
+    }
+
+    Hardware(const Hardware&) = delete;
+    Hardware& operator=(const Hardware&) = delete;
+
+    Memory& memory;
+    MMIO mmio;
+    DMAEngine dma;
+    CommandProcessorInterface cp;
+    PixelEngineInterface pe;
+    ProcessorInterface pi;
+    VideoInterface vi;
+    MemoryInterface mi;
+    DSPInterface dsp;
+    DVDInterface di;
+    SerialInterface si;
+    ExternalInterface exi;
+    AudioInterface ai;
+    IPCInterface ipc;
+    GPIOInterface gpio;
+};
+
+// Event Scheduler
+// Guest time is counted in Broadway cycles. Devices register an event type
+// once and schedule it some number of cycles ahead; the CPU loop advances
+// time and fires due events in order. Host threads hand results back with
+// ScheduleEventAtFromThread, which is merged on the CPU thread.
+
+class Scheduler {
+public:
+    using EventCallback = std::function<void(uint64_t userdata, int64_t cycles_late)>;
+
+    int RegisterEvent(const char* name, EventCallback callback) {
+        event_types.push_back({name, std::move(callback)});
+        return static_cast<int>(event_types.size() - 1);
+    }
+
+    void ScheduleEvent(uint64_t cycles_into_future, int event_type, uint64_t userdata = 0) {
+        events.push_back({ticks + cycles_into_future, next_order++, event_type, userdata});
+        std::push_heap(events.begin(), events.end(), Later);
+        next_event_ticks = events.front().when;
+    }
+
+    void RemoveEvent(int event_type) {
+        events.erase(std::remove_if(events.begin(), events.end(),
+                                    [event_type](const Event& event) { return event.type == event_type; }),
+                     events.end());
+        std::make_heap(events.begin(), events.end(), Later);
+        next_event_ticks = events.empty() ? UINT64_MAX : events.front().when;
+    }
+
+    // Callable from any thread. The event fires at the absolute tick, or on
+    // the next Advance if that tick has already passed.
+    void ScheduleEventAtFromThread(uint64_t tick, int event_type, uint64_t userdata = 0) {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending.push_back({tick, 0, event_type, userdata});
+        has_pending.store(true, std::memory_order_release);
+    }
+
+    // Moves guest time forward and runs every event that has come due
+    void Advance(uint64_t cycles) {
+        ticks += cycles;
+        if (has_pending.load(std::memory_order_acquire)) {
+            MergePending();
+        }
+        if (ticks >= next_event_ticks) {
+            RunDueEvents();
+        }
+    }
+
+    uint64_t GetTicks() const { return ticks; }
+
+    uint64_t GetCyclesUntilNextEvent() const {
+        return next_event_ticks > ticks ? next_event_ticks - ticks : 0;
+    }
+
+    // Events posted from other threads and not merged yet; a savestate
+    // cannot hold these
+    bool HasPendingFromThreads() const { return has_pending.load(std::memory_order_acquire); }
+
+    struct State;
+    void SaveState(State& state) const;
+    void LoadState(const State& state);
+
+private:
+    struct EventType {
+        const char* name;
+        EventCallback callback;
+    };
+
+    struct Event {
+        uint64_t when;
+        uint64_t order;     // Keeps events scheduled for the same tick in FIFO order
+        int type;
+        uint64_t userdata;
+    };
+
+    std::vector<EventType> event_types;
+    std::vector<Event> events;          // Min-heap on (when, order)
+    uint64_t ticks = 0;
+    uint64_t next_event_ticks = UINT64_MAX;
+    uint64_t next_order = 0;
+    std::mutex pending_mutex;
+    std::vector<Event> pending;         // Events posted by other threads
+    std::atomic<bool> has_pending{false};
+
+    void MergePending() {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        for (Event& event : pending) {
+            event.when = std::max(event.when, ticks);
+            event.order = next_order++;
+            events.push_back(event);
+            std::push_heap(events.begin(), events.end(), Later);
+        }
+        pending.clear();
+        has_pending.store(false, std::memory_order_relaxed);
+        next_event_ticks = events.empty() ? UINT64_MAX : events.front().when;
+    }
+
+    static bool Later(const Event& a, const Event& b) {
+        return a.when != b.when ? a.when > b.when : a.order > b.order;
+    }
+
+public:
+    // Guest time and the queued events, for savestates. Event types and
+    // their callbacks belong to the host and are not part of it.
+    struct State {
+        uint64_t ticks = 0;
+        uint64_t next_order = 0;
+        std::vector<Event> events;
+    };
+
+private:
+
+    void RunDueEvents() {
+        while (!events.empty() && events.front().when <= ticks) {
+            std::pop_heap(events.begin(), events.end(), Later);
+            Event event = events.back();
+            events.pop_back();
+            next_event_ticks = events.empty() ? UINT64_MAX : events.front().when;
+            event_types[event.type].callback(event.userdata, static_cast<int64_t>(ticks - event.when));
+        }
+    }
+};
+
+inline void Scheduler::SaveState(State& state) const {
+    state.ticks = ticks;
+    state.next_order = next_order;
+    state.events = events;
+}
+
+inline void Scheduler::LoadState(const State& state) {
+    ticks = state.ticks;
+    next_order = state.next_order;
+    events = state.events;
+    next_event_ticks = events.empty() ? UINT64_MAX : events.front().when;
+}
+
+// Emulator Context
+// Everything a kernel or HLE handler may touch
+struct EmulatorContext {
+    CPUState& cpu;
+    Memory& memory;
+    Hardware& hardware;
+    Scheduler& scheduler;
+};
+
+// Worker Pool
+// A fixed set of host threads for blocking work such as file I/O. Tasks must
+// not touch guest state; they hand their results back through the scheduler.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t thread_count) {
+        for (size_t i = 0; i < thread_count; ++i) {
+            threads.emplace_back([this] { Run(); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void Submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    // Pending tasks are drained before a stopping worker exits
+    void Run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+// Disc Reader
+// Random-access reads from a disc image on the host. IOS workers read
+// concurrently, so the stream is guarded.
+constexpr uint32_t kWiiDiscMagic = 0x5D1C9EA3;        // Header word at 0x18
+constexpr uint32_t kGameCubeDiscMagic = 0xC2339F3D;   // Header word at 0x1C
+
+class DiscReader {
+public:
+    bool Open(const std::string& filename) {
+        std::lock_guard<std::mutex> lock(mutex);
+        file.open(filename, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        file.seekg(0, std::ios::end);
+        size = static_cast<uint64_t>(file.tellg());
+        char id[6] = {};
+        file.seekg(0);
+        file.read(id, sizeof(id));
+        game_id.assign(id, static_cast<size_t>(file.gcount()));
+        file.clear();
+        return true;
+    }
+
+    // Returns false if the range is not entirely inside the image
+    bool Read(uint64_t offset, uint8_t* dst, size_t length) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!file.is_open() || offset > size || length > size - offset) {
+            return false;
+        }
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(length));
+        bool ok = static_cast<size_t>(file.gcount()) == length;
+        file.clear();
+        return ok;
+    }
+
+    bool IsOpen() const { return size != 0; }
+    uint64_t GetSize() const { return size; }
+    const std::string& GetGameID() const { return game_id; }
+
+private:
+    std::ifstream file;
+    std::mutex mutex;
+    uint64_t size = 0;
+    std::string game_id;
+};
+
+// IOS HLE
+// Starlet's IOS kernel is replaced by host implementations of its devices.
+// A request is parsed on the CPU thread (guest memory is only touched there),
+// the host work runs on a worker pool, and the completion comes back through
+// the scheduler after a modelled latency, so a slow host file operation never
+// stalls the PowerPC.
+enum IOSCommand : uint32_t {
+    kIOSOpen = 1,
+    kIOSClose = 2,
+    kIOSRead = 3,
+    kIOSWrite = 4,
+    kIOSSeek = 5,
+    kIOSIOCtl = 6,
+    kIOSIOCtlV = 7,
+    kIOSReply = 8,
+};
+
+enum IOSResult : int32_t {
+    kIPCEAccess = -1,
+    kIPCEExist = -2,
+    kIPCEInval = -4,
+    kIPCENoEnt = -6,
+    kIPCENoMem = -22,       // Also returned when the descriptor table is full
+    kFSEInval = -101,
+    kFSEAccess = -102,
+    kFSEExist = -105,
+    kFSENoEnt = -106,
+};
+
+// Modelled latencies in Broadway cycles
+constexpr uint64_t kIOSRequestLatency = 2700;               // IPC round trip through Starlet
+constexpr uint64_t kNANDBytesPerSecond = 8 * 1024 * 1024;
+constexpr uint64_t kDiscSeekLatency = kCpuClockHz / 1000;   // Short seek within a layer
+constexpr uint64_t kDiscBytesPerSecond = 3 * 1024 * 1024;   // Average CAV transfer rate
+constexpr size_t kIOSMaxFds = 32;
+constexpr size_t kIOSWorkerThreads = 2;
+
+// A guest buffer: for inputs, data holds the guest contents; for outputs, data
+// is written back to the guest when the request completes.
+struct IOSBuffer {
+    uint32_t address = 0;
+    uint32_t size = 0;
+    std::vector<uint8_t> data;
+};
+
+// A request block (0x40 bytes in guest memory) parsed into host form
+struct IOSRequest {
+    uint32_t address = 0;
+    uint32_t command = 0;
+    int32_t fd = -1;
+    uint32_t args[5] = {};
+    std::string path;                       // Open
+    IOSBuffer buffer;                       // Read/Write data, IOCtl input
+    IOSBuffer output;                       // IOCtl output
+    std::vector<IOSBuffer> in_vectors;      // IOCtlV inputs
+    std::vector<IOSBuffer> io_vectors;      // IOCtlV outputs, pre-loaded with guest contents
+};
+
+struct IOSReply {
+    int32_t result = 0;
+    uint64_t latency = kIOSRequestLatency;
+    std::vector<IOSBuffer> outputs;
+};
+
+inline IOSReply IOSResultReply(int32_t result, uint64_t latency = kIOSRequestLatency) {
+    IOSReply reply;
+    reply.result = result;
+    reply.latency = latency;
+    return reply;
+}
+
+inline uint64_t TransferCycles(uint64_t bytes, uint64_t bytes_per_second) {
+    return bytes * kCpuClockHz / bytes_per_second;
+}
+
+// Copies a NUL-terminated string of at most max_length bytes out of a buffer
+inline std::string BufferString(const std::vector<uint8_t>& data, size_t offset, size_t max_length) {
+    std::string result;
+    for (size_t i = offset; i < data.size() && i < offset + max_length && data[i]; ++i) {
+        result.push_back(static_cast<char>(data[i]));
+    }
+    return result;
+}
+
+inline IOSBuffer OutputWord(const IOSBuffer& target, uint32_t value) {
+    IOSBuffer out{target.address, 4, std::vector<uint8_t>(4)};
+    StoreBigEndian(out.data.data(), value);
+    return out;
+}
+
+// An open descriptor. Calls arrive on worker threads; the kernel holds mutex
+// around each call so one handle never runs two operations at once.
+class IOSHandle {
+public:
+    virtual ~IOSHandle() = default;
+    virtual IOSReply Read(IOSRequest&) { return IOSResultReply(kIPCEInval); }
+    virtual IOSReply Write(IOSRequest&) { return IOSResultReply(kIPCEInval); }
+    virtual IOSReply Seek(IOSRequest&) { return IOSResultReply(kIPCEInval); }
+    virtual IOSReply IOCtl(IOSRequest&) { return IOSResultReply(kIPCEInval); }
+    virtual IOSReply IOCtlV(IOSRequest&) { return IOSResultReply(kIPCEInval); }
+
+    std::mutex mutex;
+};
+
+// Maps a NAND path onto the host directory. Paths are absolute and may not
+// climb out of the root.
+inline bool NANDHostPath(const std::filesystem::path& root, const std::string& path,
+                         std::filesystem::path& host) {
+    if (path.empty() || path[0] != '/') {
+        return false;
+    }
+    std::filesystem::path relative = std::filesystem::path(path).relative_path();
+    for (const std::filesystem::path& part : relative) {
+        if (part == "..") {
+            return false;
+        }
+    }
+    host = root / relative;
+    return true;
+}
+
+// A file on the emulated NAND, opened by path through IOS_Open
+class NANDFile : public IOSHandle {
+public:
+    enum Mode : uint32_t { kModeRead = 1, kModeWrite = 2 };
+    static constexpr uint32_t kIOCtlGetFileStats = 0x0B;
+
+    NANDFile(std::fstream stream, uint32_t mode) : stream(std::move(stream)), mode(mode) {}
+
+    static std::shared_ptr<IOSHandle> Open(const std::filesystem::path& host, uint32_t mode, int32_t& result) {
+        std::error_code error;
+        if (!std::filesystem::is_regular_file(host, error)) {
+            result = kFSENoEnt;
+            return nullptr;
+        }
+        std::ios::openmode open_mode = std::ios::binary | std::ios::in;
+        if (mode & kModeWrite) {
+            open_mode |= std::ios::out;
+        }
+        std::fstream stream(host, open_mode);
+        if (!stream) {
+            result = kFSEAccess;
+            return nullptr;
+        }
+        result = 0;
+        return std::make_shared<NANDFile>(std::move(stream), mode);
+    }
+
+    IOSReply Read(IOSRequest& request) override {
+        if (!(mode & kModeRead)) {
+            return IOSResultReply(kFSEAccess);
+        }
+        // Sized by what is left of the file, not by the guest's length alone
+        stream.seekg(0, std::ios::end);
+        std::streamoff end = stream.tellg();
+        stream.clear();
+        int64_t remaining = std::max<int64_t>(end - position, 0);
+        uint32_t length = static_cast<uint32_t>(std::min<int64_t>(remaining, request.buffer.size));
+        IOSBuffer out{request.buffer.address, 0, std::vector<uint8_t>(length)};
+        stream.seekg(position);
+        stream.read(reinterpret_cast<char*>(out.data.data()), length);
+        out.size = static_cast<uint32_t>(stream.gcount());
+        out.data.resize(out.size);
+        stream.clear();
+        position += out.size;
+
+        IOSReply reply = IOSResultReply(static_cast<int32_t>(out.size),
+                                        kIOSRequestLatency + TransferCycles(out.size, kNANDBytesPerSecond));
+        reply.outputs.push_back(std::move(out));
+        return reply;
+    }
+
+    IOSReply Write(IOSRequest& request) override {
+        if (!(mode & kModeWrite)) {
+            return IOSResultReply(kFSEAccess);
+        }
+        stream.seekp(position);
+        stream.write(reinterpret_cast<const char*>(request.buffer.data.data()), request.buffer.size);
+        if (!stream) {
+            stream.clear();
+            return IOSResultReply(kFSEAccess);
+        }
+        position += request.buffer.size;
+        return IOSResultReply(static_cast<int32_t>(request.buffer.size),
+                              kIOSRequestLatency + TransferCycles(request.buffer.size, kNANDBytesPerSecond));
+    }
+
+    // args: offset, whence (0 set, 1 current, 2 end); returns the new position
+    IOSReply Seek(IOSRequest& request) override {
+        int64_t base = 0;
+        switch (request.args[1]) {
+            case 0: base = 0; break;
+            case 1: base = position; break;
+            case 2: base = Length(); break;
+            default: return IOSResultReply(kFSEInval);
+        }
+        int64_t target = base + static_cast<int32_t>(request.args[0]);
+        if (target < 0 || target > Length()) {
+            return IOSResultReply(kFSEInval);
+        }
+        position = target;
+        return IOSResultReply(static_cast<int32_t>(position));
+    }
+
+    IOSReply IOCtl(IOSRequest& request) override {
+        if (request.args[0] != kIOCtlGetFileStats || request.output.size < 8) {
+            return IOSResultReply(kFSEInval);
+        }
+        IOSBuffer out{request.output.address, 8, std::vector<uint8_t>(8)};
+        StoreBigEndian(out.data.data(), static_cast<uint32_t>(Length()));
+        StoreBigEndian(out.data.data() + 4, static_cast<uint32_t>(position));
+        IOSReply reply = IOSResultReply(0);
+        reply.outputs.push_back(std::move(out));
+        return reply;
+    }
+
+private:
+    std::fstream stream;
+    uint32_t mode;
+    int64_t position = 0;
+
+    int64_t Length() {
+        stream.seekg(0, std::ios::end);
+        int64_t length = static_cast<int64_t>(stream.tellg());
+        stream.clear();
+        return length;
+    }
+};
+
+// /dev/fs - namespace operations on the NAND, which lives in a host directory
+class FSDevice : public IOSHandle {
+public:
+    enum IOCtlNumber : uint32_t {
+        kFormat = 0x01,
+        kGetStats = 0x02,
+        kCreateDir = 0x03,
+        kReadDir = 0x04,
+        kSetAttr = 0x05,
+        kGetAttr = 0x06,
+        kDelete = 0x07,
+        kRename = 0x08,
+        kCreateFile = 0x09,
+        kGetUsage = 0x0C,
+    };
+    // Attribute block: owner u32, group u16, path[64], owner/group/other perms, attributes
+    static constexpr size_t kAttrPathOffset = 6;
+    static constexpr size_t kAttrSize = 0x4C;
+    static constexpr size_t kPathLength = 64;
+    static constexpr size_t kNameLength = 13;    // 8.3 name plus terminator
+
+    explicit FSDevice(std::filesystem::path root) : root(std::move(root)) {}
+
+    const std::filesystem::path& GetRoot() const { return root; }
+
+    IOSReply IOCtl(IOSRequest& request) override {
+        const std::vector<uint8_t>& in = request.buffer.data;
+        std::filesystem::path host;
+        std::error_code error;
+        switch (request.args[0]) {
+            case kFormat:
+            case kSetAttr:
+                return IOSResultReply(0);
+
+            case kGetStats: {
+                // Block size, free/used clusters, bad, reserved, free/used inodes
+                static constexpr uint32_t kStats[7] = {0x4000, 0x5DEC, 0x1DD4, 0, 0, 0xF8F, 0x71};
+                IOSBuffer out{request.output.address, sizeof(kStats), std::vector<uint8_t>(sizeof(kStats))};
+                if (request.output.size < out.size) {
+                    return IOSResultReply(kFSEInval);
+                }
+                for (size_t i = 0; i < 7; ++i) {
+                    StoreBigEndian(out.data.data() + i * 4, kStats[i]);
+                }
+                IOSReply reply = IOSResultReply(0);
+                reply.outputs.push_back(std::move(out));
+                return reply;
+            }
+
+            case kCreateDir:
+            case kCreateFile: {
+                if (!NANDHostPath(root, BufferString(in, kAttrPathOffset, kPathLength), host)) {
+                    return IOSResultReply(kFSEInval);
+                }
+                if (std::filesystem::exists(host, error)) {
+                    return IOSResultReply(kFSEExist);
+                }
+                if (!std::filesystem::is_directory(host.parent_path(), error)) {
+                    return IOSResultReply(kFSENoEnt);
+                }
+                bool created = request.args[0] == kCreateDir
+                                   ? std::filesystem::create_directory(host, error)
+                                   : static_cast<bool>(std::ofstream(host, std::ios::binary));
+                return IOSResultReply(created ? 0 : kFSEAccess, NANDWriteLatency());
+            }
+
+            case kGetAttr: {
+                std::string path = BufferString(in, 0, kPathLength);
+                if (!NANDHostPath(root, path, host)) {
+                    return IOSResultReply(kFSEInval);
+                }
+                if (!std::filesystem::exists(host, error)) {
+                    return IOSResultReply(kFSENoEnt);
+                }
+                if (request.output.size < kAttrSize) {
+                    return IOSResultReply(kFSEInval);
+                }
+                IOSBuffer out{request.output.address, kAttrSize, std::vector<uint8_t>(kAttrSize)};
+                std::memcpy(out.data.data() + kAttrPathOffset, path.data(), std::min(path.size(), kPathLength - 1));
+                out.data[kAttrPathOffset + kPathLength + 0] = 3;    // Owner: read/write
+                out.data[kAttrPathOffset + kPathLength + 1] = 3;    // Group: read/write
+                out.data[kAttrPathOffset + kPathLength + 2] = 3;    // Other: read/write
+                IOSReply reply = IOSResultReply(0);
+                reply.outputs.push_back(std::move(out));
+                return reply;
+            }
+
+            case kDelete: {
+                if (!NANDHostPath(root, BufferString(in, 0, kPathLength), host)) {
+                    return IOSResultReply(kFSEInval);
+                }
+                if (!std::filesystem::exists(host, error)) {
+                    return IOSResultReply(kFSENoEnt);
+                }
+                std::filesystem::remove_all(host, error);
+                return IOSResultReply(error ? kFSEAccess : 0, NANDWriteLatency());
+            }
+
+            case kRename: {
+                std::filesystem::path target;
+                if (!NANDHostPath(root, BufferString(in, 0, kPathLength), host) ||
+                    !NANDHostPath(root, BufferString(in, kPathLength, kPathLength), target)) {
+                    return IOSResultReply(kFSEInval);
+                }
+                if (!std::filesystem::exists(host, error)) {
+                    return IOSResultReply(kFSENoEnt);
+                }
+                std::filesystem::rename(host, target, error);
+                return IOSResultReply(error ? kFSEAccess : 0, NANDWriteLatency());
+            }
+
+            default:
+                std::cerr << "IOS: /dev/fs unhandled ioctl 0x" << std::hex << request.args[0] << std::dec << "\n";
+                return IOSResultReply(kFSEInval);
+        }
+    }
+
+    IOSReply IOCtlV(IOSRequest& request) override {
+        std::vector<IOSBuffer>& in = request.in_vectors;
+        std::vector<IOSBuffer>& io = request.io_vectors;
+        std::filesystem::path host;
+        std::error_code error;
+        if (in.empty() || !NANDHostPath(root, BufferString(in[0].data, 0, kPathLength), host)) {
+            return IOSResultReply(kFSEInval);
+        }
+        if (!std::filesystem::is_directory(host, error)) {
+            return IOSResultReply(kFSENoEnt);
+        }
+
+        switch (request.args[0]) {
+            case kReadDir: {
+                // With a name buffer: in = {path, max count}, io = {names, count}.
+                // Without: in = {path}, io = {count}.
+                std::vector<std::string> names;
+                for (const auto& entry : std::filesystem::directory_iterator(host, error)) {
+                    names.push_back(entry.path().filename().string());
+                }
+                std::sort(names.begin(), names.end());
+                IOSReply reply = IOSResultReply(0, kIOSRequestLatency + TransferCycles(names.size() * kNameLength,
+                                                                                       kNANDBytesPerSecond));
+                if (in.size() >= 2 && io.size() >= 2 && in[1].size >= 4) {
+                    uint32_t max_count = LoadBigEndian<uint32_t>(in[1].data.data());
+                    IOSBuffer out{io[0].address, io[0].size, std::vector<uint8_t>(io[0].size)};
+                    size_t offset = 0;
+                    uint32_t count = 0;
+                    for (const std::string& name : names) {
+                        if (count == max_count || offset + name.size() + 1 > out.size) {
+                            break;
+                        }
+                        std::memcpy(out.data.data() + offset, name.data(), name.size());
+                        offset += name.size() + 1;
+                        ++count;
+                    }
+                    reply.outputs.push_back(std::move(out));
+                    reply.outputs.push_back(OutputWord(io[1], count));
+                } else if (!io.empty() && io[0].size >= 4) {
+                    reply.outputs.push_back(OutputWord(io[0], static_cast<uint32_t>(names.size())));
+                } else {
+                    return IOSResultReply(kFSEInval);
+                }
+                return reply;
+            }
+
+            case kGetUsage: {
+                // io = {clusters, inodes}
+                if (io.size() < 2 || io[0].size < 4 || io[1].size < 4) {
+                    return IOSResultReply(kFSEInval);
+                }
+                uint64_t bytes = 0;
+                uint32_t inodes = 0;
+                for (const auto& entry : std::filesystem::recursive_directory_iterator(host, error)) {
+                    ++inodes;
+                    if (entry.is_regular_file(error)) {
+                        bytes += entry.file_size(error);
+                    }
+                }
+                IOSReply reply = IOSResultReply(0);
+                reply.outputs.push_back(OutputWord(io[0], static_cast<uint32_t>((bytes + 0x3FFF) / 0x4000)));
+                reply.outputs.push_back(OutputWord(io[1], inodes));
+                return reply;
+            }
+
+            default:
+                std::cerr << "IOS: /dev/fs unhandled ioctlv 0x" << std::hex << request.args[0] << std::dec << "\n";
+                return IOSResultReply(kFSEInval);
+        }
+    }
+
+private:
+    std::filesystem::path root;
+
+    // Metadata updates rewrite a superblock cluster
+    static uint64_t NANDWriteLatency() {
+        return kIOSRequestLatency + TransferCycles(0x4000, kNANDBytesPerSecond);
+    }
+};
+
+// /dev/es - title metadata. The running title comes from the disc header;
+// installed titles are the title/<high>/<low> directories on the NAND.
+class ESDevice : public IOSHandle {
+public:
+    enum IOCtlNumber : uint32_t {
+        kGetTitleCount = 0x0E,
+        kGetTitles = 0x0F,
+        kGetConsumption = 0x16,
+        kGetDataDir = 0x1D,
+        kGetTitleID = 0x20,
+    };
+
+    ESDevice(std::filesystem::path nand_root, uint64_t title_id)
+        : nand_root(std::move(nand_root)), title_id(title_id) {}
+
+    IOSReply IOCtlV(IOSRequest& request) override {
+        std::vector<IOSBuffer>& in = request.in_vectors;
+        std::vector<IOSBuffer>& io = request.io_vectors;
+        IOSReply reply = IOSResultReply(0);
+        switch (request.args[0]) {
+            case kGetTitleID: {
+                if (io.empty() || io[0].size < 8) {
+                    return IOSResultReply(kIPCEInval);
+                }
+                IOSBuffer out{io[0].address, 8, std::vector<uint8_t>(8)};
+                StoreBigEndian(out.data.data(), title_id);
+                reply.outputs.push_back(std::move(out));
+                return reply;
+            }
+
+            case kGetTitleCount: {
+                if (io.empty() || io[0].size < 4) {
+                    return IOSResultReply(kIPCEInval);
+                }
+                reply.outputs.push_back(OutputWord(io[0], static_cast<uint32_t>(ListTitles().size())));
+                return reply;
+            }
+
+            case kGetTitles: {
+                if (in.empty() || in[0].size < 4 || io.empty()) {
+                    return IOSResultReply(kIPCEInval);
+                }
+                std::vector<uint64_t> titles = ListTitles();
+                size_t count = std::min<size_t>({titles.size(), LoadBigEndian<uint32_t>(in[0].data.data()),
+                                                 io[0].size / 8});
+                IOSBuffer out{io[0].address, static_cast<uint32_t>(count * 8), std::vector<uint8_t>(count * 8)};
+                for (size_t i = 0; i < count; ++i) {
+                    StoreBigEndian(out.data.data() + i * 8, titles[i]);
+                }
+                reply.outputs.push_back(std::move(out));
+                return reply;
+            }
+
+            case kGetDataDir: {
+                if (in.empty() || in[0].size < 8 || io.empty()) {
+                    return IOSResultReply(kIPCEInval);
+                }
+                uint64_t id = LoadBigEndian<uint64_t>(in[0].data.data());
+                char path[32];
+                std::snprintf(path, sizeof(path), "/title/%08x/%08x/data",
+                              static_cast<uint32_t>(id >> 32), static_cast<uint32_t>(id));
+                size_t length = std::min<size_t>(std::strlen(path) + 1, io[0].size);
+                IOSBuffer out{io[0].address, static_cast<uint32_t>(length),
+                              std::vector<uint8_t>(path, path + length)};
+                reply.outputs.push_back(std::move(out));
+                return reply;
+            }
+
+            case kGetConsumption: {
+                // No usage limits: zero entries
+                if (io.size() >= 2 && io[1].size >= 4) {
+                    reply.outputs.push_back(OutputWord(io[1], 0));
+                }
+                return reply;
+            }
+
+            default:
+                std::cerr << "IOS: /dev/es unhandled ioctlv 0x" << std::hex << request.args[0] << std::dec << "\n";
+                return IOSResultReply(kIPCEInval);
+        }
+    }
+
+private:
+    std::filesystem::path nand_root;
+    uint64_t title_id;
+
+    std::vector<uint64_t> ListTitles() const {
+        std::vector<uint64_t> titles{title_id};
+        std::error_code error;
+        for (const auto& high : std::filesystem::directory_iterator(nand_root / "title", error)) {
+            for (const auto& low : std::filesystem::directory_iterator(high.path(), error)) {
+                try {
+                    uint64_t id = std::stoull(high.path().filename().string(), nullptr, 16) << 32 |
+                                  std::stoull(low.path().filename().string(), nullptr, 16);
+                    if (id != title_id) {
+                        titles.push_back(id);
+                    }
+                } catch (const std::exception&) {
+                    // Not a title directory
+                }
+            }
+        }
+        return titles;
+    }
+};
+
+// /dev/di - drive commands carried in the ioctl input block
+// (command << 24, then command-specific words). The image is read as a plain
+// decrypted dump; partition crypto is not modelled.
+class DIDevice : public IOSHandle {
+public:
+    enum Command : uint8_t {
+        kInquiry = 0x12,
+        kReadDiscID = 0x70,
+        kRead = 0x71,
+        kGetCoverRegister = 0x7A,
+        kClearCoverInterrupt = 0x86,
+        kGetCoverStatus = 0x88,
+        kReset = 0x8A,
+        kUnencryptedRead = 0x8D,
+        kEnableDVDVideo = 0x8E,
+        kSeek = 0xAB,
+        kRequestError = 0xE0,
+        kStopMotor = 0xE3,
+    };
+    enum DIResult : int32_t { kDISuccess = 1, kDIError = 2 };
+
+    explicit DIDevice(DiscReader& disc) : disc(disc) {}
+
+    IOSReply IOCtl(IOSRequest& request) override {
+        const std::vector<uint8_t>& in = request.buffer.data;
+        auto word = [&in](size_t index) {
+            return index * 4 + 4 <= in.size() ? LoadBigEndian<uint32_t>(in.data() + index * 4) : 0u;
+        };
+        IOSReply reply = IOSResultReply(kDISuccess);
+        switch (static_cast<uint8_t>(request.args[0])) {
+            case kInquiry: {
+                IOSBuffer out{request.output.address, std::min<uint32_t>(request.output.size, 0x20),
+                              std::vector<uint8_t>(std::min<uint32_t>(request.output.size, 0x20))};
+                if (out.size >= 8) {
+                    StoreBigEndian(out.data.data(), static_cast<uint16_t>(0x0002));     // Revision
+                    StoreBigEndian(out.data.data() + 2, static_cast<uint16_t>(0x0020)); // Device code
+                    StoreBigEndian(out.data.data() + 4, 0x20060526u);                   // Release date
+                }
+                reply.outputs.push_back(std::move(out));
+                return reply;
+            }
+
+            case kReadDiscID:
+                return ReadDisc(request.output, 0, 0x20);
+
+            case kRead:
+            case kUnencryptedRead:
+                // word 1: length, word 2: offset in 32-bit words
+                return ReadDisc(request.output, static_cast<uint64_t>(word(2)) << 2, word(1));
+
+            case kGetCoverStatus:
+            case kGetCoverRegister:
+            case kRequestError: {
+                // Cover status 2: disc inserted
+                uint32_t value = request.args[0] == kGetCoverStatus ? (disc.IsOpen() ? 2u : 1u) : 0u;
+                if (request.output.size >= 4) {
+                    reply.outputs.push_back(OutputWord(request.output, value));
+                }
+                return reply;
+            }
+
+            case kSeek:
+                reply.latency = kIOSRequestLatency + kDiscSeekLatency;
+                return reply;
+
+            case kClearCoverInterrupt:
+            case kReset:
+            case kEnableDVDVideo:
+            case kStopMotor:
+                return reply;
+
+            default:
+                std::cerr << "IOS: /dev/di unhandled command 0x" << std::hex << request.args[0] << std::dec << "\n";
+                return IOSResultReply(kDIError);
+        }
+    }
+
+private:
+    DiscReader& disc;
+
+    IOSReply ReadDisc(const IOSBuffer& target, uint64_t offset, uint32_t length) {
+        length = std::min(length, target.size);
+        IOSBuffer out{target.address, length, std::vector<uint8_t>(length)};
+        if (!disc.Read(offset, out.data.data(), length)) {
+            return IOSResultReply(kDIError);
+        }
+        IOSReply reply = IOSResultReply(kDISuccess, kIOSRequestLatency + kDiscSeekLatency +
+                                                        TransferCycles(length, kDiscBytesPerSecond));
+        reply.outputs.push_back(std::move(out));
+        return reply;
+    }
+};
+
+// IOS Kernel
+// Owns the descriptor table and device namespace. Submit and the completion
+// event run on the CPU thread; device calls run on the worker pool. Finished
+// requests queue up for HW_IPC_ARMMSG, which holds one reply at a time.
+class IOSKernel {
+public:
+    IOSKernel(Memory& memory, DMAEngine& dma, Scheduler& scheduler, DiscReader& disc,
+              const std::filesystem::path& nand_root, uint64_t title_id)
+        : memory(memory), dma(dma), scheduler(scheduler), workers(kIOSWorkerThreads) {
+        std::error_code error;
+        std::filesystem::create_directories(nand_root, error);
+        auto fs = std::make_shared<FSDevice>(nand_root);
+        devices["/dev/fs"] = fs;
+        devices["/dev/es"] = std::make_shared<ESDevice>(nand_root, title_id);
+        devices["/dev/di"] = std::make_shared<DIDevice>(disc);
+        nand = std::move(fs);
+        reply_event = scheduler.RegisterEvent("IOSReply", [this](uint64_t token, int64_t) { Complete(token); });
+    }
+
+    // Accepts the request block at a physical address (HW_IPC_PPCMSG)
+    void Submit(uint32_t address) {
+        in_flight.fetch_add(1, std::memory_order_relaxed);
+        uint64_t token = next_token++;
+        uint64_t deadline = scheduler.GetTicks();
+        IOSRequest request;
+        request.address = address;
+        std::shared_ptr<IOSHandle> handle;
+        int32_t error = ParseRequest(request);
+        if (error == 0 && request.command != kIOSOpen) {
+            if (request.fd < 0 || static_cast<size_t>(request.fd) >= kIOSMaxFds || !fds[request.fd]) {
+                error = kIPCEInval;
+            } else {
+                handle = fds[request.fd];
+            }
+        }
+        if (error != 0) {
+            Finish(token, request, IOSResultReply(error), nullptr, deadline);
+            return;
+        }
+
+        ++requests_submitted;
+        workers.Submit([this, token, deadline, request = std::move(request), handle]() mutable {
+            std::shared_ptr<IOSHandle> opened;
+            IOSReply reply;
+            try {
+                reply = Execute(request, handle, opened);
+            } catch (const std::bad_alloc&) {
+                reply = IOSResultReply(kIPCENoMem);
+            }
+            Finish(token, request, std::move(reply), std::move(opened), deadline);
+        });
+    }
+
+    // Next completed request for HW_IPC_ARMMSG, in completion order
+    bool PopReply(uint32_t& address) {
+        if (replies.empty()) {
+            return false;
+        }
+        address = replies.front();
+        replies.pop_front();
+        return true;
+    }
+
+    uint64_t GetRequestCount() const { return requests_submitted; }
+
+    // No request is between Submit and its reply reaching HW_IPC_ARMMSG.
+    // Host file I/O cannot be rewound, so savestates are only taken then.
+    bool IsIdle() const { return in_flight.load(std::memory_order_acquire) == 0 && replies.empty(); }
+
+private:
+    struct Completion {
+        uint32_t address;
+        uint32_t command;
+        int32_t fd;
+        IOSReply reply;
+        std::shared_ptr<IOSHandle> opened;
+    };
+
+    Memory& memory;
+    DMAEngine& dma;
+    Scheduler& scheduler;
+    std::unordered_map<std::string, std::shared_ptr<IOSHandle>> devices;    // Immutable after construction
+    std::shared_ptr<FSDevice> nand;
+    std::array<std::shared_ptr<IOSHandle>, kIOSMaxFds> fds;
+    std::deque<uint32_t> replies;
+    std::mutex completion_mutex;
+    std::unordered_map<uint64_t, Completion> completions;
+    uint64_t next_token = 0;
+    uint64_t requests_submitted = 0;
+    std::atomic<uint32_t> in_flight{0};     // Submitted, reply not yet queued
+    int reply_event = -1;
+    WorkerPool workers;     // Declared last: joined before the state above is destroyed
+
+    // Copies everything the request refers to out of guest memory
+    int32_t ParseRequest(IOSRequest& request) {
+        try {
+            uint32_t address = request.address;
+            request.command = memory.Read<uint32_t>(address + 0x00);
+            request.fd = static_cast<int32_t>(memory.Read<uint32_t>(address + 0x08));
+            for (size_t i = 0; i < 5; ++i) {
+                request.args[i] = memory.Read<uint32_t>(address + 0x0C + static_cast<uint32_t>(i) * 4);
+            }
+            switch (request.command) {
+                case kIOSOpen:
+                    for (uint32_t p = request.args[0]; request.path.size() < 0x40; ++p) {
+                        char c = static_cast<char>(memory.Read<uint8_t>(p));
+                        if (!c) break;
+                        request.path.push_back(c);
+                    }
+                    break;
+                case kIOSClose:
+                case kIOSSeek:
+                    break;
+                case kIOSRead:
+                    request.buffer = GuestRange(request.args[0], request.args[1]);
+                    break;
+                case kIOSWrite:
+                    request.buffer = ReadGuestBuffer(request.args[0], request.args[1]);
+                    break;
+                case kIOSIOCtl:
+                    request.buffer = ReadGuestBuffer(request.args[1], request.args[2]);
+                    request.output = GuestRange(request.args[3], request.args[4]);
+                    break;
+                case kIOSIOCtlV: {
+                    uint32_t in_count = request.args[1];
+                    uint32_t io_count = request.args[2];
+                    if (in_count > 32 || io_count > 32 - in_count) {
+                        return kIPCEInval;
+                    }
+                    for (uint32_t i = 0; i < in_count + io_count; ++i) {
+                        uint32_t vector = request.args[3] + i * 8;
+                        IOSBuffer buffer = ReadGuestBuffer(memory.Read<uint32_t>(vector),
+                                                           memory.Read<uint32_t>(vector + 4));
+                        (i < in_count ? request.in_vectors : request.io_vectors).push_back(std::move(buffer));
+                    }
+                    break;
+                }
+                default:
+                    std::cerr << "IOS: unknown command " << request.command << "\n";
+                    return kIPCEInval;
+            }
+        } catch (const std::out_of_range&) {
+            return kIPCEInval;
+        }
+        return 0;
+    }
+
+    // A guest buffer, checked to be one run of RAM before any host buffer is
+    // sized from it; ParseRequest turns a bad one into kIPCEInval
+    IOSBuffer GuestRange(uint32_t address, uint32_t size) {
+        if (size && memory.RamOffset(address, size) < 0) {
+            throw std::out_of_range("IOS buffer outside RAM");
+        }
+        return IOSBuffer{address, size, {}};
+    }
+
+    IOSBuffer ReadGuestBuffer(uint32_t address, uint32_t size) {
+        IOSBuffer buffer = GuestRange(address, size);
+        buffer.data.resize(size);
+        if (size) {
+            dma.ReadFromGuest(buffer.data.data(), address, size, SwapWidth::kNone);
+        }
+        return buffer;
+    }
+
+    // Worker thread: runs the host side of a request
+    IOSReply Execute(IOSRequest& request, const std::shared_ptr<IOSHandle>& handle,
+                     std::shared_ptr<IOSHandle>& opened) {
+        if (request.command == kIOSOpen) {
+            auto device = devices.find(request.path);
+            if (device != devices.end()) {
+                opened = device->second;
+                return IOSResultReply(0);
+            }
+            std::filesystem::path host;
+            if (request.path.compare(0, 5, "/dev/") == 0 || !NANDHostPath(nand->GetRoot(), request.path, host)) {
+                return IOSResultReply(kIPCENoEnt);
+            }
+            int32_t result = 0;
+            opened = NANDFile::Open(host, request.args[1], result);
+            return IOSResultReply(result, kIOSRequestLatency + TransferCycles(0x4000, kNANDBytesPerSecond));
+        }
+
+        std::lock_guard<std::mutex> lock(handle->mutex);
+        switch (request.command) {
+            case kIOSClose: return IOSResultReply(0);
+            case kIOSRead: return handle->Read(request);
+            case kIOSWrite: return handle->Write(request);
+            case kIOSSeek: return handle->Seek(request);
+            case kIOSIOCtl: return handle->IOCtl(request);
+            case kIOSIOCtlV: return handle->IOCtlV(request);
+            default: return IOSResultReply(kIPCEInval);
+        }
+    }
+
+    // Any thread: parks the result and schedules its delivery at
+    // submission time + modelled latency
+    void Finish(uint64_t token, const IOSRequest& request, IOSReply reply, std::shared_ptr<IOSHandle> opened,
+                uint64_t submitted) {
+        uint64_t when = submitted + reply.latency;
+        {
+            std::lock_guard<std::mutex> lock(completion_mutex);
+            completions.emplace(token, Completion{request.address, request.command, request.fd,
+                                                  std::move(reply), std::move(opened)});
+        }
+        scheduler.ScheduleEventAtFromThread(when, reply_event, token);
+    }
+
+    // CPU thread: writes results into guest memory and queues the reply
+    void Complete(uint64_t token) {
+        Completion completion;
+        {
+            std::lock_guard<std::mutex> lock(completion_mutex);
+            auto it = completions.find(token);
+            if (it == completions.end()) {
+                return;
+            }
+            completion = std::move(it->second);
+            completions.erase(it);
+        }
+        in_flight.fetch_sub(1, std::memory_order_relaxed);
+
+        int32_t result = completion.reply.result;
+        try {
+            for (const IOSBuffer& out : completion.reply.outputs) {
+                if (out.size) {
+                    dma.WriteToGuest(out.address, out.data.data(), out.size, SwapWidth::kNone);
+                }
+            }
+        } catch (const std::out_of_range&) {
+            result = kIPCEInval;
+        }
+
+        if (completion.command == kIOSOpen && result >= 0) {
+            auto slot = std::find(fds.begin(), fds.end(), nullptr);
+            if (slot == fds.end()) {
+                result = kIPCENoMem;
+            } else {
+                *slot = std::move(completion.opened);
+                result = static_cast<int32_t>(slot - fds.begin());
+            }
+        } else if (completion.command == kIOSClose && result >= 0) {
+            fds[completion.fd].reset();
+        }
+
+        // The reply overwrites the command with kIOSReply and moves it to the fd slot
+        try {
+            memory.Write<uint32_t>(completion.address + 0x04, static_cast<uint32_t>(result));
+            memory.Write<uint32_t>(completion.address + 0x08, completion.command);
+            memory.Write<uint32_t>(completion.address + 0x00, kIOSReply);
+        } catch (const std::out_of_range&) {
+            return;
+        }
+        replies.push_back(completion.address);
+    }
+};
+
+// Work-Stealing Pool
+// Runs an indexed batch of jobs on every core. Indices are dealt round-robin
+// into per-thread queues; a thread pops from the back of its own queue and
+// steals from the front of the others once it runs dry. The calling thread
+// takes part, so a pool of one thread runs everything inline.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t thread_count) {
+        thread_count = std::max<size_t>(thread_count, 1);
+        for (size_t i = 0; i < thread_count; ++i) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 1; i < thread_count; ++i) {
+            threads.emplace_back([this, i] { WorkerLoop(i); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Runs fn(i) for every i in [0, count) and returns when all have finished
+    void ParallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) {
+            return;
+        }
+        remaining.store(count, std::memory_order_relaxed);
+        job = &fn;
+        for (size_t i = 0; i < count; ++i) {
+            Queue& queue = *queues[i % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.items.push_back(i);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++generation;
+        }
+        wake.notify_all();
+        while (remaining.load(std::memory_order_acquire) != 0) {
+            if (!RunOne(0)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    size_t GetThreadCount() const { return queues.size(); }
+
+private:
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;     // Index 0 belongs to the calling thread
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    uint64_t generation = 0;
+    bool stopping = false;
+    const std::function<void(size_t)>* job = nullptr;
+    std::atomic<size_t> remaining{0};
+
+    bool RunOne(size_t self) {
+        size_t index = 0;
+        bool found = false;
+        {
+            Queue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.items.empty()) {
+                index = own.items.back();
+                own.items.pop_back();
+                found = true;
+            }
+        }
+        for (size_t i = 1; !found && i < queues.size(); ++i) {
+            Queue& victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.items.empty()) {
+                index = victim.items.front();
+                victim.items.pop_front();
+                found = true;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        (*job)(index);
+        remaining.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    void WorkerLoop(size_t self) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            while (remaining.load(std::memory_order_acquire) != 0) {
+                if (!RunOne(self)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+};
+
+// Software GX Renderer
+// Rasterizes post-transform triangles into a 640x528 EFB held in 32x32
+// tiles, each tile's color and depth contiguous (8 KB) so a tile stays in L2
+// while its triangles are drawn. Triangles are set up and binned into the
+// tiles they touch as they arrive; Flush rasterizes every tile in parallel,
+// in submission order within a tile. Coordinates are snapped to 1/16 pixel
+// and coverage uses integer edge functions with a top-left fill rule,
+// rejected hierarchically: tiles at binning, then 8x8 blocks, which are
+// either trivially accepted or handed to a SIMD coverage kernel.
+//
+// Each tile also keeps coarse min/max depth bounds per 8x8 block (Hi-Z). A
+// block whose triangle depth range fails the depth test against them is
+// skipped before coverage and shading. Failing the depth test leaves a pixel
+// untouched whether it runs before or after the alpha test, so the
+// rejection holds for late-Z pipelines too. Bounds are recomputed from the
+// depth buffer after a block is written, so pixels the alpha test kills
+// never loosen them.
+constexpr int kEFBWidth = 640;
+constexpr int kEFBHeight = 528;
+constexpr int kGXTileSize = 32;
+constexpr int kGXTilesX = (kEFBWidth + kGXTileSize - 1) / kGXTileSize;
+constexpr int kGXTilesY = (kEFBHeight + kGXTileSize - 1) / kGXTileSize;
+constexpr int kGXSubpixelBits = 4;
+constexpr int kGXSubpixelOne = 1 << kGXSubpixelBits;
+constexpr float kGXGuardBand = 2048.0f;     // Vertices are clamped this far outside the EFB
+constexpr uint32_t kGXMaxDepth = 0xFFFFFF;
+
+enum GXCompare : uint8_t {
+    kCompareNever, kCompareLess, kCompareEqual, kCompareLEqual,
+    kCompareGreater, kCompareNEqual, kCompareGEqual, kCompareAlways,
+};
+
+// GX_BL_* factors; 2/3 mean destination color as a source factor and source
+// color as a destination factor
+enum GXBlendFactor : uint8_t {
+    kBlendZero, kBlendOne, kBlendColor, kBlendInvColor,
+    kBlendSrcAlpha, kBlendInvSrcAlpha, kBlendDstAlpha, kBlendInvDstAlpha,
+};
+
+// TEV (Texture Environment)
+// Up to 16 combiner stages. Each computes, separately for color and alpha,
+//   dest = ((d + bias) << shift) +/- lerp(a, b, c)
+// then rescales and clamps, picking a, b, c and d from the PREV and C0-C2
+// registers, texture, rasterized color, konst and fixed values. a, b and c
+// use the low 8 bits of their input, d all 11 signed bits. A stage's
+// texture inputs read the texture map its TEV_ORDER enables, sampled at
+// texcoord 0 (the only one transformed), or zero when it enables none;
+// swap tables, indirect texturing and compare-mode bias (bias 3) are not
+// modelled.
+constexpr int kGXTevStages = 16;
+constexpr int kGXTexMaps = 8;
+constexpr uint8_t kGXTexOrderEnable = 8;    // GXTevState::tex_order: the map in bits 0-2 is sampled
+
+enum GXTevColorInput : uint8_t {
+    kTevCPrev, kTevAPrev, kTevC0, kTevA0, kTevC1, kTevA1, kTevC2, kTevA2,
+    kTevTexC, kTevTexA, kTevRasC, kTevRasA, kTevOne, kTevHalf, kTevKonstC, kTevZeroC,
+};
+
+enum GXTevAlphaInput : uint8_t {
+    kTevAlphaPrev, kTevAlpha0, kTevAlpha1, kTevAlpha2, kTevTexAlpha, kTevRasAlpha, kTevKonstA, kTevZeroA,
+};
+
+enum GXAlphaOp : uint8_t { kAlphaOpAnd, kAlphaOpOr, kAlphaOpXor, kAlphaOpXnor };
+
+// Fields of a TEV_COLOR_ENV (BP 0xC0 + 2 * stage) or TEV_ALPHA_ENV
+// (0xC1 + 2 * stage) value
+struct GXTevEnv {
+    uint8_t a, b, c, d;     // GXTevColorInput or GXTevAlphaInput
+    uint8_t bias;           // 0: none, 1: +128, 2: -128
+    bool subtract;
+    bool clamp;             // To [0, 255] instead of [-1024, 1023]
+    uint8_t scale;          // 0: x1, 1: x2, 2: x4, 3: x0.5
+    uint8_t dest;           // PREV, C0, C1, C2
+
+    static GXTevEnv Color(uint32_t env) {
+        return GXTevEnv{static_cast<uint8_t>((env >> 12) & 0xF), static_cast<uint8_t>((env >> 8) & 0xF),
+                        static_cast<uint8_t>((env >> 4) & 0xF), static_cast<uint8_t>(env & 0xF),
+                        static_cast<uint8_t>((env >> 16) & 3), ((env >> 18) & 1) != 0, ((env >> 19) & 1) != 0,
+                        static_cast<uint8_t>((env >> 20) & 3), static_cast<uint8_t>((env >> 22) & 3)};
+    }
+
+    static GXTevEnv Alpha(uint32_t env) {
+        return GXTevEnv{static_cast<uint8_t>((env >> 13) & 7), static_cast<uint8_t>((env >> 10) & 7),
+                        static_cast<uint8_t>((env >> 7) & 7), static_cast<uint8_t>((env >> 4) & 7),
+                        static_cast<uint8_t>((env >> 16) & 3), ((env >> 18) & 1) != 0, ((env >> 19) & 1) != 0,
+                        static_cast<uint8_t>((env >> 20) & 3), static_cast<uint8_t>((env >> 22) & 3)};
+    }
+};
+
+// Whether either half of a stage reads its texture
+inline bool GXTevReadsTexture(uint32_t color_env, uint32_t alpha_env) {
+    GXTevEnv color = GXTevEnv::Color(color_env), alpha = GXTevEnv::Alpha(alpha_env);
+    for (uint8_t input : {color.a, color.b, color.c, color.d}) {
+        if (input == kTevTexC || input == kTevTexA) return true;
+    }
+    for (uint8_t input : {alpha.a, alpha.b, alpha.c, alpha.d}) {
+        if (input == kTevTexAlpha) return true;
+    }
+    return false;
+}
+
+// GX_PASSCLR: the rasterized color, clamped, into PREV
+constexpr uint32_t kTevPassColorEnv = kTevRasC | kTevZeroC << 4 | kTevZeroC << 8 | kTevZeroC << 12 | 1u << 19;
+constexpr uint32_t kTevPassAlphaEnv = kTevRasAlpha << 4 | kTevZeroA << 7 | kTevZeroA << 10 | kTevZeroA << 13 | 1u << 19;
+
+// The structure of the TEV setup: what a pixel pipeline is specialized on.
+// Compared and hashed bytewise, so keep it free of padding.
+struct GXTevState {
+    uint32_t color_env[kGXTevStages] = {kTevPassColorEnv};
+    uint32_t alpha_env[kGXTevStages] = {kTevPassAlphaEnv};
+    uint8_t konst_color[kGXTevStages] = {};     // KCSEL of each stage
+    uint8_t konst_alpha[kGXTevStages] = {};     // KASEL of each stage
+    uint8_t tex_order[kGXTevStages] = {};       // Texture map of each stage, | kGXTexOrderEnable if sampled
+    uint8_t stages = 1;
+    uint8_t alpha_func0 = kCompareAlways;
+    uint8_t alpha_func1 = kCompareAlways;
+    uint8_t alpha_op = kAlphaOpAnd;
+};
+static_assert(sizeof(GXTevState) == 180, "GXTevState must stay padding-free");
+
+// The values a TEV setup reads; pipelines take these as data
+struct GXTevConstants {
+    int16_t regs[4][4] = {};                    // PREV, C0-C2 before the first stage, RGBA
+    uint8_t konst[kGXTevStages][4] = {};        // The konst input of each stage, RGBA
+    uint8_t alpha_ref[2] = {};
+    uint8_t reserved[2] = {};
+};
+static_assert(sizeof(GXTevConstants) == 100, "GXTevConstants must stay padding-free");
+
+// Post-transform vertex: EFB pixel coordinates, depth in [0, 1], clip-space
+// w for perspective-correct attributes, color channels in [0, 255]
+struct GXVertex {
+    float x, y, z, w;
+    float color[4];
+    float uv[2];
+};
+
+// A decoded texture as the sampler reads it
+struct CachedTexture {
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> pixels;   // RGBA8888
+};
+
+// TX_SETMODE0 wrap modes
+enum GXTextureWrap : uint8_t { kWrapClamp, kWrapRepeat, kWrapMirror };
+
+// A texture map as the draws after it sample it. The texels are shared with
+// the texture cache, which decodes changed data into a fresh texture, so
+// they stay put while triangles that sample them wait to be rasterized.
+struct GXTextureMap {
+    std::shared_ptr<const CachedTexture> texture;   // Null reads zero
+    uint8_t wrap_s = kWrapClamp;
+    uint8_t wrap_t = kWrapClamp;
+
+    bool operator==(const GXTextureMap& other) const {
+        return texture == other.texture && wrap_s == other.wrap_s && wrap_t == other.wrap_t;
+    }
+};
+using GXTextureMaps = std::array<GXTextureMap, kGXTexMaps>;
+
+// Compared bytewise, so keep it free of padding
+struct GXRasterState {
+    bool z_enable = true;
+    uint8_t z_func = kCompareLEqual;
+    bool z_update = true;
+    bool color_update = true;
+    bool alpha_update = true;
+    bool blend_enable = false;
+    uint8_t blend_src = kBlendSrcAlpha;
+    uint8_t blend_dst = kBlendInvSrcAlpha;
+    int16_t scissor_x0 = 0, scissor_y0 = 0;
+    int16_t scissor_x1 = kEFBWidth - 1, scissor_y1 = kEFBHeight - 1;
+    GXTevState tev;
+    GXTevConstants tev_constants;
+
+    bool operator==(const GXRasterState& other) const {
+        return std::memcmp(this, &other, sizeof(*this)) == 0;
+    }
+};
+static_assert(sizeof(GXRasterState) == 16 + sizeof(GXTevState) + sizeof(GXTevConstants),
+              "GXRasterState must stay padding-free");
+
+// value(x, y) = a * x + b * y + c over EFB pixel coordinates
+struct GXPlane {
+    float a, b, c;
+
+    float At(float x, float y) const { return a * x + b * y + c; }
+
+    static GXPlane Fit(const float (&x)[3], const float (&y)[3], float v0, float v1, float v2) {
+        float dx1 = x[1] - x[0], dy1 = y[1] - y[0];
+        float dx2 = x[2] - x[0], dy2 = y[2] - y[0];
+        float det = dx1 * dy2 - dx2 * dy1;
+        GXPlane plane;
+        plane.a = ((v1 - v0) * dy2 - (v2 - v0) * dy1) / det;
+        plane.b = (dx1 * (v2 - v0) - dx2 * (v1 - v0)) / det;
+        plane.c = v0 - plane.a * x[0] - plane.b * y[0];
+        return plane;
+    }
+};
+
+// A set-up triangle. Edge i is E(X, Y) = a*X + b*Y + c over 1/16-pixel
+// coordinates of pixel centers; a pixel is covered when all three are >= 0
+// (the fill-rule bias is folded into c).
+struct GXTriangle {
+    int64_t edge_a[3], edge_b[3], edge_c[3];
+    int min_x, min_y, max_x, max_y;     // Inclusive pixel bounds, scissored
+    GXPlane z, inv_w;
+    GXPlane color[4];                   // Divided by w
+    GXPlane uv[2];                      // Divided by w
+    uint32_t state;
+};
+
+inline bool GXCompareValues(uint8_t func, uint32_t value, uint32_t reference) {
+    switch (func) {
+        case kCompareNever: return false;
+        case kCompareLess: return value < reference;
+        case kCompareEqual: return value == reference;
+        case kCompareLEqual: return value <= reference;
+        case kCompareGreater: return value > reference;
+        case kCompareNEqual: return value != reference;
+        case kCompareGEqual: return value >= reference;
+        default: return true;
+    }
+}
+
+inline uint32_t PackRGBA(const int (&rgba)[4]) {
+    return static_cast<uint32_t>(rgba[0]) << 24 | static_cast<uint32_t>(rgba[1]) << 16 |
+           static_cast<uint32_t>(rgba[2]) << 8 | static_cast<uint32_t>(rgba[3]);
+}
+
+inline void UnpackRGBA(uint32_t pixel, int (&rgba)[4]) {
+    rgba[0] = pixel >> 24;
+    rgba[1] = (pixel >> 16) & 0xFF;
+    rgba[2] = (pixel >> 8) & 0xFF;
+    rgba[3] = pixel & 0xFF;
+}
+
+// 8x8 Block Coverage
+// Bit (y * 8 + x) of the result is set when that pixel of the block is inside
+// all three edges. edge holds each edge function at the block's first pixel
+// center; step_x/step_y are its increments per pixel. The caller keeps all
+// values inside int32 range. The scalar kernel is the reference the SIMD
+// kernels are validated against.
+constexpr int kGXBlockSize = 8;
+
+using CoverageKernel = uint64_t (*)(const int32_t (&edge)[3], const int32_t (&step_x)[3],
+                                    const int32_t (&step_y)[3]);
+
+inline uint64_t BlockCoverageScalar(const int32_t (&edge)[3], const int32_t (&step_x)[3],
+                                    const int32_t (&step_y)[3]) {
+    uint64_t mask = 0;
+    for (int y = 0; y < kGXBlockSize; ++y) {
+        for (int x = 0; x < kGXBlockSize; ++x) {
+            int32_t e0 = edge[0] + x * step_x[0] + y * step_y[0];
+            int32_t e1 = edge[1] + x * step_x[1] + y * step_y[1];
+            int32_t e2 = edge[2] + x * step_x[2] + y * step_y[2];
+            if ((e0 | e1 | e2) >= 0) {
+                mask |= 1ull << (y * kGXBlockSize + x);
+            }
+        }
+    }
+    return mask;
+}
+
+#ifdef EMUWII_X86_SIMD
+// Two rows (16 pixels) per iteration; a pixel is covered when the OR of its
+// three edge values has a clear sign bit
+__attribute__((target("avx2")))
+inline uint64_t BlockCoverageAVX2(const int32_t (&edge)[3], const int32_t (&step_x)[3],
+                                  const int32_t (&step_y)[3]) {
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i row[3], next[3], step2[3];
+    for (int i = 0; i < 3; ++i) {
+        row[i] = _mm256_add_epi32(_mm256_set1_epi32(edge[i]),
+                                  _mm256_mullo_epi32(lanes, _mm256_set1_epi32(step_x[i])));
+        next[i] = _mm256_add_epi32(row[i], _mm256_set1_epi32(step_y[i]));
+        step2[i] = _mm256_set1_epi32(2 * step_y[i]);
+    }
+    uint64_t mask = 0;
+    for (int y = 0; y < kGXBlockSize; y += 2) {
+        __m256i a = _mm256_or_si256(_mm256_or_si256(row[0], row[1]), row[2]);
+        __m256i b = _mm256_or_si256(_mm256_or_si256(next[0], next[1]), next[2]);
+        uint32_t outside = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(a))) |
+                           static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(b))) << 8;
+        mask |= static_cast<uint64_t>(~outside & 0xFFFF) << (y * kGXBlockSize);
+        for (int i = 0; i < 3; ++i) {
+            row[i] = _mm256_add_epi32(row[i], step2[i]);
+            next[i] = _mm256_add_epi32(next[i], step2[i]);
+        }
+    }
+    return mask;
+}
+#endif
+
+inline CoverageKernel CoverageKernelFor(SimdLevel level) {
+#ifdef EMUWII_X86_SIMD
+    if (level == SimdLevel::kAVX2) return BlockCoverageAVX2;
+#endif
+    (void)level;
+    return BlockCoverageScalar;
+}
+
+// TEV Interpreter
+// Shades one pixel from a GXRasterState, decoding the TEV setup as it goes.
+// It is the reference the specialized pixel pipelines are validated against.
+inline int GXTevCombine(int a, int b, int c, int d, const GXTevEnv& env) {
+    a &= 0xFF;
+    b &= 0xFF;
+    c &= 0xFF;
+    c += c >> 7;
+    int shift = env.scale == 1 ? 1 : env.scale == 2 ? 2 : 0;
+    int lerp = (((a * (256 - c) + b * c) << shift) + (env.scale == 3 ? 0 : env.subtract ? 127 : 128)) >> 8;
+    int bias = env.bias == 1 ? 128 : env.bias == 2 ? -128 : 0;
+    int result = (d + bias) * (1 << shift) + (env.subtract ? -lerp : lerp);
+    if (env.scale == 3) result >>= 1;
+    return env.clamp ? std::clamp(result, 0, 255) : std::clamp(result, -1024, 1023);
+}
+
+inline bool GXAlphaTest(const GXTevState& tev, const GXTevConstants& constants, int alpha) {
+    bool pass0 = GXCompareValues(tev.alpha_func0, static_cast<uint32_t>(alpha), constants.alpha_ref[0]);
+    bool pass1 = GXCompareValues(tev.alpha_func1, static_cast<uint32_t>(alpha), constants.alpha_ref[1]);
+    switch (tev.alpha_op) {
+        case kAlphaOpAnd: return pass0 && pass1;
+        case kAlphaOpOr: return pass0 || pass1;
+        case kAlphaOpXor: return pass0 != pass1;
+        default: return pass0 == pass1;
+    }
+}
+
+inline void GXBlendPixel(const GXRasterState& state, int (&src)[4], uint32_t dst_pixel) {
+    int dst[4];
+    UnpackRGBA(dst_pixel, dst);
+    auto factor = [&](uint8_t mode, bool source, int channel) {
+        switch (mode) {
+            case kBlendZero: return 0;
+            case kBlendOne: return 255;
+            case kBlendColor: return source ? dst[channel] : src[channel];
+            case kBlendInvColor: return 255 - (source ? dst[channel] : src[channel]);
+            case kBlendSrcAlpha: return src[3];
+            case kBlendInvSrcAlpha: return 255 - src[3];
+            case kBlendDstAlpha: return dst[3];
+            default: return 255 - dst[3];
+        }
+    };
+    int result[4];
+    for (int c = 0; c < 4; ++c) {
+        int value = src[c] * factor(state.blend_src, true, c) + dst[c] * factor(state.blend_dst, false, c);
+        result[c] = std::min(255, (value + 127) / 255);
+    }
+    std::copy(std::begin(result), std::end(result), std::begin(src));
+}
+
+// Texel index i of an axis size texels long after wrapping
+inline int GXWrapTexel(int i, int size, uint8_t wrap) {
+    switch (wrap) {
+        case kWrapRepeat:
+            i %= size;
+            return i < 0 ? i + size : i;
+        case kWrapMirror:
+            i %= 2 * size;
+            if (i < 0) i += 2 * size;
+            return i < size ? i : 2 * size - 1 - i;
+        default:
+            return std::clamp(i, 0, size - 1);
+    }
+}
+
+// The texel of map nearest normalized (u, v), RGBA8888. Both shading paths
+// sample through this with the same coordinates. Texel coordinates are
+// clamped to 2^24 either way first, NaN to the low end, so they convert
+// exactly.
+inline uint32_t GXSampleTexture(const GXTextureMap& map, float u, float v) {
+    const CachedTexture* texture = map.texture.get();
+    if (!texture) {
+        return 0;
+    }
+    auto texel = [](float coordinate, int size, uint8_t wrap) {
+        constexpr float kLimit = 16777216.0f;
+        float value = coordinate * static_cast<float>(size);
+        value = value >= -kLimit ? value : -kLimit;
+        value = value <= kLimit ? value : kLimit;
+        int i = static_cast<int>(value);
+        if (static_cast<float>(i) > value) --i;
+        return GXWrapTexel(i, size, wrap);
+    };
+    int s = texel(u, texture->width, map.wrap_s), t = texel(v, texture->height, map.wrap_t);
+    return texture->pixels[static_cast<size_t>(t) * texture->width + s];
+}
+
+inline void GXShadePixel(const GXTriangle& tri, const GXRasterState& state, const GXTextureMaps& textures, int x,
+                         int y, uint32_t& color, uint32_t& depth) {
+    float fx = x + 0.5f, fy = y + 0.5f;
+    float z = std::min(std::max(tri.z.At(fx, fy), 0.0f), 1.0f);
+    uint32_t pixel_depth = static_cast<uint32_t>(z * kGXMaxDepth);
+    if (state.z_enable && !GXCompareValues(state.z_func, pixel_depth, depth)) {
+        return;
+    }
+
+    float w = 1.0f / tri.inv_w.At(fx, fy);
+    int ras[4];
+    for (int c = 0; c < 4; ++c) {
+        float value = tri.color[c].At(fx, fy) * w;
+        ras[c] = static_cast<int>(std::min(std::max(value, 0.0f), 255.0f) + 0.5f);
+    }
+    float u = tri.uv[0].At(fx, fy) * w, v = tri.uv[1].At(fx, fy) * w;
+
+    const GXTevState& tev = state.tev;
+    const GXTevConstants& constants = state.tev_constants;
+    int regs[4][4];
+    for (int r = 0; r < 4; ++r) {
+        std::copy(std::begin(constants.regs[r]), std::end(constants.regs[r]), std::begin(regs[r]));
+    }
+    uint8_t color_dest = 0, alpha_dest = 0;
+    for (int stage = 0; stage < tev.stages; ++stage) {
+        const uint8_t (&konst)[4] = constants.konst[stage];
+        int tex[4] = {};
+        if (tev.tex_order[stage] & kGXTexOrderEnable) {
+            UnpackRGBA(GXSampleTexture(textures[tev.tex_order[stage] & (kGXTexMaps - 1)], u, v), tex);
+        }
+        auto color_input = [&](uint8_t input, int c) {
+            switch (input) {
+                case kTevCPrev: case kTevC0: case kTevC1: case kTevC2: return regs[input / 2][c];
+                case kTevAPrev: case kTevA0: case kTevA1: case kTevA2: return regs[input / 2][3];
+                case kTevTexC: return tex[c];
+                case kTevTexA: return tex[3];
+                case kTevRasC: return ras[c];
+                case kTevRasA: return ras[3];
+                case kTevOne: return 255;
+                case kTevHalf: return 128;
+                case kTevKonstC: return static_cast<int>(konst[c]);
+                default: return 0;
+            }
+        };
+        auto alpha_input = [&](uint8_t input) {
+            switch (input) {
+                case kTevAlphaPrev: case kTevAlpha0: case kTevAlpha1: case kTevAlpha2: return regs[input][3];
+                case kTevTexAlpha: return tex[3];
+                case kTevRasAlpha: return ras[3];
+                case kTevKonstA: return static_cast<int>(konst[3]);
+                default: return 0;
+            }
+        };
+        GXTevEnv color_env = GXTevEnv::Color(tev.color_env[stage]);
+        GXTevEnv alpha_env = GXTevEnv::Alpha(tev.alpha_env[stage]);
+        int result[4];
+        for (int c = 0; c < 3; ++c) {
+            result[c] = GXTevCombine(color_input(color_env.a, c), color_input(color_env.b, c),
+                                     color_input(color_env.c, c), color_input(color_env.d, c), color_env);
+        }
+        result[3] = GXTevCombine(alpha_input(alpha_env.a), alpha_input(alpha_env.b), alpha_input(alpha_env.c),
+                                 alpha_input(alpha_env.d), alpha_env);
+        // Both halves of a stage read the registers as they were before it
+        std::copy(result, result + 3, regs[color_env.dest]);
+        regs[alpha_env.dest][3] = result[3];
+        color_dest = color_env.dest;
+        alpha_dest = alpha_env.dest;
+    }
+    // The output is the low 8 bits of the last stage's results
+    int src[4] = {regs[color_dest][0] & 0xFF, regs[color_dest][1] & 0xFF, regs[color_dest][2] & 0xFF,
+                  regs[alpha_dest][3] & 0xFF};
+    if (!GXAlphaTest(tev, constants, src[3])) {
+        return;
+    }
+
+    if (state.blend_enable) {
+        GXBlendPixel(state, src, color);
+    }
+    uint32_t mask = (state.color_update ? 0xFFFFFF00u : 0u) | (state.alpha_update ? 0xFFu : 0u);
+    color = (color & ~mask) | (PackRGBA(src) & mask);
+    if (state.z_enable && state.z_update) {
+        depth = pixel_depth;
+    }
+}
+
+// Pixel Pipelines
+// Depth test, TEV, alpha test, blending and the EFB write specialized on the
+// structural part of the state (GXPixelPipelineKey). Each TEV stage becomes
+// two combine steps with their operand slots resolved and subtract, bias,
+// scale and clamp fixed by template instantiation; the depth, alpha and
+// blend functions are instantiations too, and the depth test moves ahead of
+// the TEV when the alpha test cannot discard. A pipeline shades a whole 4x4
+// quad per call, one 4-lane SIMD vector per row; texels are fetched lane by
+// lane through the interpreter's sampler. Pipelines are built once
+// per key and cached by its hash; the values the TEV reads
+// (GXTevConstants) stay data.
+constexpr int kGXQuadSize = 4;
+
+// One lane per pixel of a quad row
+typedef int32_t GXQuadRow __attribute__((vector_size(16)));
+typedef uint32_t GXQuadRowBits __attribute__((vector_size(16)));
+typedef float GXQuadRowFloats __attribute__((vector_size(16)));
+typedef GXQuadRow GXQuadLanes[kGXQuadSize];
+
+// Lanes of a where mask is set, else of b; masks are all-ones or zero
+inline GXQuadRow GXQuadSelect(GXQuadRow mask, GXQuadRow a, GXQuadRow b) { return (mask & a) | (~mask & b); }
+
+inline GXQuadRowFloats GXQuadSelect(GXQuadRow mask, GXQuadRowFloats a, GXQuadRowFloats b) {
+    return reinterpret_cast<GXQuadRowFloats>(GXQuadSelect(mask, reinterpret_cast<GXQuadRow>(a),
+                                                          reinterpret_cast<GXQuadRow>(b)));
+}
+
+inline bool GXQuadAny(const GXQuadLanes& mask) {
+    GXQuadRow any = mask[0] | mask[1] | mask[2] | mask[3];
+    return (any[0] | any[1] | any[2] | any[3]) != 0;
+}
+
+// Rows of a quad in a tile with kGXTileSize pixels per row
+inline void GXLoadQuad(const uint32_t* rows, GXQuadLanes& lanes) {
+    for (int y = 0; y < kGXQuadSize; ++y) std::memcpy(&lanes[y], rows + y * kGXTileSize, sizeof(GXQuadRow));
+}
+
+inline void GXStoreQuad(uint32_t* rows, const GXQuadLanes& lanes) {
+    for (int y = 0; y < kGXQuadSize; ++y) std::memcpy(rows + y * kGXTileSize, &lanes[y], sizeof(GXQuadRow));
+}
+
+// Operand slots of a quad: register r channel c at r * 4 + c, then the
+// texture, rasterized and konst colors and the fixed values
+enum GXQuadSlot : uint8_t {
+    kSlotTex = 16, kSlotRas = 20, kSlotKonst = 24, kSlotZero = 28, kSlotHalf, kSlotOne, kQuadSlots,
+};
+
+struct alignas(64) GXQuad {
+    GXQuadLanes value[kQuadSlots];
+};
+
+// Texture inputs of a stage that samples nothing read zero
+inline uint8_t GXTevColorSlot(uint8_t input, int channel, bool textured) {
+    switch (input) {
+        case kTevCPrev: case kTevC0: case kTevC1: case kTevC2: return static_cast<uint8_t>(input / 2 * 4 + channel);
+        case kTevAPrev: case kTevA0: case kTevA1: case kTevA2: return static_cast<uint8_t>(input / 2 * 4 + 3);
+        case kTevTexC: return static_cast<uint8_t>(textured ? kSlotTex + channel : kSlotZero);
+        case kTevTexA: return textured ? kSlotTex + 3 : kSlotZero;
+        case kTevRasC: return static_cast<uint8_t>(kSlotRas + channel);
+        case kTevRasA: return kSlotRas + 3;
+        case kTevOne: return kSlotOne;
+        case kTevHalf: return kSlotHalf;
+        case kTevKonstC: return static_cast<uint8_t>(kSlotKonst + channel);
+        default: return kSlotZero;
+    }
+}
+
+inline uint8_t GXTevAlphaSlot(uint8_t input, bool textured) {
+    switch (input) {
+        case kTevAlphaPrev: case kTevAlpha0: case kTevAlpha1: case kTevAlpha2: return static_cast<uint8_t>(input * 4 + 3);
+        case kTevTexAlpha: return textured ? kSlotTex + 3 : kSlotZero;
+        case kTevRasAlpha: return kSlotRas + 3;
+        case kTevKonstA: return kSlotKonst + 3;
+        default: return kSlotZero;
+    }
+}
+
+struct GXTevStep;
+using GXTevStepFn = void (*)(GXQuad& quad, const GXTevStep& step);
+using GXQuadCompareFn = void (*)(const GXQuadLanes& value, const GXQuadLanes& reference, GXQuadLanes& pass);
+using GXQuadBlendFn = void (*)(GXQuadLanes (&src)[4], const GXQuadLanes (&dst)[4]);
+
+// The color (three channels) or alpha (one) half of a TEV stage
+struct GXTevStep {
+    GXTevStepFn run;
+    uint8_t channels;
+    int8_t konst_stage;     // Stage whose konst color to load first, or -1
+    int8_t tex_map;         // Texture map to sample into the texture slots first, or -1
+    uint8_t a[3], b[3], c[3], d[3], dest[3];
+};
+
+// GXTevCombine on every lane
+template <bool Subtract, uint8_t Bias, uint8_t Scale, bool Clamp>
+void GXTevCombineQuad(GXQuad& quad, const GXTevStep& step) {
+    constexpr int kShift = Scale == 1 ? 1 : Scale == 2 ? 2 : 0;
+    constexpr int kRound = Scale == 3 ? 0 : Subtract ? 127 : 128;
+    constexpr int kBias = Bias == 1 ? 128 : Bias == 2 ? -128 : 0;
+    const GXQuadRow low = GXQuadRow{} + (Clamp ? 0 : -1024), high = GXQuadRow{} + (Clamp ? 255 : 1023);
+    for (int ch = 0; ch < step.channels; ++ch) {
+        const GXQuadLanes &a = quad.value[step.a[ch]], &b = quad.value[step.b[ch]];
+        const GXQuadLanes &c = quad.value[step.c[ch]], &d = quad.value[step.d[ch]];
+        GXQuadLanes result;
+        for (int y = 0; y < kGXQuadSize; ++y) {
+            GXQuadRow weight = c[y] & 0xFF;
+            weight += weight >> 7;
+            GXQuadRow lerp = ((((a[y] & 0xFF) * (256 - weight) + (b[y] & 0xFF) * weight) << kShift) + kRound) >> 8;
+            GXQuadRow value = (d[y] + kBias) * (1 << kShift);
+            if constexpr (Subtract) value -= lerp;
+            else value += lerp;
+            if constexpr (Scale == 3) value >>= 1;
+            value = GXQuadSelect(value < low, low, value);
+            result[y] = GXQuadSelect(value > high, high, value);
+        }
+        std::copy(std::begin(result), std::end(result), quad.value[step.dest[ch]]);
+    }
+}
+
+template <uint8_t Func>
+void GXCompareQuad(const GXQuadLanes& value, const GXQuadLanes& reference, GXQuadLanes& pass) {
+    for (int y = 0; y < kGXQuadSize; ++y) {
+        switch (Func) {
+            case kCompareNever: pass[y] = GXQuadRow{}; break;
+            case kCompareLess: pass[y] = value[y] < reference[y]; break;
+            case kCompareEqual: pass[y] = value[y] == reference[y]; break;
+            case kCompareLEqual: pass[y] = value[y] <= reference[y]; break;
+            case kCompareGreater: pass[y] = value[y] > reference[y]; break;
+            case kCompareNEqual: pass[y] = value[y] != reference[y]; break;
+            case kCompareGEqual: pass[y] = value[y] >= reference[y]; break;
+            default: pass[y] = GXQuadRow{} - 1; break;
+        }
+    }
+}
+
+template <uint8_t Mode, bool Source>
+GXQuadRow GXBlendFactorRow(const GXQuadLanes (&src)[4], const GXQuadLanes (&dst)[4], int channel, int y) {
+    switch (Mode) {
+        case kBlendZero: return GXQuadRow{};
+        case kBlendOne: return GXQuadRow{} + 255;
+        case kBlendColor: return Source ? dst[channel][y] : src[channel][y];
+        case kBlendInvColor: return 255 - (Source ? dst[channel][y] : src[channel][y]);
+        case kBlendSrcAlpha: return src[3][y];
+        case kBlendInvSrcAlpha: return 255 - src[3][y];
+        case kBlendDstAlpha: return dst[3][y];
+        default: return 255 - dst[3][y];
+    }
+}
+
+// GXBlendPixel on every lane. With v = value + 128, the saturated
+// (value + 127) / 255 is (v + (v >> 8)) >> 8 once v is clamped below 255 * 256.
+template <uint8_t Src, uint8_t Dst>
+void GXBlendQuad(GXQuadLanes (&src)[4], const GXQuadLanes (&dst)[4]) {
+    GXQuadLanes result[4];
+    const GXQuadRow limit = GXQuadRow{} + (255 * 256 - 1);
+    for (int c = 0; c < 4; ++c) {
+        for (int y = 0; y < kGXQuadSize; ++y) {
+            GXQuadRow value = src[c][y] * GXBlendFactorRow<Src, true>(src, dst, c, y) +
+                              dst[c][y] * GXBlendFactorRow<Dst, false>(src, dst, c, y) + 128;
+            value = GXQuadSelect(value > limit, limit, value);
+            result[c][y] = (value + (value >> 8)) >> 8;
+        }
+    }
+    for (int c = 0; c < 4; ++c) std::copy(std::begin(result[c]), std::end(result[c]), src[c]);
+}
+
+template <int... I>
+constexpr std::array<GXTevStepFn, sizeof...(I)> MakeTevCombineTable(std::integer_sequence<int, I...>) {
+    return {{&GXTevCombineQuad<((I >> 5) & 1) != 0, (I >> 3) & 3, (I >> 1) & 3, (I & 1) != 0>...}};
+}
+
+template <int... I>
+constexpr std::array<GXQuadCompareFn, sizeof...(I)> MakeCompareTable(std::integer_sequence<int, I...>) {
+    return {{&GXCompareQuad<I>...}};
+}
+
+template <int... I>
+constexpr std::array<GXQuadBlendFn, sizeof...(I)> MakeBlendTable(std::integer_sequence<int, I...>) {
+    return {{&GXBlendQuad<(I >> 3) & 7, I & 7>...}};
+}
+
+inline GXTevStepFn GXSelectTevCombine(const GXTevEnv& env) {
+    static constexpr auto kTable = MakeTevCombineTable(std::make_integer_sequence<int, 64>());
+    return kTable[(env.subtract ? 32 : 0) | env.bias << 3 | env.scale << 1 | (env.clamp ? 1 : 0)];
+}
+
+inline GXQuadCompareFn GXSelectCompare(uint8_t func) {
+    static constexpr auto kTable = MakeCompareTable(std::make_integer_sequence<int, 8>());
+    return kTable[func & 7];
+}
+
+inline GXQuadBlendFn GXSelectBlend(uint8_t src, uint8_t dst) {
+    static constexpr auto kTable = MakeBlendTable(std::make_integer_sequence<int, 64>());
+    return kTable[(src & 7) << 3 | (dst & 7)];
+}
+
+// The structural state a pipeline is built from. Fields that cannot affect
+// the result (the depth function without depth test, unused stages) are
+// zeroed so equivalent states share a pipeline. Compared and hashed
+// bytewise, so keep it free of padding.
+struct GXPixelPipelineKey {
+    bool z_enable;
+    uint8_t z_func;
+    bool z_update;
+    bool color_update;
+    bool alpha_update;
+    bool blend_enable;
+    uint8_t blend_src;
+    uint8_t blend_dst;
+    GXTevState tev;
+
+    GXPixelPipelineKey() = default;
+
+    explicit GXPixelPipelineKey(const GXRasterState& state)
+        : z_enable(state.z_enable), z_func(state.z_enable ? state.z_func : 0),
+          z_update(state.z_enable && state.z_update), color_update(state.color_update),
+          alpha_update(state.alpha_update), blend_enable(state.blend_enable),
+          blend_src(state.blend_enable ? state.blend_src : 0), blend_dst(state.blend_enable ? state.blend_dst : 0),
+          tev(state.tev) {
+        for (int stage = 0; stage < kGXTevStages; ++stage) {
+            if (stage >= tev.stages) {
+                tev.color_env[stage] = tev.alpha_env[stage] = 0;
+                tev.konst_color[stage] = tev.konst_alpha[stage] = 0;
+            }
+            if (!(tev.tex_order[stage] & kGXTexOrderEnable) ||
+                !GXTevReadsTexture(tev.color_env[stage], tev.alpha_env[stage])) {
+                tev.tex_order[stage] = 0;
+            }
+        }
+    }
+
+    bool operator==(const GXPixelPipelineKey& other) const {
+        return std::memcmp(this, &other, sizeof(*this)) == 0;
+    }
+};
+static_assert(sizeof(GXPixelPipelineKey) == 8 + sizeof(GXTevState), "GXPixelPipelineKey must stay padding-free");
+
+struct GXPixelPipelineKeyHash {
+    size_t operator()(const GXPixelPipelineKey& key) const {
+        return static_cast<size_t>(XXHash64(&key, sizeof(key)));
+    }
+};
+
+class GXPixelPipeline {
+public:
+    explicit GXPixelPipeline(const GXPixelPipelineKey& key) {
+        const GXTevState& tev = key.tev;
+        for (int stage = 0; stage < tev.stages; ++stage) {
+            GXTevEnv color = GXTevEnv::Color(tev.color_env[stage]);
+            GXTevEnv alpha = GXTevEnv::Alpha(tev.alpha_env[stage]);
+            bool konst = alpha.a == kTevKonstA || alpha.b == kTevKonstA || alpha.c == kTevKonstA ||
+                         alpha.d == kTevKonstA || color.a == kTevKonstC || color.b == kTevKonstC ||
+                         color.c == kTevKonstC || color.d == kTevKonstC;
+            // The key keeps tex_order only where a stage samples and reads it
+            bool textured = tev.tex_order[stage] & kGXTexOrderEnable;
+            int8_t tex_map = static_cast<int8_t>(textured ? tev.tex_order[stage] & (kGXTexMaps - 1) : -1);
+            GXTevStep step{GXSelectTevCombine(color), 3, static_cast<int8_t>(konst ? stage : -1), tex_map,
+                           {}, {}, {}, {}, {}};
+            for (int c = 0; c < 3; ++c) {
+                step.a[c] = GXTevColorSlot(color.a, c, textured);
+                step.b[c] = GXTevColorSlot(color.b, c, textured);
+                step.c[c] = GXTevColorSlot(color.c, c, textured);
+                step.d[c] = GXTevColorSlot(color.d, c, textured);
+                step.dest[c] = static_cast<uint8_t>(color.dest * 4 + c);
+            }
+            // The alpha half runs second but must read the registers as they
+            // were before the stage; the color half never writes alpha slots
+            GXTevStep alpha_step{GXSelectTevCombine(alpha), 1, -1, -1, {GXTevAlphaSlot(alpha.a, textured)},
+                                 {GXTevAlphaSlot(alpha.b, textured)}, {GXTevAlphaSlot(alpha.c, textured)},
+                                 {GXTevAlphaSlot(alpha.d, textured)}, {static_cast<uint8_t>(alpha.dest * 4 + 3)}};
+            samples |= textured;
+            steps.push_back(step);
+            steps.push_back(alpha_step);
+            color_dest = color.dest;
+            alpha_dest = alpha.dest;
+        }
+
+        // The alpha test is dropped when no alpha value can fail it
+        auto combine = [&](bool pass0, bool pass1) {
+            switch (tev.alpha_op) {
+                case kAlphaOpAnd: return pass0 && pass1;
+                case kAlphaOpOr: return pass0 || pass1;
+                case kAlphaOpXor: return pass0 != pass1;
+                default: return pass0 == pass1;
+            }
+        };
+        auto possible = [](uint8_t func, bool pass) { return pass ? func != kCompareNever : func != kCompareAlways; };
+        for (bool pass0 : {false, true}) {
+            for (bool pass1 : {false, true}) {
+                if (!combine(pass0, pass1) && possible(tev.alpha_func0, pass0) && possible(tev.alpha_func1, pass1)) {
+                    alpha_test = true;
+                }
+            }
+        }
+        alpha_compare[0] = GXSelectCompare(tev.alpha_func0);
+        alpha_compare[1] = GXSelectCompare(tev.alpha_func1);
+        alpha_op = tev.alpha_op;
+
+        if (key.z_enable) {
+            depth_compare = GXSelectCompare(key.z_func);
+            early_depth = !alpha_test;
+            depth_write = key.z_update;
+        }
+        if (key.blend_enable) {
+            blend = GXSelectBlend(key.blend_src, key.blend_dst);
+        }
+        write_mask = (key.color_update ? 0xFFFFFF00u : 0u) | (key.alpha_update ? 0xFFu : 0u);
+    }
+
+    // Shades the pixels of the quad at EFB (x, y) set in mask (bit y * 4 + x);
+    // color and depth point at the quad's first pixel in its tile. quad is
+    // scratch space.
+    void ShadeQuad(const GXTriangle& tri, const GXTevConstants& constants, const GXTextureMaps& textures, int x,
+                   int y, uint32_t mask, uint32_t* color, uint32_t* depth, GXQuad& quad) const {
+        static const GXQuadRow kLaneX = {0, 1, 2, 3}, kLaneBit = {1, 2, 4, 8};
+        GXQuadLanes live, pixel_depth, stored_depth, pass;
+        GXQuadRowFloats fx = __builtin_convertvector(kLaneX + x, GXQuadRowFloats) + 0.5f, fy[kGXQuadSize];
+        // Same operations in the same order as GXShadePixel, so results match
+        // it bit for bit
+        auto interpolate = [&](const GXPlane& plane, int row) { return plane.a * fx + plane.b * fy[row] + plane.c; };
+        auto clamp = [](GXQuadRowFloats value, float high) {
+            value = GXQuadSelect(value < 0.0f, GXQuadRowFloats{}, value);
+            return GXQuadSelect(high < value, GXQuadRowFloats{} + high, value);
+        };
+        for (int row = 0; row < kGXQuadSize; ++row) {
+            live[row] = ((GXQuadRow{} + static_cast<int32_t>(mask >> (row * kGXQuadSize))) & kLaneBit) != 0;
+            fy[row] = GXQuadRowFloats{} + (static_cast<float>(y + row) + 0.5f);
+            GXQuadRowFloats z = clamp(interpolate(tri.z, row), 1.0f);
+            pixel_depth[row] = __builtin_convertvector(z * static_cast<float>(kGXMaxDepth), GXQuadRow);
+        }
+        if (depth_compare) {
+            GXLoadQuad(depth, stored_depth);
+            if (early_depth) {
+                depth_compare(pixel_depth, stored_depth, pass);
+                for (int row = 0; row < kGXQuadSize; ++row) live[row] &= pass[row];
+                if (!GXQuadAny(live)) return;
+            }
+        }
+
+        GXQuadRowFloats u[kGXQuadSize], v[kGXQuadSize];
+        for (int row = 0; row < kGXQuadSize; ++row) {
+            GXQuadRowFloats w = 1.0f / interpolate(tri.inv_w, row);
+            for (int c = 0; c < 4; ++c) {
+                GXQuadRowFloats value = clamp(interpolate(tri.color[c], row) * w, 255.0f) + 0.5f;
+                quad.value[kSlotRas + c][row] = __builtin_convertvector(value, GXQuadRow);
+            }
+            if (samples) {
+                u[row] = interpolate(tri.uv[0], row) * w;
+                v[row] = interpolate(tri.uv[1], row) * w;
+            }
+        }
+        auto fill = [&](int slot, int32_t value) {
+            for (GXQuadRow& row : quad.value[slot]) row = GXQuadRow{} + value;
+        };
+        for (int r = 0; r < 4; ++r) {
+            for (int c = 0; c < 4; ++c) fill(r * 4 + c, constants.regs[r][c]);
+        }
+        fill(kSlotZero, 0);
+        fill(kSlotHalf, 128);
+        fill(kSlotOne, 255);
+        for (const GXTevStep& step : steps) {
+            if (step.konst_stage >= 0) {
+                for (int c = 0; c < 4; ++c) fill(kSlotKonst + c, constants.konst[step.konst_stage][c]);
+            }
+            if (step.tex_map >= 0) {
+                // Texel fetches are gathers, so lane by lane
+                for (int row = 0; row < kGXQuadSize; ++row) {
+                    for (int lane = 0; lane < kGXQuadSize; ++lane) {
+                        uint32_t texel = GXSampleTexture(textures[step.tex_map], u[row][lane], v[row][lane]);
+                        quad.value[kSlotTex][row][lane] = static_cast<int32_t>(texel >> 24);
+                        quad.value[kSlotTex + 1][row][lane] = static_cast<int32_t>((texel >> 16) & 0xFF);
+                        quad.value[kSlotTex + 2][row][lane] = static_cast<int32_t>((texel >> 8) & 0xFF);
+                        quad.value[kSlotTex + 3][row][lane] = static_cast<int32_t>(texel & 0xFF);
+                    }
+                }
+            }
+            step.run(quad, step);
+        }
+        GXQuadLanes src[4];
+        for (int row = 0; row < kGXQuadSize; ++row) {
+            for (int c = 0; c < 3; ++c) src[c][row] = quad.value[color_dest * 4 + c][row] & 0xFF;
+            src[3][row] = quad.value[alpha_dest * 4 + 3][row] & 0xFF;
+        }
+
+        if (alpha_test) {
+            GXQuadLanes ref0, ref1, pass1;
+            std::fill(std::begin(ref0), std::end(ref0), GXQuadRow{} + constants.alpha_ref[0]);
+            std::fill(std::begin(ref1), std::end(ref1), GXQuadRow{} + constants.alpha_ref[1]);
+            alpha_compare[0](src[3], ref0, pass);
+            alpha_compare[1](src[3], ref1, pass1);
+            for (int row = 0; row < kGXQuadSize; ++row) {
+                switch (alpha_op) {
+                    case kAlphaOpAnd: live[row] &= pass[row] & pass1[row]; break;
+                    case kAlphaOpOr: live[row] &= pass[row] | pass1[row]; break;
+                    case kAlphaOpXor: live[row] &= pass[row] ^ pass1[row]; break;
+                    default: live[row] &= ~(pass[row] ^ pass1[row]); break;
+                }
+            }
+        }
+        if (depth_compare && !early_depth) {
+            depth_compare(pixel_depth, stored_depth, pass);
+            for (int row = 0; row < kGXQuadSize; ++row) live[row] &= pass[row];
+        }
+        if (!GXQuadAny(live)) return;
+
+        GXQuadLanes pixels;
+        GXLoadQuad(color, pixels);
+        if (blend) {
+            GXQuadLanes dst[4];
+            for (int row = 0; row < kGXQuadSize; ++row) {
+                GXQuadRowBits bits = reinterpret_cast<GXQuadRowBits>(pixels[row]);
+                dst[0][row] = reinterpret_cast<GXQuadRow>(bits >> 24);
+                dst[1][row] = reinterpret_cast<GXQuadRow>((bits >> 16) & 0xFF);
+                dst[2][row] = reinterpret_cast<GXQuadRow>((bits >> 8) & 0xFF);
+                dst[3][row] = reinterpret_cast<GXQuadRow>(bits & 0xFF);
+            }
+            blend(src, dst);
+        }
+        for (int row = 0; row < kGXQuadSize; ++row) {
+            GXQuadRowBits packed = reinterpret_cast<GXQuadRowBits>(src[0][row]) << 24 |
+                                   reinterpret_cast<GXQuadRowBits>(src[1][row]) << 16 |
+                                   reinterpret_cast<GXQuadRowBits>(src[2][row]) << 8 |
+                                   reinterpret_cast<GXQuadRowBits>(src[3][row]);
+            GXQuadRow write = live[row] & static_cast<int32_t>(write_mask);
+            pixels[row] = GXQuadSelect(write, reinterpret_cast<GXQuadRow>(packed), pixels[row]);
+            if (depth_write) stored_depth[row] = GXQuadSelect(live[row], pixel_depth[row], stored_depth[row]);
+        }
+        GXStoreQuad(color, pixels);
+        if (depth_write) GXStoreQuad(depth, stored_depth);
+    }
+
+private:
+    std::vector<GXTevStep> steps;
+    bool samples = false;                       // A step samples a texture
+    uint8_t color_dest = 0, alpha_dest = 0;     // Registers holding the output
+    bool alpha_test = false;
+    GXQuadCompareFn alpha_compare[2] = {};
+    uint8_t alpha_op = kAlphaOpAnd;
+    GXQuadCompareFn depth_compare = nullptr;    // Null without depth test
+    bool early_depth = false;
+    bool depth_write = false;
+    GXQuadBlendFn blend = nullptr;              // Null without blending
+    uint32_t write_mask = 0;
+};
+
+// Pipelines are built outside the lock, so a Precompile from another thread
+// never stalls the renderer for longer than a lookup
+class GXPixelPipelineCache {
+public:
+    struct Stats {
+        uint64_t lookups = 0;
+        uint64_t hits = 0;
+        uint64_t compiled = 0;      // Built on first use
+        uint64_t precompiled = 0;   // Built ahead of use
+    };
+
+    const GXPixelPipeline& Get(const GXRasterState& state) {
+        GXPixelPipelineKey key(state);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++stats.lookups;
+            auto it = pipelines.find(key);
+            if (it != pipelines.end()) {
+                ++stats.hits;
+                return *it->second;
+            }
+        }
+        return Insert(key, false);
+    }
+
+    // Safe to call from any thread
+    void Precompile(const GXPixelPipelineKey& key) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pipelines.count(key)) return;
+        }
+        Insert(key, true);
+    }
+
+    std::vector<GXPixelPipelineKey> GetKeys() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<GXPixelPipelineKey> keys;
+        for (const auto& entry : pipelines) keys.push_back(entry.first);
+        return keys;
+    }
+
+    Stats GetStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<GXPixelPipelineKey, std::unique_ptr<GXPixelPipeline>, GXPixelPipelineKeyHash> pipelines;
+    Stats stats;
+
+    const GXPixelPipeline& Insert(const GXPixelPipelineKey& key, bool ahead) {
+        auto built = std::make_unique<GXPixelPipeline>(key);
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<GXPixelPipeline>& pipeline = pipelines[key];
+        if (!pipeline) {
+            pipeline = std::move(built);
+            ++(ahead ? stats.precompiled : stats.compiled);
+        }
+        return *pipeline;
+    }
+};
+
+// External Framebuffer (XFB)
+// Titles present by copying the EFB into an XFB in guest RAM, YUYV 4:2:2
+// (Y0 U Y1 V per pixel pair), which VI scans out. A display copy runs each
+// row through the vertical copy filter, the rows above, at and below the
+// output row weighted by the seven COPYFILTER coefficients (2, 3 and 2 of
+// them, 6-bit fractions of 64) and clamped to 255, then through the gamma
+// table, then into BT.601 YCbCr with U and V from the pair's rounded
+// average. Scanout converts back to RGBA8888. Both directions have a scalar
+// reference and SSSE3/AVX2 kernels that agree with it bit for bit; gamma
+// other than 1.0 is a table lookup, gathered under AVX2 and per byte in the
+// SSSE3 kernel.
+struct GXCopyFilter {
+    uint16_t weights[3] = {0, 64, 0};   // Rows above, at and below; each at most 189
+    uint8_t gamma = 0;                  // 0: 1.0, 1: 1.7, 2: 2.2
+    bool clamp_top = true;              // The first row of the rectangle stands in for the one above it
+    bool clamp_bottom = true;           // Likewise the last row for the one below
+};
+
+// 255 * (i / 255)^(1 / gamma), as 32-bit entries for the AVX2 gathers
+inline const int32_t* GXGammaTable(uint8_t gamma) {
+    static const auto tables = [] {
+        static const double kGammas[3] = {1.0, 1.7, 2.2};
+        std::array<std::array<int32_t, 256>, 3> result{};
+        for (int g = 0; g < 3; ++g) {
+            for (int i = 0; i < 256; ++i) {
+                result[g][i] = static_cast<int32_t>(std::lround(255.0 * std::pow(i / 255.0, 1.0 / kGammas[g])));
+            }
+        }
+        return result;
+    }();
+    return tables[std::min<uint8_t>(gamma, 2)].data();
+}
+
+// Filtered, gamma-corrected R, G and B of one pixel (0xRRGGBBAA)
+inline void XFBFilterPixel(uint32_t above, uint32_t at, uint32_t below, const GXCopyFilter& filter,
+                           const int32_t* gamma, int (&rgb)[3]) {
+    for (int c = 0; c < 3; ++c) {
+        int shift = 24 - 8 * c;
+        uint32_t sum = filter.weights[0] * ((above >> shift) & 0xFF) + filter.weights[1] * ((at >> shift) & 0xFF) +
+                       filter.weights[2] * ((below >> shift) & 0xFF);
+        rgb[c] = gamma[std::min<uint32_t>(sum >> 6, 255)];
+    }
+}
+
+inline uint8_t XFBLuma(const int (&rgb)[3]) {
+    return static_cast<uint8_t>(((66 * rgb[0] + 129 * rgb[1] + 25 * rgb[2] + 128) >> 8) + 16);
+}
+
+inline uint32_t XFBPixel(int y, int u, int v) {
+    int c = 298 * (y - 16) + 128, d = u - 128, e = v - 128;
+    auto channel = [](int value) { return static_cast<uint32_t>(std::clamp(value >> 8, 0, 255)); };
+    return channel(c + 409 * e) << 24 | channel(c - 100 * d - 208 * e) << 16 | channel(c + 516 * d) << 8 | 0xFF;
+}
+
+// Encodes `pairs` pixel pairs of one output row from its three source rows
+using XFBEncodeKernel = void (*)(const uint32_t* above, const uint32_t* at, const uint32_t* below, int pairs,
+                                 const GXCopyFilter& filter, uint8_t* dst);
+// Decodes pairs YUYV pixel pairs into RGBA8888
+using XFBDecodeKernel = void (*)(const uint8_t* src, int pairs, uint32_t* dst);
+
+inline void EncodeXFBScalar(const uint32_t* above, const uint32_t* at, const uint32_t* below, int pairs,
+                            const GXCopyFilter& filter, uint8_t* dst) {
+    const int32_t* gamma = GXGammaTable(filter.gamma);
+    for (int i = 0; i < pairs; ++i) {
+        int p0[3], p1[3], mean[3];
+        XFBFilterPixel(above[2 * i], at[2 * i], below[2 * i], filter, gamma, p0);
+        XFBFilterPixel(above[2 * i + 1], at[2 * i + 1], below[2 * i + 1], filter, gamma, p1);
+        for (int c = 0; c < 3; ++c) mean[c] = (p0[c] + p1[c] + 1) >> 1;
+        dst[4 * i] = XFBLuma(p0);
+        dst[4 * i + 1] = static_cast<uint8_t>(((-38 * mean[0] - 74 * mean[1] + 112 * mean[2] + 128) >> 8) + 128);
+        dst[4 * i + 2] = XFBLuma(p1);
+        dst[4 * i + 3] = static_cast<uint8_t>(((112 * mean[0] - 94 * mean[1] - 18 * mean[2] + 128) >> 8) + 128);
+    }
+}
+
+inline void DecodeXFBScalar(const uint8_t* src, int pairs, uint32_t* dst) {
+    for (int i = 0; i < pairs; ++i, src += 4) {
+        dst[2 * i] = XFBPixel(src[0], src[1], src[3]);
+        dst[2 * i + 1] = XFBPixel(src[2], src[1], src[3]);
+    }
+}
+
+#ifdef EMUWII_X86_SIMD
+// pmaddwd coefficients: lo multiplies the low 16-bit half of each lane, hi the high
+constexpr int32_t XFBMadd(int lo, int hi) {
+    return static_cast<int32_t>(static_cast<uint32_t>(hi) << 16 | (static_cast<uint32_t>(lo) & 0xFFFF));
+}
+
+// Pixels in memory order (A, B, G, R) to (B, G) and (R, 1) 16-bit pairs per
+// 32-bit lane, so one pmaddwd each weighs all three channels plus a constant
+__attribute__((target("ssse3")))
+inline __m128i XFBBlueGreen(__m128i pixels) {
+    return _mm_shuffle_epi8(pixels, _mm_setr_epi8(1, -1, 2, -1, 5, -1, 6, -1, 9, -1, 10, -1, 13, -1, 14, -1));
+}
+
+__attribute__((target("ssse3")))
+inline __m128i XFBRedOne(__m128i pixels) {
+    __m128i red = _mm_shuffle_epi8(pixels, _mm_setr_epi8(3, -1, -1, -1, 7, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1));
+    return _mm_or_si128(red, _mm_set1_epi32(1 << 16));
+}
+
+// (c0 * B + c1 * G + c2 * R + bias) >> 8 per pixel
+__attribute__((target("ssse3")))
+inline __m128i XFBWeigh(__m128i blue_green, __m128i red_one, int c0, int c1, int c2, int bias) {
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(blue_green, _mm_set1_epi32(XFBMadd(c0, c1))),
+                                _mm_madd_epi16(red_one, _mm_set1_epi32(XFBMadd(c2, bias))));
+    return _mm_srai_epi32(sum, 8);
+}
+
+// The copy filter on four pixels of 16-bit channels
+__attribute__((target("ssse3")))
+inline __m128i XFBFilterHalf(__m128i above, __m128i at, __m128i below, __m128i wa, __m128i wc, __m128i wb) {
+    __m128i sum = _mm_adds_epu16(_mm_mullo_epi16(above, wa), _mm_mullo_epi16(at, wc));
+    return _mm_srli_epi16(_mm_adds_epu16(sum, _mm_mullo_epi16(below, wb)), 6);
+}
+
+__attribute__((target("ssse3")))
+void EncodeXFBSSSE3(const uint32_t* above, const uint32_t* at, const uint32_t* below, int pairs,
+                    const GXCopyFilter& filter, uint8_t* dst) {
+    const __m128i wa = _mm_set1_epi16(static_cast<short>(filter.weights[0]));
+    const __m128i wc = _mm_set1_epi16(static_cast<short>(filter.weights[1]));
+    const __m128i wb = _mm_set1_epi16(static_cast<short>(filter.weights[2]));
+    const __m128i zero = _mm_setzero_si128();
+    const int32_t* gamma = GXGammaTable(filter.gamma);
+    int i = 0;
+    for (; i + 2 <= pairs; i += 2) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + 2 * i));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(at + 2 * i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + 2 * i));
+        __m128i lo = XFBFilterHalf(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(b, zero),
+                                   wa, wc, wb);
+        __m128i hi = XFBFilterHalf(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(b, zero),
+                                   wa, wc, wb);
+        __m128i pixels = _mm_packus_epi16(lo, hi);
+        if (filter.gamma) {
+            alignas(16) uint8_t bytes[16];
+            _mm_store_si128(reinterpret_cast<__m128i*>(bytes), pixels);
+            for (int k = 0; k < 16; ++k) {
+                if (k & 3) bytes[k] = static_cast<uint8_t>(gamma[bytes[k]]);
+            }
+            pixels = _mm_load_si128(reinterpret_cast<const __m128i*>(bytes));
+        }
+        // Lanes 0 and 2 end up holding each pair: Y0 | U << 8 | Y1 << 16 | V << 24
+        __m128i mean = _mm_avg_epu8(pixels, _mm_srli_epi64(pixels, 32));
+        __m128i bg = XFBBlueGreen(pixels), r1 = XFBRedOne(pixels);
+        __m128i mean_bg = XFBBlueGreen(mean), mean_r1 = XFBRedOne(mean);
+        __m128i y = _mm_add_epi32(XFBWeigh(bg, r1, 25, 129, 66, 128), _mm_set1_epi32(16));
+        __m128i u = _mm_add_epi32(XFBWeigh(mean_bg, mean_r1, 112, -74, -38, 128), _mm_set1_epi32(128));
+        __m128i v = _mm_add_epi32(XFBWeigh(mean_bg, mean_r1, -18, -94, 112, 128), _mm_set1_epi32(128));
+        __m128i yuyv = _mm_or_si128(_mm_or_si128(y, _mm_slli_epi32(u, 8)),
+                                    _mm_or_si128(_mm_slli_epi32(_mm_srli_epi64(y, 32), 16), _mm_slli_epi32(v, 24)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 4 * i), _mm_shuffle_epi32(yuyv, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    EncodeXFBScalar(above + 2 * i, at + 2 * i, below + 2 * i, pairs - i, filter, dst + 4 * i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i XFBBlueGreen(__m256i pixels) {
+    return _mm256_shuffle_epi8(pixels, _mm256_setr_epi8(1, -1, 2, -1, 5, -1, 6, -1, 9, -1, 10, -1, 13, -1, 14, -1,
+                                                        1, -1, 2, -1, 5, -1, 6, -1, 9, -1, 10, -1, 13, -1, 14, -1));
+}
+
+__attribute__((target("avx2")))
+inline __m256i XFBRedOne(__m256i pixels) {
+    const __m256i red_order = _mm256_setr_epi8(3, -1, -1, -1, 7, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1,
+                                               3, -1, -1, -1, 7, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1);
+    __m256i red = _mm256_shuffle_epi8(pixels, red_order);
+    return _mm256_or_si256(red, _mm256_set1_epi32(1 << 16));
+}
+
+__attribute__((target("avx2")))
+inline __m256i XFBWeigh(__m256i blue_green, __m256i red_one, int c0, int c1, int c2, int bias) {
+    __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(blue_green, _mm256_set1_epi32(XFBMadd(c0, c1))),
+                                   _mm256_madd_epi16(red_one, _mm256_set1_epi32(XFBMadd(c2, bias))));
+    return _mm256_srai_epi32(sum, 8);
+}
+
+__attribute__((target("avx2")))
+inline __m256i XFBFilterHalf(__m256i above, __m256i at, __m256i below, __m256i wa, __m256i wc, __m256i wb) {
+    __m256i sum = _mm256_adds_epu16(_mm256_mullo_epi16(above, wa), _mm256_mullo_epi16(at, wc));
+    return _mm256_srli_epi16(_mm256_adds_epu16(sum, _mm256_mullo_epi16(below, wb)), 6);
+}
+
+__attribute__((target("avx2")))
+void EncodeXFBAVX2(const uint32_t* above, const uint32_t* at, const uint32_t* below, int pairs,
+                   const GXCopyFilter& filter, uint8_t* dst) {
+    const __m256i wa = _mm256_set1_epi16(static_cast<short>(filter.weights[0]));
+    const __m256i wc = _mm256_set1_epi16(static_cast<short>(filter.weights[1]));
+    const __m256i wb = _mm256_set1_epi16(static_cast<short>(filter.weights[2]));
+    const __m256i zero = _mm256_setzero_si256(), low_byte = _mm256_set1_epi32(0xFF);
+    const int32_t* gamma = GXGammaTable(filter.gamma);
+    int i = 0;
+    for (; i + 4 <= pairs; i += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(above + 2 * i));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at + 2 * i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + 2 * i));
+        __m256i lo = XFBFilterHalf(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(c, zero),
+                                   _mm256_unpacklo_epi8(b, zero), wa, wc, wb);
+        __m256i hi = XFBFilterHalf(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(c, zero),
+                                   _mm256_unpackhi_epi8(b, zero), wa, wc, wb);
+        __m256i pixels = _mm256_packus_epi16(lo, hi);
+        if (filter.gamma) {
+            __m256i corrected = _mm256_and_si256(pixels, low_byte);
+            corrected = _mm256_or_si256(corrected, _mm256_slli_epi32(_mm256_i32gather_epi32(
+                gamma, _mm256_and_si256(_mm256_srli_epi32(pixels, 8), low_byte), 4), 8));
+            corrected = _mm256_or_si256(corrected, _mm256_slli_epi32(_mm256_i32gather_epi32(
+                gamma, _mm256_and_si256(_mm256_srli_epi32(pixels, 16), low_byte), 4), 16));
+            corrected = _mm256_or_si256(corrected, _mm256_slli_epi32(_mm256_i32gather_epi32(
+                gamma, _mm256_srli_epi32(pixels, 24), 4), 24));
+            pixels = corrected;
+        }
+        __m256i mean = _mm256_avg_epu8(pixels, _mm256_srli_epi64(pixels, 32));
+        __m256i bg = XFBBlueGreen(pixels), r1 = XFBRedOne(pixels);
+        __m256i mean_bg = XFBBlueGreen(mean), mean_r1 = XFBRedOne(mean);
+        __m256i y = _mm256_add_epi32(XFBWeigh(bg, r1, 25, 129, 66, 128), _mm256_set1_epi32(16));
+        __m256i u = _mm256_add_epi32(XFBWeigh(mean_bg, mean_r1, 112, -74, -38, 128), _mm256_set1_epi32(128));
+        __m256i v = _mm256_add_epi32(XFBWeigh(mean_bg, mean_r1, -18, -94, 112, 128), _mm256_set1_epi32(128));
+        __m256i yuyv = _mm256_or_si256(_mm256_or_si256(y, _mm256_slli_epi32(u, 8)),
+                                       _mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi64(y, 32), 16),
+                                                       _mm256_slli_epi32(v, 24)));
+        yuyv = _mm256_permutevar8x32_epi32(yuyv, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i), _mm256_castsi256_si128(yuyv));
+    }
+    EncodeXFBScalar(above + 2 * i, at + 2 * i, below + 2 * i, pairs - i, filter, dst + 4 * i);
+}
+
+// Scanout: 16-bit (Y, V), (Y, U) and (V, 0) pairs per pixel from a YUYV run,
+// then R, G and B as one or two pmaddwd plus a constant that folds in the
+// -16/-128 offsets and the rounding term
+constexpr int kXFBRedBias = -298 * 16 - 409 * 128 + 128;
+constexpr int kXFBGreenBias = -298 * 16 + 100 * 128 + 208 * 128 + 128;
+constexpr int kXFBBlueBias = -298 * 16 - 516 * 128 + 128;
+
+// R, G and B lanes of four pixels to their RGBA8888 memory order (A, B, G, R)
+__attribute__((target("ssse3")))
+inline __m128i XFBPackPixels(__m128i r, __m128i g, __m128i b) {
+    __m128i planes = _mm_packus_epi16(_mm_packs_epi32(r, g), _mm_packs_epi32(b, _mm_set1_epi32(0xFF)));
+    return _mm_shuffle_epi8(planes, _mm_setr_epi8(12, 8, 4, 0, 13, 9, 5, 1, 14, 10, 6, 2, 15, 11, 7, 3));
+}
+
+__attribute__((target("ssse3")))
+void DecodeXFBSSSE3(const uint8_t* src, int pairs, uint32_t* dst) {
+    const __m128i yv_order = _mm_setr_epi8(0, -1, 3, -1, 2, -1, 3, -1, 4, -1, 7, -1, 6, -1, 7, -1);
+    const __m128i yu_order = _mm_setr_epi8(0, -1, 1, -1, 2, -1, 1, -1, 4, -1, 5, -1, 6, -1, 5, -1);
+    const __m128i v_order = _mm_setr_epi8(3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1);
+    int i = 0;
+    for (; i + 2 <= pairs; i += 2) {
+        __m128i yuyv = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + 4 * i));
+        __m128i yv = _mm_shuffle_epi8(yuyv, yv_order), yu = _mm_shuffle_epi8(yuyv, yu_order);
+        __m128i r = _mm_add_epi32(_mm_madd_epi16(yv, _mm_set1_epi32(XFBMadd(298, 409))), _mm_set1_epi32(kXFBRedBias));
+        __m128i g = _mm_add_epi32(_mm_madd_epi16(yu, _mm_set1_epi32(XFBMadd(298, -100))),
+                                  _mm_madd_epi16(_mm_shuffle_epi8(yuyv, v_order), _mm_set1_epi32(XFBMadd(-208, 0))));
+        g = _mm_add_epi32(g, _mm_set1_epi32(kXFBGreenBias));
+        __m128i b = _mm_add_epi32(_mm_madd_epi16(yu, _mm_set1_epi32(XFBMadd(298, 516))), _mm_set1_epi32(kXFBBlueBias));
+        __m128i pixels = XFBPackPixels(_mm_srai_epi32(r, 8), _mm_srai_epi32(g, 8), _mm_srai_epi32(b, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), pixels);
+    }
+    DecodeXFBScalar(src + 4 * i, pairs - i, dst + 2 * i);
+}
+
+// Eight pixels per step: the 16 source bytes are broadcast and each 128-bit
+// lane shuffles its own half
+__attribute__((target("avx2")))
+void DecodeXFBAVX2(const uint8_t* src, int pairs, uint32_t* dst) {
+    const __m256i yv_order = _mm256_setr_epi8(0, -1, 3, -1, 2, -1, 3, -1, 4, -1, 7, -1, 6, -1, 7, -1,
+                                              8, -1, 11, -1, 10, -1, 11, -1, 12, -1, 15, -1, 14, -1, 15, -1);
+    const __m256i yu_order = _mm256_setr_epi8(0, -1, 1, -1, 2, -1, 1, -1, 4, -1, 5, -1, 6, -1, 5, -1,
+                                              8, -1, 9, -1, 10, -1, 9, -1, 12, -1, 13, -1, 14, -1, 13, -1);
+    const __m256i v_order = _mm256_setr_epi8(3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1,
+                                             11, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1, 15, -1, -1, -1);
+    const __m256i pixel_order = _mm256_setr_epi8(12, 8, 4, 0, 13, 9, 5, 1, 14, 10, 6, 2, 15, 11, 7, 3,
+                                                 12, 8, 4, 0, 13, 9, 5, 1, 14, 10, 6, 2, 15, 11, 7, 3);
+    int i = 0;
+    for (; i + 4 <= pairs; i += 4) {
+        __m256i yuyv = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i)));
+        __m256i yv = _mm256_shuffle_epi8(yuyv, yv_order), yu = _mm256_shuffle_epi8(yuyv, yu_order);
+        __m256i r = _mm256_add_epi32(_mm256_madd_epi16(yv, _mm256_set1_epi32(XFBMadd(298, 409))),
+                                     _mm256_set1_epi32(kXFBRedBias));
+        __m256i g = _mm256_add_epi32(_mm256_madd_epi16(yu, _mm256_set1_epi32(XFBMadd(298, -100))),
+                                     _mm256_madd_epi16(_mm256_shuffle_epi8(yuyv, v_order),
+                                                       _mm256_set1_epi32(XFBMadd(-208, 0))));
+        g = _mm256_add_epi32(g, _mm256_set1_epi32(kXFBGreenBias));
+        __m256i b = _mm256_add_epi32(_mm256_madd_epi16(yu, _mm256_set1_epi32(XFBMadd(298, 516))),
+                                     _mm256_set1_epi32(kXFBBlueBias));
+        r = _mm256_srai_epi32(r, 8);
+        g = _mm256_srai_epi32(g, 8);
+        b = _mm256_srai_epi32(b, 8);
+        __m256i planes = _mm256_packus_epi16(_mm256_packs_epi32(r, g), _mm256_packs_epi32(b, _mm256_set1_epi32(0xFF)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i), _mm256_shuffle_epi8(planes, pixel_order));
+    }
+    DecodeXFBScalar(src + 4 * i, pairs - i, dst + 2 * i);
+}
+#endif
+
+inline XFBEncodeKernel XFBEncodeKernelFor(SimdLevel level) {
+#ifdef EMUWII_X86_SIMD
+    if (level == SimdLevel::kAVX2) return EncodeXFBAVX2;
+    if (level == SimdLevel::kSSSE3) return EncodeXFBSSSE3;
+#endif
+    (void)level;
+    return EncodeXFBScalar;
+}
+
+inline XFBDecodeKernel XFBDecodeKernelFor(SimdLevel level) {
+#ifdef EMUWII_X86_SIMD
+    if (level == SimdLevel::kAVX2) return DecodeXFBAVX2;
+    if (level == SimdLevel::kSSSE3) return DecodeXFBSSSE3;
+#endif
+    (void)level;
+    return DecodeXFBScalar;
+}
+
+// The XFB VI points at, or nullptr when VI has no XFB in RAM
+inline const uint8_t* FindXFB(const Memory& memory, const VideoInterface& vi, int& xfb_width, int& xfb_height,
+                              size_t& stride) {
+    xfb_width = vi.GetXFBWidth();
+    xfb_height = vi.GetXFBHeight();
+    stride = vi.GetXFBStride();
+    if (xfb_width == 0 || xfb_height == 0 || stride < static_cast<size_t>(xfb_width) * 2) {
+        return nullptr;
+    }
+    return memory.GetContiguousRange(vi.GetXFBAddress(),
+                                     static_cast<uint32_t>(stride * (xfb_height - 1) + xfb_width * 2));
+}
+
+// Decodes YUYV rows stride bytes apart into width x height RGBA8888 rows
+// pitch bytes apart; whatever the source does not cover is black
+inline void ScanoutYUYV(const uint8_t* src, size_t stride, int src_width, int src_height, uint8_t* dst,
+                        size_t pitch, int width, int height, XFBDecodeKernel decode) {
+    int columns = std::min(width, src_width) & ~1;
+    for (int y = 0; y < height; ++y) {
+        uint32_t* row = reinterpret_cast<uint32_t*>(dst + y * pitch);
+        int filled = 0;
+        if (y < src_height) {
+            decode(src + y * stride, columns / 2, row);
+            filled = columns;
+        }
+        std::fill(row + filled, row + width, 0x000000FFu);
+    }
+}
+
+// A frame on its way to the display: the part of the XFB a width x height
+// screen shows, still YUYV (half the size of the RGBA8888 it becomes), or
+// an RGBA8888 EFB resolve before the guest has set up an XFB
+struct ScanoutFrame {
+    bool yuyv = false;
+    int width = 0;      // Rows are width * 2 (YUYV) or width * 4 bytes, packed
+    int height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Copies the rows of the XFB VI points at that a width x height screen
+// shows into frame. Returns false, leaving frame untouched, when VI has no
+// XFB in RAM.
+inline bool CaptureXFB(const Memory& memory, const VideoInterface& vi, int width, int height, ScanoutFrame& frame) {
+    int xfb_width = 0, xfb_height = 0;
+    size_t stride = 0;
+    const uint8_t* xfb = FindXFB(memory, vi, xfb_width, xfb_height, stride);
+    if (!xfb) {
+        return false;
+    }
+    frame.yuyv = true;
+    frame.width = std::min(width, xfb_width) & ~1;
+    frame.height = std::min(height, xfb_height);
+    size_t row_bytes = static_cast<size_t>(frame.width) * 2;
+    frame.pixels.resize(row_bytes * frame.height);
+    for (int y = 0; y < frame.height; ++y) {
+        std::memcpy(frame.pixels.data() + y * row_bytes, xfb + y * stride, row_bytes);
+    }
+    return true;
+}
+
+// XXH64 of the XFB VI points at, row by row so the stride padding is left
+// out. Returns false when VI has no XFB in RAM.
+inline bool HashXFB(const Memory& memory, const VideoInterface& vi, uint64_t& hash) {
+    int xfb_width = 0, xfb_height = 0;
+    size_t stride = 0;
+    const uint8_t* xfb = FindXFB(memory, vi, xfb_width, xfb_height, stride);
+    if (!xfb) {
+        return false;
+    }
+    hash = 0;
+    for (int y = 0; y < xfb_height; ++y) {
+        hash = XXHash64(xfb + y * stride, static_cast<size_t>(xfb_width) * 2, hash);
+    }
+    return true;
+}
+
+class SWRenderer {
+public:
+    static constexpr int kTileBlocks = kGXTileSize / kGXBlockSize;
+
+    struct alignas(64) EFBTile {
+        uint32_t color[kGXTileSize * kGXTileSize];     // 0xRRGGBBAA, as SDL_PIXELFORMAT_RGBA8888
+        uint32_t depth[kGXTileSize * kGXTileSize];     // 24-bit
+        uint32_t depth_min[kTileBlocks * kTileBlocks]; // Hi-Z bounds per 8x8 block
+        uint32_t depth_max[kTileBlocks * kTileBlocks];
+        uint32_t stale_bounds;                          // Bit per block written since its bounds
+    };
+
+    // Hi-Z: blocks checked against the bounds, and of those the ones whose
+    // depth test could not pass anywhere
+    struct DepthStats {
+        uint64_t tested = 0;
+        uint64_t rejected = 0;
+    };
+
+    explicit SWRenderer(size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+        : pool(threads), tiles(kGXTilesX * kGXTilesY), bins(kGXTilesX * kGXTilesY),
+          tile_pixels(kGXTilesX * kGXTilesY), tile_depth(kGXTilesX * kGXTilesY),
+          coverage(CoverageKernelFor(HostSimdLevel())), xfb_encode(XFBEncodeKernelFor(HostSimdLevel())) {
+        states.push_back(GXRasterState{});
+        pipelines.push_back(&pipeline_cache.Get(states.back()));
+        textures.emplace_back();
+        Clear(0x000000FF, kGXMaxDepth);
+    }
+
+    // Applies to triangles submitted after this call
+    void SetState(const GXRasterState& state) {
+        if (!(states.back() == state)) {
+            states.push_back(state);
+            pipelines.push_back(&pipeline_cache.Get(state));
+            textures.push_back(textures.back());
+        }
+    }
+
+    // The texture maps triangles submitted after this call sample; they are
+    // held until those triangles have been rasterized
+    void SetTextures(const GXTextureMaps& maps) {
+        if (!(textures.back() == maps)) {
+            states.push_back(states.back());
+            pipelines.push_back(pipelines.back());
+            textures.push_back(maps);
+        }
+    }
+
+    const GXRasterState& GetState() const { return states.back(); }
+
+    void DrawTriangle(const GXVertex& v0, const GXVertex& v1, const GXVertex& v2) {
+        const GXVertex* v[3] = {&v0, &v1, &v2};
+        const GXRasterState& state = states.back();
+        int64_t fx[3], fy[3];
+        float px[3], py[3];
+        for (int i = 0; i < 3; ++i) {
+            fx[i] = SnapCoordinate(v[i]->x);
+            fy[i] = SnapCoordinate(v[i]->y);
+            px[i] = static_cast<float>(fx[i]) / kGXSubpixelOne;
+            py[i] = static_cast<float>(fy[i]) / kGXSubpixelOne;
+        }
+        int64_t area = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fx[2] - fx[0]) * (fy[1] - fy[0]);
+        if (area == 0) {
+            return;
+        }
+
+        GXTriangle tri;
+        int order[3] = {0, 1, 2};
+        if (area < 0) {
+            std::swap(order[1], order[2]);
+        }
+        for (int e = 0; e < 3; ++e) {
+            int a = order[e], b = order[(e + 1) % 3];
+            int64_t edge_a = -(fy[b] - fy[a]);
+            int64_t edge_b = fx[b] - fx[a];
+            bool top_left = edge_a > 0 || (edge_a == 0 && edge_b > 0);
+            tri.edge_a[e] = edge_a;
+            tri.edge_b[e] = edge_b;
+            tri.edge_c[e] = -(edge_a * fx[a] + edge_b * fy[a]) - (top_left ? 0 : 1);
+        }
+
+        int64_t min_fx = std::min({fx[0], fx[1], fx[2]}), max_fx = std::max({fx[0], fx[1], fx[2]});
+        int64_t min_fy = std::min({fy[0], fy[1], fy[2]}), max_fy = std::max({fy[0], fy[1], fy[2]});
+        tri.min_x = std::max<int>(state.scissor_x0, static_cast<int>(min_fx >> kGXSubpixelBits));
+        tri.min_y = std::max<int>(state.scissor_y0, static_cast<int>(min_fy >> kGXSubpixelBits));
+        tri.max_x = std::min<int>({state.scissor_x1, kEFBWidth - 1, static_cast<int>(max_fx >> kGXSubpixelBits)});
+        tri.max_y = std::min<int>({state.scissor_y1, kEFBHeight - 1, static_cast<int>(max_fy >> kGXSubpixelBits)});
+        if (tri.min_x > tri.max_x || tri.min_y > tri.max_y) {
+            return;
+        }
+
+        float inv_w[3];
+        for (int i = 0; i < 3; ++i) {
+            inv_w[i] = v[i]->w != 0.0f ? 1.0f / v[i]->w : 1.0f;
+        }
+        tri.z = GXPlane::Fit(px, py, v0.z, v1.z, v2.z);
+        tri.inv_w = GXPlane::Fit(px, py, inv_w[0], inv_w[1], inv_w[2]);
+        for (int c = 0; c < 4; ++c) {
+            tri.color[c] = GXPlane::Fit(px, py, v0.color[c] * inv_w[0], v1.color[c] * inv_w[1],
+                                        v2.color[c] * inv_w[2]);
+        }
+        for (int t = 0; t < 2; ++t) {
+            tri.uv[t] = GXPlane::Fit(px, py, v0.uv[t] * inv_w[0], v1.uv[t] * inv_w[1], v2.uv[t] * inv_w[2]);
+        }
+        tri.state = static_cast<uint32_t>(states.size() - 1);
+
+        uint32_t index = static_cast<uint32_t>(triangles.size());
+        triangles.push_back(tri);
+        bool single_tile = tri.min_x / kGXTileSize == tri.max_x / kGXTileSize &&
+                           tri.min_y / kGXTileSize == tri.max_y / kGXTileSize;
+        for (int ty = tri.min_y / kGXTileSize; ty <= tri.max_y / kGXTileSize; ++ty) {
+            for (int tx = tri.min_x / kGXTileSize; tx <= tri.max_x / kGXTileSize; ++tx) {
+                if (single_tile || !OutsideEdge(tri, tx * kGXTileSize, ty * kGXTileSize, kGXTileSize)) {
+                    bins[ty * kGXTilesX + tx].push_back(index);
+                }
+            }
+        }
+    }
+
+    // Rasterizes everything binned so far
+    void Flush() {
+        if (triangles.empty()) {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        pool.ParallelFor(tiles.size(), [this](size_t tile) {
+            tile_pixels[tile] = RasterizeTile(tile, tile_depth[tile]);
+        });
+        flush_nanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        triangle_count += triangles.size();
+        for (uint64_t& pixels : tile_pixels) {
+            pixel_count += pixels;
+            pixels = 0;
+        }
+        for (DepthStats& depth : tile_depth) {
+            frame_depth.tested += depth.tested;
+            frame_depth.rejected += depth.rejected;
+            depth = DepthStats{};
+        }
+        triangles.clear();
+        for (std::vector<uint32_t>& bin : bins) {
+            bin.clear();
+        }
+        GXRasterState current = states.back();
+        states.assign(1, current);
+        pipelines.assign(1, pipelines.back());
+        GXTextureMaps maps = textures.back();
+        textures.assign(1, maps);
+    }
+
+    void Clear(uint32_t color, uint32_t depth) {
+        Flush();
+        pool.ParallelFor(tiles.size(), [&](size_t tile) {
+            std::fill(std::begin(tiles[tile].color), std::end(tiles[tile].color), color);
+            std::fill(std::begin(tiles[tile].depth), std::end(tiles[tile].depth), depth);
+            std::fill(std::begin(tiles[tile].depth_min), std::end(tiles[tile].depth_min), depth);
+            std::fill(std::begin(tiles[tile].depth_max), std::end(tiles[tile].depth_max), depth);
+            tiles[tile].stale_bounds = 0;
+        });
+    }
+
+    // Copies the top-left width x height of the EFB into a linear RGBA8888
+    // image with rows stride pixels apart (width if zero)
+    void ResolveToFramebuffer(uint32_t* dst, int width, int height, size_t stride = 0) {
+        Flush();
+        stride = stride ? stride : static_cast<size_t>(width);
+        width = std::min(width, kEFBWidth);
+        height = std::min(height, kEFBHeight);
+        int tile_rows = (height + kGXTileSize - 1) / kGXTileSize;
+        pool.ParallelFor(tile_rows, [&](size_t ty) {
+            for (int tx = 0; tx * kGXTileSize < width; ++tx) {
+                const EFBTile& tile = tiles[ty * kGXTilesX + tx];
+                int columns = std::min(kGXTileSize, width - tx * kGXTileSize);
+                for (int y = 0; y < kGXTileSize; ++y) {
+                    int row = static_cast<int>(ty) * kGXTileSize + y;
+                    if (row >= height) break;
+                    std::memcpy(dst + row * stride + tx * kGXTileSize, tile.color + y * kGXTileSize,
+                                columns * sizeof(uint32_t));
+                }
+            }
+        });
+    }
+
+    // Display copy of the width x height EFB rectangle at (x, y) into YUYV
+    // rows stride bytes apart; an odd last column is dropped. Rows are
+    // encoded in parallel bands, each band keeping the three source rows the
+    // filter reads in a small ring indexed by EFB row modulo 3.
+    void CopyToXFB(int x, int y, int width, int height, const GXCopyFilter& filter, uint8_t* dst, size_t stride) {
+        Flush();
+        x = std::clamp(x, 0, kEFBWidth);
+        y = std::clamp(y, 0, kEFBHeight);
+        width = std::min(width, kEFBWidth - x) & ~1;
+        height = std::min(height, kEFBHeight - y);
+        if (width <= 0 || height <= 0) {
+            return;
+        }
+        constexpr int kBandRows = 16;
+        pool.ParallelFor((height + kBandRows - 1) / kBandRows, [&](size_t band) {
+            alignas(64) uint32_t rows[3][kEFBWidth];
+            int held[3] = {-1, -1, -1};
+            auto fetch = [&](int row) {
+                uint32_t* buffer = rows[row % 3];
+                if (held[row % 3] != row) {
+                    ReadRow(row, x, width, buffer);
+                    held[row % 3] = row;
+                }
+                return buffer;
+            };
+            int first = static_cast<int>(band) * kBandRows, last = std::min(first + kBandRows, height);
+            for (int r = first; r < last; ++r) {
+                int row = y + r;
+                int above = r == 0 && filter.clamp_top ? row : std::max(row - 1, 0);
+                int below = r == height - 1 && filter.clamp_bottom ? row : std::min(row + 1, kEFBHeight - 1);
+                const uint32_t* at = fetch(row);
+                const uint32_t* previous = fetch(above);
+                xfb_encode(previous, at, fetch(below), width / 2, filter, dst + r * stride);
+            }
+        });
+    }
+
+    // Texture copy source: the width x height EFB rectangle at (x, y), which
+    // must lie inside the EFB, as linear rows; with half set, each 2x2 box
+    // averaged (rounded) into a width/2 x height/2 image
+    void CopyRect(int x, int y, int width, int height, bool half, uint32_t* dst) {
+        Flush();
+        if (!half) {
+            for (int r = 0; r < height; ++r) {
+                ReadRow(y + r, x, width, dst + static_cast<size_t>(r) * width);
+            }
+            return;
+        }
+        alignas(64) uint32_t rows[2][kEFBWidth];
+        int out_width = width / 2;
+        for (int r = 0; r < height / 2; ++r) {
+            ReadRow(y + r * 2, x, out_width * 2, rows[0]);
+            ReadRow(y + r * 2 + 1, x, out_width * 2, rows[1]);
+            for (int c = 0; c < out_width; ++c) {
+                uint32_t box[4] = {rows[0][c * 2], rows[0][c * 2 + 1], rows[1][c * 2], rows[1][c * 2 + 1]};
+                uint32_t value = 0;
+                for (int shift = 0; shift < 32; shift += 8) {
+                    uint32_t sum = 2;
+                    for (uint32_t pixel : box) sum += (pixel >> shift) & 0xFF;
+                    value |= (sum >> 2) << shift;
+                }
+                dst[static_cast<size_t>(r) * out_width + c] = value;
+            }
+        }
+    }
+
+    // Color, depth and Hi-Z bounds of the whole EFB, for savestates
+    void SaveEFB(std::vector<EFBTile>& efb) {
+        Flush();
+        efb = tiles;
+    }
+    void LoadEFB(const std::vector<EFBTile>& efb) {
+        Flush();
+        tiles = efb;
+    }
+
+    uint32_t PeekColor(int x, int y) const { return *ColorAt(x, y); }
+    uint32_t PeekDepth(int x, int y) const { return *DepthAt(x, y); }
+    void PokeColor(int x, int y, uint32_t value) { *const_cast<uint32_t*>(ColorAt(x, y)) = value; }
+    void PokeDepth(int x, int y, uint32_t value) {
+        *const_cast<uint32_t*>(DepthAt(x, y)) = value;
+        tiles[(y / kGXTileSize) * kGXTilesX + x / kGXTileSize].stale_bounds |=
+            1u << ((y % kGXTileSize) / kGXBlockSize * kTileBlocks + (x % kGXTileSize) / kGXBlockSize);
+    }
+
+    // Selects the coverage and XFB kernels; kScalar is the reference path
+    void SetSimdLevel(SimdLevel level) {
+        coverage = CoverageKernelFor(level);
+        xfb_encode = XFBEncodeKernelFor(level);
+    }
+
+    // Shade with the cached pixel pipelines (the default) or the per-pixel
+    // TEV interpreter they are validated against
+    void SetSpecializedPipelines(bool enabled) { specialized = enabled; }
+
+    // Hi-Z block rejection, on by default; off is the reference
+    void SetHierarchicalZ(bool enabled) { hierarchical_z = enabled; }
+
+    // Closes the per-frame counters; GetFrameDepthStats reports the frame just ended
+    void EndFrame() {
+        Flush();
+        last_frame_depth = frame_depth;
+        total_depth.tested += frame_depth.tested;
+        total_depth.rejected += frame_depth.rejected;
+        frame_depth = DepthStats{};
+    }
+
+    const DepthStats& GetFrameDepthStats() const { return last_frame_depth; }
+    const DepthStats& GetTotalDepthStats() const { return total_depth; }
+
+    GXPixelPipelineCache::Stats GetPipelineStats() const { return pipeline_cache.GetStats(); }
+    GXPixelPipelineCache& GetPipelineCache() { return pipeline_cache; }
+
+    uint64_t GetTriangleCount() const { return triangle_count; }
+    uint64_t GetPixelCount() const { return pixel_count; }     // Covered pixels, before depth test
+    uint64_t GetFlushNanoseconds() const { return flush_nanoseconds; }
+    size_t GetThreadCount() const { return pool.GetThreadCount(); }
+
+private:
+    WorkStealingPool pool;
+    std::vector<EFBTile> tiles;
+    std::vector<std::vector<uint32_t>> bins;    // Triangle indices per tile
+    std::vector<GXTriangle> triangles;
+    std::vector<GXRasterState> states;          // Triangles refer to these by index
+    std::vector<const GXPixelPipeline*> pipelines;  // The pipeline of each state
+    std::vector<GXTextureMaps> textures;        // The texture maps of each state
+    GXPixelPipelineCache pipeline_cache;
+    bool specialized = true;
+    std::vector<uint64_t> tile_pixels;          // Covered pixels per tile in the current flush
+    std::vector<DepthStats> tile_depth;         // Hi-Z counts per tile in the current flush
+    bool hierarchical_z = true;
+    DepthStats frame_depth, last_frame_depth, total_depth;
+    CoverageKernel coverage;
+    XFBEncodeKernel xfb_encode;
+    uint64_t triangle_count = 0;
+    uint64_t pixel_count = 0;
+    uint64_t flush_nanoseconds = 0;
+
+    static int64_t SnapCoordinate(float value) {
+        value = std::min(std::max(value, -kGXGuardBand), kEFBWidth + kGXGuardBand);
+        return static_cast<int64_t>(std::lround(value * kGXSubpixelOne));
+    }
+
+    const uint32_t* ColorAt(int x, int y) const {
+        const EFBTile& tile = tiles[(y / kGXTileSize) * kGXTilesX + x / kGXTileSize];
+        return &tile.color[(y % kGXTileSize) * kGXTileSize + x % kGXTileSize];
+    }
+
+    const uint32_t* DepthAt(int x, int y) const {
+        const EFBTile& tile = tiles[(y / kGXTileSize) * kGXTilesX + x / kGXTileSize];
+        return &tile.depth[(y % kGXTileSize) * kGXTileSize + x % kGXTileSize];
+    }
+
+    // Copies width pixels of an EFB row from column x, one run per tile
+    void ReadRow(int row, int x, int width, uint32_t* dst) const {
+        const EFBTile* tile_row = &tiles[(row / kGXTileSize) * kGXTilesX];
+        int y = row % kGXTileSize;
+        for (int column = x; column < x + width;) {
+            int run = std::min(kGXTileSize - column % kGXTileSize, x + width - column);
+            const uint32_t* src = tile_row[column / kGXTileSize].color + y * kGXTileSize + column % kGXTileSize;
+            std::memcpy(dst + (column - x), src, run * sizeof(uint32_t));
+            column += run;
+        }
+    }
+
+    // True if a size x size pixel square lies entirely outside one edge,
+    // judged at the pixel center where each edge function is largest
+    static bool OutsideEdge(const GXTriangle& tri, int x, int y, int size) {
+        int64_t center_x = static_cast<int64_t>(x) * kGXSubpixelOne + kGXSubpixelOne / 2;
+        int64_t center_y = static_cast<int64_t>(y) * kGXSubpixelOne + kGXSubpixelOne / 2;
+        int64_t span = static_cast<int64_t>(size - 1) * kGXSubpixelOne;
+        for (int i = 0; i < 3; ++i) {
+            int64_t best = tri.edge_a[i] * center_x + tri.edge_b[i] * center_y + tri.edge_c[i] +
+                           std::max<int64_t>(tri.edge_a[i], 0) * span + std::max<int64_t>(tri.edge_b[i], 0) * span;
+            if (best < 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Pixels of the block at (block_x, block_y) inside [x0, x1] x [y0, y1]
+    static uint64_t ClipMask(int block_x, int block_y, int x0, int x1, int y0, int y1) {
+        int first_x = std::max(x0 - block_x, 0), last_x = std::min(x1 - block_x, kGXBlockSize - 1);
+        int first_y = std::max(y0 - block_y, 0), last_y = std::min(y1 - block_y, kGXBlockSize - 1);
+        uint64_t row = ((1ull << (last_x - first_x + 1)) - 1) << first_x;
+        uint64_t mask = 0;
+        for (int y = first_y; y <= last_y; ++y) {
+            mask |= row << (y * kGXBlockSize);
+        }
+        return mask;
+    }
+
+    // Recomputes the Hi-Z bounds of a block from its depth values
+    static void UpdateDepthBounds(EFBTile& tile, int block) {
+        const uint32_t* depth = tile.depth + (block / kTileBlocks) * kGXBlockSize * kGXTileSize +
+                                (block % kTileBlocks) * kGXBlockSize;
+        GXQuadRow low = GXQuadRow{} + static_cast<int32_t>(kGXMaxDepth), high = GXQuadRow{};
+        for (int y = 0; y < kGXBlockSize; ++y) {
+            for (int x = 0; x < kGXBlockSize; x += kGXQuadSize) {
+                GXQuadRow values;
+                std::memcpy(&values, depth + y * kGXTileSize + x, sizeof(values));
+                low = values < low ? values : low;
+                high = values > high ? values : high;
+            }
+        }
+        tile.depth_min[block] = static_cast<uint32_t>(std::min({low[0], low[1], low[2], low[3]}));
+        tile.depth_max[block] = static_cast<uint32_t>(std::max({high[0], high[1], high[2], high[3]}));
+    }
+
+    // The 24-bit depths the triangle can produce at pixel centers inside
+    // [x0, x1] x [y0, y1]: the plane's extremes at the corners, widened past
+    // the rounding of its per-pixel float evaluation and quantization. False
+    // if the plane is not finite there.
+    static bool DepthRange(const GXPlane& z, int x0, int y0, int x1, int y1, uint32_t& low, uint32_t& high) {
+        double ax0 = static_cast<double>(z.a) * (x0 + 0.5), ax1 = static_cast<double>(z.a) * (x1 + 0.5);
+        double by0 = static_cast<double>(z.b) * (y0 + 0.5), by1 = static_cast<double>(z.b) * (y1 + 0.5);
+        double slack = 1e-6 * (std::max(std::abs(ax0), std::abs(ax1)) + std::max(std::abs(by0), std::abs(by1)) +
+                               std::abs(static_cast<double>(z.c)));
+        double min_z = z.c + std::min(ax0, ax1) + std::min(by0, by1) - slack;
+        double max_z = z.c + std::max(ax0, ax1) + std::max(by0, by1) + slack;
+        if (!std::isfinite(min_z) || !std::isfinite(max_z)) {
+            return false;
+        }
+        min_z = std::min(std::max(min_z, 0.0), 1.0) * kGXMaxDepth;
+        max_z = std::min(std::max(max_z, 0.0), 1.0) * kGXMaxDepth;
+        low = static_cast<uint32_t>(std::max(std::floor(min_z) - 2.0, 0.0));
+        high = static_cast<uint32_t>(std::min(std::ceil(max_z) + 2.0, static_cast<double>(kGXMaxDepth)));
+        return true;
+    }
+
+    // True when no depth in [low, high] passes func against any stored depth
+    // in [block_min, block_max]
+    static bool DepthRejects(uint8_t func, uint32_t low, uint32_t high, uint32_t block_min, uint32_t block_max) {
+        switch (func) {
+            case kCompareNever: return true;
+            case kCompareLess: return low >= block_max;
+            case kCompareEqual: return low > block_max || high < block_min;
+            case kCompareLEqual: return low > block_max;
+            case kCompareGreater: return high <= block_min;
+            case kCompareGEqual: return high < block_min;
+            default: return false;      // NEqual and Always
+        }
+    }
+
+    // Returns the number of covered pixels
+    uint64_t RasterizeTile(size_t tile_index, DepthStats& depth_stats) {
+        constexpr int64_t kBlockSpan = (kGXBlockSize - 1) * kGXSubpixelOne;
+        constexpr int64_t kEdgeLimit = int64_t(1) << 30;
+        EFBTile& tile = tiles[tile_index];
+        int tile_x = static_cast<int>(tile_index % kGXTilesX) * kGXTileSize;
+        int tile_y = static_cast<int>(tile_index / kGXTilesX) * kGXTileSize;
+        uint64_t covered = 0;
+        GXQuad quad;
+        for (uint32_t index : bins[tile_index]) {
+            const GXTriangle& tri = triangles[index];
+            const GXRasterState& state = states[tri.state];
+            const GXPixelPipeline& pipeline = *pipelines[tri.state];
+            const GXTextureMaps& maps = textures[tri.state];
+            const bool hiz = hierarchical_z && state.z_enable && state.z_func != kCompareNEqual &&
+                             state.z_func != kCompareAlways;
+            const bool writes_depth = state.z_enable && state.z_update;
+            int x0 = std::max(tri.min_x, tile_x), x1 = std::min(tri.max_x, tile_x + kGXTileSize - 1);
+            int y0 = std::max(tri.min_y, tile_y), y1 = std::min(tri.max_y, tile_y + kGXTileSize - 1);
+            int32_t step_x[3], step_y[3];
+            for (int i = 0; i < 3; ++i) {
+                step_x[i] = static_cast<int32_t>(tri.edge_a[i] * kGXSubpixelOne);
+                step_y[i] = static_cast<int32_t>(tri.edge_b[i] * kGXSubpixelOne);
+            }
+
+            for (int block_y = y0 & ~(kGXBlockSize - 1); block_y <= y1; block_y += kGXBlockSize) {
+                for (int block_x = x0 & ~(kGXBlockSize - 1); block_x <= x1; block_x += kGXBlockSize) {
+                    int64_t center_x = static_cast<int64_t>(block_x) * kGXSubpixelOne + kGXSubpixelOne / 2;
+                    int64_t center_y = static_cast<int64_t>(block_y) * kGXSubpixelOne + kGXSubpixelOne / 2;
+                    int32_t edge[3];
+                    bool outside = false, inside = true;
+                    for (int i = 0; i < 3 && !outside; ++i) {
+                        int64_t value = tri.edge_a[i] * center_x + tri.edge_b[i] * center_y + tri.edge_c[i];
+                        int64_t high = value + std::max<int64_t>(tri.edge_a[i], 0) * kBlockSpan +
+                                       std::max<int64_t>(tri.edge_b[i], 0) * kBlockSpan;
+                        int64_t low = value + std::min<int64_t>(tri.edge_a[i], 0) * kBlockSpan +
+                                      std::min<int64_t>(tri.edge_b[i], 0) * kBlockSpan;
+                        outside = high < 0;
+                        inside = inside && low >= 0;
+                        // Far from the edge the sign is uniform over the block, so clamping
+                        // keeps every in-block value inside int32
+                        edge[i] = static_cast<int32_t>(std::min(std::max(value, -kEdgeLimit), kEdgeLimit));
+                    }
+                    if (outside) {
+                        continue;
+                    }
+                    uint64_t mask = ClipMask(block_x, block_y, x0, x1, y0, y1);
+                    if (!inside) {
+                        mask &= coverage(edge, step_x, step_y);
+                    }
+                    covered += static_cast<uint64_t>(__builtin_popcountll(mask));
+                    int block = (block_y - tile_y) / kGXBlockSize * kTileBlocks + (block_x - tile_x) / kGXBlockSize;
+                    if (hiz && mask) {
+                        if (tile.stale_bounds & (1u << block)) {
+                            UpdateDepthBounds(tile, block);
+                            tile.stale_bounds &= ~(1u << block);
+                        }
+                        ++depth_stats.tested;
+                        int first_x = std::max(x0, block_x), last_x = std::min(x1, block_x + kGXBlockSize - 1);
+                        int first_y = std::max(y0, block_y), last_y = std::min(y1, block_y + kGXBlockSize - 1);
+                        uint32_t low, high;
+                        if (DepthRange(tri.z, first_x, first_y, last_x, last_y, low, high) &&
+                            DepthRejects(state.z_func, low, high, tile.depth_min[block], tile.depth_max[block])) {
+                            ++depth_stats.rejected;
+                            continue;
+                        }
+                    }
+                    if (writes_depth && mask) tile.stale_bounds |= 1u << block;
+                    if (specialized) {
+                        for (int quad_y = 0; quad_y < kGXBlockSize; quad_y += kGXQuadSize) {
+                            for (int quad_x = 0; quad_x < kGXBlockSize; quad_x += kGXQuadSize) {
+                                uint32_t quad_mask = 0;
+                                for (int row = 0; row < kGXQuadSize; ++row) {
+                                    quad_mask |= static_cast<uint32_t>(
+                                        (mask >> ((quad_y + row) * kGXBlockSize + quad_x)) & 0xF) << (row * 4);
+                                }
+                                if (quad_mask == 0) continue;
+                                int x = block_x + quad_x, y = block_y + quad_y;
+                                int offset = (y - tile_y) * kGXTileSize + (x - tile_x);
+                                pipeline.ShadeQuad(tri, state.tev_constants, maps, x, y, quad_mask,
+                                                   &tile.color[offset], &tile.depth[offset], quad);
+                            }
+                        }
+                        continue;
+                    }
+                    while (mask) {
+                        int bit = __builtin_ctzll(mask);
+                        mask &= mask - 1;
+                        int x = block_x + (bit & (kGXBlockSize - 1)), y = block_y + bit / kGXBlockSize;
+                        int offset = (y - tile_y) * kGXTileSize + (x - tile_x);
+                        GXShadePixel(tri, state, maps, x, y, tile.color[offset], tile.depth[offset]);
+                    }
+                }
+            }
+        }
+        return covered;
+    }
+};
+
+// Texture Decoding
+// GX textures are stored in tiled blocks of 32 bytes (64 for RGBA8, whose
+// block splits into an AR half and a GB half). Decoders turn them into
+// linear RGBA8888 (0xRRGGBBAA, the framebuffer_texture format). Each format
+// has a scalar reference kernel and SIMD kernels chosen at runtime; a kernel
+// decodes a run of horizontally adjacent blocks so the AVX2 kernels for 4x4
+// formats can fill whole 8-pixel rows from two blocks at once.
+enum GXTextureFormat : uint8_t {
+    kTexI4 = 0x0,
+    kTexI8 = 0x1,
+    kTexIA4 = 0x2,
+    kTexIA8 = 0x3,
+    kTexRGB565 = 0x4,
+    kTexRGB5A3 = 0x5,
+    kTexRGBA8 = 0x6,
+    kTexC4 = 0x8,
+    kTexC8 = 0x9,
+    kTexC14X2 = 0xA,
+    kTexCMPR = 0xE,
+};
+
+enum GXTlutFormat : uint8_t { kTlutIA8 = 0, kTlutRGB565 = 1, kTlutRGB5A3 = 2 };
+
+struct TextureFormatInfo {
+    const char* name;
+    uint8_t block_width;
+    uint8_t block_height;
+    uint8_t block_bytes;
+    uint16_t palette_entries;   // Zero for direct-color formats
+};
+
+inline const TextureFormatInfo* GetTextureFormatInfo(uint8_t format) {
+    static const TextureFormatInfo kI4{"I4", 8, 8, 32, 0}, kI8{"I8", 8, 4, 32, 0}, kIA4{"IA4", 8, 4, 32, 0},
+        kIA8{"IA8", 4, 4, 32, 0}, kRGB565{"RGB565", 4, 4, 32, 0}, kRGB5A3{"RGB5A3", 4, 4, 32, 0},
+        kRGBA8{"RGBA8", 4, 4, 64, 0}, kC4{"C4", 8, 8, 32, 16}, kC8{"C8", 8, 4, 32, 256},
+        kC14X2{"C14X2", 4, 4, 32, 16384}, kCMPR{"CMPR", 8, 8, 32, 0};
+    switch (format) {
+        case kTexI4: return &kI4;
+        case kTexI8: return &kI8;
+        case kTexIA4: return &kIA4;
+        case kTexIA8: return &kIA8;
+        case kTexRGB565: return &kRGB565;
+        case kTexRGB5A3: return &kRGB5A3;
+        case kTexRGBA8: return &kRGBA8;
+        case kTexC4: return &kC4;
+        case kTexC8: return &kC8;
+        case kTexC14X2: return &kC14X2;
+        case kTexCMPR: return &kCMPR;
+        default: return nullptr;
+    }
+}
+
+// Bytes a width x height texture occupies in guest memory (whole blocks)
+inline size_t TextureEncodedSize(uint8_t format, int width, int height) {
+    const TextureFormatInfo* info = GetTextureFormatInfo(format);
+    if (!info) {
+        return 0;
+    }
+    size_t blocks_x = (width + info->block_width - 1) / info->block_width;
+    size_t blocks_y = (height + info->block_height - 1) / info->block_height;
+    return blocks_x * blocks_y * info->block_bytes;
+}
+
+inline uint32_t MakeRGBA(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    return r << 24 | g << 16 | b << 8 | a;
+}
+
+inline uint32_t Expand5(uint32_t v) { return (v << 3) | (v >> 2); }
+inline uint32_t Expand6(uint32_t v) { return (v << 2) | (v >> 4); }
+inline uint32_t Expand4(uint32_t v) { return (v << 4) | v; }
+inline uint32_t Expand3(uint32_t v) { return (v << 5) | (v << 2) | (v >> 1); }
+
+inline uint32_t DecodeRGB565(uint16_t v) {
+    return MakeRGBA(Expand5(v >> 11), Expand6((v >> 5) & 0x3F), Expand5(v & 0x1F), 0xFF);
+}
+
+inline uint32_t DecodeRGB5A3(uint16_t v) {
+    if (v & 0x8000) {
+        return MakeRGBA(Expand5((v >> 10) & 0x1F), Expand5((v >> 5) & 0x1F), Expand5(v & 0x1F), 0xFF);
+    }
+    return MakeRGBA(Expand4((v >> 8) & 0xF), Expand4((v >> 4) & 0xF), Expand4(v & 0xF), Expand3((v >> 12) & 0x7));
+}
+
+inline uint32_t DecodeIA8(uint16_t v) {
+    uint32_t i = v & 0xFF;
+    return MakeRGBA(i, i, i, v >> 8);
+}
+
+// Palette decoded once per texture. planes[c][i] is byte c (in memory order)
+// of colors[i], for the 16-entry pshufb lookups of C4.
+struct TextureDecodeContext {
+    const uint32_t* palette = nullptr;
+    alignas(16) uint8_t planes[4][16] = {};
+};
+
+// Decodes count horizontally adjacent blocks; block k goes to
+// dst + k * block_width, rows stride pixels apart
+using TextureDecodeKernel = void (*)(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                                     const TextureDecodeContext& context);
+
+// CMPR sub-block palette: GX blends 5/8 + 3/8 rather than DXT1's thirds
+inline void DecodeCMPRPalette(const uint8_t* src, uint32_t (&colors)[4]) {
+    uint16_t c0 = LoadBigEndian<uint16_t>(src), c1 = LoadBigEndian<uint16_t>(src + 2);
+    uint32_t r0 = Expand5(c0 >> 11), g0 = Expand6((c0 >> 5) & 0x3F), b0 = Expand5(c0 & 0x1F);
+    uint32_t r1 = Expand5(c1 >> 11), g1 = Expand6((c1 >> 5) & 0x3F), b1 = Expand5(c1 & 0x1F);
+    colors[0] = MakeRGBA(r0, g0, b0, 0xFF);
+    colors[1] = MakeRGBA(r1, g1, b1, 0xFF);
+    if (c0 > c1) {
+        colors[2] = MakeRGBA((r0 * 5 + r1 * 3) >> 3, (g0 * 5 + g1 * 3) >> 3, (b0 * 5 + b1 * 3) >> 3, 0xFF);
+        colors[3] = MakeRGBA((r0 * 3 + r1 * 5) >> 3, (g0 * 3 + g1 * 5) >> 3, (b0 * 3 + b1 * 5) >> 3, 0xFF);
+    } else {
+        colors[2] = MakeRGBA((r0 + r1) >> 1, (g0 + g1) >> 1, (b0 + b1) >> 1, 0xFF);
+        colors[3] = MakeRGBA((r0 + r1) >> 1, (g0 + g1) >> 1, (b0 + b1) >> 1, 0x00);
+    }
+}
+
+// Scalar reference kernels: texel(x, y, block) gives one pixel of one block
+template <int BlockWidth, int BlockHeight, int BlockBytes, typename Texel>
+inline void DecodeBlocksScalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count, Texel texel) {
+    for (size_t block = 0; block < count; ++block) {
+        const uint8_t* data = src + block * BlockBytes;
+        uint32_t* out = dst + block * BlockWidth;
+        for (int y = 0; y < BlockHeight; ++y) {
+            for (int x = 0; x < BlockWidth; ++x) {
+                out[y * stride + x] = texel(data, x, y);
+            }
+        }
+    }
+}
+
+inline void DecodeI4Scalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                           const TextureDecodeContext&) {
+    DecodeBlocksScalar<8, 8, 32>(dst, stride, src, count, [](const uint8_t* data, int x, int y) {
+        uint8_t byte = data[y * 4 + x / 2];
+        return Expand4((x & 1) ? byte & 0xF : byte >> 4) * 0x01010101u;
+    });
+}
+
+inline void DecodeI8Scalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                           const TextureDecodeContext&) {
+    DecodeBlocksScalar<8, 4, 32>(dst, stride, src, count, [](const uint8_t* data, int x, int y) {
+        return data[y * 8 + x] * 0x01010101u;
+    });
+}
+
+inline void DecodeIA4Scalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                            const TextureDecodeContext&) {
+    DecodeBlocksScalar<8, 4, 32>(dst, stride, src, count, [](const uint8_t* data, int x, int y) {
+        uint8_t byte = data[y * 8 + x];
+        uint32_t i = Expand4(byte & 0xF);
+        return MakeRGBA(i, i, i, Expand4(byte >> 4));
+    });
+}
+
+inline void DecodeIA8Scalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                            const TextureDecodeContext&) {
+    DecodeBlocksScalar<4, 4, 32>(dst, stride, src, count, [](const uint8_t* data, int x, int y) {
+        return DecodeIA8(LoadBigEndian<uint16_t>(data + (y * 4 + x) * 2));
+    });
+}
+
+inline void DecodeRGB565Scalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                               const TextureDecodeContext&) {
+    DecodeBlocksScalar<4, 4, 32>(dst, stride, src, count, [](const uint8_t* data, int x, int y) {
+        return DecodeRGB565(LoadBigEndian<uint16_t>(data + (y * 4 + x) * 2));
+    });
+}
+
+inline void DecodeRGB5A3Scalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                               const TextureDecodeContext&) {
+    DecodeBlocksScalar<4, 4, 32>(dst, stride, src, count, [](const uint8_t* data, int x, int y) {
+        return DecodeRGB5A3(LoadBigEndian<uint16_t>(data + (y * 4 + x) * 2));
+    });
+}
+
+inline void DecodeRGBA8Scalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                              const TextureDecodeContext&) {
+    DecodeBlocksScalar<4, 4, 64>(dst, stride, src, count, [](const uint8_t* data, int x, int y) {
+        int p = (y * 4 + x) * 2;
+        return MakeRGBA(data[p + 1], data[32 + p], data[32 + p + 1], data[p]);
+    });
+}
+
+inline void DecodeC4Scalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                           const TextureDecodeContext& context) {
+    const uint32_t* palette = context.palette;
+    DecodeBlocksScalar<8, 8, 32>(dst, stride, src, count, [palette](const uint8_t* data, int x, int y) {
+        uint8_t byte = data[y * 4 + x / 2];
+        return palette[(x & 1) ? byte & 0xF : byte >> 4];
+    });
+}
+
+inline void DecodeC8Scalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                           const TextureDecodeContext& context) {
+    const uint32_t* palette = context.palette;
+    DecodeBlocksScalar<8, 4, 32>(dst, stride, src, count, [palette](const uint8_t* data, int x, int y) {
+        return palette[data[y * 8 + x]];
+    });
+}
+
+inline void DecodeC14X2Scalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                              const TextureDecodeContext& context) {
+    const uint32_t* palette = context.palette;
+    DecodeBlocksScalar<4, 4, 32>(dst, stride, src, count, [palette](const uint8_t* data, int x, int y) {
+        return palette[LoadBigEndian<uint16_t>(data + (y * 4 + x) * 2) & 0x3FFF];
+    });
+}
+
+inline void DecodeCMPRScalar(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                             const TextureDecodeContext&) {
+    for (size_t block = 0; block < count; ++block) {
+        for (int sub = 0; sub < 4; ++sub) {
+            const uint8_t* data = src + block * 32 + sub * 8;
+            uint32_t colors[4];
+            DecodeCMPRPalette(data, colors);
+            uint32_t* out = dst + block * 8 + (sub >> 1) * 4 * stride + (sub & 1) * 4;
+            for (int y = 0; y < 4; ++y) {
+                for (int x = 0; x < 4; ++x) {
+                    out[y * stride + x] = colors[(data[4 + y] >> (6 - 2 * x)) & 3];
+                }
+            }
+        }
+    }
+}
+
+#ifdef EMUWII_X86_SIMD
+// The SIMD kernels build pixels in memory byte order (A, B, G, R on x86)
+
+// Replicates byte n of each 4-byte group: masks for pixels 0-3, 4-7, 8-11, 12-15
+__attribute__((target("ssse3")))
+inline __m128i ReplicateMask(int first) {
+    return _mm_setr_epi8(first, first, first, first, first + 1, first + 1, first + 1, first + 1,
+                         first + 2, first + 2, first + 2, first + 2, first + 3, first + 3, first + 3, first + 3);
+}
+
+// Stores 16 intensity bytes as two 8-pixel rows
+__attribute__((target("ssse3")))
+inline void StoreIntensityRows(uint32_t* row0, uint32_t* row1, __m128i values) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row0), _mm_shuffle_epi8(values, ReplicateMask(0)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row0 + 4), _mm_shuffle_epi8(values, ReplicateMask(4)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row1), _mm_shuffle_epi8(values, ReplicateMask(8)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row1 + 4), _mm_shuffle_epi8(values, ReplicateMask(12)));
+}
+
+// Splits 16 bytes into 32 nibbles in pixel order (high nibble first)
+__attribute__((target("ssse3")))
+inline void SplitNibbles(__m128i bytes, __m128i& first, __m128i& second) {
+    const __m128i low4 = _mm_set1_epi8(0x0F);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), low4);
+    __m128i low = _mm_and_si128(bytes, low4);
+    first = _mm_unpacklo_epi8(high, low);
+    second = _mm_unpackhi_epi8(high, low);
+}
+
+// n -> n * 17 for bytes holding 0-15
+__attribute__((target("ssse3")))
+inline __m128i ExpandNibbles(__m128i v) {
+    return _mm_or_si128(v, _mm_slli_epi16(v, 4));
+}
+
+// Interleaves byte planes (A, B, G, R) into 16 pixels written as four rows of
+// four, rows stride apart
+__attribute__((target("ssse3")))
+inline void StorePlanes4x4(uint32_t* dst, size_t stride, __m128i a, __m128i b, __m128i g, __m128i r) {
+    __m128i ab_lo = _mm_unpacklo_epi8(a, b), gr_lo = _mm_unpacklo_epi8(g, r);
+    __m128i ab_hi = _mm_unpackhi_epi8(a, b), gr_hi = _mm_unpackhi_epi8(g, r);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(ab_lo, gr_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + stride), _mm_unpackhi_epi16(ab_lo, gr_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * stride), _mm_unpacklo_epi16(ab_hi, gr_hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * stride), _mm_unpackhi_epi16(ab_hi, gr_hi));
+}
+
+// Same for an 8x2 run: pixels 0-7 to row0, 8-15 to row1
+__attribute__((target("ssse3")))
+inline void StorePlanes8x2(uint32_t* row0, uint32_t* row1, __m128i a, __m128i b, __m128i g, __m128i r) {
+    __m128i ab_lo = _mm_unpacklo_epi8(a, b), gr_lo = _mm_unpacklo_epi8(g, r);
+    __m128i ab_hi = _mm_unpackhi_epi8(a, b), gr_hi = _mm_unpackhi_epi8(g, r);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row0), _mm_unpacklo_epi16(ab_lo, gr_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row0 + 4), _mm_unpackhi_epi16(ab_lo, gr_lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row1), _mm_unpacklo_epi16(ab_hi, gr_hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row1 + 4), _mm_unpackhi_epi16(ab_hi, gr_hi));
+}
+
+// 16-bit lane operations for SSSE3 (__m128i) and AVX2 (__m256i)
+struct SSE16Ops {
+    using V = __m128i;
+    __attribute__((target("ssse3"))) static V Set(short v) { return _mm_set1_epi16(v); }
+    __attribute__((target("ssse3"))) static V And(V a, V b) { return _mm_and_si128(a, b); }
+    __attribute__((target("ssse3"))) static V Or(V a, V b) { return _mm_or_si128(a, b); }
+    __attribute__((target("ssse3"))) static V AndNot(V a, V b) { return _mm_andnot_si128(a, b); }
+    template <int N> __attribute__((target("ssse3"))) static V Shl(V a) { return _mm_slli_epi16(a, N); }
+    template <int N> __attribute__((target("ssse3"))) static V Shr(V a) { return _mm_srli_epi16(a, N); }
+    template <int N> __attribute__((target("ssse3"))) static V Sar(V a) { return _mm_srai_epi16(a, N); }
+    __attribute__((target("ssse3"))) static V Swap16(V a) {
+        return _mm_shuffle_epi8(a, _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+    }
+    // Pixels from 16-bit (A | B << 8) and (G | R << 8) lanes
+    __attribute__((target("ssse3"))) static V PixelsLo(V ab, V gr) { return _mm_unpacklo_epi16(ab, gr); }
+    __attribute__((target("ssse3"))) static V PixelsHi(V ab, V gr) { return _mm_unpackhi_epi16(ab, gr); }
+};
+
+struct AVX16Ops {
+    using V = __m256i;
+    __attribute__((target("avx2"))) static V Set(short v) { return _mm256_set1_epi16(v); }
+    __attribute__((target("avx2"))) static V And(V a, V b) { return _mm256_and_si256(a, b); }
+    __attribute__((target("avx2"))) static V Or(V a, V b) { return _mm256_or_si256(a, b); }
+    __attribute__((target("avx2"))) static V AndNot(V a, V b) { return _mm256_andnot_si256(a, b); }
+    template <int N> __attribute__((target("avx2"))) static V Shl(V a) { return _mm256_slli_epi16(a, N); }
+    template <int N> __attribute__((target("avx2"))) static V Shr(V a) { return _mm256_srli_epi16(a, N); }
+    template <int N> __attribute__((target("avx2"))) static V Sar(V a) { return _mm256_srai_epi16(a, N); }
+    __attribute__((target("avx2"))) static V Swap16(V a) {
+        return _mm256_shuffle_epi8(a, _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                                       1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+    }
+    __attribute__((target("avx2"))) static V PixelsLo(V ab, V gr) { return _mm256_unpacklo_epi16(ab, gr); }
+    __attribute__((target("avx2"))) static V PixelsHi(V ab, V gr) { return _mm256_unpackhi_epi16(ab, gr); }
+};
+
+// Channel math for 16-bit formats, stamped out once per instruction set so
+// each copy is compiled for its own target: byte-swapped RGB565 / RGB5A3
+// lanes -> (A | B << 8, G | R << 8)
+#define EMUWII_DEFINE_16BIT_LANES(Ops, isa)                                                           \
+    __attribute__((target(isa))) inline Ops::V Expand5Lanes(Ops::V v) {                               \
+        return Ops::Or(Ops::Shl<3>(v), Ops::Shr<2>(v));                                               \
+    }                                                                                                 \
+    __attribute__((target(isa))) inline Ops::V SelectLanes(Ops::V mask, Ops::V a, Ops::V b) {         \
+        return Ops::Or(Ops::And(mask, a), Ops::AndNot(mask, b));                                      \
+    }                                                                                                 \
+    __attribute__((target(isa))) inline void RGB565Lanes(Ops::V v, Ops::V& ab, Ops::V& gr) {          \
+        Ops::V r = Expand5Lanes(Ops::Shr<11>(v));                                                     \
+        Ops::V g6 = Ops::And(Ops::Shr<5>(v), Ops::Set(0x3F));                                         \
+        Ops::V g = Ops::Or(Ops::Shl<2>(g6), Ops::Shr<4>(g6));                                         \
+        Ops::V b = Expand5Lanes(Ops::And(v, Ops::Set(0x1F)));                                         \
+        ab = Ops::Or(Ops::Set(0xFF), Ops::Shl<8>(b));                                                 \
+        gr = Ops::Or(g, Ops::Shl<8>(r));                                                              \
+    }                                                                                                 \
+    __attribute__((target(isa))) inline void RGB5A3Lanes(Ops::V v, Ops::V& ab, Ops::V& gr) {          \
+        Ops::V opaque = Ops::Sar<15>(v);                                                              \
+        Ops::V r5 = Expand5Lanes(Ops::And(Ops::Shr<10>(v), Ops::Set(0x1F)));                          \
+        Ops::V g5 = Expand5Lanes(Ops::And(Ops::Shr<5>(v), Ops::Set(0x1F)));                           \
+        Ops::V b5 = Expand5Lanes(Ops::And(v, Ops::Set(0x1F)));                                        \
+        Ops::V r4 = Ops::And(Ops::Shr<8>(v), Ops::Set(0xF));                                          \
+        Ops::V g4 = Ops::And(Ops::Shr<4>(v), Ops::Set(0xF));                                          \
+        Ops::V b4 = Ops::And(v, Ops::Set(0xF));                                                       \
+        Ops::V a3 = Ops::And(Ops::Shr<12>(v), Ops::Set(0x7));                                         \
+        Ops::V a = Ops::Or(Ops::Or(Ops::Shl<5>(a3), Ops::Shl<2>(a3)), Ops::Shr<1>(a3));               \
+        Ops::V r = SelectLanes(opaque, r5, Ops::Or(r4, Ops::Shl<4>(r4)));                             \
+        Ops::V g = SelectLanes(opaque, g5, Ops::Or(g4, Ops::Shl<4>(g4)));                             \
+        Ops::V b = SelectLanes(opaque, b5, Ops::Or(b4, Ops::Shl<4>(b4)));                             \
+        ab = Ops::Or(SelectLanes(opaque, Ops::Set(0xFF), a), Ops::Shl<8>(b));                         \
+        gr = Ops::Or(g, Ops::Shl<8>(r));                                                              \
+    }
+
+EMUWII_DEFINE_16BIT_LANES(SSE16Ops, "ssse3")
+EMUWII_DEFINE_16BIT_LANES(AVX16Ops, "avx2")
+#undef EMUWII_DEFINE_16BIT_LANES
+
+__attribute__((target("ssse3")))
+void DecodeI4SSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count, const TextureDecodeContext&) {
+    for (size_t block = 0; block < count; ++block, src += 32, dst += 8) {
+        for (int half = 0; half < 2; ++half) {
+            __m128i first, second;
+            SplitNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + half * 16)), first, second);
+            uint32_t* rows = dst + half * 4 * stride;
+            StoreIntensityRows(rows, rows + stride, ExpandNibbles(first));
+            StoreIntensityRows(rows + 2 * stride, rows + 3 * stride, ExpandNibbles(second));
+        }
+    }
+}
+
+__attribute__((target("ssse3")))
+void DecodeI8SSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count, const TextureDecodeContext&) {
+    for (size_t block = 0; block < count; ++block, src += 32, dst += 8) {
+        StoreIntensityRows(dst, dst + stride, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+        StoreIntensityRows(dst + 2 * stride, dst + 3 * stride,
+                           _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)));
+    }
+}
+
+__attribute__((target("ssse3")))
+void DecodeIA4SSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count, const TextureDecodeContext&) {
+    const __m128i low4 = _mm_set1_epi8(0x0F);
+    for (size_t block = 0; block < count; ++block, src += 32, dst += 8) {
+        for (int half = 0; half < 2; ++half) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + half * 16));
+            __m128i alpha = ExpandNibbles(_mm_and_si128(_mm_srli_epi16(bytes, 4), low4));
+            __m128i intensity = ExpandNibbles(_mm_and_si128(bytes, low4));
+            uint32_t* rows = dst + half * 2 * stride;
+            StorePlanes8x2(rows, rows + stride, alpha, intensity, intensity, intensity);
+        }
+    }
+}
+
+__attribute__((target("ssse3")))
+void DecodeIA8SSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count, const TextureDecodeContext&) {
+    const __m128i first = _mm_setr_epi8(0, 1, 1, 1, 2, 3, 3, 3, 4, 5, 5, 5, 6, 7, 7, 7);
+    const __m128i second = _mm_setr_epi8(8, 9, 9, 9, 10, 11, 11, 11, 12, 13, 13, 13, 14, 15, 15, 15);
+    for (size_t block = 0; block < count; ++block, src += 32, dst += 4) {
+        for (int half = 0; half < 2; ++half) {
+            __m128i pairs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + half * 16));
+            uint32_t* rows = dst + half * 2 * stride;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rows), _mm_shuffle_epi8(pairs, first));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rows + stride), _mm_shuffle_epi8(pairs, second));
+        }
+    }
+}
+
+template <void (*Lanes)(__m128i, __m128i&, __m128i&)>
+__attribute__((target("ssse3")))
+void Decode16BitSSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count) {
+    for (size_t block = 0; block < count; ++block, src += 32, dst += 4) {
+        for (int half = 0; half < 2; ++half) {
+            __m128i v = SSE16Ops::Swap16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + half * 16)));
+            __m128i ab, gr;
+            Lanes(v, ab, gr);
+            uint32_t* rows = dst + half * 2 * stride;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rows), SSE16Ops::PixelsLo(ab, gr));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rows + stride), SSE16Ops::PixelsHi(ab, gr));
+        }
+    }
+}
+
+__attribute__((target("ssse3")))
+void DecodeRGB565SSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                       const TextureDecodeContext&) {
+    Decode16BitSSSE3<RGB565Lanes>(dst, stride, src, count);
+}
+
+__attribute__((target("ssse3")))
+void DecodeRGB5A3SSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                       const TextureDecodeContext&) {
+    Decode16BitSSSE3<RGB5A3Lanes>(dst, stride, src, count);
+}
+
+__attribute__((target("ssse3")))
+void DecodeRGBA8SSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                      const TextureDecodeContext&) {
+    // (A, R) and (G, B) pairs -> A, B, G, R
+    const __m128i order = _mm_setr_epi8(0, 3, 2, 1, 4, 7, 6, 5, 8, 11, 10, 9, 12, 15, 14, 13);
+    for (size_t block = 0; block < count; ++block, src += 64, dst += 4) {
+        for (int half = 0; half < 2; ++half) {
+            __m128i ar = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + half * 16));
+            __m128i gb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32 + half * 16));
+            uint32_t* rows = dst + half * 2 * stride;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rows), _mm_shuffle_epi8(_mm_unpacklo_epi16(ar, gb), order));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rows + stride),
+                             _mm_shuffle_epi8(_mm_unpackhi_epi16(ar, gb), order));
+        }
+    }
+}
+
+// 16-entry palette lookups: one pshufb per byte plane
+__attribute__((target("ssse3")))
+void DecodeC4SSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                   const TextureDecodeContext& context) {
+    __m128i planes[4];
+    for (int c = 0; c < 4; ++c) {
+        planes[c] = _mm_load_si128(reinterpret_cast<const __m128i*>(context.planes[c]));
+    }
+    for (size_t block = 0; block < count; ++block, src += 32, dst += 8) {
+        for (int half = 0; half < 2; ++half) {
+            __m128i indices[2];
+            SplitNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + half * 16)), indices[0], indices[1]);
+            for (int pair = 0; pair < 2; ++pair) {
+                uint32_t* rows = dst + (half * 4 + pair * 2) * stride;
+                StorePlanes8x2(rows, rows + stride, _mm_shuffle_epi8(planes[0], indices[pair]),
+                               _mm_shuffle_epi8(planes[1], indices[pair]), _mm_shuffle_epi8(planes[2], indices[pair]),
+                               _mm_shuffle_epi8(planes[3], indices[pair]));
+            }
+        }
+    }
+}
+
+// Large palettes have no SSSE3 lookup; C8/C14X2 use the scalar loop here and
+// hardware gathers under AVX2
+__attribute__((target("ssse3")))
+void DecodeC8SSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                   const TextureDecodeContext& context) {
+    DecodeC8Scalar(dst, stride, src, count, context);
+}
+
+__attribute__((target("ssse3")))
+void DecodeC14X2SSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                      const TextureDecodeContext& context) {
+    DecodeC14X2Scalar(dst, stride, src, count, context);
+}
+
+// Each 4x4 sub-block: the four palette colors are transposed into byte planes
+// of one register and the 2-bit indices pulled out with shifts, so a
+// sub-block costs four pshufb lookups
+__attribute__((target("ssse3")))
+void DecodeCMPRSSSE3(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                     const TextureDecodeContext&) {
+    const __m128i transpose = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    const __m128i replicate = ReplicateMask(0);
+    const __m128i lane_masks[4] = {
+        _mm_set1_epi32(0x00000003), _mm_set1_epi32(0x00000300), _mm_set1_epi32(0x00030000), _mm_set1_epi32(0x03000000),
+    };
+    for (size_t block = 0; block < count; ++block, dst += 8) {
+        for (int sub = 0; sub < 4; ++sub, src += 8) {
+            uint32_t colors[4];
+            DecodeCMPRPalette(src, colors);
+            __m128i table = _mm_shuffle_epi8(
+                _mm_setr_epi32(static_cast<int>(colors[0]), static_cast<int>(colors[1]), static_cast<int>(colors[2]),
+                               static_cast<int>(colors[3])),
+                transpose);
+
+            // Index byte y replicated four times; lane x keeps bits 7-6, 5-4, 3-2, 1-0
+            int32_t raw;
+            std::memcpy(&raw, src + 4, 4);
+            __m128i bytes = _mm_shuffle_epi8(_mm_cvtsi32_si128(raw), replicate);
+            __m128i indices = _mm_or_si128(
+                _mm_or_si128(_mm_and_si128(_mm_srli_epi16(bytes, 6), lane_masks[0]),
+                             _mm_and_si128(_mm_srli_epi16(bytes, 4), lane_masks[1])),
+                _mm_or_si128(_mm_and_si128(_mm_srli_epi16(bytes, 2), lane_masks[2]),
+                             _mm_and_si128(bytes, lane_masks[3])));
+            uint32_t* out = dst + (sub >> 1) * 4 * stride + (sub & 1) * 4;
+            StorePlanes4x4(out, stride, _mm_shuffle_epi8(table, indices),
+                           _mm_shuffle_epi8(table, _mm_add_epi8(indices, _mm_set1_epi8(4))),
+                           _mm_shuffle_epi8(table, _mm_add_epi8(indices, _mm_set1_epi8(8))),
+                           _mm_shuffle_epi8(table, _mm_add_epi8(indices, _mm_set1_epi8(12))));
+        }
+    }
+}
+
+// AVX2 kernels for the 4x4 formats decode two blocks at once: lane 0 holds
+// the left block, lane 1 the right, so each store fills an 8-pixel row
+template <size_t BlockBytes>
+__attribute__((target("avx2")))
+inline __m256i LoadBlockPair(const uint8_t* src, size_t offset) {
+    return _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + offset))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + BlockBytes + offset)), 1);
+}
+
+__attribute__((target("avx2")))
+void DecodeI8AVX2(uint32_t* dst, size_t stride, const uint8_t* src, size_t count, const TextureDecodeContext&) {
+    const __m256i row0 = _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                          4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7);
+    const __m256i row1 = _mm256_add_epi8(row0, _mm256_set1_epi8(8));
+    for (size_t block = 0; block < count; ++block, src += 32, dst += 8) {
+        for (int half = 0; half < 2; ++half) {
+            __m256i rows = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + half * 16)));
+            uint32_t* out = dst + half * 2 * stride;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_shuffle_epi8(rows, row0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + stride), _mm256_shuffle_epi8(rows, row1));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void DecodeIA8AVX2(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                   const TextureDecodeContext& context) {
+    const __m256i first = _mm256_setr_epi8(0, 1, 1, 1, 2, 3, 3, 3, 4, 5, 5, 5, 6, 7, 7, 7,
+                                           0, 1, 1, 1, 2, 3, 3, 3, 4, 5, 5, 5, 6, 7, 7, 7);
+    const __m256i second = _mm256_add_epi8(first, _mm256_set1_epi8(8));
+    for (; count >= 2; count -= 2, src += 64, dst += 8) {
+        for (int half = 0; half < 2; ++half) {
+            __m256i pairs = LoadBlockPair<32>(src, half * 16);
+            uint32_t* rows = dst + half * 2 * stride;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rows), _mm256_shuffle_epi8(pairs, first));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rows + stride), _mm256_shuffle_epi8(pairs, second));
+        }
+    }
+    DecodeIA8SSSE3(dst, stride, src, count, context);
+}
+
+template <void (*Lanes)(__m256i, __m256i&, __m256i&)>
+__attribute__((target("avx2")))
+void Decode16BitAVX2(uint32_t*& dst, size_t stride, const uint8_t*& src, size_t& count) {
+    for (; count >= 2; count -= 2, src += 64, dst += 8) {
+        for (int half = 0; half < 2; ++half) {
+            __m256i v = AVX16Ops::Swap16(LoadBlockPair<32>(src, half * 16));
+            __m256i ab, gr;
+            Lanes(v, ab, gr);
+            uint32_t* rows = dst + half * 2 * stride;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rows), AVX16Ops::PixelsLo(ab, gr));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rows + stride), AVX16Ops::PixelsHi(ab, gr));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void DecodeRGB565AVX2(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                      const TextureDecodeContext& context) {
+    Decode16BitAVX2<RGB565Lanes>(dst, stride, src, count);
+    DecodeRGB565SSSE3(dst, stride, src, count, context);
+}
+
+__attribute__((target("avx2")))
+void DecodeRGB5A3AVX2(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                      const TextureDecodeContext& context) {
+    Decode16BitAVX2<RGB5A3Lanes>(dst, stride, src, count);
+    DecodeRGB5A3SSSE3(dst, stride, src, count, context);
+}
+
+__attribute__((target("avx2")))
+void DecodeRGBA8AVX2(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                     const TextureDecodeContext& context) {
+    const __m256i order = _mm256_setr_epi8(0, 3, 2, 1, 4, 7, 6, 5, 8, 11, 10, 9, 12, 15, 14, 13,
+                                           0, 3, 2, 1, 4, 7, 6, 5, 8, 11, 10, 9, 12, 15, 14, 13);
+    for (; count >= 2; count -= 2, src += 128, dst += 8) {
+        for (int half = 0; half < 2; ++half) {
+            __m256i ar = LoadBlockPair<64>(src, half * 16);
+            __m256i gb = LoadBlockPair<64>(src, 32 + half * 16);
+            uint32_t* rows = dst + half * 2 * stride;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rows),
+                                _mm256_shuffle_epi8(_mm256_unpacklo_epi16(ar, gb), order));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rows + stride),
+                                _mm256_shuffle_epi8(_mm256_unpackhi_epi16(ar, gb), order));
+        }
+    }
+    DecodeRGBA8SSSE3(dst, stride, src, count, context);
+}
+
+__attribute__((target("avx2")))
+void DecodeC8AVX2(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                  const TextureDecodeContext& context) {
+    const int* palette = reinterpret_cast<const int*>(context.palette);
+    for (size_t block = 0; block < count; ++block, src += 32, dst += 8) {
+        for (int y = 0; y < 4; ++y) {
+            __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + y * 8)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + y * stride),
+                                _mm256_i32gather_epi32(palette, indices, 4));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void DecodeC14X2AVX2(uint32_t* dst, size_t stride, const uint8_t* src, size_t count,
+                     const TextureDecodeContext& context) {
+    const int* palette = reinterpret_cast<const int*>(context.palette);
+    const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    const __m256i index_mask = _mm256_set1_epi32(0x3FFF);
+    for (; count >= 2; count -= 2, src += 64, dst += 8) {
+        for (int y = 0; y < 4; ++y) {
+            __m128i left = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + y * 8));
+            __m128i right = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + 32 + y * 8));
+            __m256i indices = _mm256_and_si256(
+                _mm256_cvtepu16_epi32(_mm_shuffle_epi8(_mm_unpacklo_epi64(left, right), swap)), index_mask);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + y * stride),
+                                _mm256_i32gather_epi32(palette, indices, 4));
+        }
+    }
+    DecodeC14X2Scalar(dst, stride, src, count, context);
+}
+#endif
+
+struct TextureDecodeKernels {
+    TextureDecodeKernel scalar;
+    TextureDecodeKernel ssse3;
+    TextureDecodeKernel avx2;
+};
+
+// I4, IA4, C4 and CMPR are bound by nibble/2-bit unpacking within 16-byte
+// lookups; their AVX2 entries use the SSSE3 kernels
+inline const TextureDecodeKernels* GetTextureDecodeKernels(uint8_t format) {
+#ifdef EMUWII_X86_SIMD
+#define EMUWII_TEXTURE_KERNELS(name, ssse3, avx2) \
+    static const TextureDecodeKernels k##name{Decode##name##Scalar, ssse3, avx2}
+#else
+#define EMUWII_TEXTURE_KERNELS(name, ssse3, avx2) \
+    static const TextureDecodeKernels k##name{Decode##name##Scalar, nullptr, nullptr}
+#endif
+    EMUWII_TEXTURE_KERNELS(I4, DecodeI4SSSE3, DecodeI4SSSE3);
+    EMUWII_TEXTURE_KERNELS(I8, DecodeI8SSSE3, DecodeI8AVX2);
+    EMUWII_TEXTURE_KERNELS(IA4, DecodeIA4SSSE3, DecodeIA4SSSE3);
+    EMUWII_TEXTURE_KERNELS(IA8, DecodeIA8SSSE3, DecodeIA8AVX2);
+    EMUWII_TEXTURE_KERNELS(RGB565, DecodeRGB565SSSE3, DecodeRGB565AVX2);
+    EMUWII_TEXTURE_KERNELS(RGB5A3, DecodeRGB5A3SSSE3, DecodeRGB5A3AVX2);
+    EMUWII_TEXTURE_KERNELS(RGBA8, DecodeRGBA8SSSE3, DecodeRGBA8AVX2);
+    EMUWII_TEXTURE_KERNELS(C4, DecodeC4SSSE3, DecodeC4SSSE3);
+    EMUWII_TEXTURE_KERNELS(C8, DecodeC8SSSE3, DecodeC8AVX2);
+    EMUWII_TEXTURE_KERNELS(C14X2, DecodeC14X2SSSE3, DecodeC14X2AVX2);
+    EMUWII_TEXTURE_KERNELS(CMPR, DecodeCMPRSSSE3, DecodeCMPRSSSE3);
+#undef EMUWII_TEXTURE_KERNELS
+    switch (format) {
+        case kTexI4: return &kI4;
+        case kTexI8: return &kI8;
+        case kTexIA4: return &kIA4;
+        case kTexIA8: return &kIA8;
+        case kTexRGB565: return &kRGB565;
+        case kTexRGB5A3: return &kRGB5A3;
+        case kTexRGBA8: return &kRGBA8;
+        case kTexC4: return &kC4;
+        case kTexC8: return &kC8;
+        case kTexC14X2: return &kC14X2;
+        case kTexCMPR: return &kCMPR;
+        default: return nullptr;
+    }
+}
+
+inline TextureDecodeKernel TextureDecodeKernelFor(uint8_t format, SimdLevel level) {
+    const TextureDecodeKernels* kernels = GetTextureDecodeKernels(format);
+    if (!kernels) {
+        return nullptr;
+    }
+    if (level == SimdLevel::kAVX2 && kernels->avx2) return kernels->avx2;
+    if (level >= SimdLevel::kSSSE3 && kernels->ssse3) return kernels->ssse3;
+    return kernels->scalar;
+}
+
+// Decodes palette entries (big-endian 16-bit, as loaded into TMEM)
+inline void DecodeTlut(uint32_t* dst, const uint8_t* tlut, size_t entries, uint8_t tlut_format) {
+    for (size_t i = 0; i < entries; ++i) {
+        uint16_t value = tlut ? LoadBigEndian<uint16_t>(tlut + i * 2) : 0;
+        switch (tlut_format) {
+            case kTlutIA8: dst[i] = DecodeIA8(value); break;
+            case kTlutRGB565: dst[i] = DecodeRGB565(value); break;
+            default: dst[i] = DecodeRGB5A3(value); break;
+        }
+    }
+}
+
+// Decodes a GX texture into width x height linear RGBA8888 pixels. tlut
+// points at the palette for C4/C8/C14X2 and may be null otherwise. Returns
+// false for an unknown format.
+inline bool DecodeTexture(uint32_t* dst, const uint8_t* src, uint8_t format, int width, int height,
+                          const uint8_t* tlut = nullptr, uint8_t tlut_format = kTlutRGB5A3,
+                          SimdLevel level = HostSimdLevel()) {
+    const TextureFormatInfo* info = GetTextureFormatInfo(format);
+    TextureDecodeKernel kernel = TextureDecodeKernelFor(format, level);
+    if (!info || !kernel || width <= 0 || height <= 0) {
+        return false;
+    }
+
+    TextureDecodeContext context;
+    std::vector<uint32_t> palette;
+    if (info->palette_entries) {
+        palette.resize(info->palette_entries);
+        DecodeTlut(palette.data(), tlut, palette.size(), tlut_format);
+        context.palette = palette.data();
+        for (size_t i = 0; i < 16; ++i) {
+            for (int c = 0; c < 4; ++c) {
+                context.planes[c][i] = static_cast<uint8_t>(palette[i] >> (8 * c));
+            }
+        }
+    }
+
+    // Sizes that are not whole blocks decode into a padded image first
+    int blocks_x = (width + info->block_width - 1) / info->block_width;
+    int blocks_y = (height + info->block_height - 1) / info->block_height;
+    int padded_width = blocks_x * info->block_width;
+    int padded_height = blocks_y * info->block_height;
+    std::vector<uint32_t> padded;
+    uint32_t* out = dst;
+    if (padded_width != width || padded_height != height) {
+        padded.resize(static_cast<size_t>(padded_width) * padded_height);
+        out = padded.data();
+    }
+    for (int by = 0; by < blocks_y; ++by) {
+        kernel(out + static_cast<size_t>(by) * info->block_height * padded_width, padded_width,
+               src + static_cast<size_t>(by) * blocks_x * info->block_bytes, blocks_x, context);
+    }
+    if (out != dst) {
+        for (int y = 0; y < height; ++y) {
+            std::memcpy(dst + static_cast<size_t>(y) * width, out + static_cast<size_t>(y) * padded_width,
+                        width * sizeof(uint32_t));
+        }
+    }
+    return true;
+}
+
+// EFB Copies to Texture
+// A texture copy (PE_COPY_EXECUTE without the XFB bit) is kept on the host
+// as the RGBA8888 texels the texture cache would decode from it, quantized
+// to the target format in one pass; the texture cache hands those to the
+// TEV's texture fetch in place of decoding RAM. Guest
+// RAM is only written when something needs the bytes: the RAM pages under a
+// pending copy are protected, and the first CPU access to them (or
+// host-side pointer lookup) faults the copy back into RAM in the tiled GX
+// layout. A later copy covering a pending one replaces it without it ever
+// being encoded, and savestates carry pending copies across a rewind.
+//
+// Copies arrive on the thread consuming the FIFO, which only records them:
+// a pending copy the new one partly overlaps is marked superseded, and the
+// CPU thread writes it back (ApplyProtection) when it protects the new
+// pages, before the CPU can observe the copy through a PE interrupt or
+// register. Faults may come from either thread. Everything is under one
+// mutex, and the fault path reaches RAM only through RamOffset, so it never
+// re-enters the memory map. Copies are written back oldest first, so where
+// they overlap the newest bytes land last.
+
+// EFB copy target formats: PE_COPY_EXECUTE bits 3-6 with the low bit moved to
+// the top. With bit 15 set, R4/R8/RA4/RA8 take luma instead of red.
+enum GXCopyFormat : uint8_t {
+    kCopyR4, kCopyR8Low, kCopyRA4, kCopyRA8, kCopyRGB565, kCopyRGB5A3, kCopyRGBA8, kCopyA8,
+    kCopyR8, kCopyG8, kCopyB8,
+};
+
+// Texture format a copy format is stored as, or -1 if copies to it are not modelled
+inline int GXCopyTextureFormat(uint8_t copy_format) {
+    switch (copy_format) {
+        case kCopyR4: return kTexI4;
+        case kCopyRA4: return kTexIA4;
+        case kCopyRA8: return kTexIA8;
+        case kCopyRGB565: return kTexRGB565;
+        case kCopyRGB5A3: return kTexRGB5A3;
+        case kCopyRGBA8: return kTexRGBA8;
+        case kCopyR8Low: case kCopyA8: case kCopyR8: case kCopyG8: case kCopyB8: return kTexI8;
+        default: return -1;
+    }
+}
+
+// An EFB pixel as the texture decoder will see it once copied: the source
+// channel moved into intensity, then reduced to the format's precision and
+// expanded again
+inline uint32_t QuantizeCopyTexel(uint8_t copy_format, bool intensity, uint32_t rgba) {
+    uint32_t r = rgba >> 24, g = (rgba >> 16) & 0xFF, b = (rgba >> 8) & 0xFF, a = rgba & 0xFF;
+    uint32_t i = r;
+    if (intensity && copy_format <= kCopyRA8) {
+        const int rgb[3] = {static_cast<int>(r), static_cast<int>(g), static_cast<int>(b)};
+        i = XFBLuma(rgb);
+    } else if (copy_format == kCopyA8) {
+        i = a;
+    } else if (copy_format == kCopyG8) {
+        i = g;
+    } else if (copy_format == kCopyB8) {
+        i = b;
+    }
+    switch (copy_format) {
+        case kCopyR4: return Expand4(i >> 4) * 0x01010101u;
+        case kCopyRA4: return MakeRGBA(Expand4(i >> 4), Expand4(i >> 4), Expand4(i >> 4), Expand4(a >> 4));
+        case kCopyRA8: return MakeRGBA(i, i, i, a);
+        case kCopyRGB565: return MakeRGBA(Expand5(r >> 3), Expand6(g >> 2), Expand5(b >> 3), 0xFF);
+        case kCopyRGB5A3:
+            if (a >= 0xE0) return MakeRGBA(Expand5(r >> 3), Expand5(g >> 3), Expand5(b >> 3), 0xFF);
+            return MakeRGBA(Expand4(r >> 4), Expand4(g >> 4), Expand4(b >> 4), Expand3(a >> 5));
+        case kCopyRGBA8: return rgba;
+        default: return i * 0x01010101u;
+    }
+}
+
+// Writes width x height quantized texels into the tiled layout of a texture
+// format, block rows stride bytes apart; texels past the edges are zero.
+// Encoding a quantized texel gives back the bits it was quantized from.
+inline void EncodeCopyTexture(uint8_t* dst, size_t stride, const uint32_t* texels, uint8_t format, int width,
+                              int height) {
+    const TextureFormatInfo* info = GetTextureFormatInfo(format);
+    int block_width = info->block_width, block_height = info->block_height;
+    for (int by = 0; by * block_height < height; ++by) {
+        uint8_t* block = dst + by * stride;
+        for (int bx = 0; bx * block_width < width; ++bx, block += info->block_bytes) {
+            std::memset(block, 0, info->block_bytes);
+            for (int y = 0; y < block_height; ++y) {
+                for (int x = 0; x < block_width; ++x) {
+                    int tx = bx * block_width + x, ty = by * block_height + y;
+                    if (tx >= width || ty >= height) continue;
+                    uint32_t texel = texels[static_cast<size_t>(ty) * width + tx];
+                    uint32_t r = texel >> 24, g = (texel >> 16) & 0xFF, b = (texel >> 8) & 0xFF, a = texel & 0xFF;
+                    int p = (y * 4 + x) * 2;
+                    switch (format) {
+                        case kTexI4: block[y * 4 + x / 2] |= static_cast<uint8_t>((r >> 4) << (x & 1 ? 0 : 4)); break;
+                        case kTexI8: block[y * 8 + x] = static_cast<uint8_t>(r); break;
+                        case kTexIA4: block[y * 8 + x] = static_cast<uint8_t>((a >> 4) << 4 | r >> 4); break;
+                        case kTexIA8: StoreBigEndian<uint16_t>(block + p, static_cast<uint16_t>(a << 8 | r)); break;
+                        case kTexRGB565:
+                            StoreBigEndian<uint16_t>(block + p,
+                                                     static_cast<uint16_t>((r >> 3) << 11 | (g >> 2) << 5 | b >> 3));
+                            break;
+                        case kTexRGB5A3:
+                            StoreBigEndian<uint16_t>(block + p, static_cast<uint16_t>(
+                                a >= 0xE0 ? 0x8000 | (r >> 3) << 10 | (g >> 3) << 5 | b >> 3
+                                          : (a >> 5) << 12 | (r >> 4) << 8 | (g >> 4) << 4 | b >> 4));
+                            break;
+                        case kTexRGBA8:
+                            block[p] = static_cast<uint8_t>(a);
+                            block[p + 1] = static_cast<uint8_t>(r);
+                            block[32 + p] = static_cast<uint8_t>(g);
+                            block[32 + p + 1] = static_cast<uint8_t>(b);
+                            break;
+                        default: break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Bytes a copy's destination spans: whole block rows stride bytes apart
+inline size_t CopyTextureSize(uint8_t format, size_t stride, int height) {
+    const TextureFormatInfo* info = GetTextureFormatInfo(format);
+    return stride * ((height + info->block_height - 1) / info->block_height);
+}
+
+class EFBCopyStore {
+    struct Copy;
+
+public:
+    struct Stats {
+        uint64_t copies = 0;
+        uint64_t written_back = 0;  // Encoded into RAM on a fault
+        uint64_t replaced = 0;      // Overwritten before anything needed their bytes
+    };
+
+    explicit EFBCopyStore(Memory& memory) : memory(memory) {
+        memory.SetFaultHandler([this](uint32_t address) { Fault(address); });
+    }
+
+    ~EFBCopyStore() {
+        WriteBackAll();
+        memory.SetFaultHandler(nullptr);
+    }
+
+    EFBCopyStore(const EFBCopyStore&) = delete;
+    EFBCopyStore& operator=(const EFBCopyStore&) = delete;
+
+    // A finished copy: width x height quantized texels for the tiled layout of
+    // format at address, block rows stride bytes apart. texels is taken only
+    // when the copy is accepted; false means the destination is not one run
+    // of RAM and the caller must write it itself.
+    bool Add(uint32_t address, uint8_t format, size_t stride, int width, int height, std::vector<uint32_t>&& texels) {
+        uint32_t size = static_cast<uint32_t>(CopyTextureSize(format, stride, height));
+        int64_t ram_offset = memory.RamOffset(address, size);
+        if (ram_offset < 0 || size == 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < copies.size();) {
+            Copy& old = copies[i];
+            if (old.ram_offset >= ram_offset + size || ram_offset >= old.ram_offset + old.size) {
+                ++i;
+            } else if (old.ram_offset >= ram_offset && old.ram_offset + old.size <= ram_offset + size) {
+                // The new copy's pages cover the old one's; they stay protected
+                copies.erase(copies.begin() + static_cast<std::ptrdiff_t>(i));
+                ++stats.replaced;
+            } else {
+                old.superseded = true;
+                ++i;
+            }
+        }
+        auto texture = std::make_shared<CachedTexture>();
+        texture->width = width;
+        texture->height = height;
+        texture->pixels = std::move(texels);
+        Copy copy;
+        copy.address = address;
+        copy.ram_offset = static_cast<uint32_t>(ram_offset);
+        copy.size = size;
+        copy.format = format;
+        copy.stride = stride;
+        copy.texture = std::move(texture);
+        copies.push_back(std::move(copy));
+        ++stats.copies;
+        return true;
+    }
+
+    // The pending copy at address if it is exactly this texture (tightly
+    // packed blocks) and no later copy overlaps it. The texels stay valid
+    // for as long as the caller holds them, whatever becomes of the copy.
+    std::shared_ptr<const CachedTexture> Find(uint32_t address, uint8_t format, int width, int height) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Copy& copy : copies) {
+            if (!copy.superseded && copy.address == address && copy.format == format &&
+                copy.texture->width == width && copy.texture->height == height &&
+                copy.size == TextureEncodedSize(format, width, height)) {
+                return copy.texture;
+            }
+        }
+        return nullptr;
+    }
+
+    // CPU thread: writes back the copies superseded since the last call and
+    // protects the pages of the copies added since then
+    void ApplyProtection() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (std::any_of(copies.begin(), copies.end(), [](const Copy& copy) { return copy.superseded; })) {
+            std::vector<bool> write_back(copies.size());
+            for (size_t i = 0; i < copies.size(); ++i) write_back[i] = copies[i].superseded;
+            WriteBack(write_back);
+        }
+        for (Copy& copy : copies) {
+            if (!copy.protected_pages) {
+                memory.ProtectRam(copy.ram_offset, copy.size);
+                copy.protected_pages = true;
+            }
+        }
+    }
+
+    void WriteBackAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<bool> write_back(copies.size(), true);
+        WriteBack(write_back);
+    }
+
+    // The pending copies, for savestates. The texels are shared rather than
+    // copied; nothing changes them once the copy is made.
+    struct Pending {
+        std::vector<Copy> copies;
+    };
+    void SavePending(Pending& pending) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.copies = copies;
+    }
+    // Drops the current copies unwritten, for when RAM is rewound past them,
+    // and protects the saved ones' pages again; the caller has synced the GPU
+    void LoadPending(const Pending& pending) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Copy& copy : copies) {
+            memory.UnprotectRam(copy.ram_offset, copy.size);
+        }
+        copies = pending.copies;
+        for (Copy& copy : copies) {
+            memory.ProtectRam(copy.ram_offset, copy.size);
+            copy.protected_pages = true;
+        }
+    }
+
+    Stats GetStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    size_t GetPendingCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return copies.size();
+    }
+
+private:
+    struct Copy {
+        uint32_t address = 0;
+        uint32_t ram_offset = 0;
+        uint32_t size = 0;
+        uint8_t format = 0;
+        bool protected_pages = false;
+        bool superseded = false;    // Partly overlapped by a later copy
+        size_t stride = 0;
+        std::shared_ptr<CachedTexture> texture;
+    };
+
+    Memory& memory;
+    mutable std::mutex mutex;
+    std::vector<Copy> copies;   // Pending; titles keep a handful
+    Stats stats;
+
+    // Writes back every copy on the faulting page, then releases the page
+    void Fault(uint32_t address) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t page = memory.RamOffset(address & ~kPageMask, kPageSize);
+        if (page < 0) {
+            return;
+        }
+        std::vector<bool> write_back(copies.size());
+        for (size_t i = 0; i < copies.size(); ++i) {
+            write_back[i] = copies[i].ram_offset < page + kPageSize && page < copies[i].ram_offset + copies[i].size;
+        }
+        WriteBack(write_back);
+        memory.UnprotectRam(static_cast<uint32_t>(page), kPageSize);
+    }
+
+    static bool Overlaps(const Copy& a, const Copy& b) {
+        return a.ram_offset < b.ram_offset + b.size && b.ram_offset < a.ram_offset + a.size;
+    }
+
+    // Encodes the copies set in write_back (indexed like copies) into RAM and
+    // drops them, along with every older copy one of them overlaps. One pass
+    // from the newest copy down gathers that set, and one pass from the
+    // oldest up writes it, so where copies overlap the newest bytes land
+    // last. Their pages are released unless a copy left pending and
+    // protected still covers them; every copy is stored before any page is
+    // released, and the release stores in the page table publish the data
+    // to the other thread.
+    void WriteBack(std::vector<bool>& write_back) {
+        for (size_t i = copies.size(); i-- > 0;) {
+            for (size_t j = 0; write_back[i] && j < i; ++j) {
+                if (Overlaps(copies[j], copies[i])) write_back[j] = true;
+            }
+        }
+        std::vector<Copy> pending, written;
+        for (size_t i = 0; i < copies.size(); ++i) {
+            Copy& copy = copies[i];
+            if (!write_back[i]) {
+                pending.push_back(std::move(copy));
+                continue;
+            }
+            EncodeCopyTexture(memory.GetRam() + copy.ram_offset, copy.stride, copy.texture->pixels.data(),
+                              copy.format, copy.texture->width, copy.texture->height);
+            memory.MarkDirty(copy.address, copy.size);
+            ++stats.written_back;
+            written.push_back(std::move(copy));
+        }
+        copies = std::move(pending);
+        for (const Copy& copy : written) {
+            uint32_t first = copy.ram_offset & ~kPageMask;
+            for (uint32_t page = first; page < copy.ram_offset + copy.size; page += kPageSize) {
+                bool covered = false;
+                for (const Copy& other : copies) {
+                    covered |= other.protected_pages && other.ram_offset < page + kPageSize &&
+                               page < other.ram_offset + other.size;
+                }
+                if (!covered) {
+                    memory.UnprotectRam(page, kPageSize);
+                }
+            }
+        }
+    }
+};
+
+// Texture Cache
+// Decoded textures keyed by guest address, format, size and TLUT hash. An
+// entry stays valid while the page versions over its source range are
+// unchanged, so a hit costs one RangeVersion sum rather than a hash. When
+// the pages have been written, the content hash decides whether the data
+// really changed before anything is decoded again. Decoded size is held
+// under a byte budget with LRU eviction. The GX pipeline looks up the maps
+// its TEV stages sample at every draw. Decoded textures are shared with the
+// renderer: changed data is decoded into a fresh texture, so triangles still
+// waiting to be rasterized keep sampling what they were drawn with.
+constexpr size_t kTextureCacheBudget = 128 * 1024 * 1024;
+
+class TextureCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t decoded_bytes = 0;     // RGBA8888 bytes produced
+        uint64_t efb_copy_hits = 0;     // Served from a pending EFB copy
+    };
+
+    // With efb_copies, textures still pending there as EFB copies are served
+    // without their bytes ever reaching RAM
+    explicit TextureCache(Memory& memory, size_t budget_bytes = kTextureCacheBudget,
+                          EFBCopyStore* efb_copies = nullptr)
+        : memory(memory), budget(budget_bytes), efb_copies(efb_copies) {}
+
+    void SetEFBCopyStore(EFBCopyStore* store) { efb_copies = store; }
+
+    // Decoded pixels for a texture in guest RAM, or nullptr if the source is
+    // not contiguous RAM or the format is unknown. tlut is the palette for
+    // C4/C8/C14X2 (TMEM contents, big-endian). The texels never change while
+    // the caller holds them.
+    std::shared_ptr<const CachedTexture> Get(uint32_t address, uint8_t format, int width, int height,
+                                             const uint8_t* tlut = nullptr, uint8_t tlut_format = kTlutRGB5A3) {
+        if (efb_copies) {
+            if (std::shared_ptr<const CachedTexture> copy = efb_copies->Find(address, format, width, height)) {
+                ++frame.efb_copy_hits;
+                return copy;
+            }
+        }
+        const TextureFormatInfo* info = GetTextureFormatInfo(format);
+        size_t size = TextureEncodedSize(format, width, height);
+        const uint8_t* source = info ? memory.GetContiguousRange(address, static_cast<uint32_t>(size)) : nullptr;
+        if (!source || width <= 0 || height <= 0) {
+            return nullptr;
+        }
+
+        Key key{address, format, static_cast<uint16_t>(width), static_cast<uint16_t>(height), tlut_format, 0};
+        if (info->palette_entries) {
+            key.tlut_hash = XXHash64(tlut, tlut ? info->palette_entries * 2u : 0);
+        }
+        uint64_t version = memory.RangeVersion(address, static_cast<uint32_t>(size));
+
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            Entry& entry = it->second;
+            lru.splice(lru.begin(), lru, entry.lru);
+            if (entry.version == version) {
+                ++frame.hits;
+                return entry.texture;
+            }
+            entry.version = version;
+            uint64_t hash = XXHash64(source, size);
+            if (hash == entry.content_hash) {
+                ++frame.hits;
+                return entry.texture;
+            }
+            entry.content_hash = hash;
+            Decode(entry, source, key, tlut);
+            return entry.texture;
+        }
+
+        auto inserted = entries.emplace(key, Entry{});
+        Entry& entry = inserted.first->second;
+        entry.version = version;
+        entry.content_hash = XXHash64(source, size);
+        lru.push_front(key);
+        entry.lru = lru.begin();
+        Decode(entry, source, key, tlut);
+        bytes_used += entry.texture->pixels.size() * sizeof(uint32_t);
+        Evict(key);
+        return entry.texture;
+    }
+
+    // Closes the per-frame counters; GetFrameStats reports the frame just ended
+    void EndFrame() {
+        last_frame = frame;
+        total.hits += frame.hits;
+        total.misses += frame.misses;
+        total.decoded_bytes += frame.decoded_bytes;
+        total.efb_copy_hits += frame.efb_copy_hits;
+        frame = Stats{};
+    }
+
+    void Clear() {
+        entries.clear();
+        lru.clear();
+        bytes_used = 0;
+    }
+
+    const Stats& GetFrameStats() const { return last_frame; }
+    const Stats& GetTotalStats() const { return total; }
+    size_t GetEntryCount() const { return entries.size(); }
+    size_t GetBytesUsed() const { return bytes_used; }
+
+private:
+    struct Key {
+        uint32_t address;
+        uint8_t format;
+        uint16_t width;
+        uint16_t height;
+        uint8_t tlut_format;
+        uint64_t tlut_hash;
+
+        bool operator==(const Key& other) const {
+            return address == other.address && format == other.format && width == other.width &&
+                   height == other.height && tlut_format == other.tlut_format && tlut_hash == other.tlut_hash;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            uint64_t packed = static_cast<uint64_t>(key.address) << 32 | static_cast<uint64_t>(key.format) << 24 |
+                              static_cast<uint64_t>(key.tlut_format) << 20 |
+                              (static_cast<uint64_t>(key.width) * 4099u + key.height);
+            return static_cast<size_t>((packed ^ key.tlut_hash) * kXXPrime1 >> 7);
+        }
+    };
+
+    struct Entry {
+        std::shared_ptr<CachedTexture> texture;
+        uint64_t version = 0;
+        uint64_t content_hash = 0;
+        std::list<Key>::iterator lru;
+    };
+
+    Memory& memory;
+    size_t budget;
+    EFBCopyStore* efb_copies;
+    size_t bytes_used = 0;
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::list<Key> lru;     // Most recently used first
+    Stats frame;
+    Stats last_frame;
+    Stats total;
+
+    // Into a fresh texture, leaving the old one to whoever still holds it
+    void Decode(Entry& entry, const uint8_t* source, const Key& key, const uint8_t* tlut) {
+        auto texture = std::make_shared<CachedTexture>();
+        texture->width = key.width;
+        texture->height = key.height;
+        texture->pixels.resize(static_cast<size_t>(key.width) * key.height);
+        DecodeTexture(texture->pixels.data(), source, key.format, key.width, key.height, tlut, key.tlut_format);
+        entry.texture = std::move(texture);
+        ++frame.misses;
+        frame.decoded_bytes += entry.texture->pixels.size() * sizeof(uint32_t);
+    }
+
+    // Drops least recently used entries until under budget, never the one just added
+    void Evict(const Key& keep) {
+        while (bytes_used > budget && lru.size() > 1) {
+            const Key& victim = lru.back();
+            if (victim == keep) {
+                break;
+            }
+            auto it = entries.find(victim);
+            bytes_used -= it->second.texture->pixels.size() * sizeof(uint32_t);
+            entries.erase(it);
+            lru.pop_back();
+        }
+    }
+};
+
+// GX Command Stream
+// The byte stream the command processor reads from the FIFO and from display
+// lists: register loads for the CP (vertex formats and arrays), XF (transform)
+// and BP (raster and pixel engine) units, and draws followed by their
+// vertices in the format selected by the VCD and one of eight VAT entries.
+enum GXOpcode : uint8_t {
+    kGXNop = 0x00,
+    kGXLoadCPReg = 0x08,
+    kGXLoadXFReg = 0x10,
+    kGXLoadIndexA = 0x20,
+    kGXLoadIndexB = 0x28,
+    kGXLoadIndexC = 0x30,
+    kGXLoadIndexD = 0x38,
+    kGXCallDisplayList = 0x40,
+    kGXInvalidateVertexCache = 0x48,
+    kGXLoadBPReg = 0x61,
+    kGXDrawQuads = 0x80,
+    kGXDrawQuads2 = 0x88,
+    kGXDrawTriangles = 0x90,
+    kGXDrawTriangleStrip = 0x98,
+    kGXDrawTriangleFan = 0xA0,
+    kGXDrawLines = 0xA8,
+    kGXDrawLineStrip = 0xB0,
+    kGXDrawPoints = 0xB8,
+};
+
+enum GXAttributeType : uint8_t { kAttrNone, kAttrDirect, kAttrIndex8, kAttrIndex16 };
+enum GXComponentFormat : uint8_t { kCompU8, kCompS8, kCompU16, kCompS16, kCompF32 };
+enum GXColorFormat : uint8_t {
+    kColorRGB565, kColorRGB888, kColorRGB888x, kColorRGBA4444, kColorRGBA6, kColorRGBA8888,
+};
+
+// CP array slots (ARRAY_BASE 0xA0 + slot, ARRAY_STRIDE 0xB0 + slot)
+enum GXArray : uint8_t {
+    kArrayPosition = 0, kArrayNormal = 1, kArrayColor0 = 2, kArrayTexCoord0 = 4, kArrayIndexedXF = 12,
+};
+
+constexpr uint8_t kCPVCDLo = 0x50;
+constexpr uint8_t kCPVCDHi = 0x60;
+constexpr uint8_t kCPVATA = 0x70;
+constexpr uint8_t kCPVATB = 0x80;
+constexpr uint8_t kCPVATC = 0x90;
+constexpr uint8_t kCPArrayBase = 0xA0;
+constexpr uint8_t kCPArrayStride = 0xB0;
+
+// XF registers, as offsets from 0x1000
+enum GXXFRegister : uint16_t {
+    kXFNumColors = 0x09,
+    kXFAmbient0 = 0x0A,
+    kXFMatColor0 = 0x0C,
+    kXFColor0Control = 0x0E,
+    kXFAlpha0Control = 0x10,
+    kXFMatrixIndexA = 0x18,     // Position matrix in bits 0-5, texture 0 matrix in 6-11
+    kXFViewport = 0x1A,         // Scale x, y, z, offset x, y, z
+    kXFProjection = 0x20,       // Six parameters, then the projection type
+    kXFProjectionType = 0x26,
+    kXFNumTexGens = 0x3F,
+    kXFTexGen0 = 0x40,
+};
+constexpr uint32_t kXFMemoryWords = 0x1000;
+constexpr uint32_t kXFNormalMatrices = 0x400;   // 3x3, three words per position matrix index
+constexpr uint32_t kXFLights = 0x600;           // 16 words per light
+constexpr uint32_t kXFRegisterBase = 0x1000;
+constexpr uint32_t kXFRegisterCount = 0x100;
+
+// BP registers the software pipeline reacts to
+enum GXBPRegister : uint8_t {
+    kBPGenMode = 0x00,
+    kBPScissorTL = 0x20,
+    kBPScissorBR = 0x21,
+    kBPTevOrder = 0x28,         // Texture map (bits 0-2, 12-14) and enable (6, 18) of two stages, 0x28-0x2F
+    kBPZMode = 0x40,
+    kBPBlendMode = 0x41,
+    kBPDrawDone = 0x45,
+    kBPToken = 0x47,
+    kBPTokenInt = 0x48,
+    kBPCopySrcTL = 0x49,        // EFB copy source: x in bits 0-9, y in 10-19
+    kBPCopySrcWH = 0x4A,        // Width - 1 and height - 1, same layout
+    kBPCopyDstBase = 0x4B,      // Destination address >> 5
+    kBPCopyDstStride = 0x4D,    // Destination row stride in 32-byte units
+    kBPClearAR = 0x4F,
+    kBPClearGB = 0x50,
+    kBPClearZ = 0x51,
+    kBPCopyExecute = 0x52,
+    kBPCopyFilter0 = 0x53,      // Vertical copy filter coefficients 0-3, 6 bits each
+    kBPCopyFilter1 = 0x54,      // Coefficients 4-6
+    kBPScissorOffset = 0x59,
+    kBPTexMode0 = 0x80,         // Wrap s (bits 0-1) and t (2-3) of maps 0-3; maps 4-7 are 0x20 up
+    kBPTexImage0 = 0x88,        // Width - 1 and height - 1 (10 bits each), then the format
+    kBPTexImage3 = 0x94,        // Address >> 5
+    kBPTevColorEnv = 0xC0,      // Color then alpha env per stage, 0xC0-0xDF
+    kBPTevRegister = 0xE0,      // RA then BG of PREV, C0-C2 or K0-K3, 0xE0-0xE7
+    kBPAlphaCompare = 0xF3,
+    kBPTevKSel = 0xF6,          // Konst selections of two stages each, 0xF6-0xFD
+    kBPMask = 0xFE,
+};
+constexpr int kGXScreenOffset = 342;    // Scissor and viewport origins are biased by this
+
+// One vertex attribute as laid out in the stream
+struct GXVertexAttribute {
+    uint8_t type = kAttrNone;   // GXAttributeType
+    uint8_t format = 0;         // GXComponentFormat, or GXColorFormat for colors
+    uint8_t count = 0;          // Components
+    uint8_t frac = 0;           // Fixed-point fraction bits
+};
+
+// Vertex layout resolved from the VCD and one VAT entry
+struct GXVertexFormat {
+    bool pos_matrix_index = false;
+    uint8_t tex_matrix_index = 0;   // Bit i: texcoord i matrix index byte present
+    GXVertexAttribute position, normal, color[2], texcoord[8];
+    uint32_t stride = 0;
+};
+
+constexpr uint8_t kGXComponentSize[8] = {1, 1, 2, 2, 4, 4, 4, 4};
+constexpr uint8_t kGXColorSize[8] = {2, 3, 4, 2, 3, 4, 4, 4};
+
+// Bytes an attribute occupies in the stream
+inline uint32_t GXAttributeSize(const GXVertexAttribute& attribute, bool color) {
+    switch (attribute.type) {
+        case kAttrNone: return 0;
+        case kAttrIndex8: return 1;
+        case kAttrIndex16: return 2;
+        default: break;
+    }
+    return color ? kGXColorSize[attribute.format] : attribute.count * kGXComponentSize[attribute.format];
+}
+
+// Bytes an attribute's data occupies in its array
+inline uint32_t GXAttributeDataSize(const GXVertexAttribute& attribute, bool color) {
+    return color ? kGXColorSize[attribute.format] : attribute.count * kGXComponentSize[attribute.format];
+}
+
+inline GXVertexFormat MakeVertexFormat(uint32_t vcd_lo, uint32_t vcd_hi, uint32_t vat_a, uint32_t vat_b,
+                                       uint32_t vat_c) {
+    GXVertexFormat format;
+    format.pos_matrix_index = vcd_lo & 1;
+    format.tex_matrix_index = static_cast<uint8_t>(vcd_lo >> 1);
+    format.position = {static_cast<uint8_t>((vcd_lo >> 9) & 3), static_cast<uint8_t>((vat_a >> 1) & 7),
+                       static_cast<uint8_t>(vat_a & 1 ? 3 : 2), static_cast<uint8_t>((vat_a >> 4) & 0x1F)};
+    uint8_t normal_format = (vat_a >> 10) & 7;
+    format.normal = {static_cast<uint8_t>((vcd_lo >> 11) & 3), normal_format,
+                     static_cast<uint8_t>((vat_a >> 9) & 1 ? 9 : 3),
+                     static_cast<uint8_t>(normal_format == kCompS8 ? 6 : normal_format == kCompS16 ? 14 : 0)};
+    for (int i = 0; i < 2; ++i) {
+        format.color[i] = {static_cast<uint8_t>((vcd_lo >> (13 + 2 * i)) & 3),
+                           static_cast<uint8_t>((vat_a >> (14 + 4 * i)) & 7),
+                           static_cast<uint8_t>((vat_a >> (13 + 4 * i)) & 1 ? 4 : 3), 0};
+    }
+    // Texcoord fields are packed across the three VAT words: {word, count
+    // bit, format shift, fraction word, fraction shift}
+    static constexpr uint8_t kTexFields[8][5] = {
+        {0, 21, 22, 0, 25}, {1, 0, 1, 1, 4}, {1, 9, 10, 1, 13}, {1, 18, 19, 1, 22},
+        {1, 27, 28, 2, 0}, {2, 5, 6, 2, 9}, {2, 14, 15, 2, 18}, {2, 23, 24, 2, 27},
+    };
+    const uint32_t vat[3] = {vat_a, vat_b, vat_c};
+    for (int i = 0; i < 8; ++i) {
+        const uint8_t* field = kTexFields[i];
+        format.texcoord[i] = {static_cast<uint8_t>((vcd_hi >> (2 * i)) & 3),
+                              static_cast<uint8_t>((vat[field[0]] >> field[2]) & 7),
+                              static_cast<uint8_t>((vat[field[0]] >> field[1]) & 1 ? 2 : 1),
+                              static_cast<uint8_t>((vat[field[3]] >> field[4]) & 0x1F)};
+    }
+
+    format.stride = (format.pos_matrix_index ? 1 : 0) + __builtin_popcount(format.tex_matrix_index) +
+                    GXAttributeSize(format.position, false) + GXAttributeSize(format.normal, false) +
+                    GXAttributeSize(format.color[0], true) + GXAttributeSize(format.color[1], true);
+    for (const GXVertexAttribute& texcoord : format.texcoord) {
+        format.stride += GXAttributeSize(texcoord, false);
+    }
+    return format;
+}
+
+inline float GXFloatFromBits(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// GX Vertex Loader
+// Turns a draw's vertex stream into SoA attribute streams for transform.
+// Only what the pipeline consumes is read (position matrix index, position,
+// normal, color 0, texcoord 0); every other attribute is skipped over by
+// offset. A loader is built once per distinct (VCD, VAT) register
+// combination.
+//
+// The loader is a list of steps, one per attribute, each a template
+// instantiation for that attribute's index type and component format that
+// loops over every vertex. On x86-64 SysV hosts the same steps are also
+// compiled to machine code that walks the stream once, byte-swapping and
+// dequantizing into the output arrays; the steps remain the fallback for
+// other hosts and for --no-jit. Neither branches on the format per vertex.
+enum GXVertexChannel : uint8_t {
+    kChannelPosition = 0,       // x, y, z
+    kChannelColor = 3,          // r, g, b, a in [0, 255]
+    kChannelTexCoord = 7,       // s, t
+    kChannelNormal = 9,         // x, y, z; the binormal and tangent are skipped
+    kVertexChannels = 12,
+};
+
+// Decoded vertices, one array per channel. Whether the matrix index, normal
+// and color were present is a property of the draw, not of each vertex.
+struct GXVertexStreams {
+    std::vector<float> channel[kVertexChannels];
+    std::vector<uint8_t> matrix;
+
+    size_t Size() const { return matrix.size(); }
+
+    void Resize(size_t size) {
+        for (std::vector<float>& values : channel) values.resize(size);
+        matrix.resize(size);
+    }
+};
+
+// Where one draw's vertices go, already offset to its first vertex. Read by
+// generated code.
+struct GXLoaderOutput {
+    float* channel[kVertexChannels];
+    uint8_t* matrix;
+};
+
+// Arrays behind the indexed attributes a loader reads
+enum GXLoaderArray : uint8_t { kLoaderPosition, kLoaderColor, kLoaderTexCoord, kLoaderNormal, kLoaderArrays };
+constexpr uint8_t kGXLoaderArraySlot[kLoaderArrays] = {kArrayPosition, kArrayColor0, kArrayTexCoord0, kArrayNormal};
+
+// Indexed attribute sources. An element at offset index * stride below limit
+// is read from base + offset, anything else reads zero as ReadGuest would
+// outside RAM. min/max accumulate the offsets used. Read by generated code.
+struct GXLoaderArrays {
+    const uint8_t* base[kLoaderArrays];
+    const uint8_t* zero;
+    uint32_t stride[kLoaderArrays];
+    uint32_t limit[kLoaderArrays];
+    uint32_t min[kLoaderArrays];
+    uint32_t max[kLoaderArrays];
+};
+
+alignas(16) inline constexpr uint8_t kGXZeroAttribute[16] = {};
+
+struct GXLoaderStep;
+using GXLoaderStepFn = void (*)(const GXLoaderStep& step, const uint8_t* stream, uint32_t stride, uint32_t count,
+                                const GXLoaderOutput& out, GXLoaderArrays& arrays);
+
+struct GXLoaderStep {
+    enum Kind : uint8_t { kMatrix, kComponents, kColor, kZero };
+
+    GXLoaderStepFn run;
+    Kind kind;
+    uint8_t type;           // GXAttributeType
+    uint8_t format;         // GXComponentFormat (kCompF32 for 4..7) or GXColorFormat
+    uint8_t components;     // Read from the stream, at most channels
+    uint8_t channel;        // First output channel
+    uint8_t channels;       // Written; those past components are zeroed
+    uint8_t array;          // GXLoaderArray, when indexed
+    uint32_t offset;        // Of the attribute or its index within a vertex
+    uint32_t size;          // Attribute data bytes
+    float scale;            // 1 / 2^frac for fixed-point components
+};
+
+template <uint8_t Type>
+inline const uint8_t* GXAttributeSource(const uint8_t* vertex, const GXLoaderStep& step, GXLoaderArrays& arrays) {
+    if constexpr (Type == kAttrDirect) {
+        return vertex + step.offset;
+    } else {
+        uint32_t index = Type == kAttrIndex8 ? vertex[step.offset] : LoadBigEndian<uint16_t>(vertex + step.offset);
+        uint32_t offset = index * arrays.stride[step.array];
+        arrays.min[step.array] = std::min(arrays.min[step.array], offset);
+        arrays.max[step.array] = std::max(arrays.max[step.array], offset);
+        return offset < arrays.limit[step.array] ? arrays.base[step.array] + offset : arrays.zero;
+    }
+}
+
+template <uint8_t Format>
+inline float GXReadComponent(const uint8_t* data, float scale) {
+    if constexpr (Format == kCompU8) return data[0] * scale;
+    else if constexpr (Format == kCompS8) return static_cast<int8_t>(data[0]) * scale;
+    else if constexpr (Format == kCompU16) return LoadBigEndian<uint16_t>(data) * scale;
+    else if constexpr (Format == kCompS16) return LoadBigEndian<int16_t>(data) * scale;
+    else return LoadBigEndian<float>(data);
+}
+
+template <uint8_t Type, uint8_t Format, int Components>
+void GXLoadComponents(const GXLoaderStep& step, const uint8_t* stream, uint32_t stride, uint32_t count,
+                      const GXLoaderOutput& out, GXLoaderArrays& arrays) {
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint8_t* data = GXAttributeSource<Type>(stream + i * stride, step, arrays);
+        for (int c = 0; c < Components; ++c) {
+            out.channel[step.channel + c][i] = GXReadComponent<Format>(data + c * kGXComponentSize[Format], step.scale);
+        }
+        for (int c = Components; c < step.channels; ++c) out.channel[step.channel + c][i] = 0.0f;
+    }
+}
+
+template <uint8_t Format>
+inline void GXUnpackVertexColor(const uint8_t* data, uint32_t (&rgba)[4]) {
+    if constexpr (Format == kColorRGB565) {
+        uint32_t c = LoadBigEndian<uint16_t>(data);
+        rgba[0] = Expand5(c >> 11), rgba[1] = Expand6((c >> 5) & 0x3F), rgba[2] = Expand5(c & 0x1F), rgba[3] = 0xFF;
+    } else if constexpr (Format == kColorRGB888 || Format == kColorRGB888x) {
+        rgba[0] = data[0], rgba[1] = data[1], rgba[2] = data[2], rgba[3] = 0xFF;
+    } else if constexpr (Format == kColorRGBA4444) {
+        rgba[0] = Expand4(data[0] >> 4), rgba[1] = Expand4(data[0] & 0xF);
+        rgba[2] = Expand4(data[1] >> 4), rgba[3] = Expand4(data[1] & 0xF);
+    } else if constexpr (Format == kColorRGBA6) {
+        uint32_t c = static_cast<uint32_t>(data[0]) << 16 | data[1] << 8 | data[2];
+        rgba[0] = Expand6(c >> 18), rgba[1] = Expand6((c >> 12) & 0x3F);
+        rgba[2] = Expand6((c >> 6) & 0x3F), rgba[3] = Expand6(c & 0x3F);
+    } else {
+        rgba[0] = data[0], rgba[1] = data[1], rgba[2] = data[2], rgba[3] = data[3];
+    }
+}
+
+template <uint8_t Type, uint8_t Format>
+void GXLoadColor(const GXLoaderStep& step, const uint8_t* stream, uint32_t stride, uint32_t count,
+                 const GXLoaderOutput& out, GXLoaderArrays& arrays) {
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t rgba[4];
+        GXUnpackVertexColor<Format>(GXAttributeSource<Type>(stream + i * stride, step, arrays), rgba);
+        for (int c = 0; c < 4; ++c) out.channel[kChannelColor + c][i] = static_cast<float>(rgba[c]);
+    }
+}
+
+inline void GXLoadMatrixIndex(const GXLoaderStep& step, const uint8_t* stream, uint32_t stride, uint32_t count,
+                              const GXLoaderOutput& out, GXLoaderArrays&) {
+    for (uint32_t i = 0; i < count; ++i) out.matrix[i] = stream[i * stride + step.offset] & 0x3F;
+}
+
+inline void GXZeroChannels(const GXLoaderStep& step, const uint8_t*, uint32_t, uint32_t count,
+                           const GXLoaderOutput& out, GXLoaderArrays&) {
+    for (int c = 0; c < step.channels; ++c) std::fill_n(out.channel[step.channel + c], count, 0.0f);
+}
+
+template <uint8_t Type, uint8_t Format>
+GXLoaderStepFn GXComponentStep(int components) {
+    switch (components) {
+        case 1:  return GXLoadComponents<Type, Format, 1>;
+        case 2:  return GXLoadComponents<Type, Format, 2>;
+        default: return GXLoadComponents<Type, Format, 3>;
+    }
+}
+
+template <uint8_t Type>
+GXLoaderStepFn GXComponentStep(uint8_t format, int components) {
+    switch (format) {
+        case kCompU8:  return GXComponentStep<Type, kCompU8>(components);
+        case kCompS8:  return GXComponentStep<Type, kCompS8>(components);
+        case kCompU16: return GXComponentStep<Type, kCompU16>(components);
+        case kCompS16: return GXComponentStep<Type, kCompS16>(components);
+        default:       return GXComponentStep<Type, kCompF32>(components);
+    }
+}
+
+template <uint8_t Type>
+GXLoaderStepFn GXColorStep(uint8_t format) {
+    switch (format) {
+        case kColorRGB565:   return GXLoadColor<Type, kColorRGB565>;
+        case kColorRGB888:   return GXLoadColor<Type, kColorRGB888>;
+        case kColorRGB888x:  return GXLoadColor<Type, kColorRGB888x>;
+        case kColorRGBA4444: return GXLoadColor<Type, kColorRGBA4444>;
+        case kColorRGBA6:    return GXLoadColor<Type, kColorRGBA6>;
+        default:             return GXLoadColor<Type, kColorRGBA8888>;
+    }
+}
+
+inline GXLoaderStepFn GXSelectStep(const GXLoaderStep& step) {
+    switch (step.kind) {
+        case GXLoaderStep::kMatrix: return GXLoadMatrixIndex;
+        case GXLoaderStep::kZero: return GXZeroChannels;
+        case GXLoaderStep::kColor:
+            if (step.type == kAttrDirect) return GXColorStep<kAttrDirect>(step.format);
+            if (step.type == kAttrIndex8) return GXColorStep<kAttrIndex8>(step.format);
+            return GXColorStep<kAttrIndex16>(step.format);
+        default:
+            if (step.type == kAttrDirect) return GXComponentStep<kAttrDirect>(step.format, step.components);
+            if (step.type == kAttrIndex8) return GXComponentStep<kAttrIndex8>(step.format, step.components);
+            return GXComponentStep<kAttrIndex16>(step.format, step.components);
+    }
+}
+
+// Executable Code
+// Generated code lives in its own mapping, written while read-write and then
+// flipped to read-execute, so no page is ever writable and executable.
+#if defined(__x86_64__) && !defined(_WIN32)
+#define EMUWII_X64_JIT 1
+#include <sys/mman.h>
+#endif
+
+class ExecutableCode {
+public:
+    ExecutableCode() = default;
+    ExecutableCode(const ExecutableCode&) = delete;
+    ExecutableCode& operator=(const ExecutableCode&) = delete;
+    ~ExecutableCode() { Release(); }
+
+    // Maps a copy of code; false if the host cannot run generated code
+    bool Load(const std::vector<uint8_t>& code) {
+        Release();
+#ifdef EMUWII_X64_JIT
+        size_t size = (code.size() + kPageSize - 1) & ~static_cast<size_t>(kPageMask);
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        std::memcpy(mapping, code.data(), code.size());
+        if (mprotect(mapping, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(mapping, size);
+            return false;
+        }
+        data = mapping;
+        mapped = size;
+        return true;
+#else
+        (void)code;
+        return false;
+#endif
+    }
+
+    template <typename Fn>
+    Fn Entry() const { return reinterpret_cast<Fn>(data); }
+
+private:
+    void* data = nullptr;
+    size_t mapped = 0;
+
+    void Release() {
+#ifdef EMUWII_X64_JIT
+        if (data) munmap(data, mapped);
+#endif
+        data = nullptr;
+        mapped = 0;
+    }
+};
+
+// x86-64 Emitter
+// Just the integer, SSE scalar and branch forms the code generators use.
+// Memory operands are [base + index * 2^scale + disp]; every register
+// operand is 32-bit unless the method says otherwise.
+class X64Emitter {
+public:
+    enum Reg : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+    enum Cond : uint8_t { kBelow = 2, kAboveEqual = 3, kZero = 4, kNotZero = 5, kAbove = 7 };
+
+    struct Mem {
+        uint8_t base;
+        int32_t disp = 0;
+        int8_t index = -1;
+        uint8_t scale = 0;
+    };
+
+    const std::vector<uint8_t>& GetCode() const { return code; }
+    size_t Position() const { return code.size(); }
+
+    void MovzxB(Reg dst, Mem src) { Op({0x0F, 0xB6}, dst, src); }
+    void MovzxW(Reg dst, Mem src) { Op({0x0F, 0xB7}, dst, src); }
+    void MovsxB(Reg dst, Mem src) { Op({0x0F, 0xBE}, dst, src); }
+    void MovsxW(Reg dst, Reg src) { OpRR({0x0F, 0xBF}, dst, src); }
+    void Mov(Reg dst, Mem src) { Op({0x8B}, dst, src); }
+    void Mov(Mem dst, Reg src) { Op({0x89}, src, dst); }
+    void Mov(Reg dst, Reg src) { OpRR({0x89}, src, dst); }
+    void Mov(Reg dst, uint32_t imm) { Rex(false, 0, 0, dst); Byte(0xB8 + (dst & 7)); Imm32(imm); }
+    void Mov(Mem dst, uint32_t imm) { Op({0xC7}, 0, dst); Imm32(imm); }
+    void Mov64(Reg dst, Mem src) { Op({0x8B}, dst, src, true); }
+    void MovB(Mem dst, Reg src) { Op({0x88}, src, dst); }
+    void Bswap(Reg reg) { Rex(false, 0, 0, reg); Byte(0x0F); Byte(0xC8 + (reg & 7)); }
+    void Rol16(Reg reg, uint8_t bits) { OpRR({0xC1}, 0, reg, false, 0x66); Byte(bits); }
+    void Shl(Reg reg, uint8_t bits) { OpRR({0xC1}, 4, reg); Byte(bits); }
+    void Shr(Reg reg, uint8_t bits) { OpRR({0xC1}, 5, reg); Byte(bits); }
+    void And(Reg reg, uint32_t imm) { OpRR({0x81}, 4, reg); Imm32(imm); }
+    void Or(Reg dst, Reg src) { OpRR({0x09}, src, dst); }
+    void Xor(Reg dst, Reg src) { OpRR({0x31}, src, dst); }
+    void Imul(Reg dst, Mem src) { Op({0x0F, 0xAF}, dst, src); }
+    void Imul(Reg dst, Reg src, int8_t imm) { OpRR({0x6B}, dst, src); Byte(static_cast<uint8_t>(imm)); }
+    void Cmp(Reg a, Reg b) { OpRR({0x39}, b, a); }
+    void Cmp(Reg a, Mem b) { Op({0x3B}, a, b); }
+    void Cmov(Cond cond, Reg dst, Reg src) { OpRR({0x0F, static_cast<uint8_t>(0x40 + cond)}, dst, src); }
+    void Cmov64(Cond cond, Reg dst, Mem src) { Op({0x0F, static_cast<uint8_t>(0x40 + cond)}, dst, src, true); }
+    void Lea64(Reg dst, Mem src) { Op({0x8D}, dst, src, true); }
+    void Add64(Reg dst, Reg src) { OpRR({0x01}, src, dst, true); }
+    void Add64(Reg reg, uint32_t imm) { OpRR({0x81}, 0, reg, true); Imm32(imm); }
+    void Inc64(Reg reg) { OpRR({0xFF}, 0, reg, true); }
+    void Dec64(Reg reg) { OpRR({0xFF}, 1, reg, true); }
+    void Test64(Reg a, Reg b) { OpRR({0x85}, b, a, true); }
+    void Push(Reg reg) { Rex(false, 0, 0, reg); Byte(0x50 + (reg & 7)); }
+    void Pop(Reg reg) { Rex(false, 0, 0, reg); Byte(0x58 + (reg & 7)); }
+    void Xorps(uint8_t dst, uint8_t src) { OpRR({0x0F, 0x57}, dst, src); }
+    void Cvtsi2ss(uint8_t xmm, Reg src) { OpRR({0x0F, 0x2A}, xmm, src, false, 0xF3); }
+    void Movd(uint8_t xmm, Reg src) { OpRR({0x0F, 0x6E}, xmm, src, false, 0x66); }
+    void Mulss(uint8_t dst, uint8_t src) { OpRR({0x0F, 0x59}, dst, src, false, 0xF3); }
+    void Movss(Mem dst, uint8_t xmm) { Op({0x0F, 0x11}, xmm, dst, false, 0xF3); }
+    void Ret() { Byte(0xC3); }
+
+    // Forward branch; returns the fixup to pass to Bind
+    size_t Jump(Cond cond) {
+        Byte(0x0F);
+        Byte(0x80 + cond);
+        Imm32(0);
+        return code.size();
+    }
+
+    void Bind(size_t fixup) { Patch(fixup, code.size()); }
+
+    // Backward branch to a Position()
+    void Jump(Cond cond, size_t target) {
+        size_t fixup = Jump(cond);
+        Patch(fixup, target);
+    }
+
+private:
+    std::vector<uint8_t> code;
+
+    void Byte(uint8_t value) { code.push_back(value); }
+
+    void Imm32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) Byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    void Patch(size_t fixup, size_t target) {
+        uint32_t rel = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(fixup));
+        for (int i = 0; i < 4; ++i) code[fixup - 4 + i] = static_cast<uint8_t>(rel >> (8 * i));
+    }
+
+    void Rex(bool wide, uint8_t reg, uint8_t index, uint8_t base) {
+        uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3);
+        if (rex != 0x40) Byte(rex);
+    }
+
+    // [prefix] [REX] opcode ModRM [SIB] [disp]
+    void Op(std::initializer_list<uint8_t> opcode, uint8_t reg, const Mem& mem, bool wide = false,
+            uint8_t prefix = 0) {
+        if (prefix) Byte(prefix);
+        Rex(wide, reg, mem.index >= 0 ? static_cast<uint8_t>(mem.index) : 0, mem.base);
+        for (uint8_t byte : opcode) Byte(byte);
+        bool sib = mem.index >= 0 || (mem.base & 7) == RSP;
+        uint8_t mod = mem.disp == 0 && (mem.base & 7) != RBP ? 0 : mem.disp >= -128 && mem.disp < 128 ? 1 : 2;
+        Byte(static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | (sib ? 4 : mem.base & 7)));
+        if (sib) {
+            int index = mem.index >= 0 ? mem.index : static_cast<int>(RSP);
+            Byte(static_cast<uint8_t>(mem.scale << 6 | (index & 7) << 3 | (mem.base & 7)));
+        }
+        if (mod == 1) Byte(static_cast<uint8_t>(mem.disp));
+        if (mod == 2) Imm32(static_cast<uint32_t>(mem.disp));
+    }
+
+    void OpRR(std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t rm, bool wide = false, uint8_t prefix = 0) {
+        if (prefix) Byte(prefix);
+        Rex(wide, reg, 0, rm);
+        for (uint8_t byte : opcode) Byte(byte);
+        Byte(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+    }
+};
+
+// A compiled loader: fn(stream, count, out, arrays)
+using GXVertexLoaderCode = void (*)(const uint8_t* stream, uint32_t count, const GXLoaderOutput* out,
+                                    GXLoaderArrays* arrays);
+
+// Emits the loader for steps. Register use: rdi vertex, rsi vertices left,
+// rdx out, rcx arrays, r8 output index, r10 attribute data, eax/r9/r11/
+// xmm0/xmm1 scratch. The min/max offsets of each indexed array are kept in
+// a pair of callee-saved registers for the whole loop.
+inline std::vector<uint8_t> GXEmitVertexLoader(const std::vector<GXLoaderStep>& steps, uint32_t stride) {
+    using E = X64Emitter;
+    E e;
+    auto channel_ptr = [](int channel) {
+        return E::Mem{E::RDX, static_cast<int32_t>(offsetof(GXLoaderOutput, channel) + channel * sizeof(float*))};
+    };
+    auto array_field = [](size_t field, int array) {
+        return E::Mem{E::RCX, static_cast<int32_t>(field + array * sizeof(uint32_t))};
+    };
+    const E::Mem element{E::R11, 0, E::R8, 2};
+    auto store_float = [&](int channel) {
+        e.Mov64(E::R11, channel_ptr(channel));
+        e.Movss(element, 0);
+    };
+
+    // min/max of the first three indexed arrays live in callee-saved
+    // register pairs; a fourth updates its fields in place through r9
+    constexpr int kRegisterPairs = 3;
+    static constexpr E::Reg kPairMin[kRegisterPairs] = {E::RBX, E::R12, E::R14};
+    static constexpr E::Reg kPairMax[kRegisterPairs] = {E::RBP, E::R13, E::R15};
+    bool indexed[kLoaderArrays] = {};
+    for (const GXLoaderStep& step : steps) {
+        if (step.kind != GXLoaderStep::kMatrix && step.kind != GXLoaderStep::kZero && step.type != kAttrDirect) {
+            indexed[step.array] = true;
+        }
+    }
+    int pair[kLoaderArrays];
+    int pairs = 0;
+    for (int a = 0; a < kLoaderArrays; ++a) {
+        pair[a] = indexed[a] && pairs < kRegisterPairs ? pairs++ : -1;
+        if (pair[a] < 0) continue;
+        e.Push(kPairMin[pair[a]]);
+        e.Push(kPairMax[pair[a]]);
+        e.Mov(kPairMin[pair[a]], array_field(offsetof(GXLoaderArrays, min), a));
+        e.Mov(kPairMax[pair[a]], array_field(offsetof(GXLoaderArrays, max), a));
+    }
+
+    e.Test64(E::RSI, E::RSI);
+    size_t done = e.Jump(E::kZero);
+    e.Xor(E::R8, E::R8);
+    size_t loop = e.Position();
+    for (const GXLoaderStep& step : steps) {
+        const int32_t offset = static_cast<int32_t>(step.offset);
+        if (step.kind == GXLoaderStep::kMatrix) {
+            e.MovzxB(E::RAX, {E::RDI, offset});
+            e.And(E::RAX, 0x3F);
+            e.Mov64(E::R11, {E::RDX, static_cast<int32_t>(offsetof(GXLoaderOutput, matrix))});
+            e.MovB({E::R11, 0, E::R8, 0}, E::RAX);
+            continue;
+        }
+        if (step.kind == GXLoaderStep::kZero) {
+            for (int c = 0; c < step.channels; ++c) {
+                e.Mov64(E::R11, channel_ptr(step.channel + c));
+                e.Mov(element, 0u);
+            }
+            continue;
+        }
+
+        // r10 = attribute data
+        if (step.type == kAttrDirect) {
+            e.Lea64(E::R10, {E::RDI, offset});
+        } else {
+            if (step.type == kAttrIndex8) {
+                e.MovzxB(E::RAX, {E::RDI, offset});
+            } else {
+                e.MovzxW(E::RAX, {E::RDI, offset});
+                e.Rol16(E::RAX, 8);
+            }
+            e.Imul(E::RAX, array_field(offsetof(GXLoaderArrays, stride), step.array));
+            if (pair[step.array] >= 0) {
+                E::Reg min = kPairMin[pair[step.array]], max = kPairMax[pair[step.array]];
+                e.Cmp(E::RAX, min);
+                e.Cmov(E::kBelow, min, E::RAX);
+                e.Cmp(E::RAX, max);
+                e.Cmov(E::kAbove, max, E::RAX);
+            } else {
+                const E::Mem min = array_field(offsetof(GXLoaderArrays, min), step.array);
+                const E::Mem max = array_field(offsetof(GXLoaderArrays, max), step.array);
+                e.Mov(E::R9, min);
+                e.Cmp(E::RAX, E::R9);
+                e.Cmov(E::kBelow, E::R9, E::RAX);
+                e.Mov(min, E::R9);
+                e.Mov(E::R9, max);
+                e.Cmp(E::RAX, E::R9);
+                e.Cmov(E::kAbove, E::R9, E::RAX);
+                e.Mov(max, E::R9);
+            }
+            e.Mov64(E::R10, {E::RCX, static_cast<int32_t>(offsetof(GXLoaderArrays, base) + step.array * sizeof(void*))});
+            e.Add64(E::R10, E::RAX);
+            e.Cmp(E::RAX, array_field(offsetof(GXLoaderArrays, limit), step.array));
+            e.Cmov64(E::kAboveEqual, E::R10, {E::RCX, static_cast<int32_t>(offsetof(GXLoaderArrays, zero))});
+        }
+
+        if (step.kind == GXLoaderStep::kComponents) {
+            int32_t size = kGXComponentSize[step.format];
+            for (int c = 0; c < step.components; ++c) {
+                E::Mem data{E::R10, c * size};
+                if (step.format == kCompF32) {
+                    e.Mov(E::RAX, data);
+                    e.Bswap(E::RAX);
+                    e.Mov64(E::R11, channel_ptr(step.channel + c));
+                    e.Mov(element, E::RAX);
+                    continue;
+                }
+                switch (step.format) {
+                    case kCompU8: e.MovzxB(E::RAX, data); break;
+                    case kCompS8: e.MovsxB(E::RAX, data); break;
+                    default:
+                        e.MovzxW(E::RAX, data);
+                        e.Rol16(E::RAX, 8);
+                        if (step.format == kCompS16) e.MovsxW(E::RAX, E::RAX);
+                        break;
+                }
+                e.Xorps(0, 0);     // cvtsi2ss only writes the low lane
+                e.Cvtsi2ss(0, E::RAX);
+                if (step.scale != 1.0f) {
+                    uint32_t bits;
+                    std::memcpy(&bits, &step.scale, sizeof(bits));
+                    e.Mov(E::RAX, bits);
+                    e.Movd(1, E::RAX);
+                    e.Mulss(0, 1);
+                }
+                store_float(step.channel + c);
+            }
+            for (int c = step.components; c < step.channels; ++c) {
+                e.Mov64(E::R11, channel_ptr(step.channel + c));
+                e.Mov(element, 0u);
+            }
+            continue;
+        }
+
+        // Colors: {shift, bits} per channel from the value in r9, or a byte
+        // of the data for the 8-bit formats
+        struct Field { uint8_t shift, bits; };
+        const Field* fields = nullptr;
+        static constexpr Field kRGB565[4] = {{11, 5}, {5, 6}, {0, 5}, {0, 0}};
+        static constexpr Field kRGBA4444[4] = {{12, 4}, {8, 4}, {4, 4}, {0, 4}};
+        static constexpr Field kRGBA6[4] = {{18, 6}, {12, 6}, {6, 6}, {0, 6}};
+        switch (step.format) {
+            case kColorRGB565:
+            case kColorRGBA4444:
+                e.MovzxW(E::R9, {E::R10, 0});
+                e.Rol16(E::R9, 8);
+                fields = step.format == kColorRGB565 ? kRGB565 : kRGBA4444;
+                break;
+            case kColorRGBA6:
+                e.MovzxB(E::R9, {E::R10, 0});
+                e.Shl(E::R9, 16);
+                e.MovzxW(E::RAX, {E::R10, 1});
+                e.Rol16(E::RAX, 8);
+                e.Or(E::R9, E::RAX);
+                fields = kRGBA6;
+                break;
+            default:
+                break;
+        }
+        bool has_alpha = step.format == kColorRGBA4444 || step.format == kColorRGBA6 || step.format >= kColorRGBA8888;
+        for (int c = 0; c < 4; ++c) {
+            if (c == 3 && !has_alpha) {
+                e.Mov(E::RAX, 0xFFu);
+            } else if (!fields) {
+                e.MovzxB(E::RAX, {E::R10, c});
+            } else {
+                e.Mov(E::RAX, E::R9);
+                if (fields[c].shift) e.Shr(E::RAX, fields[c].shift);
+                e.And(E::RAX, (1u << fields[c].bits) - 1);
+                if (fields[c].bits == 4) {
+                    e.Imul(E::RAX, E::RAX, 0x11);
+                } else {
+                    // Expand5/Expand6: v << (8 - bits) | v >> (2 * bits - 8)
+                    e.Mov(E::R11, E::RAX);
+                    e.Shl(E::RAX, static_cast<uint8_t>(8 - fields[c].bits));
+                    e.Shr(E::R11, static_cast<uint8_t>(2 * fields[c].bits - 8));
+                    e.Or(E::RAX, E::R11);
+                }
+            }
+            e.Xorps(0, 0);
+            e.Cvtsi2ss(0, E::RAX);
+            store_float(kChannelColor + c);
+        }
+    }
+    e.Add64(E::RDI, stride);
+    e.Inc64(E::R8);
+    e.Dec64(E::RSI);
+    e.Jump(E::kNotZero, loop);
+    e.Bind(done);
+    for (int a = kLoaderArrays - 1; a >= 0; --a) {
+        if (pair[a] < 0) continue;
+        e.Mov(array_field(offsetof(GXLoaderArrays, min), a), kPairMin[pair[a]]);
+        e.Mov(array_field(offsetof(GXLoaderArrays, max), a), kPairMax[pair[a]]);
+        e.Pop(kPairMax[pair[a]]);
+        e.Pop(kPairMin[pair[a]]);
+    }
+    e.Ret();
+    return e.GetCode();
+}
+
+// The (VCD, VAT) register values a loader is built from
+struct GXVertexLoaderKey {
+    uint32_t regs[5];   // VCD lo, VCD hi, VAT A, B, C
+
+    bool operator==(const GXVertexLoaderKey& other) const {
+        return std::equal(std::begin(regs), std::end(regs), std::begin(other.regs));
+    }
+};
+
+struct GXVertexLoaderKeyHash {
+    size_t operator()(const GXVertexLoaderKey& key) const {
+        return static_cast<size_t>(XXHash64(key.regs, sizeof(key.regs)));
+    }
+};
+
+class GXVertexLoader {
+public:
+    enum Flags : uint8_t { kHasMatrix = 1, kHasColor = 2, kHasNormal = 4 };
+
+    GXVertexLoader(const GXVertexLoaderKey& key, bool jit)
+        : format(MakeVertexFormat(key.regs[0], key.regs[1], key.regs[2], key.regs[3], key.regs[4])) {
+        BuildSteps();
+        if (jit && code.Load(GXEmitVertexLoader(steps, format.stride))) {
+            compiled = code.Entry<GXVertexLoaderCode>();
+        }
+    }
+
+    const GXVertexFormat& GetFormat() const { return format; }
+    uint8_t GetFlags() const { return flags; }
+    bool IsCompiled() const { return compiled != nullptr; }
+
+    // Attribute data size for an array the loader indexes, or 0 if it does not
+    uint32_t GetArrayDataSize(int array) const { return array_size[array]; }
+
+    void Load(const uint8_t* stream, uint32_t count, const GXLoaderOutput& out, GXLoaderArrays& arrays) const {
+        if (compiled) {
+            compiled(stream, count, &out, &arrays);
+            return;
+        }
+        for (const GXLoaderStep& step : steps) {
+            step.run(step, stream, format.stride, count, out, arrays);
+        }
+    }
+
+private:
+    GXVertexFormat format;
+    std::vector<GXLoaderStep> steps;
+    uint8_t flags = 0;
+    uint32_t array_size[kLoaderArrays] = {};
+    ExecutableCode code;
+    GXVertexLoaderCode compiled = nullptr;
+
+    void BuildSteps() {
+        uint32_t offset = 0;
+        auto add = [&](GXLoaderStep step) {
+            step.run = GXSelectStep(step);
+            steps.push_back(step);
+        };
+        auto attribute = [&](const GXVertexAttribute& attribute, bool color, GXLoaderStep::Kind kind,
+                             uint8_t channel, uint8_t channels, uint8_t array) {
+            if (attribute.type == kAttrNone) {
+                if (kind != GXLoaderStep::kColor) add({nullptr, GXLoaderStep::kZero, 0, 0, 0, channel, channels, 0, 0, 0, 1.0f});
+                return;
+            }
+            uint8_t component_format = color ? attribute.format : std::min<uint8_t>(attribute.format, kCompF32);
+            uint8_t components = static_cast<uint8_t>(std::min<int>(attribute.count, channels));
+            uint32_t size = GXAttributeDataSize(attribute, color);
+            add({nullptr, kind, attribute.type, component_format, components, channel, channels, array, offset, size,
+                 1.0f / static_cast<float>(1u << attribute.frac)});
+            if (attribute.type != kAttrDirect) array_size[array] = size;
+        };
+
+        if (format.pos_matrix_index) {
+            add({nullptr, GXLoaderStep::kMatrix, 0, 0, 0, 0, 0, 0, offset, 1, 1.0f});
+            flags |= kHasMatrix;
+            ++offset;
+        }
+        offset += __builtin_popcount(format.tex_matrix_index);
+        attribute(format.position, false, GXLoaderStep::kComponents, kChannelPosition, 3, kLoaderPosition);
+        offset += GXAttributeSize(format.position, false);
+        if (format.normal.type != kAttrNone) {
+            flags |= kHasNormal;
+            attribute(format.normal, false, GXLoaderStep::kComponents, kChannelNormal, 3, kLoaderNormal);
+        }
+        offset += GXAttributeSize(format.normal, false);
+        if (format.color[0].type != kAttrNone) flags |= kHasColor;
+        attribute(format.color[0], true, GXLoaderStep::kColor, kChannelColor, 4, kLoaderColor);
+        offset += GXAttributeSize(format.color[0], true) + GXAttributeSize(format.color[1], true);
+        attribute(format.texcoord[0], false, GXLoaderStep::kComponents, kChannelTexCoord, 2, kLoaderTexCoord);
+    }
+};
+
+// Loaders by (VCD, VAT) values. Entries are never evicted: games use a few
+// dozen formats, and loaders stay referenced by the pipeline.
+class GXVertexLoaderCache {
+public:
+    struct Stats {
+        uint64_t loaders = 0;
+        uint64_t compiled = 0;      // Of loaders, those running generated code
+        uint64_t precompiled = 0;   // Of loaders, those built ahead of use
+    };
+
+    explicit GXVertexLoaderCache(bool jit = true) : jit(jit) {}
+
+    const GXVertexLoader& Get(const GXVertexLoaderKey& key) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = loaders.find(key);
+            if (it != loaders.end()) return *it->second;
+        }
+        return Insert(key, false);
+    }
+
+    // Safe to call from any thread
+    void Precompile(const GXVertexLoaderKey& key) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (loaders.count(key)) return;
+        }
+        Insert(key, true);
+    }
+
+    std::vector<GXVertexLoaderKey> GetKeys() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<GXVertexLoaderKey> keys;
+        for (const auto& entry : loaders) keys.push_back(entry.first);
+        return keys;
+    }
+
+    Stats GetStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    bool jit;
+    mutable std::mutex mutex;
+    std::unordered_map<GXVertexLoaderKey, std::unique_ptr<GXVertexLoader>, GXVertexLoaderKeyHash> loaders;
+    Stats stats;
+
+    // Generates code outside the lock
+    const GXVertexLoader& Insert(const GXVertexLoaderKey& key, bool ahead) {
+        auto built = std::make_unique<GXVertexLoader>(key, jit);
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<GXVertexLoader>& loader = loaders[key];
+        if (!loader) {
+            loader = std::move(built);
+            ++stats.loaders;
+            if (loader->IsCompiled()) ++stats.compiled;
+            if (ahead) ++stats.precompiled;
+        }
+        return *loader;
+    }
+};
+
+// XF Transform
+// Turns a draw's decoded vertices into GXVertex: the position through its
+// 3x4 matrix, the projection and the viewport; the normal through the
+// matching normal matrix; texcoord 0 through texgen 0; and color channel 0
+// through up to eight lights. The setup is decoded from XF registers and
+// memory when they change, not per vertex.
+//
+// One kernel body is written against a lane type F. With F = float it is the
+// scalar reference; with GCC vectors it takes SoA blocks of 4 (SSE) or 8
+// (AVX2) vertices, gathering each lane's matrix rows from XF memory by index,
+// or broadcasting them when the block shares one. Every instantiation runs
+// the same float operations in the same order and none enables FMA, so they
+// agree bit for bit. A draw's tail shorter than a block takes the scalar body.
+//
+// Until XF_NUMCOLORS is set the vertex color (or the material register
+// without one) passes through unlit, and without texgens texcoord 0 does.
+constexpr int kGXLights = 8;
+
+enum GXDiffuseFunction : uint8_t { kDiffuseNone, kDiffuseSign, kDiffuseClamp };
+enum GXAttenuation : uint8_t { kAttenuationNone, kAttenuationSpecular, kAttenuationDirectional, kAttenuationSpot };
+
+// A light as loaded into XF memory, colors in [0, 255]
+struct GXLight {
+    float color[4];
+    float cos_attenuation[3];
+    float dist_attenuation[3];
+    float position[3];
+    float direction[3];
+};
+
+// The color or alpha half of channel 0, from its channel control register
+struct GXLitChannel {
+    bool material_vertex = false;   // Material from the vertex color rather than the register
+    bool lighting = false;
+    bool ambient_vertex = false;
+    uint8_t diffuse = kDiffuseNone;
+    uint8_t attenuation = kAttenuationNone;
+    uint8_t lights = 0;             // Bit per light
+
+    bool SameFactors(const GXLitChannel& other) const {
+        return diffuse == other.diffuse && attenuation == other.attenuation;
+    }
+};
+
+inline GXLitChannel MakeLitChannel(uint32_t control) {
+    GXLitChannel channel;
+    channel.material_vertex = control & 1;
+    channel.lighting = (control >> 1) & 1;
+    channel.lights = static_cast<uint8_t>(((control >> 2) & 0xF) | ((control >> 11) & 0xF) << 4);
+    channel.ambient_vertex = (control >> 6) & 1;
+    channel.diffuse = (control >> 7) & 3;
+    channel.attenuation = (control >> 9) & 3;
+    return channel;
+}
+
+struct GXTransformSetup {
+    const uint32_t* xf_memory = nullptr;
+    uint8_t flags = 0;              // GXVertexLoader::Flags of the draw
+    uint8_t matrix = 0;             // Position matrix of vertices without an index
+    bool orthographic = false;
+    float projection[6] = {};
+    float viewport[6] = {};
+    bool color_channels = false;    // Channel 0 follows its control registers
+    bool lit_normals = false;       // Some light needs the transformed normal
+    GXLitChannel color, alpha;
+    float ambient[4] = {};
+    float material[4] = {};
+    GXLight lights[kGXLights] = {};
+    bool texgen = false;            // Texcoord 0 from texgen 0
+    bool texgen_stq = false;        // s and t divided by the third row
+    bool texgen_abc1 = false;       // Three input components rather than two and a 1
+    uint8_t texgen_source = 0;      // Source row: 0 position, 1 normal, anything else texcoord 0
+    float tex_matrix[12] = {};
+};
+
+inline GXTransformSetup MakeTransformSetup(const uint32_t* xf_memory, const uint32_t* xf_regs) {
+    GXTransformSetup setup;
+    setup.xf_memory = xf_memory;
+    setup.matrix = xf_regs[kXFMatrixIndexA] & 0x3F;
+    setup.orthographic = xf_regs[kXFProjectionType] & 1;
+    for (int i = 0; i < 6; ++i) {
+        setup.projection[i] = GXFloatFromBits(xf_regs[kXFProjection + i]);
+        setup.viewport[i] = GXFloatFromBits(xf_regs[kXFViewport + i]);
+    }
+
+    int ambient[4], material[4];
+    UnpackRGBA(xf_regs[kXFAmbient0], ambient);
+    UnpackRGBA(xf_regs[kXFMatColor0], material);
+    for (int c = 0; c < 4; ++c) {
+        setup.ambient[c] = static_cast<float>(ambient[c]);
+        setup.material[c] = static_cast<float>(material[c]);
+    }
+    setup.color_channels = xf_regs[kXFNumColors] != 0;
+    setup.color = MakeLitChannel(xf_regs[kXFColor0Control]);
+    setup.alpha = MakeLitChannel(xf_regs[kXFAlpha0Control]);
+    setup.lit_normals = setup.color_channels && ((setup.color.lighting && setup.color.lights) ||
+                                                 (setup.alpha.lighting && setup.alpha.lights));
+    // Words 0-2 of a light are unused, then color, cosine and distance
+    // attenuation, position and direction
+    for (int l = 0; l < kGXLights; ++l) {
+        const uint32_t* words = xf_memory + kXFLights + l * 16;
+        GXLight& light = setup.lights[l];
+        int color[4];
+        UnpackRGBA(words[3], color);
+        for (int c = 0; c < 4; ++c) light.color[c] = static_cast<float>(color[c]);
+        for (int i = 0; i < 3; ++i) {
+            light.cos_attenuation[i] = GXFloatFromBits(words[4 + i]);
+            light.dist_attenuation[i] = GXFloatFromBits(words[7 + i]);
+            light.position[i] = GXFloatFromBits(words[10 + i]);
+            light.direction[i] = GXFloatFromBits(words[13 + i]);
+        }
+    }
+
+    // Only regular texgens; emboss and color texgens keep texcoord 0
+    uint32_t texgen = xf_regs[kXFTexGen0];
+    setup.texgen = (xf_regs[kXFNumTexGens] & 0xF) != 0 && ((texgen >> 4) & 7) == 0;
+    setup.texgen_stq = (texgen >> 1) & 1;
+    setup.texgen_abc1 = (texgen >> 2) & 1;
+    setup.texgen_source = (texgen >> 7) & 0x1F;
+    const uint32_t* tex_matrix = xf_memory + ((xf_regs[kXFMatrixIndexA] >> 6) & 0x3F) * 4;
+    for (int i = 0; i < 12; ++i) setup.tex_matrix[i] = GXFloatFromBits(tex_matrix[i]);
+    return setup;
+}
+
+// Lane operations; the float overloads are the scalar reference's. Vectors
+// are passed by reference so 32-byte lanes never cross a non-AVX signature.
+inline void GXLoadLanes(float& lanes, const float* src) { lanes = *src; }
+inline void GXSplat(float& lanes, float value) { lanes = value; }
+// elements[k] of each lane is word k from that lane's offset in XF memory
+template <int Elements>
+inline void GXGatherMatrix(float (&elements)[Elements], const uint32_t* memory, const uint32_t* offsets) {
+    for (int k = 0; k < Elements; ++k) elements[k] = GXFloatFromBits(memory[offsets[0] + k]);
+}
+// fields are the GXVertex members in order, one vertex per lane
+constexpr int kGXVertexFields = sizeof(GXVertex) / sizeof(float);
+static_assert(sizeof(GXVertex) == 10 * sizeof(float), "GXVertex is stored as ten packed floats");
+inline void GXStoreVertices(const float (&fields)[kGXVertexFields], GXVertex* out, uint8_t* visible) {
+    std::memcpy(out, fields, sizeof(GXVertex));
+    visible[0] = out->w > 0.0f;
+}
+inline void GXSqrt(float& lanes) { lanes = std::sqrt(lanes); }
+// Values are within int32 range
+inline void GXTruncate(float& lanes) { lanes = static_cast<float>(static_cast<int32_t>(lanes)); }
+
+#ifdef EMUWII_X86_SIMD
+typedef float GXXFLanes4 __attribute__((vector_size(16)));
+typedef float GXXFLanes8 __attribute__((vector_size(32)));
+
+template <typename F>
+inline void GXLoadLanes(F& lanes, const float* src) { std::memcpy(&lanes, src, sizeof(F)); }
+template <typename F>
+inline void GXSplat(F& lanes, float value) {
+    for (size_t i = 0; i < sizeof(F) / sizeof(float); ++i) lanes[i] = value;
+}
+
+// Four rows of four words transposed per group of elements; the last
+// group may read past Elements but stays inside XF memory
+template <int Elements>
+inline void GXGatherMatrix(GXXFLanes4 (&elements)[Elements], const uint32_t* memory, const uint32_t* offsets) {
+    const float* words = reinterpret_cast<const float*>(memory);
+    for (int k = 0; k < Elements; k += 4) {
+        __m128 r0 = _mm_loadu_ps(words + offsets[0] + k), r1 = _mm_loadu_ps(words + offsets[1] + k);
+        __m128 r2 = _mm_loadu_ps(words + offsets[2] + k), r3 = _mm_loadu_ps(words + offsets[3] + k);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        const __m128 columns[4] = {r0, r1, r2, r3};
+        for (int c = 0; c < 4 && k + c < Elements; ++c) elements[k + c] = columns[c];
+    }
+}
+
+// Fields transposed four at a time into each vertex's 16 bytes; the last two
+// go out as 8-byte halves
+inline void GXStoreVertices(const GXXFLanes4 (&fields)[kGXVertexFields], GXVertex* out, uint8_t* visible) {
+    float* vertex[4] = {&out[0].x, &out[1].x, &out[2].x, &out[3].x};
+    for (int k = 0; k < 8; k += 4) {
+        __m128 r0 = fields[k], r1 = fields[k + 1], r2 = fields[k + 2], r3 = fields[k + 3];
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(vertex[0] + k, r0);
+        _mm_storeu_ps(vertex[1] + k, r1);
+        _mm_storeu_ps(vertex[2] + k, r2);
+        _mm_storeu_ps(vertex[3] + k, r3);
+    }
+    __m128 low = _mm_unpacklo_ps(fields[8], fields[9]), high = _mm_unpackhi_ps(fields[8], fields[9]);
+    _mm_storel_pi(reinterpret_cast<__m64*>(vertex[0] + 8), low);
+    _mm_storeh_pi(reinterpret_cast<__m64*>(vertex[1] + 8), low);
+    _mm_storel_pi(reinterpret_cast<__m64*>(vertex[2] + 8), high);
+    _mm_storeh_pi(reinterpret_cast<__m64*>(vertex[3] + 8), high);
+    int w = _mm_movemask_ps(_mm_cmpgt_ps(fields[3], _mm_setzero_ps()));
+    for (int lane = 0; lane < 4; ++lane) visible[lane] = (w >> lane) & 1;
+}
+
+inline void GXSqrt(GXXFLanes4& lanes) { lanes = _mm_sqrt_ps(lanes); }
+inline void GXTruncate(GXXFLanes4& lanes) { lanes = _mm_cvtepi32_ps(_mm_cvttps_epi32(lanes)); }
+__attribute__((target("avx2")))
+inline void GXSqrt(GXXFLanes8& lanes) { lanes = _mm256_sqrt_ps(lanes); }
+__attribute__((target("avx2")))
+inline void GXTruncate(GXXFLanes8& lanes) { lanes = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(lanes)); }
+template <int Elements>
+__attribute__((target("avx2")))
+inline void GXGatherMatrix(GXXFLanes8 (&elements)[Elements], const uint32_t* memory, const uint32_t* offsets) {
+    const float* words = reinterpret_cast<const float*>(memory);
+    for (int k = 0; k < Elements; k += 4) {
+        __m256 r[4];    // Lanes 0-3 low, 4-7 high
+        for (int lane = 0; lane < 4; ++lane) {
+            r[lane] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(words + offsets[lane] + k)),
+                                           _mm_loadu_ps(words + offsets[lane + 4] + k), 1);
+        }
+        __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+        __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+        const __m256 columns[4] = {_mm256_shuffle_ps(t0, t2, 0x44), _mm256_shuffle_ps(t0, t2, 0xEE),
+                                   _mm256_shuffle_ps(t1, t3, 0x44), _mm256_shuffle_ps(t1, t3, 0xEE)};
+        for (int c = 0; c < 4 && k + c < Elements; ++c) elements[k + c] = columns[c];
+    }
+}
+__attribute__((target("avx2")))
+inline void GXStoreVertices(const GXXFLanes8 (&fields)[kGXVertexFields], GXVertex* out, uint8_t* visible) {
+    for (int k = 0; k < 8; k += 4) {
+        __m256 t0 = _mm256_unpacklo_ps(fields[k], fields[k + 1]), t1 = _mm256_unpackhi_ps(fields[k], fields[k + 1]);
+        __m256 t2 = _mm256_unpacklo_ps(fields[k + 2], fields[k + 3]);
+        __m256 t3 = _mm256_unpackhi_ps(fields[k + 2], fields[k + 3]);
+        const __m256 rows[4] = {_mm256_shuffle_ps(t0, t2, 0x44), _mm256_shuffle_ps(t0, t2, 0xEE),
+                                _mm256_shuffle_ps(t1, t3, 0x44), _mm256_shuffle_ps(t1, t3, 0xEE)};
+        for (int lane = 0; lane < 4; ++lane) {
+            _mm_storeu_ps(&out[lane].x + k, _mm256_castps256_ps128(rows[lane]));
+            _mm_storeu_ps(&out[lane + 4].x + k, _mm256_extractf128_ps(rows[lane], 1));
+        }
+    }
+    __m256 low = _mm256_unpacklo_ps(fields[8], fields[9]), high = _mm256_unpackhi_ps(fields[8], fields[9]);
+    const __m128 uv[4] = {_mm256_castps256_ps128(low), _mm256_castps256_ps128(high),
+                          _mm256_extractf128_ps(low, 1), _mm256_extractf128_ps(high, 1)};
+    for (int half = 0; half < 2; ++half) {
+        _mm_storel_pi(reinterpret_cast<__m64*>(out[half * 4 + 0].uv), uv[half * 2]);
+        _mm_storeh_pi(reinterpret_cast<__m64*>(out[half * 4 + 1].uv), uv[half * 2]);
+        _mm_storel_pi(reinterpret_cast<__m64*>(out[half * 4 + 2].uv), uv[half * 2 + 1]);
+        _mm_storeh_pi(reinterpret_cast<__m64*>(out[half * 4 + 3].uv), uv[half * 2 + 1]);
+    }
+    int w = _mm256_movemask_ps(_mm256_cmp_ps(fields[3], _mm256_setzero_ps(), _CMP_GT_OQ));
+    for (int lane = 0; lane < 8; ++lane) visible[lane] = (w >> lane) & 1;
+}
+#endif
+
+// std::clamp's comparisons, so a NaN passes through as it does there
+template <typename F>
+inline void GXClampLanes(F& lanes, float low, float high) {
+    lanes = lanes < low ? low : (high < lanes ? high : lanes);
+}
+
+// Diffuse term times attenuation of one light at a view-space position
+template <typename F>
+inline void GXLightFactor(const GXLight& light, const GXLitChannel& channel, const F (&position)[3],
+                          const F (&normal)[3], F& factor) {
+    F dir[3];
+    for (int i = 0; i < 3; ++i) dir[i] = light.position[i] - position[i];
+    F dist2 = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+    F dist = dist2;
+    GXSqrt(dist);
+    // A light on the vertex shines along the normal
+    for (int i = 0; i < 3; ++i) dir[i] = dist2 > 0.0f ? dir[i] / dist : normal[i];
+
+    F attenuation;
+    GXSplat(attenuation, 1.0f);
+    if (channel.attenuation == kAttenuationSpecular || channel.attenuation == kAttenuationSpot) {
+        F angle, distance, distance2;
+        if (channel.attenuation == kAttenuationSpecular) {
+            // Specular lights attenuate by the half-angle direction, both terms
+            F facing = normal[0] * dir[0] + normal[1] * dir[1] + normal[2] * dir[2];
+            F half = normal[0] * light.direction[0] + normal[1] * light.direction[1] +
+                     normal[2] * light.direction[2];
+            angle = facing >= 0.0f ? (half > 0.0f ? half : 0.0f) : 0.0f;
+            distance = angle;
+            distance2 = angle * angle;
+        } else {
+            F spot = dir[0] * light.direction[0] + dir[1] * light.direction[1] + dir[2] * light.direction[2];
+            angle = spot > 0.0f ? spot : 0.0f;
+            distance = dist;
+            distance2 = dist2;
+        }
+        F cos_term = light.cos_attenuation[0] + light.cos_attenuation[1] * angle +
+                     light.cos_attenuation[2] * (angle * angle);
+        F dist_term = light.dist_attenuation[0] + light.dist_attenuation[1] * distance +
+                      light.dist_attenuation[2] * distance2;
+        cos_term = cos_term > 0.0f ? cos_term : 0.0f;
+        attenuation = dist_term != 0.0f ? cos_term / dist_term : 0.0f;
+    }
+
+    if (channel.diffuse == kDiffuseNone) {
+        factor = attenuation;
+        return;
+    }
+    F diffuse = dir[0] * normal[0] + dir[1] * normal[1] + dir[2] * normal[2];
+    if (channel.diffuse != kDiffuseSign) diffuse = diffuse > 0.0f ? diffuse : 0.0f;
+    factor = attenuation * diffuse;
+}
+
+// Channel 0 from the vertex color it holds on entry. Lit halves sum the
+// ambient and each light's color times its factor, clamp to [0, 255] and
+// scale the material by it as the hardware does, light + (light >> 7) over
+// 256; unlit halves are the material.
+template <typename F>
+inline void GXLightVertices(const GXTransformSetup& setup, const F (&position)[3], const F (&normal)[3],
+                            F (&color)[4]) {
+    const bool vertex_color = setup.flags & GXVertexLoader::kHasColor;
+    F material[4], light[4];
+    for (int c = 0; c < 4; ++c) {
+        const GXLitChannel& half = c < 3 ? setup.color : setup.alpha;
+        if (half.material_vertex && vertex_color) material[c] = color[c];
+        else GXSplat(material[c], setup.material[c]);
+        if (half.ambient_vertex && vertex_color) light[c] = color[c];
+        else GXSplat(light[c], setup.ambient[c]);
+    }
+
+    uint8_t color_lights = setup.color.lighting ? setup.color.lights : 0;
+    uint8_t alpha_lights = setup.alpha.lighting ? setup.alpha.lights : 0;
+    for (int l = 0; l < kGXLights; ++l) {
+        bool lit_color = (color_lights >> l) & 1, lit_alpha = (alpha_lights >> l) & 1;
+        if (!lit_color && !lit_alpha) continue;
+        const GXLight& source = setup.lights[l];
+        F factor;
+        if (lit_color) {
+            GXLightFactor(source, setup.color, position, normal, factor);
+            for (int c = 0; c < 3; ++c) light[c] += factor * source.color[c];
+        }
+        if (lit_alpha) {
+            if (!lit_color || !setup.alpha.SameFactors(setup.color)) {
+                GXLightFactor(source, setup.alpha, position, normal, factor);
+            }
+            light[3] += factor * source.color[3];
+        }
+    }
+
+    for (int c = 0; c < 4; ++c) {
+        const GXLitChannel& half = c < 3 ? setup.color : setup.alpha;
+        if (!half.lighting) {
+            color[c] = material[c];
+            continue;
+        }
+        F lit = light[c] > 0.0f ? (light[c] < 255.0f ? light[c] : 255.0f) : 0.0f;
+        GXTruncate(lit);
+        F carry = lit * (1.0f / 128.0f);
+        GXTruncate(carry);
+        F value = material[c] * (lit + carry) * (1.0f / 256.0f);
+        GXTruncate(value);
+        color[c] = value;
+    }
+}
+
+// Transforms the vertices at in[i, i + lanes) into out and visible (w > 0)
+template <typename F>
+inline void GXTransformBlock(const GXTransformSetup& setup, const GXVertexStreams& in, size_t i, GXVertex* out,
+                             uint8_t* visible) {
+    constexpr int kLanes = sizeof(F) / sizeof(float);
+    const bool has_normal = setup.flags & GXVertexLoader::kHasNormal;
+    F position[3], normal[3] = {};
+    for (int c = 0; c < 3; ++c) GXLoadLanes(position[c], in.channel[kChannelPosition + c].data() + i);
+    if (has_normal) {
+        for (int c = 0; c < 3; ++c) GXLoadLanes(normal[c], in.channel[kChannelNormal + c].data() + i);
+    }
+
+    // Position matrices are 3x4, row-major, four words apart per index; the
+    // normal matrix of an index is 3x3 at three words apart
+    F m[12], n[9];
+    const bool indexed = setup.flags & GXVertexLoader::kHasMatrix;
+    const uint8_t first = indexed ? in.matrix[i] : setup.matrix;
+    bool shared = true;
+    for (int lane = 1; indexed && lane < kLanes; ++lane) shared = shared && in.matrix[i + lane] == first;
+    if (shared) {
+        const uint32_t* words = setup.xf_memory + first * 4;
+        for (int k = 0; k < 12; ++k) GXSplat(m[k], GXFloatFromBits(words[k]));
+        words = setup.xf_memory + kXFNormalMatrices + (first & 31) * 3;
+        for (int k = 0; setup.lit_normals && k < 9; ++k) GXSplat(n[k], GXFloatFromBits(words[k]));
+    } else {
+        uint32_t offsets[kLanes];
+        for (int lane = 0; lane < kLanes; ++lane) offsets[lane] = in.matrix[i + lane] * 4;
+        GXGatherMatrix(m, setup.xf_memory, offsets);
+        if (setup.lit_normals) {
+            for (int lane = 0; lane < kLanes; ++lane) offsets[lane] = kXFNormalMatrices + (in.matrix[i + lane] & 31) * 3;
+            GXGatherMatrix(n, setup.xf_memory, offsets);
+        }
+    }
+
+    F view[3];
+    for (int row = 0; row < 3; ++row) {
+        view[row] = m[row * 4 + 0] * position[0] + m[row * 4 + 1] * position[1] + m[row * 4 + 2] * position[2] +
+                    m[row * 4 + 3];
+    }
+    const float* p = setup.projection;
+    F clip_x, clip_y, clip_z, clip_w;
+    if (setup.orthographic) {
+        clip_x = p[0] * view[0] + p[1];
+        clip_y = p[2] * view[1] + p[3];
+        GXSplat(clip_w, 1.0f);
+    } else {
+        clip_x = p[0] * view[0] + p[1] * view[2];
+        clip_y = p[2] * view[1] + p[3] * view[2];
+        clip_w = -view[2];
+    }
+    clip_z = p[4] * view[2] + p[5];
+    const float* vp = setup.viewport;
+    F inv_w = 1.0f / clip_w;
+    F x = clip_x * inv_w * vp[0] + vp[3] - static_cast<float>(kGXScreenOffset);
+    F y = clip_y * inv_w * vp[1] + vp[4] - static_cast<float>(kGXScreenOffset);
+    F z = (clip_z * inv_w * vp[2] + vp[5]) / static_cast<float>(kGXMaxDepth);
+    GXClampLanes(x, -kGXGuardBand, kGXGuardBand);
+    GXClampLanes(y, -kGXGuardBand, kGXGuardBand);
+    GXClampLanes(z, 0.0f, 1.0f);
+
+    F color[4];
+    for (int c = 0; c < 4; ++c) {
+        if (setup.flags & GXVertexLoader::kHasColor) GXLoadLanes(color[c], in.channel[kChannelColor + c].data() + i);
+        else GXSplat(color[c], setup.material[c]);
+    }
+    if (setup.color_channels) {
+        F eye_normal[3] = {};
+        if (setup.lit_normals) {
+            for (int row = 0; row < 3; ++row) {
+                eye_normal[row] = n[row * 3 + 0] * normal[0] + n[row * 3 + 1] * normal[1] + n[row * 3 + 2] * normal[2];
+            }
+            F length2 = eye_normal[0] * eye_normal[0] + eye_normal[1] * eye_normal[1] + eye_normal[2] * eye_normal[2];
+            F length = length2;
+            GXSqrt(length);
+            for (F& value : eye_normal) value = length2 > 0.0f ? value / length : value;
+        }
+        GXLightVertices(setup, view, eye_normal, color);
+    }
+
+    F uv[2];
+    GXLoadLanes(uv[0], in.channel[kChannelTexCoord].data() + i);
+    GXLoadLanes(uv[1], in.channel[kChannelTexCoord + 1].data() + i);
+    if (setup.texgen) {
+        F source[3];
+        if (setup.texgen_source == 0) {
+            for (int c = 0; c < 3; ++c) source[c] = position[c];
+        } else if (setup.texgen_source == 1) {
+            for (int c = 0; c < 3; ++c) source[c] = normal[c];
+        } else {
+            source[0] = uv[0];
+            source[1] = uv[1];
+            GXSplat(source[2], 1.0f);
+        }
+        if (!setup.texgen_abc1) GXSplat(source[2], 1.0f);
+        const float* row = setup.tex_matrix;
+        F s = row[0] * source[0] + row[1] * source[1] + row[2] * source[2] + row[3];
+        F t = row[4] * source[0] + row[5] * source[1] + row[6] * source[2] + row[7];
+        if (setup.texgen_stq) {
+            F q = row[8] * source[0] + row[9] * source[1] + row[10] * source[2] + row[11];
+            s = q != 0.0f ? s / q : s;
+            t = q != 0.0f ? t / q : t;
+        }
+        uv[0] = s;
+        uv[1] = t;
+    }
+
+    const F fields[kGXVertexFields] = {x, y, z, clip_w, color[0], color[1], color[2], color[3], uv[0], uv[1]};
+    GXStoreVertices(fields, out, visible);
+}
+
+template <typename F>
+inline void GXTransformVertices(const GXTransformSetup& setup, const GXVertexStreams& in, size_t first,
+                                uint32_t count, GXVertex* out, uint8_t* visible) {
+    constexpr uint32_t kLanes = sizeof(F) / sizeof(float);
+    uint32_t i = 0;
+    for (; i + kLanes <= count; i += kLanes) GXTransformBlock<F>(setup, in, first + i, out + i, visible + i);
+    for (; i < count; ++i) GXTransformBlock<float>(setup, in, first + i, out + i, visible + i);
+}
+
+// Transforms count vertices of in from first into out and visible
+using GXTransformKernel = void (*)(const GXTransformSetup& setup, const GXVertexStreams& in, size_t first,
+                                   uint32_t count, GXVertex* out, uint8_t* visible);
+
+inline void GXTransformScalar(const GXTransformSetup& setup, const GXVertexStreams& in, size_t first,
+                              uint32_t count, GXVertex* out, uint8_t* visible) {
+    GXTransformVertices<float>(setup, in, first, count, out, visible);
+}
+
+#ifdef EMUWII_X86_SIMD
+// SSE2 is the x86-64 baseline, so the 4-wide kernel needs no target
+inline void GXTransformSSE(const GXTransformSetup& setup, const GXVertexStreams& in, size_t first, uint32_t count,
+                           GXVertex* out, uint8_t* visible) {
+    GXTransformVertices<GXXFLanes4>(setup, in, first, count, out, visible);
+}
+
+// flatten pulls the generic body into the AVX2 target, where the 8-wide
+// lane operations can inline
+__attribute__((target("avx2"), flatten))
+inline void GXTransformAVX2(const GXTransformSetup& setup, const GXVertexStreams& in, size_t first, uint32_t count,
+                            GXVertex* out, uint8_t* visible) {
+    GXTransformVertices<GXXFLanes8>(setup, in, first, count, out, visible);
+}
+#endif
+
+inline GXTransformKernel GXTransformKernelFor(SimdLevel level) {
+#ifdef EMUWII_X86_SIMD
+    if (level == SimdLevel::kAVX2) return GXTransformAVX2;
+    if (level == SimdLevel::kSSSE3) return GXTransformSSE;
+#endif
+    (void)level;
+    return GXTransformScalar;
+}
+
+// Shader Cache
+// The pixel pipeline and vertex loader keys a title has built, saved to
+// <cache dir>/<game ID>.gxcache so the next launch builds them on a
+// background pool before the game first asks. Keys rather than generated
+// code are stored: building from a key is cheap, and the code depends on the
+// host and --no-jit. The file is a header (magic, version, key sizes)
+// followed by records of a kind byte, the key bytes and their XXHash64; a
+// header mismatch discards the file and a bad checksum ends the load at that
+// record. A key with a field out of range (a file from a different build,
+// or one edited by hand) discards the whole file, as it says nothing else
+// in it can be trusted. Bump kGXShaderCacheVersion whenever a key's meaning
+// changes.
+constexpr uint32_t kGXShaderCacheMagic = 0x58475745;   // "EWGX"
+constexpr uint32_t kGXShaderCacheVersion = 2;
+
+class GXShaderCache {
+public:
+    enum Kind : uint8_t { kPixelPipeline = 0, kVertexLoader = 1 };
+
+    explicit GXShaderCache(std::filesystem::path path) : path(std::move(path)) {}
+
+    ~GXShaderCache() { Wait(); }
+
+    GXShaderCache(const GXShaderCache&) = delete;
+    GXShaderCache& operator=(const GXShaderCache&) = delete;
+
+    // The game ID comes straight from the image header, so anything but six
+    // letters and digits is named by its hash instead of used as a path
+    static std::filesystem::path PathFor(const std::filesystem::path& directory, const std::string& game_id) {
+        bool valid = game_id.size() == 6 && std::all_of(game_id.begin(), game_id.end(), [](char c) {
+            return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+        });
+        std::ostringstream name;
+        if (valid) {
+            name << game_id;
+        } else {
+            name << std::hex << std::setw(16) << std::setfill('0') << XXHash64(game_id.data(), game_id.size());
+        }
+        return directory / (name.str() + ".gxcache");
+    }
+
+    // Reads the keys saved by the previous run; returns how many were valid
+    size_t Load() {
+        Wait();
+        pixel_keys.clear();
+        loader_keys.clear();
+        std::ifstream file(path, std::ios::binary);
+        uint32_t header[4] = {};
+        if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != kGXShaderCacheMagic ||
+            header[1] != kGXShaderCacheVersion || header[2] != sizeof(GXPixelPipelineKey) ||
+            header[3] != sizeof(GXVertexLoaderKey)) {
+            return 0;
+        }
+        uint8_t kind;
+        while (file.read(reinterpret_cast<char*>(&kind), 1)) {
+            if (kind == kPixelPipeline) {
+                GXPixelPipelineKey key;
+                if (!ReadRecord(file, kind, &key, sizeof(key))) break;
+                if (!IsValid(key)) return Discard();
+                pixel_keys.push_back(key);
+            } else if (kind == kVertexLoader) {
+                GXVertexLoaderKey key;
+                if (!ReadRecord(file, kind, &key, sizeof(key))) break;
+                if (!IsValid(key)) return Discard();
+                loader_keys.push_back(key);
+            } else {
+                break;
+            }
+        }
+        return pixel_keys.size() + loader_keys.size();
+    }
+
+    // Builds every loaded key into the caches on a pool of threads, in the
+    // background; the caches stay usable meanwhile
+    void Precompile(GXPixelPipelineCache& pipelines, GXVertexLoaderCache& loaders,
+                    size_t threads = std::max(1u, std::thread::hardware_concurrency() / 2)) {
+        Wait();
+        worker = std::thread([this, &pipelines, &loaders, threads] {
+            WorkStealingPool pool(threads);
+            size_t pixel_count = pixel_keys.size();
+            pool.ParallelFor(pixel_count + loader_keys.size(), [&](size_t i) {
+                if (i < pixel_count) pipelines.Precompile(pixel_keys[i]);
+                else loaders.Precompile(loader_keys[i - pixel_count]);
+            });
+        });
+    }
+
+    void Wait() {
+        if (worker.joinable()) worker.join();
+    }
+
+    // Writes every key now in the caches, replacing the file only once the
+    // new one is complete; returns the number of keys, or 0 on failure
+    size_t Save(const GXPixelPipelineCache& pipelines, const GXVertexLoaderCache& loaders) {
+        Wait();
+        std::vector<GXPixelPipelineKey> pixels = pipelines.GetKeys();
+        std::vector<GXVertexLoaderKey> vertex_loaders = loaders.GetKeys();
+        std::error_code error;
+        if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), error);
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            const uint32_t header[4] = {kGXShaderCacheMagic, kGXShaderCacheVersion, sizeof(GXPixelPipelineKey),
+                                        sizeof(GXVertexLoaderKey)};
+            file.write(reinterpret_cast<const char*>(header), sizeof(header));
+            // Keys Load would reject (formats the hardware does not define)
+            // are left out rather than poisoning the file
+            pixels.erase(std::remove_if(pixels.begin(), pixels.end(),
+                                        [](const GXPixelPipelineKey& key) { return !IsValid(key); }),
+                         pixels.end());
+            vertex_loaders.erase(std::remove_if(vertex_loaders.begin(), vertex_loaders.end(),
+                                                [](const GXVertexLoaderKey& key) { return !IsValid(key); }),
+                                 vertex_loaders.end());
+            for (const GXPixelPipelineKey& key : pixels) WriteRecord(file, kPixelPipeline, &key, sizeof(key));
+            for (const GXVertexLoaderKey& key : vertex_loaders) WriteRecord(file, kVertexLoader, &key, sizeof(key));
+            if (!file.flush()) return 0;
+        }
+        std::filesystem::rename(temporary, path, error);
+        return error ? 0 : pixels.size() + vertex_loaders.size();
+    }
+
+    const std::filesystem::path& GetPath() const { return path; }
+
+private:
+    std::filesystem::path path;
+    std::vector<GXPixelPipelineKey> pixel_keys;
+    std::vector<GXVertexLoaderKey> loader_keys;
+    std::thread worker;
+
+    size_t Discard() {
+        pixel_keys.clear();
+        loader_keys.clear();
+        return 0;
+    }
+
+    static bool IsBool(bool value) {
+        uint8_t byte;
+        std::memcpy(&byte, &value, 1);
+        return byte <= 1;
+    }
+
+    // Whether every field holds a value GXPixelPipelineKey's constructor
+    // could have produced: in range, and zero where it would be canonicalized
+    static bool IsValid(const GXPixelPipelineKey& key) {
+        const GXTevState& tev = key.tev;
+        if (!IsBool(key.z_enable) || !IsBool(key.z_update) || !IsBool(key.color_update) ||
+            !IsBool(key.alpha_update) || !IsBool(key.blend_enable) || key.z_func > kCompareAlways ||
+            key.blend_src > kBlendInvDstAlpha || key.blend_dst > kBlendInvDstAlpha ||
+            (!key.z_enable && (key.z_func || key.z_update)) ||
+            (!key.blend_enable && (key.blend_src || key.blend_dst))) {
+            return false;
+        }
+        if (tev.stages == 0 || tev.stages > kGXTevStages || tev.alpha_func0 > kCompareAlways ||
+            tev.alpha_func1 > kCompareAlways || tev.alpha_op > kAlphaOpXnor) {
+            return false;
+        }
+        for (int stage = 0; stage < kGXTevStages; ++stage) {
+            bool used = stage < tev.stages;
+            if (tev.color_env[stage] > (used ? 0xFFFFFFu : 0) || tev.alpha_env[stage] > (used ? 0xFFFFFFu : 0) ||
+                tev.konst_color[stage] > (used ? 0x1F : 0) || tev.konst_alpha[stage] > (used ? 0x1F : 0)) {
+                return false;
+            }
+            bool samples = used && GXTevReadsTexture(tev.color_env[stage], tev.alpha_env[stage]);
+            if (tev.tex_order[stage] && (!samples || (tev.tex_order[stage] & ~7) != kGXTexOrderEnable)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether every present attribute uses a component or color format the
+    // hardware defines; the loader reads any other value as the last one
+    static bool IsValid(const GXVertexLoaderKey& key) {
+        GXVertexFormat format = MakeVertexFormat(key.regs[0], key.regs[1], key.regs[2], key.regs[3], key.regs[4]);
+        auto valid = [](const GXVertexAttribute& attribute, uint8_t last) {
+            return attribute.type == kAttrNone || attribute.format <= last;
+        };
+        if (!valid(format.position, kCompF32) || !valid(format.normal, kCompF32)) return false;
+        for (const GXVertexAttribute& color : format.color) {
+            if (!valid(color, kColorRGBA8888)) return false;
+        }
+        for (const GXVertexAttribute& texcoord : format.texcoord) {
+            if (!valid(texcoord, kCompF32)) return false;
+        }
+        return true;
+    }
+
+    static bool ReadRecord(std::ifstream& file, uint8_t kind, void* key, size_t size) {
+        uint64_t checksum;
+        return file.read(static_cast<char*>(key), static_cast<std::streamsize>(size)) &&
+               file.read(reinterpret_cast<char*>(&checksum), sizeof(checksum)) &&
+               checksum == XXHash64(key, size, kind);
+    }
+
+    static void WriteRecord(std::ofstream& file, uint8_t kind, const void* key, size_t size) {
+        uint64_t checksum = XXHash64(key, size, kind);
+        file.write(reinterpret_cast<const char*>(&kind), 1);
+        file.write(static_cast<const char*>(key), static_cast<std::streamsize>(size));
+        file.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    }
+};
+
+// A display list pre-parsed into register loads and draws over decoded
+// vertices. Decoding depended on the CP registers in cp_inputs (those read
+// before the list itself wrote them) and on the indexed array bytes in
+// arrays; a replay is only valid while both are unchanged.
+struct GXDisplayList {
+    enum Kind : uint8_t { kLoadCP, kLoadXF, kLoadIndexedXF, kLoadBP, kDraw };
+
+    struct Command {
+        Kind kind;
+        uint8_t primitive;      // kDraw
+        uint16_t reg;           // CP register, XF address, indexed-XF slot or kDraw loader flags
+        uint32_t value;         // Register value, or first vertex for kDraw
+        uint32_t count;         // kDraw vertex count
+    };
+
+    struct ArrayRange {
+        uint32_t address;
+        uint32_t size;
+        uint64_t version;
+    };
+
+    uint64_t version = 0;       // Page versions over the list when recorded
+    uint64_t content_hash = 0;
+    std::vector<Command> commands;
+    GXVertexStreams vertices;
+    std::vector<std::pair<uint8_t, uint32_t>> cp_inputs;
+    std::vector<ArrayRange> arrays;
+
+    size_t GetBytes() const {
+        return sizeof(*this) + commands.size() * sizeof(Command) +
+               vertices.Size() * (kVertexChannels * sizeof(float) + 1) + cp_inputs.size() * sizeof(cp_inputs[0]) +
+               arrays.size() * sizeof(ArrayRange);
+    }
+};
+
+// GX Pipeline
+// CP, XF and BP register state and the interpreter that turns the command
+// stream into SWRenderer triangles: vertices are decoded from the stream or
+// their arrays by the loader for their format, transformed by the current
+// position matrix, projection and viewport, and assembled into triangles.
+// Every draw whose TEV stages sample texture maps looks them up in the
+// texture cache first, so texture data rewritten since the last draw is
+// picked up; color-indexed maps stay unbound, as TLUT loads are not
+// modelled. Culling, clipping (triangles behind the eye are dropped) and
+// lines/points are not modelled yet. Everything here belongs
+// to the thread consuming the FIFO; draw-done and token events are
+// published through atomics for the CPU side to turn into interrupts.
+//
+// Display lists are recorded the first time they are called and replayed
+// from the recording afterwards, skipping command parsing and vertex
+// decoding. A recording is checked against the page versions of the list
+// (rehashing only if they moved) and of the arrays it decoded from.
+constexpr size_t kDisplayListCacheBudget = 64 * 1024 * 1024;
+
+class GXPipeline {
+public:
+    struct Stats {
+        uint64_t commands = 0;
+        uint64_t draws = 0;
+        uint64_t vertices = 0;
+        uint64_t triangles = 0;
+        uint64_t display_lists = 0;
+        uint64_t display_list_replays = 0;  // Calls served from a recording
+        uint64_t xfb_copies = 0;
+        uint64_t texture_copies = 0;
+        uint64_t unknown_opcodes = 0;
+    };
+
+    GXPipeline(Memory& memory, SWRenderer& renderer, bool jit = true)
+        : memory(memory), renderer(renderer), texture_cache(memory), vertex_loaders(jit) {
+        // Raster state as GXInit leaves it, matching GXRasterState's defaults
+        bp_regs[kBPZMode] = 1 | (kCompareLEqual << 1) | (1 << 4);
+        bp_regs[kBPBlendMode] = (1 << 3) | (1 << 4) | (kBlendInvSrcAlpha << 5) | (kBlendSrcAlpha << 8);
+        bp_regs[kBPScissorTL] = kGXScreenOffset << 12 | kGXScreenOffset;
+        bp_regs[kBPScissorBR] = (kGXScreenOffset + kEFBWidth - 1) << 12 | (kGXScreenOffset + kEFBHeight - 1);
+        bp_regs[kBPScissorOffset] = (kGXScreenOffset / 2) << 10 | (kGXScreenOffset / 2);
+        bp_regs[kBPTevColorEnv] = kTevPassColorEnv;
+        bp_regs[kBPTevColorEnv + 1] = kTevPassAlphaEnv;
+        bp_regs[kBPAlphaCompare] = kCompareAlways << 16 | kCompareAlways << 19;
+        bp_regs[kBPCopyFilter0] = 21 << 12 | 22 << 18;     // Filter off: the row itself, 21 + 22 + 21
+        bp_regs[kBPCopyFilter1] = 21;
+        UpdateRasterState();
+    }
+
+    // Runs every complete command at the start of data and returns the bytes
+    // consumed; a trailing partial command is left for the next call
+    size_t Execute(const uint8_t* data, size_t size) {
+        size_t position = 0;
+        while (position < size) {
+            const uint8_t* command = data + position;
+            size_t available = size - position;
+            size_t length = CommandLength(command, available);
+            if (length == 0 || length > available) {
+                break;
+            }
+            RunCommand(command);
+            ++stats.commands;
+            position += length;
+        }
+        return position;
+    }
+
+    // Register state for savestates. Vertex loaders, the transform setup and
+    // the raster state are derived from it again on load.
+    struct Registers {
+        uint32_t cp_regs[0x100];
+        uint32_t xf_memory[kXFMemoryWords];
+        uint32_t xf_regs[kXFRegisterCount];
+        uint32_t bp_regs[0x100];
+        uint32_t bp_mask;
+        int16_t tev_regs[4][4];
+        uint8_t tev_konst[4][4];
+        uint32_t finish_count;
+        uint32_t token_interrupts;
+        uint16_t token;
+    };
+
+    void SaveRegisters(Registers& out) const {
+        std::memcpy(out.cp_regs, cp_regs, sizeof(cp_regs));
+        std::memcpy(out.xf_memory, xf_memory, sizeof(xf_memory));
+        std::memcpy(out.xf_regs, xf_regs, sizeof(xf_regs));
+        std::memcpy(out.bp_regs, bp_regs, sizeof(bp_regs));
+        out.bp_mask = bp_mask;
+        std::memcpy(out.tev_regs, tev_regs, sizeof(tev_regs));
+        std::memcpy(out.tev_konst, tev_konst, sizeof(tev_konst));
+        out.finish_count = finish_count.load(std::memory_order_relaxed);
+        out.token_interrupts = token_interrupts.load(std::memory_order_relaxed);
+        out.token = token.load(std::memory_order_relaxed);
+    }
+
+    void LoadRegisters(const Registers& in) {
+        std::memcpy(cp_regs, in.cp_regs, sizeof(cp_regs));
+        std::memcpy(xf_memory, in.xf_memory, sizeof(xf_memory));
+        std::memcpy(xf_regs, in.xf_regs, sizeof(xf_regs));
+        std::memcpy(bp_regs, in.bp_regs, sizeof(bp_regs));
+        bp_mask = in.bp_mask;
+        std::memcpy(tev_regs, in.tev_regs, sizeof(tev_regs));
+        std::memcpy(tev_konst, in.tev_konst, sizeof(tev_konst));
+        finish_count.store(in.finish_count, std::memory_order_relaxed);
+        token_interrupts.store(in.token_interrupts, std::memory_order_relaxed);
+        token.store(in.token, std::memory_order_relaxed);
+        std::fill(std::begin(vat_loaders), std::end(vat_loaders), nullptr);
+        std::fill(std::begin(loader_arrays.base), std::end(loader_arrays.base), nullptr);
+        xf_changed = true;
+        UpdateRasterState();
+    }
+
+    void SetDisplayListCacheEnabled(bool enabled) {
+        display_list_cache_enabled = enabled;
+        display_lists.clear();
+        display_list_bytes = 0;
+    }
+
+    void SetSimdLevel(SimdLevel level) { transform = GXTransformKernelFor(level); }
+
+    // Keeps texture copies on the host in store, where the texture fetch
+    // reads them; without one they are encoded into guest RAM as they
+    // execute (the reference path)
+    void SetEFBCopyStore(EFBCopyStore* store) {
+        efb_copies = store;
+        texture_cache.SetEFBCopyStore(store);
+    }
+
+    const Stats& GetStats() const { return stats; }
+    GXVertexLoaderCache::Stats GetVertexLoaderStats() const { return vertex_loaders.GetStats(); }
+    GXVertexLoaderCache& GetVertexLoaders() { return vertex_loaders; }
+    TextureCache& GetTextureCache() { return texture_cache; }
+    uint32_t GetFinishCount() const { return finish_count.load(std::memory_order_acquire); }
+    uint32_t GetTokenInterruptCount() const { return token_interrupts.load(std::memory_order_acquire); }
+    uint16_t GetToken() const { return token.load(std::memory_order_acquire); }
+
+private:
+    Memory& memory;
+    SWRenderer& renderer;
+    EFBCopyStore* efb_copies = nullptr;
+    TextureCache texture_cache;
+    uint32_t cp_regs[0x100] = {};
+    uint32_t xf_memory[kXFMemoryWords] = {};
+    uint32_t xf_regs[kXFRegisterCount] = {};
+    uint32_t bp_regs[0x100] = {};
+    uint32_t bp_mask = 0xFFFFFF;
+    int16_t tev_regs[4][4] = {};        // PREV, C0-C2, RGBA; share BP addresses with tev_konst
+    uint8_t tev_konst[4][4] = {};       // K0-K3, RGBA
+    bool in_display_list = false;
+    GXVertexStreams decoded;
+    std::vector<GXVertex> vertices;
+    std::vector<uint8_t> visible;
+    GXTransformKernel transform = GXTransformKernelFor(HostSimdLevel());
+    GXTransformSetup transform_setup;
+    bool xf_changed = true;             // transform_setup is stale
+    Stats stats;
+    std::atomic<uint32_t> finish_count{0};
+    std::atomic<uint32_t> token_interrupts{0};
+    std::atomic<uint16_t> token{0};
+
+    // Vertex loaders, with the one for each VAT resolved until VCD/VAT change
+    GXVertexLoaderCache vertex_loaders;
+    const GXVertexLoader* vat_loaders[8] = {};
+    GXLoaderArrays loader_arrays = {};
+    uint32_t loader_array_base[kLoaderArrays] = {}, loader_array_reach[kLoaderArrays] = {};
+
+    // Display list cache, keyed by address << 32 | size
+    bool display_list_cache_enabled = true;
+    std::unordered_map<uint64_t, GXDisplayList> display_lists;
+    size_t display_list_bytes = 0;
+    GXDisplayList* recording = nullptr;
+    uint8_t cp_written[0x100] = {};     // While recording: CP registers the list loaded
+    uint32_t array_min[16] = {}, array_max[16] = {};
+
+    // CP register read on behalf of vertex decoding; while recording, values
+    // from outside the list become inputs of the recording
+    uint32_t ReadCP(uint8_t reg) {
+        if (recording && !cp_written[reg]) {
+            cp_written[reg] = 1;
+            recording->cp_inputs.emplace_back(reg, cp_regs[reg]);
+        }
+        return cp_regs[reg];
+    }
+
+    void SetCP(uint8_t reg, uint32_t value) {
+        cp_regs[reg] = value;
+        if (reg >= kCPVCDLo && reg < kCPArrayBase) {
+            std::fill(std::begin(vat_loaders), std::end(vat_loaders), nullptr);
+        }
+    }
+
+    void LoadCP(uint8_t reg, uint32_t value) {
+        SetCP(reg, value);
+        if (recording) {
+            cp_written[reg] = 1;
+            recording->commands.push_back({GXDisplayList::kLoadCP, 0, reg, value, 0});
+        }
+    }
+
+    const GXVertexLoader& GetVertexLoader(int vat) {
+        GXVertexLoaderKey key = {{ReadCP(kCPVCDLo), ReadCP(kCPVCDHi), ReadCP(kCPVATA + vat), ReadCP(kCPVATB + vat),
+                                  ReadCP(kCPVATC + vat)}};
+        if (!vat_loaders[vat]) {
+            vat_loaders[vat] = &vertex_loaders.Get(key);
+        }
+        return *vat_loaders[vat];
+    }
+
+    // Length of the command at data, or 0 if not even its header is present
+    size_t CommandLength(const uint8_t* data, size_t available) {
+        uint8_t opcode = data[0];
+        if (opcode & 0x80) {
+            if (available < 3) return 0;
+            return 3 + static_cast<size_t>(LoadBigEndian<uint16_t>(data + 1)) * GetVertexLoader(opcode & 7).GetFormat().stride;
+        }
+        switch (opcode) {
+            case kGXLoadCPReg: return 6;
+            case kGXLoadXFReg:
+                if (available < 5) return 0;
+                return 5 + 4 * (((LoadBigEndian<uint32_t>(data + 1) >> 16) & 0xF) + 1);
+            case kGXLoadIndexA: case kGXLoadIndexB: case kGXLoadIndexC: case kGXLoadIndexD: return 5;
+            case kGXCallDisplayList: return 9;
+            case kGXLoadBPReg: return 5;
+            default: return 1;
+        }
+    }
+
+    void RunCommand(const uint8_t* data) {
+        uint8_t opcode = data[0];
+        if (opcode & 0x80) {
+            Draw(opcode & 0xF8, GetVertexLoader(opcode & 7), data + 3, LoadBigEndian<uint16_t>(data + 1));
+            return;
+        }
+        switch (opcode) {
+            case kGXNop:
+            case kGXInvalidateVertexCache:
+                break;
+            case kGXLoadCPReg:
+                LoadCP(data[1], LoadBigEndian<uint32_t>(data + 2));
+                break;
+            case kGXLoadXFReg: {
+                uint32_t header = LoadBigEndian<uint32_t>(data + 1);
+                uint32_t count = ((header >> 16) & 0xF) + 1;
+                for (uint32_t i = 0; i < count; ++i) {
+                    uint32_t address = (header & 0xFFFF) + i, value = LoadBigEndian<uint32_t>(data + 5 + i * 4);
+                    LoadXF(address, value);
+                    if (recording) {
+                        recording->commands.push_back({GXDisplayList::kLoadXF, 0, static_cast<uint16_t>(address),
+                                                       value, 0});
+                    }
+                }
+                break;
+            }
+            case kGXLoadIndexA: case kGXLoadIndexB: case kGXLoadIndexC: case kGXLoadIndexD: {
+                uint16_t slot = (opcode - kGXLoadIndexA) >> 3;
+                uint32_t value = LoadBigEndian<uint32_t>(data + 1);
+                LoadIndexedXF(slot, value);
+                if (recording) {
+                    recording->commands.push_back({GXDisplayList::kLoadIndexedXF, 0, slot, value, 0});
+                }
+                break;
+            }
+            case kGXCallDisplayList:
+                CallDisplayList(LoadBigEndian<uint32_t>(data + 1), LoadBigEndian<uint32_t>(data + 5));
+                break;
+            case kGXLoadBPReg: {
+                uint32_t value = LoadBigEndian<uint32_t>(data + 1);
+                LoadBP(value);
+                if (recording) {
+                    recording->commands.push_back({GXDisplayList::kLoadBP, 0, 0, value, 0});
+                }
+                break;
+            }
+            default:
+                ++stats.unknown_opcodes;
+                break;
+        }
+    }
+
+    void LoadXF(uint32_t address, uint32_t value) {
+        xf_changed = true;
+        if (address < kXFMemoryWords) {
+            xf_memory[address] = value;
+        } else if (address - kXFRegisterBase < kXFRegisterCount) {
+            xf_regs[address - kXFRegisterBase] = value;
+        }
+    }
+
+    // LOAD_INDX: index << 16 | (words - 1) << 12 | XF address, read through
+    // the indexed-XF array slots. Replays read the array again, so these
+    // are not inputs of a recording.
+    void LoadIndexedXF(int slot, uint32_t value) {
+        uint32_t words = ((value >> 12) & 0xF) + 1;
+        uint32_t address = cp_regs[kCPArrayBase + kArrayIndexedXF + slot] +
+                           (value >> 16) * cp_regs[kCPArrayStride + kArrayIndexedXF + slot];
+        uint8_t data[16 * 4];
+        ReadGuest(address, data, words * 4);
+        for (uint32_t i = 0; i < words; ++i) {
+            LoadXF((value & 0xFFF) + i, LoadBigEndian<uint32_t>(data + i * 4));
+        }
+    }
+
+    // Display lists cannot nest; a call inside one is ignored as on hardware
+    void CallDisplayList(uint32_t address, uint32_t size) {
+        if (in_display_list) {
+            return;
+        }
+        const uint8_t* list = memory.GetContiguousRange(address, size);
+        if (!list) {
+            return;
+        }
+        ++stats.display_lists;
+        in_display_list = true;
+        if (!display_list_cache_enabled) {
+            Execute(list, size);
+        } else if (GXDisplayList* cached = FindDisplayList(address, size, list)) {
+            Replay(*cached);
+            ++stats.display_list_replays;
+        } else {
+            Record(address, size, list);
+        }
+        in_display_list = false;
+    }
+
+    // The recording for a list if it is still valid for the current state
+    GXDisplayList* FindDisplayList(uint32_t address, uint32_t size, const uint8_t* list) {
+        auto it = display_lists.find(static_cast<uint64_t>(address) << 32 | size);
+        if (it == display_lists.end()) {
+            return nullptr;
+        }
+        GXDisplayList& entry = it->second;
+        uint64_t version = memory.RangeVersion(address, size);
+        if (version != entry.version) {
+            if (XXHash64(list, size) != entry.content_hash) {
+                return nullptr;
+            }
+            entry.version = version;
+        }
+        for (const auto& input : entry.cp_inputs) {
+            if (cp_regs[input.first] != input.second) return nullptr;
+        }
+        for (const GXDisplayList::ArrayRange& range : entry.arrays) {
+            if (memory.RangeVersion(range.address, range.size) != range.version) return nullptr;
+        }
+        return &entry;
+    }
+
+    // Executes the list while capturing it
+    void Record(uint32_t address, uint32_t size, const uint8_t* list) {
+        uint64_t key = static_cast<uint64_t>(address) << 32 | size;
+        auto existing = display_lists.find(key);
+        if (existing != display_lists.end()) {
+            display_list_bytes -= existing->second.GetBytes();
+            display_lists.erase(existing);
+        }
+        if (display_list_bytes > kDisplayListCacheBudget) {
+            display_lists.clear();      // Rare enough that recording afresh beats tracking age
+            display_list_bytes = 0;
+        }
+
+        GXDisplayList& entry = display_lists[key];
+        entry.version = memory.RangeVersion(address, size);
+        entry.content_hash = XXHash64(list, size);
+        std::memset(cp_written, 0, sizeof(cp_written));
+        std::fill(std::begin(array_min), std::end(array_min), UINT32_MAX);
+        std::fill(std::begin(array_max), std::end(array_max), 0);
+        recording = &entry;
+        Execute(list, size);
+        recording = nullptr;
+
+        for (int slot = 0; slot < 16; ++slot) {
+            if (array_min[slot] < array_max[slot]) {
+                uint32_t range_size = array_max[slot] - array_min[slot];
+                entry.arrays.push_back({array_min[slot], range_size, memory.RangeVersion(array_min[slot], range_size)});
+            }
+        }
+        display_list_bytes += entry.GetBytes();
+    }
+
+    void Replay(const GXDisplayList& list) {
+        for (const GXDisplayList::Command& command : list.commands) {
+            switch (command.kind) {
+                case GXDisplayList::kLoadCP: SetCP(static_cast<uint8_t>(command.reg), command.value); break;
+                case GXDisplayList::kLoadXF: LoadXF(command.reg, command.value); break;
+                case GXDisplayList::kLoadIndexedXF: LoadIndexedXF(command.reg, command.value); break;
+                case GXDisplayList::kLoadBP: LoadBP(command.value); break;
+                case GXDisplayList::kDraw:
+                    ++stats.draws;
+                    stats.vertices += command.count;
+                    DrawDecoded(command.primitive, static_cast<uint8_t>(command.reg), list.vertices, command.value,
+                                command.count);
+                    break;
+            }
+        }
+        stats.commands += list.commands.size();
+    }
+
+    void LoadBP(uint32_t command) {
+        uint8_t reg = static_cast<uint8_t>(command >> 24);
+        uint32_t value = command & 0xFFFFFF;
+        if (reg == kBPMask) {
+            bp_mask = value;
+            return;
+        }
+        bp_regs[reg] = (bp_regs[reg] & ~bp_mask) | (value & bp_mask);
+        bp_mask = 0xFFFFFF;
+        value = bp_regs[reg];
+
+        switch (reg) {
+            case kBPScissorTL:
+            case kBPScissorBR:
+            case kBPScissorOffset:
+            case kBPZMode:
+            case kBPBlendMode:
+            case kBPGenMode:
+            case kBPAlphaCompare:
+                UpdateRasterState();
+                break;
+            case kBPDrawDone:
+                renderer.Flush();
+                finish_count.fetch_add(1, std::memory_order_release);
+                break;
+            case kBPToken:
+                token.store(static_cast<uint16_t>(value), std::memory_order_release);
+                break;
+            case kBPTokenInt:
+                token.store(static_cast<uint16_t>(value), std::memory_order_release);
+                token_interrupts.fetch_add(1, std::memory_order_release);
+                break;
+            case kBPCopyExecute:
+                if (value & (1u << 14)) {
+                    CopyToXFB(value);
+                } else {
+                    CopyToTexture(value);
+                }
+                // The whole EFB is cleared, not just the copied rectangle
+                if (value & (1u << 11)) {
+                    uint32_t ar = bp_regs[kBPClearAR], gb = bp_regs[kBPClearGB];
+                    int rgba[4] = {static_cast<int>(ar & 0xFF), static_cast<int>((gb >> 8) & 0xFF),
+                                   static_cast<int>(gb & 0xFF), static_cast<int>((ar >> 8) & 0xFF)};
+                    renderer.Clear(PackRGBA(rgba), bp_regs[kBPClearZ] & kGXMaxDepth);
+                }
+                break;
+            default:
+                if (reg >= kBPTevRegister && reg < kBPTevRegister + 8) {
+                    LoadTevRegister(reg, value);
+                    UpdateRasterState();
+                } else if ((reg >= kBPTevColorEnv && reg < kBPTevColorEnv + 2 * kGXTevStages) ||
+                           (reg >= kBPTevKSel && reg < kBPTevKSel + kGXTevStages / 2) ||
+                           (reg >= kBPTevOrder && reg < kBPTevOrder + kGXTevStages / 2)) {
+                    UpdateRasterState();
+                }
+                break;
+        }
+    }
+
+    // Display copy (PE_COPY_EXECUTE with bit 14 set) of the source rectangle
+    // to YUYV rows in guest RAM. Bits 0/1 clamp the filter at the top and
+    // bottom edges and bits 7-8 pick the gamma. Vertical scaling
+    // (DISP_COPY_Y_SCALE) is not modelled: the copy is 1:1. As on hardware,
+    // the CPU waits for the copy (draw done) before VI reads the XFB.
+    void CopyToXFB(uint32_t execute) {
+        uint32_t tl = bp_regs[kBPCopySrcTL], wh = bp_regs[kBPCopySrcWH];
+        int x = tl & 0x3FF, y = (tl >> 10) & 0x3FF;
+        int width = static_cast<int>(wh & 0x3FF) + 1, height = static_cast<int>((wh >> 10) & 0x3FF) + 1;
+        uint32_t address = (bp_regs[kBPCopyDstBase] & 0xFFFFFF) << 5;
+        size_t stride = static_cast<size_t>(bp_regs[kBPCopyDstStride] & 0x3FF) * 32;
+        uint32_t bytes = static_cast<uint32_t>(stride * (height - 1)) + width * 2;
+        uint8_t* dst = memory.GetContiguousRange(address, bytes);
+        if (!dst || stride < static_cast<size_t>(width) * 2) {
+            return;
+        }
+        auto coefficient = [](uint32_t reg, int index) { return static_cast<uint16_t>((reg >> (6 * index)) & 0x3F); };
+        uint32_t filter0 = bp_regs[kBPCopyFilter0], filter1 = bp_regs[kBPCopyFilter1];
+        GXCopyFilter filter;
+        filter.weights[0] = coefficient(filter0, 0) + coefficient(filter0, 1);
+        filter.weights[1] = coefficient(filter0, 2) + coefficient(filter0, 3) + coefficient(filter1, 0);
+        filter.weights[2] = coefficient(filter1, 1) + coefficient(filter1, 2);
+        filter.gamma = (execute >> 7) & 3;
+        filter.clamp_top = execute & 1;
+        filter.clamp_bottom = execute & 2;
+        renderer.CopyToXFB(x, y, width, height, filter, dst, stride);
+        memory.MarkDirty(address, bytes);
+        ++stats.xfb_copies;
+    }
+
+    // Texture copy (PE_COPY_EXECUTE with bit 14 clear) of the source
+    // rectangle. Bits 3-6 give the target format, bit 9 halves the size with
+    // a box filter and bit 15 converts to intensity. Z copies and the
+    // formats GXCopyTextureFormat does not know are not modelled.
+    void CopyToTexture(uint32_t execute) {
+        uint32_t tl = bp_regs[kBPCopySrcTL], wh = bp_regs[kBPCopySrcWH];
+        int x = std::min<int>(tl & 0x3FF, kEFBWidth), y = std::min<int>((tl >> 10) & 0x3FF, kEFBHeight);
+        int width = std::min(static_cast<int>(wh & 0x3FF) + 1, kEFBWidth - x);
+        int height = std::min(static_cast<int>((wh >> 10) & 0x3FF) + 1, kEFBHeight - y);
+        uint8_t copy_format = static_cast<uint8_t>(((execute >> 3) & 0xF) >> 1 | ((execute >> 3) & 1) << 3);
+        int format = GXCopyTextureFormat(copy_format);
+        bool half = execute & (1u << 9);
+        int texture_width = half ? width / 2 : width, texture_height = half ? height / 2 : height;
+        if (format < 0 || texture_width <= 0 || texture_height <= 0) {
+            return;
+        }
+        uint32_t address = (bp_regs[kBPCopyDstBase] & 0xFFFFFF) << 5;
+        size_t stride = static_cast<size_t>(bp_regs[kBPCopyDstStride] & 0x3FF) * 32;
+        const TextureFormatInfo* info = GetTextureFormatInfo(static_cast<uint8_t>(format));
+        if (stride < (texture_width + info->block_width - 1) / info->block_width * size_t{info->block_bytes}) {
+            return;
+        }
+        std::vector<uint32_t> texels(static_cast<size_t>(texture_width) * texture_height);
+        renderer.CopyRect(x, y, width, height, half, texels.data());
+        bool intensity = execute & (1u << 15);
+        for (uint32_t& texel : texels) {
+            texel = QuantizeCopyTexel(copy_format, intensity, texel);
+        }
+        ++stats.texture_copies;
+        uint8_t texture_format = static_cast<uint8_t>(format);
+        if (efb_copies &&
+            efb_copies->Add(address, texture_format, stride, texture_width, texture_height, std::move(texels))) {
+            return;
+        }
+        uint32_t size = static_cast<uint32_t>(CopyTextureSize(texture_format, stride, texture_height));
+        uint8_t* dst = memory.GetContiguousRange(address, size);
+        if (dst) {
+            EncodeCopyTexture(dst, stride, texels.data(), texture_format, texture_width, texture_height);
+            memory.MarkDirty(address, size);
+        }
+    }
+
+    // Even registers hold red and alpha, odd ones blue and green, 11 bits
+    // each; bit 23 picks the konst color instead of the TEV register
+    void LoadTevRegister(uint8_t reg, uint32_t value) {
+        int index = (reg - kBPTevRegister) / 2;
+        bool blue_green = (reg - kBPTevRegister) & 1;
+        int low = blue_green ? 2 : 0, high = blue_green ? 1 : 3;
+        if (value & (1u << 23)) {
+            tev_konst[index][low] = static_cast<uint8_t>(value & 0xFF);
+            tev_konst[index][high] = static_cast<uint8_t>((value >> 12) & 0xFF);
+        } else {
+            auto extend = [](uint32_t bits) { return static_cast<int16_t>(static_cast<int32_t>(bits << 21) >> 21); };
+            tev_regs[index][low] = extend(value & 0x7FF);
+            tev_regs[index][high] = extend((value >> 12) & 0x7FF);
+        }
+    }
+
+    // The konst input a KCSEL (alpha: KASEL) value selects for a channel
+    uint8_t KonstValue(uint8_t select, int channel) const {
+        static const uint8_t kFractions[8] = {255, 223, 191, 159, 128, 96, 64, 32};
+        if (select < 8) return kFractions[select];
+        if (select >= 0x10) return tev_konst[(select - 0x10) & 3][(select - 0x10) >> 2];
+        if (select >= 0x0C && channel < 3) return tev_konst[select - 0x0C][channel];
+        return 0;
+    }
+
+    void UpdateRasterState() {
+        GXRasterState state;
+        uint32_t zmode = bp_regs[kBPZMode];
+        state.z_enable = zmode & 1;
+        state.z_func = (zmode >> 1) & 7;
+        state.z_update = (zmode >> 4) & 1;
+        uint32_t blend = bp_regs[kBPBlendMode];
+        state.blend_enable = blend & 1;
+        state.color_update = (blend >> 3) & 1;
+        state.alpha_update = (blend >> 4) & 1;
+        state.blend_dst = (blend >> 5) & 7;
+        state.blend_src = (blend >> 8) & 7;
+
+        uint32_t tl = bp_regs[kBPScissorTL], br = bp_regs[kBPScissorBR], offset = bp_regs[kBPScissorOffset];
+        int offset_x = static_cast<int>(offset & 0x3FF) * 2, offset_y = static_cast<int>((offset >> 10) & 0x3FF) * 2;
+        auto clamp = [](int value, int limit) { return static_cast<int16_t>(std::clamp(value, 0, limit - 1)); };
+        state.scissor_x0 = clamp(static_cast<int>((tl >> 12) & 0x7FF) - offset_x, kEFBWidth);
+        state.scissor_y0 = clamp(static_cast<int>(tl & 0x7FF) - offset_y, kEFBHeight);
+        state.scissor_x1 = clamp(static_cast<int>((br >> 12) & 0x7FF) - offset_x, kEFBWidth);
+        state.scissor_y1 = clamp(static_cast<int>(br & 0x7FF) - offset_y, kEFBHeight);
+
+        GXTevState& tev = state.tev;
+        GXTevConstants& constants = state.tev_constants;
+        tev.stages = static_cast<uint8_t>(((bp_regs[kBPGenMode] >> 10) & 0xF) + 1);
+        for (int stage = 0; stage < tev.stages; ++stage) {
+            tev.color_env[stage] = bp_regs[kBPTevColorEnv + 2 * stage];
+            tev.alpha_env[stage] = bp_regs[kBPTevColorEnv + 2 * stage + 1];
+            uint32_t ksel = bp_regs[kBPTevKSel + stage / 2] >> (stage & 1 ? 14 : 4);
+            tev.konst_color[stage] = ksel & 0x1F;
+            tev.konst_alpha[stage] = (ksel >> 5) & 0x1F;
+            uint32_t order = bp_regs[kBPTevOrder + stage / 2] >> (stage & 1 ? 12 : 0);
+            tev.tex_order[stage] = static_cast<uint8_t>((order & 7) | (order & (1u << 6) ? kGXTexOrderEnable : 0));
+            for (int c = 0; c < 3; ++c) constants.konst[stage][c] = KonstValue(tev.konst_color[stage], c);
+            constants.konst[stage][3] = KonstValue(tev.konst_alpha[stage], 3);
+        }
+        uint32_t alpha = bp_regs[kBPAlphaCompare];
+        tev.alpha_func0 = (alpha >> 16) & 7;
+        tev.alpha_func1 = (alpha >> 19) & 7;
+        tev.alpha_op = (alpha >> 22) & 3;
+        constants.alpha_ref[0] = alpha & 0xFF;
+        constants.alpha_ref[1] = (alpha >> 8) & 0xFF;
+        for (int r = 0; r < 4; ++r) {
+            std::copy(std::begin(tev_regs[r]), std::end(tev_regs[r]), std::begin(constants.regs[r]));
+        }
+        renderer.SetState(state);
+    }
+
+    // The BP register of a texture map's group starting at reg for map 0
+    static uint8_t TexRegister(uint8_t reg, int map) { return static_cast<uint8_t>(reg + (map & 3) + (map & 4) * 8); }
+
+    // Hands the renderer the maps the current TEV stages sample
+    void BindTextures() {
+        const GXTevState& tev = renderer.GetState().tev;
+        GXTextureMaps maps;
+        for (int stage = 0; stage < tev.stages; ++stage) {
+            int map = tev.tex_order[stage] & (kGXTexMaps - 1);
+            if (!(tev.tex_order[stage] & kGXTexOrderEnable) || maps[map].texture ||
+                !GXTevReadsTexture(tev.color_env[stage], tev.alpha_env[stage])) {
+                continue;
+            }
+            uint32_t image = bp_regs[TexRegister(kBPTexImage0, map)];
+            uint8_t format = static_cast<uint8_t>((image >> 20) & 0xF);
+            const TextureFormatInfo* info = GetTextureFormatInfo(format);
+            if (!info || info->palette_entries) {
+                continue;
+            }
+            uint32_t address = (bp_regs[TexRegister(kBPTexImage3, map)] & 0xFFFFFF) << 5;
+            int width = static_cast<int>(image & 0x3FF) + 1, height = static_cast<int>((image >> 10) & 0x3FF) + 1;
+            uint32_t mode = bp_regs[TexRegister(kBPTexMode0, map)];
+            maps[map].texture = texture_cache.Get(address, format, width, height);
+            maps[map].wrap_s = mode & 3;
+            maps[map].wrap_t = (mode >> 2) & 3;
+        }
+        renderer.SetTextures(maps);
+    }
+
+    // Copies guest bytes, or zeros if the range is not RAM
+    void ReadGuest(uint32_t address, uint8_t* dst, uint32_t size) const {
+        const uint8_t* src = memory.GetContiguousRange(address, size);
+        if (src) std::memcpy(dst, src, size);
+        else std::memset(dst, 0, size);
+    }
+
+    // Points the loader at the arrays it indexes. The bytes available behind
+    // each base are only re-measured when the base or the reach changes.
+    void PrepareLoaderArrays(const GXVertexLoader& loader) {
+        loader_arrays.zero = kGXZeroAttribute;
+        for (int a = 0; a < kLoaderArrays; ++a) {
+            uint32_t size = loader.GetArrayDataSize(a);
+            if (size == 0) continue;
+            uint8_t slot = kGXLoaderArraySlot[a];
+            uint32_t base = ReadCP(kCPArrayBase + slot), stride = ReadCP(kCPArrayStride + slot);
+            uint32_t reach = 0xFFFF * stride + size;
+            if (base != loader_array_base[a] || reach > loader_array_reach[a] || !loader_arrays.base[a]) {
+                uint32_t bytes = memory.ContiguousBytes(base, reach);
+                loader_arrays.base[a] = bytes ? memory.GetPointer(base) : kGXZeroAttribute;
+                loader_array_base[a] = base;
+                loader_array_reach[a] = reach;
+                loader_arrays.limit[a] = bytes >= size ? bytes - size + 1 : 0;
+            }
+            loader_arrays.stride[a] = stride;
+            loader_arrays.min[a] = UINT32_MAX;
+            loader_arrays.max[a] = 0;
+        }
+    }
+
+    void Draw(uint8_t primitive, const GXVertexLoader& loader, const uint8_t* data, uint32_t count) {
+        ++stats.draws;
+        stats.vertices += count;
+        if (primitive >= kGXDrawLines) {
+            return;
+        }
+        GXVertexStreams& target = recording ? recording->vertices : decoded;
+        size_t first = recording ? target.Size() : 0;
+        target.Resize(first + count);
+        GXLoaderOutput out;
+        for (int c = 0; c < kVertexChannels; ++c) out.channel[c] = target.channel[c].data() + first;
+        out.matrix = target.matrix.data() + first;
+        PrepareLoaderArrays(loader);
+        loader.Load(data, count, out, loader_arrays);
+        if (recording) {
+            for (int a = 0; a < kLoaderArrays; ++a) {
+                if (!loader.GetArrayDataSize(a) || loader_arrays.min[a] > loader_arrays.max[a]) continue;
+                uint8_t slot = kGXLoaderArraySlot[a];
+                uint32_t base = cp_regs[kCPArrayBase + slot];
+                array_min[slot] = std::min(array_min[slot], base + loader_arrays.min[a]);
+                array_max[slot] = std::max(array_max[slot], base + loader_arrays.max[a] + loader.GetArrayDataSize(a));
+            }
+            recording->commands.push_back({GXDisplayList::kDraw, primitive, loader.GetFlags(),
+                                           static_cast<uint32_t>(first), count});
+        }
+        DrawDecoded(primitive, loader.GetFlags(), target, first, count);
+    }
+
+    void DrawDecoded(uint8_t primitive, uint8_t flags, const GXVertexStreams& input, size_t first, uint32_t count) {
+        vertices.resize(count);
+        visible.resize(count);
+        if (xf_changed) {
+            transform_setup = MakeTransformSetup(xf_memory, xf_regs);
+            xf_changed = false;
+        }
+        transform_setup.flags = flags;
+        transform(transform_setup, input, first, count, vertices.data(), visible.data());
+        BindTextures();
+        auto triangle = [&](uint32_t a, uint32_t b, uint32_t c) {
+            if (visible[a] && visible[b] && visible[c]) {
+                renderer.DrawTriangle(vertices[a], vertices[b], vertices[c]);
+                ++stats.triangles;
+            }
+        };
+        switch (primitive) {
+            case kGXDrawQuads:
+            case kGXDrawQuads2:
+                for (uint32_t i = 0; i + 3 < count; i += 4) {
+                    triangle(i, i + 1, i + 2);
+                    triangle(i, i + 2, i + 3);
+                }
+                break;
+            case kGXDrawTriangles:
+                for (uint32_t i = 0; i + 2 < count; i += 3) triangle(i, i + 1, i + 2);
+                break;
+            case kGXDrawTriangleStrip:
+                for (uint32_t i = 2; i < count; ++i) {
+                    if (i & 1) triangle(i - 1, i - 2, i);
+                    else triangle(i - 2, i - 1, i);
+                }
+                break;
+            case kGXDrawTriangleFan:
+                for (uint32_t i = 2; i < count; ++i) triangle(0, i - 1, i);
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+// Lock-free single-producer/single-consumer byte ring. Head and tail are
+// running byte counts on separate cache lines; the capacity is a power of two.
+class SPSCByteRing {
+public:
+    explicit SPSCByteRing(size_t capacity)
+        : buffer(std::make_unique<uint8_t[]>(capacity)), mask(capacity - 1) {
+        if (capacity == 0 || (capacity & mask)) {
+            throw std::invalid_argument("SPSCByteRing capacity must be a power of two.");
+        }
+    }
+
+    // Producer: copies up to size bytes in, returns how many fit
+    size_t Write(const uint8_t* src, size_t size) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t free_bytes = mask + 1 - (h - tail.load(std::memory_order_acquire));
+        size = std::min(size, free_bytes);
+        size_t first = std::min(size, mask + 1 - (h & mask));
+        std::memcpy(buffer.get() + (h & mask), src, first);
+        std::memcpy(buffer.get(), src + first, size - first);
+        head.store(h + size, std::memory_order_seq_cst);
+        return size;
+    }
+
+    // Consumer: copies up to size bytes out, returns how many were read
+    size_t Read(uint8_t* dst, size_t size) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size = std::min(size, head.load(std::memory_order_acquire) - t);
+        size_t first = std::min(size, mask + 1 - (t & mask));
+        std::memcpy(dst, buffer.get() + (t & mask), first);
+        std::memcpy(dst + first, buffer.get(), size - first);
+        tail.store(t + size, std::memory_order_release);
+        return size;
+    }
+
+    size_t GetReadable() const {
+        return head.load(std::memory_order_seq_cst) - tail.load(std::memory_order_acquire);
+    }
+
+    uint64_t GetTotalWritten() const { return head.load(std::memory_order_acquire); }
+    size_t GetCapacity() const { return mask + 1; }
+
+private:
+    std::unique_ptr<uint8_t[]> buffer;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};    // Written by the producer
+    alignas(64) std::atomic<size_t> tail{0};    // Written by the consumer
+};
+
+// GX Command Processor
+// The CP FIFO is a host SPSC ring: gather pipe bursts from the CPU thread go
+// straight into it while the GP is linked, and a dedicated GPU thread drains
+// it through GXPipeline. When the GP is unlinked (display list recording)
+// the bursts land in guest RAM at the PI write pointer instead. On the CPU
+// thread, Update runs every kGPSliceCycles to publish the FIFO distance,
+// latch the high/low watermark flags and raise CP and PE interrupts. In
+// deterministic mode there is no GPU thread: Update drains the ring itself,
+// so commands execute at the same guest time on every run.
+constexpr size_t kGPFifoRingSize = 1u << 20;
+constexpr uint64_t kGPSliceCycles = 20000;
+constexpr uint32_t kPIFifoWrap = 0x04000000;    // PI_FIFO_WPTR wrapped past FIFO_END
+
+class GXCommandProcessor {
+public:
+    GXCommandProcessor(Hardware& hardware, SWRenderer& renderer, bool threaded, bool jit = true,
+                       EFBCopyStore* efb_copies = nullptr)
+        : hardware(hardware), pipeline(hardware.memory, renderer, jit), ring(kGPFifoRingSize), threaded(threaded),
+          efb_copies(efb_copies) {
+        pipeline.SetEFBCopyStore(efb_copies);
+        if (threaded) {
+            gpu_thread = std::thread([this] { RunGPUThread(); });
+        }
+    }
+
+    ~GXCommandProcessor() {
+        if (gpu_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex);
+                stop.store(true);
+            }
+            wake.notify_one();
+            gpu_thread.join();
+        }
+    }
+
+    GXCommandProcessor(const GXCommandProcessor&) = delete;
+    GXCommandProcessor& operator=(const GXCommandProcessor&) = delete;
+
+    // CPU thread: one burst from the gather pipe
+    void WriteBurst(const uint8_t* burst) {
+        AdvanceWritePointer(burst);
+        if (!(hardware.cp.cr & CommandProcessorInterface::kCRLinkEnable)) {
+            return;
+        }
+        // The commands may read anything the CPU has stored so far
+        hardware.memory.PublishWrites();
+        const uint8_t* data = burst;
+        size_t size = kGatherPipeBurst;
+        bytes_written += size;
+        while (size) {
+            size_t written = ring.Write(data, size);
+            data += written;
+            size -= written;
+            if (written) Wake();
+            if (size) {
+                // Full: wait for the GPU thread, or run the GP inline
+                if (threaded) std::this_thread::yield();
+                else Consume();
+            }
+        }
+    }
+
+    // CPU thread, every kGPSliceCycles
+    void Update() {
+        if (!threaded) {
+            Consume();
+        }
+        CommandProcessorInterface& cp = hardware.cp;
+        uint32_t distance = static_cast<uint32_t>(ring.GetReadable());
+        cp.distance = distance;
+        cp.write_ptr = hardware.pi.fifo_write & ~kPIFifoWrap;
+        uint32_t fifo_size = cp.fifo_end > cp.fifo_base ? cp.fifo_end - cp.fifo_base : 0;
+        cp.read_ptr = fifo_size ? cp.fifo_base + (cp.write_ptr - cp.fifo_base + fifo_size - distance % fifo_size) % fifo_size
+                                : cp.write_ptr;
+
+        uint16_t idle = CommandProcessorInterface::kSRReadIdle | CommandProcessorInterface::kSRCommandIdle;
+        cp.sr = static_cast<uint16_t>(cp.sr & ~idle);
+        if (distance == 0) cp.sr |= CommandProcessorInterface::kSRReadIdle;
+        if (completed.load(std::memory_order_acquire) == ring.GetTotalWritten()) {
+            cp.sr |= CommandProcessorInterface::kSRCommandIdle;
+        }
+        uint16_t linked = CommandProcessorInterface::kCRReadEnable | CommandProcessorInterface::kCRLinkEnable;
+        if ((cp.cr & linked) == linked) {
+            if (distance > cp.hi_watermark) cp.sr |= CommandProcessorInterface::kSROverflow;
+            if (distance < cp.lo_watermark) cp.sr |= CommandProcessorInterface::kSRUnderflow;
+        }
+        bool cp_interrupt = ((cp.sr & CommandProcessorInterface::kSROverflow) &&
+                             (cp.cr & CommandProcessorInterface::kCROverflowIntEnable)) ||
+                            ((cp.sr & CommandProcessorInterface::kSRUnderflow) &&
+                             (cp.cr & CommandProcessorInterface::kCRUnderflowIntEnable));
+        hardware.pi.SetInterrupt(ProcessorInterface::kIntCP, cp_interrupt);
+
+        PixelEngineInterface& pe = hardware.pe;
+        uint32_t finishes = pipeline.GetFinishCount();
+        if (finishes != seen_finishes) {
+            seen_finishes = finishes;
+            pe.ctrl |= PixelEngineInterface::kCtrlFinishFlag;
+        }
+        uint32_t tokens = pipeline.GetTokenInterruptCount();
+        if (tokens != seen_tokens) {
+            seen_tokens = tokens;
+            pe.ctrl |= PixelEngineInterface::kCtrlTokenFlag;
+        }
+        pe.token = pipeline.GetToken();
+        hardware.pi.SetInterrupt(ProcessorInterface::kIntPEFinish,
+                                 (pe.ctrl & PixelEngineInterface::kCtrlFinishFlag) &&
+                                 (pe.ctrl & PixelEngineInterface::kCtrlFinishEnable));
+        hardware.pi.SetInterrupt(ProcessorInterface::kIntPEToken,
+                                 (pe.ctrl & PixelEngineInterface::kCtrlTokenFlag) &&
+                                 (pe.ctrl & PixelEngineInterface::kCtrlTokenEnable));
+        // Every copy the state above reflects is in the store by now
+        if (efb_copies) {
+            efb_copies->ApplyProtection();
+        }
+    }
+
+    // CPU thread: returns once every byte written so far has been executed,
+    // after which the renderer and pipeline stats may be used from this thread
+    // and every page version is current
+    void Sync() {
+        hardware.memory.PublishWrites();
+        if (!threaded) {
+            Consume();
+        } else {
+            uint64_t target = ring.GetTotalWritten();
+            while (completed.load(std::memory_order_acquire) < target) {
+                std::this_thread::yield();
+            }
+        }
+        if (efb_copies) {
+            efb_copies->ApplyProtection();
+        }
+    }
+
+    // Everything the FIFO has left behind once synced: the pipeline's
+    // registers, a trailing partial command and the PE counters already
+    // reported. Only valid between Sync and the next WriteBurst.
+    struct State {
+        GXPipeline::Registers registers;
+        std::vector<uint8_t> staging;
+        uint32_t seen_finishes = 0;
+        uint32_t seen_tokens = 0;
+    };
+
+    void SaveState(State& state) const {
+        pipeline.SaveRegisters(state.registers);
+        state.staging = staging;
+        state.seen_finishes = seen_finishes;
+        state.seen_tokens = seen_tokens;
+    }
+
+    void LoadState(const State& state) {
+        pipeline.LoadRegisters(state.registers);
+        staging = state.staging;
+        seen_finishes = state.seen_finishes;
+        seen_tokens = state.seen_tokens;
+    }
+
+    bool IsThreaded() const { return threaded; }
+    uint64_t GetBytesWritten() const { return bytes_written; }
+    const GXPipeline::Stats& GetPipelineStats() const { return pipeline.GetStats(); }
+    GXVertexLoaderCache::Stats GetVertexLoaderStats() const { return pipeline.GetVertexLoaderStats(); }
+    GXVertexLoaderCache& GetVertexLoaders() { return pipeline.GetVertexLoaders(); }
+    TextureCache& GetTextureCache() { return pipeline.GetTextureCache(); }   // Only between Sync and WriteBurst
+
+private:
+    Hardware& hardware;
+    GXPipeline pipeline;
+    SPSCByteRing ring;
+    bool threaded;
+    EFBCopyStore* efb_copies;
+    uint64_t bytes_written = 0;
+    uint32_t seen_finishes = 0;
+    uint32_t seen_tokens = 0;
+
+    // Consumer side
+    std::vector<uint8_t> staging;       // Read from the ring, not yet executed
+    std::atomic<uint64_t> completed{0}; // Ring bytes read and executed
+
+    std::thread gpu_thread;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<bool> stop{false};
+    std::atomic<bool> sleeping{false};
+
+    // Moves PI_FIFO_WPTR one burst through [FIFO_BASE, FIFO_END] (the last
+    // burst inclusive), storing the burst there when it is not going to the GP
+    void AdvanceWritePointer(const uint8_t* burst) {
+        ProcessorInterface& pi = hardware.pi;
+        if (pi.fifo_end <= pi.fifo_base) {
+            return;
+        }
+        uint32_t pointer = pi.fifo_write & ~kPIFifoWrap;
+        uint32_t wrap = pi.fifo_write & kPIFifoWrap;
+        if (!(hardware.cp.cr & CommandProcessorInterface::kCRLinkEnable)) {
+            hardware.dma.WriteToGuest(pointer, burst, kGatherPipeBurst, SwapWidth::kNone);
+        }
+        pointer += kGatherPipeBurst;
+        if (pointer > pi.fifo_end) {
+            pointer = pi.fifo_base;
+            wrap = kPIFifoWrap;
+        }
+        pi.fifo_write = pointer | wrap;
+    }
+
+    void Wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            wake.notify_one();
+        }
+    }
+
+    // Consumer: executes what is in the ring; false if it was empty
+    bool Consume() {
+        size_t available = ring.GetReadable();
+        if (available == 0) {
+            return false;
+        }
+        size_t pending = staging.size();
+        staging.resize(pending + available);
+        ring.Read(staging.data() + pending, available);
+        size_t used = pipeline.Execute(staging.data(), staging.size());
+        staging.erase(staging.begin(), staging.begin() + static_cast<std::ptrdiff_t>(used));
+        completed.fetch_add(available, std::memory_order_release);
+        return true;
+    }
+
+    void RunGPUThread() {
+        while (true) {
+            if (Consume()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            sleeping.store(true, std::memory_order_seq_cst);
+            wake.wait(lock, [this] { return stop.load() || ring.GetReadable() > 0; });
+            sleeping.store(false, std::memory_order_relaxed);
+            if (stop.load() && ring.GetReadable() == 0) {
+                return;
+            }
+        }
+    }
+};
+
+// Savestates
+// An in-memory snapshot of everything the guest can observe, taken at a VI
+// frame boundary so run-ahead can rewind several times per frame. RAM is
+// copied incrementally against the page write versions: a capture copies
+// only the pages written since the previous capture, and a restore copies
+// back only the pages written since this one, bumping their versions so the
+// texture and display list caches notice. Device registers, the scheduler,
+// the GX registers and the EFB are copied whole, a few MB in all.
+//
+// The caller syncs the GPU first, and only captures while IOS is idle, as
+// host file I/O cannot be rewound. EFB copies still pending are saved as they
+// are, texels shared, and put back on restore, so run-ahead leaves them
+// unwritten just as a plain run does.
+class Savestate {
+public:
+    struct Stats {
+        uint64_t captures = 0;
+        uint64_t restores = 0;
+        uint64_t pages_saved = 0;
+        uint64_t pages_restored = 0;
+    };
+
+    Savestate(EmulatorContext& context, GXCommandProcessor& gx, SWRenderer& renderer, GatherPipe& gather_pipe,
+              EFBCopyStore* efb_copies = nullptr)
+        : context(context), gx(gx), renderer(renderer), gather_pipe(gather_pipe), efb_copies(efb_copies),
+          ram(std::make_unique<uint8_t[]>(kMemorySize)), versions(kRamPages) {}
+
+    Savestate(const Savestate&) = delete;
+    Savestate& operator=(const Savestate&) = delete;
+
+    // Returns false, taking nothing, while events posted by host threads are
+    // still on their way into the scheduler
+    bool Capture() {
+        if (context.scheduler.HasPendingFromThreads()) {
+            return false;
+        }
+        gx.Sync();
+        if (efb_copies) {
+            efb_copies->SavePending(copies);
+        }
+        const uint8_t* source = context.memory.GetRam();
+        for (uint32_t page = 0; page < kRamPages; ++page) {
+            uint32_t version = context.memory.GetPageVersion(page);
+            if (!valid || versions[page] != version) {
+                std::memcpy(ram.get() + static_cast<size_t>(page) * kPageSize,
+                            source + static_cast<size_t>(page) * kPageSize, kPageSize);
+                versions[page] = version;
+                ++stats.pages_saved;
+            }
+        }
+        valid = true;
+        cpu = context.cpu;
+        SaveHardware();
+        context.scheduler.SaveState(scheduler);
+        gx.SaveState(gpu);
+        renderer.SaveEFB(efb);
+        gather_pipe.SavePending(gather);
+        ++stats.captures;
+        return true;
+    }
+
+    // Rewinds to the last capture; the host's request to stop running survives
+    void Restore() {
+        if (!valid) {
+            return;
+        }
+        gx.Sync();
+        if (efb_copies) {
+            efb_copies->LoadPending(copies);
+        }
+        uint8_t* target = context.memory.GetRam();
+        for (uint32_t page = 0; page < kRamPages; ++page) {
+            if (context.memory.GetPageVersion(page) != versions[page]) {
+                std::memcpy(target + static_cast<size_t>(page) * kPageSize,
+                            ram.get() + static_cast<size_t>(page) * kPageSize, kPageSize);
+                context.memory.MarkRamPageDirty(page);
+                versions[page] = context.memory.GetPageVersion(page);
+                ++stats.pages_restored;
+            }
+        }
+        bool running = context.cpu.running;
+        context.cpu = cpu;
+        context.cpu.running = running;
+        LoadHardware();
+        context.scheduler.LoadState(scheduler);
+        gx.LoadState(gpu);
+        renderer.LoadEFB(efb);
+        gather_pipe.LoadPending(gather);
+        ++stats.restores;
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    EmulatorContext& context;
+    GXCommandProcessor& gx;
+    SWRenderer& renderer;
+    GatherPipe& gather_pipe;
+    EFBCopyStore* efb_copies;
+
+    bool valid = false;
+    std::unique_ptr<uint8_t[]> ram;     // Every RAM page as of its version below
+    std::vector<uint32_t> versions;
+    CPUState cpu;
+    CommandProcessorInterface cp;
+    PixelEngineInterface pe;
+    ProcessorInterface pi;
+    VideoInterface vi;
+    MemoryInterface mi;
+    DSPInterface dsp;
+    DVDInterface di;
+    SerialInterface si;
+    ExternalInterface exi;
+    AudioInterface ai;
+    IPCInterface ipc;
+    GPIOInterface gpio;
+    Scheduler::State scheduler;
+    GXCommandProcessor::State gpu;
+    std::vector<SWRenderer::EFBTile> efb;
+    GatherPipe::Pending gather;
+    EFBCopyStore::Pending copies;
+    Stats stats;
+
+    // Register blocks only; MMIO dispatch and the DMA engine hold no guest state
+    void SaveHardware() {
+        const Hardware& hardware = context.hardware;
+        cp = hardware.cp;
+        pe = hardware.pe;
+        pi = hardware.pi;
+        vi = hardware.vi;
+        mi = hardware.mi;
+        dsp = hardware.dsp;
+        di = hardware.di;
+        si = hardware.si;
+        exi = hardware.exi;
+        ai = hardware.ai;
+        ipc = hardware.ipc;
+        gpio = hardware.gpio;
+    }
+
+    void LoadHardware() {
+        Hardware& hardware = context.hardware;
+        hardware.cp = cp;
+        hardware.pe = pe;
+        hardware.pi = pi;
+        hardware.vi = vi;
+        hardware.mi = mi;
+        hardware.dsp = dsp;
+        hardware.di = di;
+        hardware.si = si;
+        hardware.exi = exi;
+        hardware.ai = ai;
+        hardware.ipc = ipc;
+        hardware.gpio = gpio;
+    }
+};
+
+// SDL2 Wrapper Class for Resource Management
+class SDLWrapper {
+public:
+    SDLWrapper() : window(nullptr), renderer(nullptr), framebuffer_texture(nullptr), width(0), height(0) {}
+
+    ~SDLWrapper() {
+        Cleanup();
+    }
+
+    void Initialize(const char* title, int width, int height) {
+        if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS) < 0) {
+            throw std::runtime_error("SDL could not initialize! SDL_Error: " + std::string(SDL_GetError()));
+        }
+
+        window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                  width, height, SDL_WINDOW_SHOWN);
+        if (!window) {
+            throw std::runtime_error("Window could not be created! SDL_Error: " + std::string(SDL_GetError()));
+        }
+        this->width = width;
+        this->height = height;
+    }
+
+    // Creates the renderer and streaming texture. An SDL renderer belongs to
+    // the thread that created it, so this runs on the presenting thread, as
+    // do LockFramebuffer, Present and DestroyRenderer.
+    void CreateRenderer() {
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+        if (!renderer) {
+            throw std::runtime_error("Renderer could not be created! SDL_Error: " + std::string(SDL_GetError()));
+        }
+
+        framebuffer_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                                               SDL_TEXTUREACCESS_STREAMING, width, height);
+        if (!framebuffer_texture) {
+            throw std::runtime_error("Framebuffer texture could not be created! SDL_Error: " + std::string(SDL_GetError()));
+        }
+    }
+
+    // The streaming texture's width x height RGBA8888 pixels, rows pitch
+    // bytes apart, to be written in place until Present; nullptr on failure
+    uint8_t* LockFramebuffer(int& pitch) {
+        void* pixels = nullptr;
+        if (SDL_LockTexture(framebuffer_texture, nullptr, &pixels, &pitch) != 0) {
+            std::cerr << "SDL_LockTexture Error: " << SDL_GetError() << "\n";
+            return nullptr;
+        }
+        return static_cast<uint8_t*>(pixels);
+    }
+
+    // Unlocks the texture written since LockFramebuffer and presents it
+    void Present() {
+        SDL_UnlockTexture(framebuffer_texture);
+        if (SDL_RenderCopy(renderer, framebuffer_texture, nullptr, nullptr) != 0) {
+            std::cerr << "SDL_RenderCopy Error: " << SDL_GetError() << "\n";
+            return;
+        }
+        SDL_RenderPresent(renderer);
+    }
+
+    void HandleEvents(bool& running) {
+        SDL_Event e;
+        while (SDL_PollEvent(&e) != 0) {
+            if (e.type == SDL_QUIT) {
+                running = false;
+            }
+            // Handle other input events here
+        }
+    }
+
+    void DestroyRenderer() {
+        if (framebuffer_texture) {
+            SDL_DestroyTexture(framebuffer_texture);
+            framebuffer_texture = nullptr;
+        }
+        if (renderer) {
+            SDL_DestroyRenderer(renderer);
+            renderer = nullptr;
+        }
+    }
+
+    void Cleanup() {
+        DestroyRenderer();
+        if (window) {
+            SDL_DestroyWindow(window);
+            window = nullptr;
+        }
+        SDL_Quit();
+    }
+
+private:
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    SDL_Texture* framebuffer_texture;
+    int width;
+    int height;
+};
+
+// Frame Presentation
+// VI hands finished frames to a presenter thread through a triple buffer.
+// The producer always owns one buffer; publishing swaps it with the middle
+// slot, and the presenter takes the middle slot in exchange for its own
+// whenever it holds a frame it has not shown. Neither side waits for the
+// other: a frame the presenter did not get to is replaced, never queued,
+// so a slow display costs dropped frames rather than emulation speed.
+// Frames travel as raw YUYV XFB rows; the presenter decodes them straight
+// into the locked SDL texture, so a frame is copied once on each side.
+template <typename Frame>
+class TripleBuffer {
+public:
+    // Producer: the buffer to fill next
+    Frame& GetBack() { return buffers[back]; }
+
+    // Producer: hands the back buffer over, replacing an unshown frame
+    void Publish() {
+        back = middle.exchange(static_cast<uint8_t>(back | kFresh), std::memory_order_acq_rel) & kIndexMask;
+    }
+
+    // Consumer: the newest published frame, or nullptr if it has already
+    // been taken; valid until the next call
+    const Frame* Acquire() {
+        if (!(middle.load(std::memory_order_acquire) & kFresh)) {
+            return nullptr;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & kIndexMask;
+        return &buffers[front];
+    }
+
+private:
+    static constexpr uint8_t kIndexMask = 3;
+    static constexpr uint8_t kFresh = 4;    // The middle slot holds a frame not yet acquired
+
+    std::array<Frame, 3> buffers;
+    std::atomic<uint8_t> middle{1};
+    uint8_t back = 0;       // Producer only
+    uint8_t front = 2;      // Consumer only
+};
+
+class FramePresenter {
+public:
+    // Starts the presenter thread and returns once it owns an SDL renderer;
+    // a renderer that cannot be created throws here
+    FramePresenter(SDLWrapper& sdl, int width, int height, XFBDecodeKernel decode)
+        : sdl(sdl), width(width), height(height), decode(decode) {
+        std::promise<void> ready;
+        std::future<void> started = ready.get_future();
+        thread = std::thread([this, &ready] { Run(ready); });
+        try {
+            started.get();
+        } catch (...) {
+            thread.join();
+            throw;
+        }
+    }
+
+    ~FramePresenter() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stop = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    FramePresenter(const FramePresenter&) = delete;
+    FramePresenter& operator=(const FramePresenter&) = delete;
+
+    // Emulation thread: the frame to fill
+    ScanoutFrame& GetBackFrame() { return frames.GetBack(); }
+
+    // Emulation thread: queues the filled frame for display
+    void Publish() {
+        frames.Publish();
+        ++published;
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            pending = true;
+        }
+        wake.notify_one();
+    }
+
+    uint64_t GetPublishedCount() const { return published; }
+    uint64_t GetPresentedCount() const { return presented.load(std::memory_order_relaxed); }
+
+private:
+    SDLWrapper& sdl;
+    int width;
+    int height;
+    XFBDecodeKernel decode;
+    TripleBuffer<ScanoutFrame> frames;
+    std::thread thread;
+    std::mutex wake_mutex;          // Guards only the wakeup, never a frame
+    std::condition_variable wake;
+    bool pending = false;
+    bool stop = false;
+    uint64_t published = 0;
+    std::atomic<uint64_t> presented{0};
+
+    void Run(std::promise<void>& ready) {
+        try {
+            sdl.CreateRenderer();
+        } catch (...) {
+            ready.set_exception(std::current_exception());
+            return;
+        }
+        ready.set_value();
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(wake_mutex);
+                wake.wait(lock, [this] { return pending || stop; });
+                if (stop) break;
+                pending = false;
+            }
+            if (const ScanoutFrame* frame = frames.Acquire()) {
+                Present(*frame);
+            }
+        }
+        sdl.DestroyRenderer();
+    }
+
+    void Present(const ScanoutFrame& frame) {
+        int pitch = 0;
+        uint8_t* pixels = sdl.LockFramebuffer(pitch);
+        if (!pixels) {
+            return;
+        }
+        if (frame.yuyv) {
+            ScanoutYUYV(frame.pixels.data(), static_cast<size_t>(frame.width) * 2, frame.width, frame.height,
+                        pixels, pitch, width, height, decode);
+        } else {
+            size_t row_bytes = static_cast<size_t>(std::min(width, frame.width)) * sizeof(uint32_t);
+            for (int y = 0; y < std::min(height, frame.height); ++y) {
+                std::memcpy(pixels + static_cast<size_t>(y) * pitch,
+                            frame.pixels.data() + static_cast<size_t>(y) * frame.width * sizeof(uint32_t), row_bytes);
+            }
+        }
+        sdl.Present();
+        presented.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Headless Video
+// With --headless there is no window, renderer or presenter thread, and SDL
+// is never initialized. Each VI frame is hashed instead of shown: the XFB in
+// RAM, or the EFB resolved into memory when the guest has no XFB. The hashes
+// go to an optional log, one "<frame> <hash>" line per frame, and fold into
+// a digest, so two runs compare with one line or diff to the first frame
+// that differs.
+class FrameHashLog {
+public:
+    // An empty path keeps only the count and the digest
+    explicit FrameHashLog(const std::string& path) {
+        if (!path.empty()) {
+            log.open(path, std::ios::trunc);
+            if (!log) {
+                throw std::runtime_error("Failed to open frame hash log: " + path);
+            }
+        }
+    }
+
+    void Record(uint64_t hash) {
+        if (log.is_open()) {
+            log << frames << ' ' << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << '\n';
+        }
+        digest = XXHash64(&hash, sizeof(hash), digest);
+        ++frames;
+    }
+
+    uint64_t GetFrameCount() const { return frames; }
+    uint64_t GetDigest() const { return digest; }
+
+private:
+    std::ofstream log;
+    uint64_t frames = 0;
+    uint64_t digest = 0;
+};
+
+// Frame Pacing
+// The emulation thread waits once per guest frame for an absolute deadline,
+// so rounding in one frame never carries into the next. Deadlines advance by
+// the VI frame period divided by the speed limit. The pacer sleeps with
+// clock_nanosleep(TIMER_ABSTIME) to kSpinWindow before the deadline, then
+// spins on the clock for the rest, because a timed sleep can wake a
+// scheduler quantum late. A host that falls more than kMaxLag behind
+// restarts the schedule from now rather than rushing to catch up.
+#if defined(__linux__)
+#define EMUWII_ABSOLUTE_SLEEP 1
+#include <cerrno>
+#include <time.h>
+#endif
+
+class FramePacer {
+public:
+    static constexpr int64_t kSpinWindow = 200000;      // ns
+    static constexpr int64_t kMaxLag = 50000000;        // ns
+    static constexpr int kJitterBuckets = 9;
+    static constexpr int64_t kJitterBounds[kJitterBuckets - 1] = {5, 20, 50, 100, 250, 500, 1000, 5000};    // us
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t resyncs = 0;                   // Schedule restarted after falling behind
+        int64_t max_jitter = 0;                 // ns
+        uint64_t jitter[kJitterBuckets] = {};   // |frame gap - period|, bucketed by kJitterBounds
+    };
+
+    // speed_percent is the limit relative to real time; 0 runs unlimited
+    explicit FramePacer(int speed_percent = 100) : speed(speed_percent) {}
+
+    void SetSpeed(int speed_percent) {
+        speed = speed_percent;
+        deadline = 0;
+    }
+
+    int GetSpeed() const { return speed; }
+
+    // Called at the end of every guest frame; returns at its deadline
+    void Pace(double frame_rate) {
+        int64_t now = Now();
+        ++stats.frames;
+        if (speed <= 0 || frame_rate <= 0) {
+            last_frame = now;
+            return;
+        }
+        int64_t period = static_cast<int64_t>(1e9 / frame_rate * 100.0 / speed);
+        if (deadline == 0 || now - deadline > kMaxLag) {
+            stats.resyncs += deadline != 0;
+            deadline = now;
+            last_frame = 0;
+        }
+        deadline += period;
+        if (deadline - now > kSpinWindow) {
+            SleepUntil(deadline - kSpinWindow);
+        }
+        while ((now = Now()) < deadline) {
+#ifdef EMUWII_X86_SIMD
+            _mm_pause();
+#endif
+        }
+        if (last_frame) {
+            int64_t jitter = std::abs(now - last_frame - period);
+            stats.max_jitter = std::max(stats.max_jitter, jitter);
+            int bucket = 0;
+            while (bucket < kJitterBuckets - 1 && jitter > kJitterBounds[bucket] * 1000) ++bucket;
+            ++stats.jitter[bucket];
+        }
+        last_frame = now;
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+    void DumpJitter(std::ostream& out) const {
+        uint64_t paced = 0;
+        for (uint64_t count : stats.jitter) paced += count;
+        out << "Frame pacing (" << (speed > 0 ? std::to_string(speed) + "%" : std::string("unlimited")) << "): "
+            << stats.frames << " frames, " << stats.resyncs << " resyncs, max jitter " << stats.max_jitter / 1000
+            << " us\n";
+        for (int i = 0; i < kJitterBuckets && paced; ++i) {
+            out << "  " << (i < kJitterBuckets - 1 ? "<= " + std::to_string(kJitterBounds[i]) + " us"
+                                                   : "> " + std::to_string(kJitterBounds[i - 1]) + " us")
+                << ": " << stats.jitter[i] << " (" << 100.0 * stats.jitter[i] / paced << "%)\n";
+        }
+    }
+
+    // Monotonic nanoseconds, on the clock SleepUntil waits on
+    static int64_t Now() {
+#ifdef EMUWII_ABSOLUTE_SLEEP
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static void SleepUntil(int64_t when) {
+#ifdef EMUWII_ABSOLUTE_SLEEP
+        timespec until{static_cast<time_t>(when / 1000000000), static_cast<long>(when % 1000000000)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR) {
+        }
+#else
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(when)));
+#endif
+    }
+
+private:
+    int speed;
+    int64_t deadline = 0;       // 0 until the first paced frame
+    int64_t last_frame = 0;
+    Stats stats;
+};
+
+// Kernel Dispatch Tables
+// Syscalls and HLE functions share one handler signature and are registered
+// at compile time. Each table is a constexpr array indexed directly by
+// syscall number or HLE function id, so dispatch is a single indexed load and
+// nothing is built at startup. Call counts and time live in separate stats
+// arrays.
+using KernelHandler = void(*)(EmulatorContext&);
+
+struct KernelFunction {
+    const char* name;
+    KernelHandler handler;
+};
+
+struct KernelStats {
+    uint64_t calls;
+    uint64_t nanoseconds;
+};
+
+void SyscallPrint(EmulatorContext& context);
+void SyscallExit(EmulatorContext& context);
+void HLEMemcpy(EmulatorContext& context);
+void HLEMemset(EmulatorContext& context);
+void HLECacheMaintenance(EmulatorContext& context);
+
+constexpr size_t kSyscallTableSize = 256;
+
+struct SyscallRegistration {
+    uint32_t number;
+    KernelFunction function;
+};
+
+constexpr SyscallRegistration kSyscallRegistrations[] = {
+    {0x01, {"Print", SyscallPrint}},    // Syscall 1: Print string at r3
+    {0x02, {"Exit", SyscallExit}},      // Syscall 2: Exit Emulator
+    // Add more syscalls as needed
+};
+
+constexpr std::array<KernelFunction, kSyscallTableSize> BuildSyscallTable() {
+    std::array<KernelFunction, kSyscallTableSize> table{};
+    for (const SyscallRegistration& registration : kSyscallRegistrations) {
+        if (registration.number >= kSyscallTableSize || table[registration.number].handler) {
+            throw std::logic_error("Invalid or duplicate syscall registration");
+        }
+        table[registration.number] = registration.function;
+    }
+    return table;
+}
+
+constexpr std::array<KernelFunction, kSyscallTableSize> syscall_table = BuildSyscallTable();
+std::array<KernelStats, kSyscallTableSize> syscall_stats{};
+
+// HLE function ids index this table directly; id 0 means "no hook"
+constexpr KernelFunction kHLEFunctions[] = {
+    {nullptr, nullptr},
+    {"memcpy", HLEMemcpy},
+    {"memset", HLEMemset},
+    {"DCFlushRange", HLECacheMaintenance},
+    {"DCInvalidateRange", HLECacheMaintenance},
+    {"DCStoreRange", HLECacheMaintenance},
+    {"DCFlushRangeNoSync", HLECacheMaintenance},
+    {"DCStoreRangeNoSync", HLECacheMaintenance},
+};
+constexpr size_t kHLEFunctionCount = sizeof(kHLEFunctions) / sizeof(kHLEFunctions[0]);
+static_assert(kHLEFunctionCount <= 256, "HLE function ids are 8 bits");
+std::array<KernelStats, kHLEFunctionCount> hle_stats{};
+
+// Guest PC -> HLE function id. A per-page slot index (zero for the vast
+// majority of pages) selects a flat id array with one byte per instruction,
+// so the per-instruction check never hashes.
+class HLEHookTable {
+public:
+    HLEHookTable() : page_slots(std::make_unique<uint16_t[]>(kNumPages)), slots(1) {}
+
+    void Add(uint32_t address, uint8_t id) {
+        uint16_t& slot = page_slots[address >> kPageShift];
+        if (!slot) {
+            if (slots.size() > 0xFFFF) {
+                throw std::runtime_error("Too many pages with HLE hooks.");
+            }
+            slot = static_cast<uint16_t>(slots.size());
+            slots.emplace_back();
+            slots.back().fill(0);
+        }
+        uint8_t& entry = slots[slot][(address & kPageMask) >> 2];
+        count += entry == 0;
+        entry = id;
+    }
+
+    uint8_t Lookup(uint32_t pc) const {
+        uint16_t slot = page_slots[pc >> kPageShift];
+        return slot ? slots[slot][(pc & kPageMask) >> 2] : 0;
+    }
+
+    size_t Size() const { return count; }
+
+private:
+    std::unique_ptr<uint16_t[]> page_slots;
+    std::vector<std::array<uint8_t, kPageSize / 4>> slots;
+    size_t count = 0;
+};
+
+HLEHookTable hle_hook_table;
+
+// Command Line Options
+struct EmulatorOptions {
+    std::string game_file = "default_game.iso";
+    std::string symbol_map;             // --symbols <file>: guest symbol map for HLE hooks
+    std::string nand_root = "nand";     // --nand <dir>: host directory backing the NAND
+    std::string cache_root = "cache";   // --cache <dir>: host directory for per-title shader caches
+    std::string benchmark;              // --bench <name|all>: run a benchmark and exit
+    bool deterministic = false;         // --deterministic: run the GP on the CPU thread
+    bool jit = true;                    // --no-jit: use the C++ fallbacks instead of generated code
+    int speed = 100;                    // --speed <percent|unlimited>: frame rate limit, 0 for none
+    int run_ahead = 0;                  // --run-ahead <frames>: show frames emulated this far ahead
+    bool headless = false;              // --headless: no SDL, hash each frame; unthrottled unless --speed
+    std::string frame_hashes;           // --frame-hashes <file>: log of the headless frame hashes
+    uint64_t frame_limit = 0;           // --frames <count>: stop after this many frames, 0 for no limit
+};
+
+// Function Prototypes
+EmulatorOptions ParseOptions(int argc, char* argv[]);
+bool RunBenchmarks(const std::string& name);
+bool InitializeWiiSubsystems();
+bool LoadGame(const std::string& filename, CPUState& state, Memory& memory);
+void TriggerInterrupt(int interrupt_type, CPUState& state);
+bool HandleStarletCommand(CPUState& state, Hardware& hardware, IOSKernel& ios);
+uint64_t TitleIDFromGameID(const std::string& game_id);
+void ExecuteInstruction(uint32_t instruction, EmulatorContext& context);
+bool IsSystemCall(uint32_t instruction);
+uint32_t FetchInstruction(const CPUState& state, const Memory& memory);
+uint32_t GetInterruptVector(int interrupt_type);
+void HandleSystemCall(uint32_t syscall_number, EmulatorContext& context);
+bool HandleHLEHook(EmulatorContext& context);
+void DumpKernelStats(std::ostream& out);
+size_t LoadHLESymbolMap(const std::string& filename);
+size_t ScanHLESignatures(const Memory& memory, uint32_t address, uint32_t size);
+
+// Helper Functions
+void SyscallPrint(EmulatorContext& context) {
+    CPUState& state = context.cpu;
+    uint32_t address = state.gpr[3]; // Assuming r3 holds the address of the string
+    std::string str;
+    try {
+        while (true) {
+            const uint8_t* byte = context.memory.GetPointer(address);
+            if (!byte) {
+                throw std::out_of_range("String read out of bounds.");
+            }
+            char c = static_cast<char>(*byte);
+            if (c == '\0') break;
+            str += c;
+            address++;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Syscall Print Error: " << e.what() << "\n";
+        state.running = false;
+        return;
+    }
+    std::cout << "Syscall Print: " << str << "\n";
+}
+
+void SyscallExit(EmulatorContext& context) {
+    std::cout << "Syscall Exit: Terminating Emulation.\n";
+    context.cpu.running = false;
+}
+
+// Runs a kernel function and accounts its call count and time
+static void CallKernelFunction(const KernelFunction& function, KernelStats& stats, EmulatorContext& context) {
+    auto start = std::chrono::steady_clock::now();
+    function.handler(context);
+    stats.nanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    ++stats.calls;
+}
+
+void DumpKernelStats(std::ostream& out) {
+    auto dump = [&out](const KernelFunction& function, const KernelStats& stats) {
+        if (stats.calls == 0) return;
+        out << "  " << function.name << ": " << stats.calls << " calls, "
+            << stats.nanoseconds / 1000 << " us total, "
+            << stats.nanoseconds / stats.calls << " ns/call\n";
+    };
+    for (size_t i = 0; i < kSyscallTableSize; ++i) dump(syscall_table[i], syscall_stats[i]);
+    for (size_t i = 1; i < kHLEFunctionCount; ++i) dump(kHLEFunctions[i], hle_stats[i]);
+}
+
+// HLE Implementations
+// Native replacements follow the PowerPC EABI: arguments in r3-r5, result in
+// r3, return through LR. Memory is accessed through the memory map so MMIO
+// and mirrors behave exactly as they would for the guest code.
+static void HLEReturn(CPUState& state) {
+    state.pc = state.spr[kSprLR];
+}
+
+void HLEMemcpy(EmulatorContext& context) {
+    CPUState& state = context.cpu;
+    uint32_t dst = state.gpr[3], src = state.gpr[4], size = state.gpr[5];
+    Memory& memory = context.memory;
+    if (memory.GetContiguousRange(dst, size) && memory.GetContiguousRange(src, size)) {
+        context.hardware.dma.CopyGuest(dst, src, size);
+    } else {
+        for (uint32_t i = 0; i < size; ++i) {
+            memory.Write<uint8_t>(dst + i, memory.Read<uint8_t>(src + i));
+        }
+    }
+    HLEReturn(state);   // r3 still holds dst
+}
+
+void HLEMemset(EmulatorContext& context) {
+    CPUState& state = context.cpu;
+    uint32_t dst = state.gpr[3], size = state.gpr[5];
+    uint8_t value = static_cast<uint8_t>(state.gpr[4]);
+    Memory& memory = context.memory;
+    if (memory.GetContiguousRange(dst, size)) {
+        context.hardware.dma.FillGuest(dst, value, size);
+    } else {
+        for (uint32_t i = 0; i < size; ++i) {
+            memory.Write<uint8_t>(dst + i, value);
+        }
+    }
+    HLEReturn(state);
+}
+
+// The data cache is not modelled: RAM is always coherent, and RAM-derived
+// caches track writes through page versions, so flush/invalidate loops can
+// return immediately.
+void HLECacheMaintenance(EmulatorContext& context) {
+    HLEReturn(context.cpu);
+}
+
+// Instruction signatures of SDK routines; a zero mask bit ignores that bit
+struct HLESignature {
+    const char* name;
+    std::vector<uint32_t> words;
+    std::vector<uint32_t> masks;
+};
+
+const HLESignature kHLESignatures[] = {
+    // cmplwi r4,0; blelr; clrlwi. r5,r3,27; beq +8; addi r4,r4,32; addi r4,r4,31;
+    // srwi r4,r4,5; mtctr r4; <dcbX r0,r3>; addi r3,r3,32; bdnz -8
+    {"DCFlushRange",
+     {0x28040000, 0x4C810020, 0x546506FF, 0x41820008, 0x38840020, 0x3884001F,
+      0x5484D97E, 0x7C8903A6, 0x7C0018AC, 0x38630020, 0x4200FFF8},
+     {}},
+    {"DCInvalidateRange",
+     {0x28040000, 0x4C810020, 0x546506FF, 0x41820008, 0x38840020, 0x3884001F,
+      0x5484D97E, 0x7C8903A6, 0x7C001BAC, 0x38630020, 0x4200FFF8},
+     {}},
+    {"DCStoreRange",
+     {0x28040000, 0x4C810020, 0x546506FF, 0x41820008, 0x38840020, 0x3884001F,
+      0x5484D97E, 0x7C8903A6, 0x7C00186C, 0x38630020, 0x4200FFF8},
+     {}},
+};
+
+// HLE function id for a symbol name, or 0 if it has no native replacement
+static uint8_t FindHLEFunction(const std::string& name) {
+    for (size_t id = 1; id < kHLEFunctionCount; ++id) {
+        if (name == kHLEFunctions[id].name) return static_cast<uint8_t>(id);
+    }
+    return 0;
+}
+
+// Reads a symbol map ("<address> [size vaddr align] <name>" per line, as
+// written by CodeWarrior and Dolphin) and hooks every known function name.
+size_t LoadHLESymbolMap(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Failed to open symbol map: " << filename << "\n";
+        return 0;
+    }
+    size_t hooked = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream tokens(line);
+        std::string address_token, token;
+        if (!(tokens >> address_token)) continue;
+        uint32_t address;
+        try {
+            address = static_cast<uint32_t>(std::stoul(address_token, nullptr, 16));
+        } catch (const std::exception&) {
+            continue;   // Section headers and comments
+        }
+        while (tokens >> token) {
+            if (uint8_t id = FindHLEFunction(token)) {
+                hle_hook_table.Add(address, id);
+                ++hooked;
+                break;
+            }
+        }
+    }
+    return hooked;
+}
+
+// Scans a guest code range for known SDK routines and hooks their entry points
+size_t ScanHLESignatures(const Memory& memory, uint32_t address, uint32_t size) {
+    const uint8_t* code = memory.GetContiguousRange(address, size);
+    if (!code) {
+        std::cerr << "HLE: signature scan range is not contiguous RAM\n";
+        return 0;
+    }
+    size_t hooked = 0;
+    for (const HLESignature& signature : kHLESignatures) {
+        uint8_t id = FindHLEFunction(signature.name);
+        size_t length = signature.words.size();
+        for (uint32_t offset = 0; offset + length * 4 <= size; offset += 4) {
+            bool match = true;
+            for (size_t i = 0; i < length && match; ++i) {
+                uint32_t mask = i < signature.masks.size() ? signature.masks[i] : 0xFFFFFFFF;
+                match = (LoadBigEndian<uint32_t>(code + offset + i * 4) & mask) == (signature.words[i] & mask);
+            }
+            if (match && id && !hle_hook_table.Lookup(address + offset)) {
+                hle_hook_table.Add(address + offset, id);
+                ++hooked;
+            }
+        }
+    }
+    return hooked;
+}
+
+// Runs the native replacement if the PC is at a hooked function entry
+bool HandleHLEHook(EmulatorContext& context) {
+    uint8_t id = hle_hook_table.Lookup(context.cpu.pc);
+    if (!id) {
+        return false;
+    }
+    CallKernelFunction(kHLEFunctions[id], hle_stats[id], context);
+    return true;
+}
+
+// Frame Runner
+// Runs the guest a frame at a time; the VI event sets frame_done at the start
+// of each frame. With run-ahead, each real frame is captured and followed by
+// `frames` speculative ones on the same input, the last of which is shown
+// before the capture is restored. A speculative frame stops short before
+// anything that cannot be rewound: an IPC submit, which IOS would act on, or
+// a syscall, which prints or exits. The real frame is shown instead, and the
+// syscall runs once when the real frames reach it.
+class FrameRunner {
+public:
+    struct Stats {
+        uint64_t ahead = 0;     // Shown from a full speculative run
+        uint64_t aborted = 0;   // Speculation cut short by IPC or a syscall
+        uint64_t behind = 0;    // Not captured: IOS busy or events in flight
+    };
+
+    // savestate is null without run-ahead
+    FrameRunner(EmulatorContext& context, IOSKernel& ios, bool& frame_done, Savestate* savestate = nullptr,
+                int frames = 0)
+        : context(context), ios(ios), frame_done(frame_done), savestate(savestate), frames(frames) {}
+
+    // Runs one real frame and presents it, or the last frame run ahead of it;
+    // false once the guest has stopped
+    template <typename EndFrame, typename Present>
+    bool Step(EndFrame&& end_frame, Present&& present) {
+        if (!RunFrame(false)) {
+            return false;
+        }
+        end_frame();
+        if (!savestate || !ios.IsIdle() || !savestate->Capture()) {
+            present();
+            stats.behind += savestate != nullptr;
+            return true;
+        }
+        int ahead = 0;
+        while (ahead < frames && RunFrame(true)) {
+            end_frame();
+            ++ahead;
+        }
+        if (ahead == frames) {
+            present();
+            ++stats.ahead;
+        }
+        savestate->Restore();
+        if (ahead < frames) {
+            present();
+            ++stats.aborted;
+        }
+        return true;
+    }
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    EmulatorContext& context;
+    IOSKernel& ios;
+    bool& frame_done;
+    Savestate* savestate;
+    int frames;
+    Stats stats;
+
+    // Runs the guest to the end of the frame; false if it stopped first
+    bool RunFrame(bool speculating) {
+        CPUState& cpu = context.cpu;
+        frame_done = false;
+        while (cpu.running && !frame_done) {
+            // Run a native replacement, or Fetch, Decode, and Execute Instruction
+            if (!HandleHLEHook(context)) {
+                uint32_t instruction = FetchInstruction(cpu, context.memory);
+                if (speculating && IsSystemCall(instruction)) {
+                    return false;
+                }
+                ExecuteInstruction(instruction, context);
+            }
+            context.scheduler.Advance(1);   // One cycle per instruction until the interpreter models timing
+
+            // Handle Starlet Commands
+            if (speculating && (context.hardware.ipc.ppcctrl & IPCInterface::kCtrlX1)) {
+                return false;
+            }
+            if (HandleStarletCommand(cpu, context.hardware, ios)) {
+                // Processed Starlet command
+            }
+        }
+        return frame_done;
+    }
+};
+
+// Main Function
+int main(int argc, char* argv[]) {
+    try {
+        EmulatorOptions options = ParseOptions(argc, argv);
+        if (!options.benchmark.empty()) {
+            return RunBenchmarks(options.benchmark) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        // Initialize SDL, unless running headless
+        std::unique_ptr<SDLWrapper> sdl;
+        if (!options.headless) {
+            sdl = std::make_unique<SDLWrapper>();
+            sdl->Initialize("Wii Emulator", kScreenWidth, kScreenHeight);
+        }
+
+        // Initialize Emulator Subsystems
+        if (!InitializeWiiSubsystems()) {
+            throw std::runtime_error("Failed to initialize Wii subsystems.");
+        }
+
+        // Initialize CPU and Memory
+        CPUState cpu_state;
+        Memory memory;
+        Hardware hardware(memory);
+        Scheduler scheduler;
+        EmulatorContext context{cpu_state, memory, hardware, scheduler};
+
+        // Load Game
+        if (!LoadGame(options.game_file, cpu_state, memory)) {
+            throw std::runtime_error("Failed to load game: " + options.game_file);
+        }
+
+        // IOS devices: NAND from a host directory, DI from the game image
+        DiscReader disc;
+        if (!disc.Open(options.game_file)) {
+            std::cerr << "IOS: disc image unavailable to /dev/di: " << options.game_file << "\n";
+        }
+        IOSKernel ios(memory, hardware.dma, scheduler, disc, options.nand_root, TitleIDFromGameID(disc.GetGameID()));
+
+        // Software GX renderer; VI scans the XFB out for the presenter thread when the guest swaps it
+        SWRenderer gx_renderer;
+        XFBDecodeKernel xfb_decode = XFBDecodeKernelFor(HostSimdLevel());
+        EFBCopyStore efb_copies(memory);
+        GXCommandProcessor gx(hardware, gx_renderer, !options.deterministic, options.jit, &efb_copies);
+        GXShaderCache shader_cache(GXShaderCache::PathFor(options.cache_root, disc.GetGameID()));
+        size_t cached_shaders = shader_cache.Load();
+        shader_cache.Precompile(gx_renderer.GetPipelineCache(), gx.GetVertexLoaders());
+        std::cout << "Shader cache: precompiling " << cached_shaders << " keys from " << shader_cache.GetPath() << "\n";
+        GatherPipe gather_pipe;
+        gather_pipe.SetBurstHandler([&gx](const uint8_t* burst) { gx.WriteBurst(burst); });
+        memory.AttachGatherPipe(&gather_pipe);
+        int gp_event = scheduler.RegisterEvent("GPFifo", [&](uint64_t, int64_t cycles_late) {
+            gx.Update();
+            if (hardware.pi.HasPendingInterrupt()) {
+                TriggerInterrupt(1, cpu_state);   // External interrupt, as for IPC
+            }
+            scheduler.ScheduleEvent(kGPSliceCycles - std::min<uint64_t>(cycles_late, kGPSliceCycles), gp_event);
+        });
+        scheduler.ScheduleEvent(kGPSliceCycles, gp_event);
+        // VI scanout, one event per line; the start of each top field ends a frame
+        bool frame_done = false;
+        int vi_event = scheduler.RegisterEvent("VIScanline", [&](uint64_t, int64_t cycles_late) {
+            VideoInterface& vi = hardware.vi;
+            if (vi.AdvanceLine() && !vi.IsBottomField()) {
+                frame_done = true;
+            }
+            hardware.pi.SetInterrupt(ProcessorInterface::kIntVI, vi.IsInterruptPending());
+            if (hardware.pi.HasPendingInterrupt()) {
+                TriggerInterrupt(1, cpu_state);
+            }
+            uint64_t line = vi.GetCyclesPerLine();
+            scheduler.ScheduleEvent(line - std::min<uint64_t>(cycles_late, line), vi_event);
+        });
+        scheduler.ScheduleEvent(hardware.vi.GetCyclesPerLine(), vi_event);
+
+        // Set PC to entry point (placeholder address)
+        cpu_state.pc = 0x80000000; // Example entry point
+
+        // Locate SDK routines that are replaced with native code
+        size_t hle_hooks = 0;
+        if (!options.symbol_map.empty()) {
+            hle_hooks += LoadHLESymbolMap(options.symbol_map);
+        }
+        hle_hooks += ScanHLESignatures(memory, 0x80000000, kMem1Size);
+        std::cout << "HLE: " << hle_hooks << " guest functions hooked.\n";
+
+        auto end_frame = [&]() {
+            gx.Sync();
+            gather_pipe.EndFrame();
+            gx_renderer.EndFrame();
+            gx.GetTextureCache().EndFrame();
+        };
+        // A new frame is presented only when the guest has swapped: VI points
+        // at another XFB, or a copy has been made into one. Without an XFB the
+        // EFB is shown once drawn to. Headless, every frame is hashed instead.
+        std::unique_ptr<FramePresenter> presenter;
+        if (!options.headless) {
+            presenter = std::make_unique<FramePresenter>(*sdl, kScreenWidth, kScreenHeight, xfb_decode);
+        }
+        FrameHashLog frame_hashes(options.frame_hashes);
+        std::vector<uint32_t> headless_frame(options.headless ? kScreenWidth * kScreenHeight : 0);
+        uint32_t presented_xfb = 0;
+        uint64_t presented_copies = 0, presented_draws = 0;
+        auto present = [&]() {
+            const VideoInterface& vi = hardware.vi;
+            if (!presenter) {
+                uint64_t hash = 0;
+                if (!HashXFB(memory, vi, hash)) {
+                    gx_renderer.ResolveToFramebuffer(headless_frame.data(), kScreenWidth, kScreenHeight);
+                    hash = XXHash64(headless_frame.data(), headless_frame.size() * sizeof(uint32_t));
+                }
+                frame_hashes.Record(hash);
+                return;
+            }
+            const GXPipeline::Stats& gp = gx.GetPipelineStats();
+            bool has_xfb = vi.GetXFBWidth() != 0;
+            if (has_xfb ? vi.GetXFBAddress() != presented_xfb || gp.xfb_copies != presented_copies
+                        : gp.draws != presented_draws) {
+                ScanoutFrame& frame = presenter->GetBackFrame();
+                if (!CaptureXFB(memory, vi, kScreenWidth, kScreenHeight, frame)) {
+                    frame.yuyv = false;
+                    frame.width = kScreenWidth;
+                    frame.height = kScreenHeight;
+                    frame.pixels.resize(static_cast<size_t>(kScreenWidth) * kScreenHeight * sizeof(uint32_t));
+                    gx_renderer.ResolveToFramebuffer(reinterpret_cast<uint32_t*>(frame.pixels.data()), kScreenWidth,
+                                                     kScreenHeight);
+                }
+                presenter->Publish();
+                presented_xfb = vi.GetXFBAddress();
+                presented_copies = gp.xfb_copies;
+                presented_draws = gp.draws;
+            }
+        };
+
+        // Main Emulation Loop, one frame per pass
+        FramePacer pacer(options.speed);
+        std::unique_ptr<Savestate> savestate;
+        if (options.run_ahead > 0) {
+            savestate = std::make_unique<Savestate>(context, gx, gx_renderer, gather_pipe, &efb_copies);
+        }
+        FrameRunner runner(context, ios, frame_done, savestate.get(), options.run_ahead);
+        uint64_t frames_run = 0;
+        auto start_time = std::chrono::steady_clock::now();
+        while (cpu_state.running && (options.frame_limit == 0 || frames_run < options.frame_limit)) {
+            if (sdl) {
+                sdl->HandleEvents(cpu_state.running);
+            }
+            if (!runner.Step(end_frame, present)) {
+                break;
+            }
+            pacer.Pace(hardware.vi.GetFrameRate());
+            ++frames_run;
+        }
+        double run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+        std::cout << "MMIO access counts:\n";
+        hardware.mmio.DumpAccessCounts(std::cout, 16);
+        std::cout << "Kernel dispatch stats:\n";
+        DumpKernelStats(std::cout);
+        std::cout << "IOS requests: " << ios.GetRequestCount() << "\n";
+        gx.Sync();
+        const GXPipeline::Stats& gp = gx.GetPipelineStats();
+        std::cout << "GX FIFO (" << (gx.IsThreaded() ? "GPU thread" : "deterministic") << "): "
+                  << gx.GetBytesWritten() << " bytes, " << gp.commands << " commands, " << gp.draws << " draws, "
+                  << gp.triangles << " triangles\n";
+        std::cout << "XFB copies: " << gp.xfb_copies << "\n";
+        if (presenter) {
+            std::cout << "VI: " << hardware.vi.fields << " fields, " << presenter->GetPublishedCount()
+                      << " frames swapped, " << presenter->GetPresentedCount() << " presented\n";
+        } else {
+            std::cout << "VI: " << hardware.vi.fields << " fields, " << frame_hashes.GetFrameCount()
+                      << " frames hashed in " << run_seconds << " s ("
+                      << (run_seconds > 0 ? frames_run / run_seconds : 0.0) << " fps), digest "
+                      << std::hex << std::setw(16) << std::setfill('0') << frame_hashes.GetDigest() << std::dec
+                      << std::setfill(' ') << "\n";
+        }
+        pacer.DumpJitter(std::cout);
+        if (savestate) {
+            const Savestate::Stats& states = savestate->GetStats();
+            const FrameRunner::Stats& frames = runner.GetStats();
+            std::cout << "Run-ahead (" << options.run_ahead << " frames): " << frames.ahead << " shown ahead, "
+                      << frames.aborted << " cut short by IPC or a syscall, " << frames.behind << " not captured; "
+                      << states.captures << " captures (" << states.pages_saved << " pages saved), " << states.restores
+                      << " restores (" << states.pages_restored << " pages restored)\n";
+        }
+        EFBCopyStore::Stats copies = efb_copies.GetStats();
+        std::cout << "EFB texture copies: " << gp.texture_copies << " (" << copies.written_back << " written back, "
+                  << copies.replaced << " replaced unread, " << efb_copies.GetPendingCount() << " pending)\n";
+        const TextureCache::Stats& textures = gx.GetTextureCache().GetTotalStats();
+        std::cout << "Texture cache: " << textures.hits << " hits, " << textures.misses << " misses ("
+                  << textures.decoded_bytes / 1024 << " KB decoded), " << textures.efb_copy_hits
+                  << " served from EFB copies; " << gx.GetTextureCache().GetFrameStats().misses
+                  << " misses in the last frame\n";
+        std::cout << "Display lists: " << gp.display_lists << " calls, " << gp.display_list_replays << " replayed ("
+                  << (gp.display_lists ? 100.0 * gp.display_list_replays / gp.display_lists : 0.0) << "%)\n";
+        GXVertexLoaderCache::Stats loaders = gx.GetVertexLoaderStats();
+        std::cout << "Vertex loaders: " << loaders.loaders << " (" << loaders.compiled << " compiled, "
+                  << loaders.precompiled << " precompiled)\n";
+        GXPixelPipelineCache::Stats pixel = gx_renderer.GetPipelineStats();
+        std::cout << "Pixel pipelines: " << pixel.compiled << " compiled, " << pixel.precompiled << " precompiled, "
+                  << pixel.hits << "/" << pixel.lookups << " lookups hit ("
+                  << (pixel.lookups ? 100.0 * pixel.hits / pixel.lookups : 0.0) << "%)\n";
+        const SWRenderer::DepthStats& depth = gx_renderer.GetTotalDepthStats();
+        std::cout << "Hi-Z: " << depth.rejected << "/" << depth.tested << " blocks rejected ("
+                  << (depth.tested ? 100.0 * depth.rejected / depth.tested : 0.0) << "%), "
+                  << gx_renderer.GetFrameDepthStats().rejected << " in the last frame\n";
+        std::cout << "Shader cache: " << shader_cache.Save(gx_renderer.GetPipelineCache(), gx.GetVertexLoaders())
+                  << " keys saved\n";
+        const GatherPipe::Stats& pipe = gather_pipe.GetTotalStats();
+        std::cout << "Gather pipe: " << pipe.bursts << " bursts, " << pipe.bytes << " bytes\n";
+        memory.AttachGatherPipe(nullptr);
+
+        // Cleanup is handled by SDLWrapper destructor
+    } catch (const std::exception& e) {
+        std::cerr << "Emulator Error: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Parse Command Line: [options] [game.iso]
+EmulatorOptions ParseOptions(int argc, char* argv[]) {
+    EmulatorOptions options;
+    bool speed_given = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next_value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for option " + arg);
+            }
+            return argv[++i];
+        };
+        if (arg == "--bench") {
+            options.benchmark = next_value();
+        } else if (arg == "--symbols") {
+            options.symbol_map = next_value();
+        } else if (arg == "--nand") {
+            options.nand_root = next_value();
+        } else if (arg == "--cache") {
+            options.cache_root = next_value();
+        } else if (arg == "--deterministic") {
+            options.deterministic = true;
+        } else if (arg == "--no-jit") {
+            options.jit = false;
+        } else if (arg == "--speed") {
+            speed_given = true;
+            std::string value = next_value();
+            if (value == "unlimited") {
+                options.speed = 0;
+            } else {
+                size_t end = 0;
+                int speed = 0;
+                try {
+                    speed = std::stoi(value, &end);
+                } catch (const std::exception&) {
+                    end = 0;
+                }
+                if (end != value.size() || speed < 1 || speed > 10000) {
+                    throw std::runtime_error("Invalid speed (percent or 'unlimited'): " + value);
+                }
+                options.speed = speed;
+            }
+        } else if (arg == "--run-ahead") {
+            std::string value = next_value();
+            size_t end = 0;
+            int frames = -1;
+            try {
+                frames = std::stoi(value, &end);
+            } catch (const std::exception&) {
+                end = 0;
+            }
+            if (end != value.size() || frames < 0 || frames > kMaxRunAhead) {
+                throw std::runtime_error("Invalid run-ahead (0-" + std::to_string(kMaxRunAhead) + " frames): " + value);
+            }
+            options.run_ahead = frames;
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frame-hashes") {
+            options.frame_hashes = next_value();
+        } else if (arg == "--frames") {
+            std::string value = next_value();
+            size_t end = 0;
+            long long frames = 0;
+            try {
+                frames = std::stoll(value, &end);
+            } catch (const std::exception&) {
+                end = 0;
+            }
+            if (end != value.size() || frames < 0) {
+                throw std::runtime_error("Invalid frame count: " + value);
+            }
+            options.frame_limit = static_cast<uint64_t>(frames);
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            throw std::runtime_error("Unknown option: " + arg);
+        } else {
+            options.game_file = arg;
+        }
+    }
+    if (options.headless && !speed_given) {
+        options.speed = 0;
+    }
+    if (!options.frame_hashes.empty() && !options.headless) {
+        throw std::runtime_error("--frame-hashes requires --headless");
+    }
+    return options;
+}
+
+// Benchmarks
+// Each entry runs standalone (no SDL, no game) and prints its own results.
+template <typename Fn>
+double MeasureSeconds(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Baseline accessors: the byte-at-a-time code Memory::ReadWord/WriteWord used
+// before Read<T>/Write<T>, kept here only for comparison.
+static uint32_t ByteShiftReadWord(const Memory& memory, uint32_t address) {
+    const uint8_t* page = memory.GetPageTable()->host[address >> kPageShift];
+    uint32_t offset = address & kPageMask;
+    if (!page || offset > kPageSize - 4) {
+        throw std::out_of_range("Memory read out of bounds");
+    }
+    return (page[offset] << 24) | (page[offset + 1] << 16) |
+           (page[offset + 2] << 8) | page[offset + 3];
+}
+
+static void ByteShiftWriteWord(const Memory& memory, uint32_t address, uint32_t value) {
+    uint8_t* page = memory.GetPageTable()->host[address >> kPageShift];
+    uint32_t offset = address & kPageMask;
+    if (!page || offset > kPageSize - 4) {
+        throw std::out_of_range("Memory write out of bounds");
+    }
+    page[offset]     = (value >> 24) & 0xFF;
+    page[offset + 1] = (value >> 16) & 0xFF;
+    page[offset + 2] = (value >> 8)  & 0xFF;
+    page[offset + 3] = value         & 0xFF;
+}
+
+void BenchmarkMemoryAccess() {
+    Memory memory;
+    uint8_t* mem1 = memory.GetMem1();
+    uint32_t seed = 0x12345678;
+    for (uint32_t i = 0; i < kMem1Size; ++i) {
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        mem1[i] = static_cast<uint8_t>(seed);
+    }
+
+    constexpr int kPasses = 8;
+    constexpr uint64_t kAccesses = static_cast<uint64_t>(kPasses) * (kMem1Size / 4);
+    volatile uint64_t sink = 0;
+    auto report = [](const char* label, double seconds, uint64_t accesses, double baseline) {
+        double ns = seconds * 1e9 / static_cast<double>(accesses);
+        std::cout << "  " << label << ": " << ns << " ns/access";
+        if (baseline > 0) std::cout << " (" << baseline / seconds << "x vs byte shift)";
+        std::cout << "\n";
+    };
+
+    uint64_t shift_sum = 0, typed_sum = 0;
+    double shift_read = MeasureSeconds([&] {
+        for (int pass = 0; pass < kPasses; ++pass)
+            for (uint32_t a = 0; a < kMem1Size; a += 4) shift_sum += ByteShiftReadWord(memory, 0x80000000 + a);
+    });
+    double typed_read = MeasureSeconds([&] {
+        for (int pass = 0; pass < kPasses; ++pass)
+            for (uint32_t a = 0; a < kMem1Size; a += 4) typed_sum += memory.Read<uint32_t>(0x80000000 + a);
+    });
+    if (shift_sum != typed_sum) {
+        std::cerr << "Memory benchmark: Read<uint32_t> disagrees with the byte-shift reader\n";
+    }
+    sink = sink + shift_sum + typed_sum;
+
+    double shift_write = MeasureSeconds([&] {
+        for (int pass = 0; pass < kPasses; ++pass)
+            for (uint32_t a = 0; a < kMem1Size; a += 4) ByteShiftWriteWord(memory, 0x80000000 + a, a ^ pass);
+    });
+    double typed_write = MeasureSeconds([&] {
+        for (int pass = 0; pass < kPasses; ++pass)
+            for (uint32_t a = 0; a < kMem1Size; a += 4) memory.Write<uint32_t>(0x80000000 + a, a ^ pass);
+    });
+
+    uint64_t half_sum = 0, dword_sum = 0;
+    double double_sum = 0;
+    double typed_read16 = MeasureSeconds([&] {
+        for (int pass = 0; pass < kPasses; ++pass)
+            for (uint32_t a = 0; a < kMem1Size; a += 4) half_sum += memory.Read<uint16_t>(0x80000000 + a);
+    });
+    double typed_read64 = MeasureSeconds([&] {
+        for (int pass = 0; pass < kPasses / 2; ++pass)
+            for (uint32_t a = 0; a < kMem1Size; a += 8) dword_sum += memory.Read<uint64_t>(0x80000000 + a);
+    });
+    double typed_readf64 = MeasureSeconds([&] {
+        for (int pass = 0; pass < kPasses / 2; ++pass)
+            for (uint32_t a = 0; a < kMem1Size; a += 8) double_sum += memory.Read<double>(0x80000000 + a);
+    });
+    sink = sink + half_sum + dword_sum + static_cast<uint64_t>(double_sum != 0);
+
+    std::cout << "memory: " << kAccesses << " accesses over MEM1\n";
+    report("ReadWord  (byte shift)", shift_read, kAccesses, 0);
+    report("Read<u32> (bswap)     ", typed_read, kAccesses, shift_read);
+    report("WriteWord (byte shift)", shift_write, kAccesses, 0);
+    report("Write<u32> (bswap)    ", typed_write, kAccesses, shift_write);
+    report("Read<u16> (bswap)     ", typed_read16, kAccesses, 0);
+    report("Read<u64> (bswap)     ", typed_read64, kAccesses / 4, 0);
+    report("Read<f64> (bswap)     ", typed_readf64, kAccesses / 4, 0);
+}
+
+void BenchmarkDMA() {
+    constexpr uint32_t kTransferSize = 256 * 1024;
+    constexpr int kRepeats = 200;
+    Memory memory;
+    DMAEngine dma(memory);
+    std::vector<uint8_t> device(kTransferSize);
+    for (uint32_t i = 0; i < kTransferSize; ++i) device[i] = static_cast<uint8_t>(i * 7);
+
+    std::cout << "dma: " << kTransferSize / 1024 << " KB device -> MEM2 transfers with 32-bit swap"
+              << " (host: " << SimdLevelName(HostSimdLevel()) << ")\n";
+    auto report = [&](const char* label, double seconds) {
+        double us = seconds * 1e6 / kRepeats;
+        std::cout << "  " << label << ": " << us << " us/transfer, "
+                  << (kTransferSize / (us * 1e-6)) / 1e9 << " GB/s\n";
+    };
+
+    uint32_t expected = 0;
+    double per_word = MeasureSeconds([&] {
+        for (int r = 0; r < kRepeats; ++r)
+            for (uint32_t i = 0; i < kTransferSize; i += 4) {
+                uint32_t word;
+                std::memcpy(&word, &device[i], 4);
+                memory.WriteWord(0x90000000 + i, word);
+            }
+    });
+    expected = memory.Read<uint32_t>(0x90000000 + 0x1234 * 4);
+    report("WriteWord loop", per_word);
+
+    SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kSSSE3, SimdLevel::kAVX2};
+    for (SimdLevel level : levels) {
+        if (level > HostSimdLevel()) continue;
+        dma.SetSimdLevel(level);
+        std::memset(memory.GetMem2(), 0, kTransferSize);
+        double seconds = MeasureSeconds([&] {
+            for (int r = 0; r < kRepeats; ++r) {
+                dma.WriteToGuest(0x90000000, device.data(), kTransferSize, SwapWidth::kSwap32);
+            }
+        });
+        std::string label = std::string("DMAEngine ") + SimdLevelName(level);
+        report(label.c_str(), seconds);
+        if (memory.Read<uint32_t>(0x90000000 + 0x1234 * 4) != expected) {
+            std::cerr << "DMA benchmark: " << SimdLevelName(level) << " result mismatch\n";
+        }
+    }
+}
+
+// Word stores to 0xCC008000 through the gather pipe page, against the same
+// stores dispatched to a device handler that feeds a second pipe, as the
+// stores were routed before the pipe had its own page type
+void BenchmarkGatherPipe() {
+    constexpr uint32_t kStores = 32u << 20;
+    Memory memory;
+    uint64_t direct_sum = 0, handler_sum = 0;
+    GatherPipe direct, dispatched;
+    direct.SetBurstHandler([&](const uint8_t* burst) { direct_sum += burst[3]; });
+    dispatched.SetBurstHandler([&](const uint8_t* burst) { handler_sum += burst[3]; });
+    memory.AttachGatherPipe(&direct);
+    memory.MapHandler(kGatherPipeAddress | 0xC0000000, kPageSize, kPageGatherPipe);
+    double fast = MeasureSeconds([&] {
+        for (uint32_t i = 0; i < kStores; ++i) memory.Write<uint32_t>(0xCC008000, i);
+    });
+
+    MMIOCallbacks callbacks;
+    callbacks.write = [&](uint32_t, uint32_t value, uint32_t size) {
+        if (size == 4) dispatched.Write<uint32_t>(value);
+    };
+    memory.MapHandler(kGatherPipeAddress | 0xC0000000, kPageSize, memory.RegisterHandler(std::move(callbacks)));
+    double slow = MeasureSeconds([&] {
+        for (uint32_t i = 0; i < kStores; ++i) memory.Write<uint32_t>(0xCC008000, i);
+    });
+    if (direct_sum != handler_sum) {
+        std::cerr << "Gather pipe benchmark: burst contents differ\n";
+    }
 
-// CPU State Structure - PowerPC Architecture
-struct FPR {
-    float ps0;
-    float ps1;
-};
+    direct.EndFrame();
+    std::cout << "gatherpipe: " << kStores << " word stores, " << direct.GetFrameStats().bursts << " bursts\n";
+    std::cout << "  handler dispatch: " << slow * 1e9 / kStores << " ns/store\n";
+    std::cout << "  gather pipe page: " << fast * 1e9 / kStores << " ns/store (" << slow / fast << "x)\n";
+}
 
-class CPUState {
-public:
-    uint32_t pc;                      // Program Counter
-    uint32_t gpr[32];                 // General Purpose Registers
-    FPR fpr[32];                      // Floating Point Registers (paired singles)
-    uint32_t spr[1024];               // Special Purpose Registers
-    bool running;                     // Emulation loop control
-    bool interrupts_enabled;         // Interrupt management
-    bool kernel_mode;                 // Kernel mode flag
+// Deterministic triangle soup over the EFB: count triangles of up to
+// max_size pixels across, random depth and color
+std::vector<GXVertex> MakeTriangleSoup(size_t count, float max_size, uint32_t seed) {
+    std::vector<GXVertex> vertices;
+    vertices.reserve(count * 3);
+    auto next = [&seed] {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+    };
+    for (size_t i = 0; i < count; ++i) {
+        float cx = next() * kEFBWidth, cy = next() * kEFBHeight;
+        float z = next();
+        for (int v = 0; v < 3; ++v) {
+            GXVertex vertex{};
+            vertex.x = cx + (next() - 0.5f) * max_size;
+            vertex.y = cy + (next() - 0.5f) * max_size;
+            vertex.z = z;
+            vertex.w = 1.0f;
+            for (float& channel : vertex.color) channel = next() * 255.0f;
+            vertices.push_back(vertex);
+        }
+    }
+    return vertices;
+}
 
-    CPUState() : pc(0), running(true), interrupts_enabled(false), kernel_mode(false) {
-        std::memset(gpr, 0, sizeof(gpr));
-        std::memset(fpr, 0, sizeof(fpr));
-        std::memset(spr, 0, sizeof(spr));
+void BenchmarkSoftwareRenderer() {
+    constexpr size_t kTriangles = 50000;
+    constexpr int kFrames = 10;
+    std::vector<GXVertex> soup = MakeTriangleSoup(kTriangles, 48.0f, 1);
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "swrender: " << kTriangles << " triangles (up to 48 px) per frame, tile-binned\n";
+
+    double single_thread = 0.0;
+    for (size_t threads = 1;; threads = std::min(threads * 2, max_threads)) {
+        SWRenderer renderer(threads);
+        double seconds = MeasureSeconds([&] {
+            for (int frame = 0; frame < kFrames; ++frame) {
+                renderer.Clear(0x000000FF, kGXMaxDepth);
+                for (size_t i = 0; i < soup.size(); i += 3) {
+                    renderer.DrawTriangle(soup[i], soup[i + 1], soup[i + 2]);
+                }
+                renderer.Flush();
+            }
+        });
+        double ms = seconds * 1e3 / kFrames;
+        if (threads == 1) single_thread = ms;
+        std::cout << "  " << threads << " thread(s): " << ms << " ms/frame, " << single_thread / ms << "x\n";
+        if (threads == max_threads) break;
     }
-};
+}
 
-// Starlet Coprocessor Memory Structure
-struct StarletMemory {
-    uint32_t command;
-    uint32_t response;
-    // Additional fields can be added as needed
-} starlet_memory;
+// Single-threaded rasterization of a fixed soup per coverage kernel; every
+// kernel must reproduce the scalar reference EFB exactly
+void BenchmarkRasterizer() {
+    constexpr int kFrames = 10;
+    std::vector<GXVertex> soup = MakeTriangleSoup(50000, 48.0f, 2);
+    std::cout << "raster: " << soup.size() / 3 << " triangles per frame, 1 thread"
+              << " (host: " << SimdLevelName(HostSimdLevel()) << ")\n";
 
-// Emulator Memory (Using Smart Pointers for Memory Management)
-class Memory {
-public:
-    Memory() {
-        data = std::make_unique<uint8_t[]>(kMemorySize);
-        std::memset(data.get(), 0, kMemorySize);
+    std::vector<uint32_t> reference;
+    SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kAVX2};
+    for (SimdLevel level : levels) {
+        if (level > HostSimdLevel()) continue;
+        SWRenderer renderer(1);
+        renderer.SetSimdLevel(level);
+        double seconds = MeasureSeconds([&] {
+            for (int frame = 0; frame < kFrames; ++frame) {
+                renderer.Clear(0x000000FF, kGXMaxDepth);
+                for (size_t i = 0; i < soup.size(); i += 3) {
+                    renderer.DrawTriangle(soup[i], soup[i + 1], soup[i + 2]);
+                }
+                renderer.Flush();
+            }
+        });
+        std::cout << "  " << SimdLevelName(level) << ": " << renderer.GetPixelCount() / seconds / 1e6
+                  << " Mpix/s (" << renderer.GetPixelCount() / kFrames << " px/frame)\n";
+
+        std::vector<uint32_t> image(static_cast<size_t>(kEFBWidth) * kEFBHeight);
+        renderer.ResolveToFramebuffer(image.data(), kEFBWidth, kEFBHeight);
+        if (reference.empty()) {
+            reference = std::move(image);
+        } else if (image != reference) {
+            std::cerr << "Rasterizer benchmark: " << SimdLevelName(level) << " differs from scalar\n";
+        }
     }
+}
 
-    uint32_t ReadWord(uint32_t address) const {
-        if (address + 3 >= kMemorySize) {
-            throw std::out_of_range("Memory read out of bounds at address: " + ToHex(address));
+// Random TEV, alpha test, depth and blend setups of 1-4 stages
+std::vector<GXRasterState> MakeRandomTevStates(size_t count, uint32_t seed) {
+    auto next = [&seed](uint32_t range) {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) % range;
+    };
+    std::vector<GXRasterState> states(count);
+    for (GXRasterState& state : states) {
+        GXTevState& tev = state.tev;
+        GXTevConstants& constants = state.tev_constants;
+        tev.stages = static_cast<uint8_t>(1 + next(4));
+        for (int stage = 0; stage < tev.stages; ++stage) {
+            uint32_t upper = next(3) << 16 | next(2) << 18 | next(2) << 19 | next(4) << 20 | next(4) << 22;
+            tev.color_env[stage] = next(16) | next(16) << 4 | next(16) << 8 | next(16) << 12 | upper;
+            upper = next(3) << 16 | next(2) << 18 | next(2) << 19 | next(4) << 20 | next(4) << 22;
+            tev.alpha_env[stage] = next(8) << 4 | next(8) << 7 | next(8) << 10 | next(8) << 13 | upper;
+            tev.konst_color[stage] = static_cast<uint8_t>(next(32));
+            tev.konst_alpha[stage] = static_cast<uint8_t>(next(32));
+            for (uint8_t& value : constants.konst[stage]) value = static_cast<uint8_t>(next(256));
         }
-        return (data[address] << 24) | (data[address + 1] << 16) |
-               (data[address + 2] << 8) | data[address + 3];
+        for (auto& reg : constants.regs) {
+            for (int16_t& value : reg) value = static_cast<int16_t>(static_cast<int>(next(2048)) - 1024);
+        }
+        // Mostly passing alpha tests, as games use them
+        tev.alpha_func0 = next(2) ? static_cast<uint8_t>(kCompareAlways) : static_cast<uint8_t>(next(8));
+        tev.alpha_func1 = static_cast<uint8_t>(next(8));
+        tev.alpha_op = static_cast<uint8_t>(next(4));
+        constants.alpha_ref[0] = static_cast<uint8_t>(next(256));
+        constants.alpha_ref[1] = static_cast<uint8_t>(next(256));
+        state.z_func = static_cast<uint8_t>(next(8));
+        state.z_update = next(2);
+        state.blend_enable = next(2);
+        state.blend_src = static_cast<uint8_t>(next(8));
+        state.blend_dst = static_cast<uint8_t>(next(8));
+        state.alpha_update = next(2);
     }
+    return states;
+}
 
-    void WriteWord(uint32_t address, uint32_t value) {
-        if (address + 3 >= kMemorySize) {
-            throw std::out_of_range("Memory write out of bounds at address: " + ToHex(address));
+// Shading throughput of the per-pixel TEV interpreter against the cached
+// pixel pipelines over a soup drawn under a rotation of random setups, half
+// of them sampling a repeating and mirrored or a clamped texture map; the
+// EFBs must match exactly
+void BenchmarkTevPipelines() {
+    constexpr int kFrames = 5;
+    constexpr size_t kStates = 64;
+    constexpr size_t kTrianglesPerState = 100;
+    std::vector<GXVertex> soup = MakeTriangleSoup(20000, 64.0f, 3);
+    for (GXVertex& vertex : soup) {
+        vertex.uv[0] = vertex.x / 48.0f;
+        vertex.uv[1] = vertex.y / 40.0f;
+    }
+    std::vector<GXRasterState> states = MakeRandomTevStates(kStates, 7);
+    for (size_t i = 1; i < kStates; i += 2) {
+        for (int stage = 0; stage < states[i].tev.stages; ++stage) {
+            states[i].tev.tex_order[stage] = static_cast<uint8_t>(kGXTexOrderEnable | (stage & 1));
         }
-        data[address]     = (value >> 24) & 0xFF;
-        data[address + 1] = (value >> 16) & 0xFF;
-        data[address + 2] = (value >> 8)  & 0xFF;
-        data[address + 3] = value         & 0xFF;
     }
+    GXTextureMaps maps;
+    uint32_t seed = 0x9E3779B9;
+    for (int map = 0; map < 2; ++map) {
+        auto texture = std::make_shared<CachedTexture>();
+        texture->width = map ? 16 : 64;
+        texture->height = map ? 16 : 32;
+        texture->pixels.resize(static_cast<size_t>(texture->width) * texture->height);
+        for (uint32_t& texel : texture->pixels) texel = seed = seed * 1664525u + 1013904223u;
+        maps[map].texture = std::move(texture);
+        maps[map].wrap_s = map ? kWrapClamp : kWrapRepeat;
+        maps[map].wrap_t = map ? kWrapClamp : kWrapMirror;
+    }
+    std::cout << "tev: " << soup.size() / 3 << " triangles (up to 64 px) per frame under " << kStates
+              << " TEV setups of 1-4 stages, half textured, 1 thread\n";
 
-    uint8_t* GetData() const { return data.get(); }
+    std::vector<uint32_t> reference;
+    for (bool specialized : {false, true}) {
+        SWRenderer renderer(1);
+        renderer.SetSpecializedPipelines(specialized);
+        renderer.SetTextures(maps);
+        double seconds = MeasureSeconds([&] {
+            for (int frame = 0; frame < kFrames; ++frame) {
+                renderer.Clear(0x000000FF, kGXMaxDepth);
+                for (size_t i = 0; i < soup.size(); i += 3) {
+                    renderer.SetState(states[i / 3 / kTrianglesPerState % kStates]);
+                    renderer.DrawTriangle(soup[i], soup[i + 1], soup[i + 2]);
+                }
+                renderer.Flush();
+            }
+        });
+        std::cout << "  " << (specialized ? "pipelines:   " : "interpreter: ") << renderer.GetPixelCount() / seconds / 1e6
+                  << " Mpix/s";
+        if (specialized) {
+            GXPixelPipelineCache::Stats stats = renderer.GetPipelineStats();
+            std::cout << " (" << stats.compiled << " compiled, " << 100.0 * stats.hits / stats.lookups << "% hits)";
+        }
+        std::cout << "\n";
 
-private:
-    std::unique_ptr<uint8_t[]> data;
+        std::vector<uint32_t> image(static_cast<size_t>(kEFBWidth) * kEFBHeight);
+        renderer.ResolveToFramebuffer(image.data(), kEFBWidth, kEFBHeight);
+        if (reference.empty()) {
+            reference = std::move(image);
+        } else if (image != reference) {
+            std::cerr << "TEV benchmark: pipelines differ from the interpreter\n";
+        }
+    }
+}
 
-    // Helper function to convert address to hex string
-    std::string ToHex(uint32_t address) const {
-        std::ostringstream oss;
-        oss << "0x" << std::hex << address;
-        return oss.str();
+// Overdraw with and without the coarse depth bounds: a front-to-back sorted
+// soup under depth-tested TEV setups (early Z, or late Z where the alpha test
+// can discard), then the same unsorted soup under random compare functions
+void BenchmarkHierarchicalZ() {
+    constexpr int kFrames = 3;
+    constexpr size_t kStates = 64;
+    constexpr size_t kTrianglesPerState = 100;
+    std::vector<GXVertex> soup = MakeTriangleSoup(20000, 96.0f, 9);
+    std::vector<GXRasterState> random_states = MakeRandomTevStates(kStates, 13);
+    std::vector<GXRasterState> sorted_states = random_states;
+    for (GXRasterState& state : sorted_states) {
+        state.z_enable = true;
+        state.z_func = kCompareLEqual;
+        state.z_update = true;
     }
-};
+    std::vector<size_t> order(soup.size() / 3);
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::vector<GXVertex> sorted;
+    sorted.reserve(soup.size());
+    std::stable_sort(order.begin(), order.end(),
+                     [&soup](size_t a, size_t b) { return soup[a * 3].z < soup[b * 3].z; });
+    for (size_t i : order) sorted.insert(sorted.end(), soup.begin() + i * 3, soup.begin() + i * 3 + 3);
+    std::cout << "hiz: " << soup.size() / 3 << " triangles (up to 96 px) per frame under " << kStates
+              << " TEV setups, 1 thread\n";
 
-// SDL2 Wrapper Class for Resource Management
-class SDLWrapper {
-public:
-    SDLWrapper() : window(nullptr), renderer(nullptr), framebuffer_texture(nullptr) {}
+    struct Scene {
+        const char* name;
+        const std::vector<GXVertex>& vertices;
+        const std::vector<GXRasterState>& states;
+    };
+    for (const Scene& scene : {Scene{"front to back", sorted, sorted_states},
+                               Scene{"random depth state", soup, random_states}}) {
+        std::vector<uint32_t> reference, reference_depth;
+        for (bool hierarchical : {false, true}) {
+            SWRenderer renderer(1);
+            renderer.SetHierarchicalZ(hierarchical);
+            double seconds = MeasureSeconds([&] {
+                for (int frame = 0; frame < kFrames; ++frame) {
+                    renderer.Clear(0x000000FF, kGXMaxDepth);
+                    for (size_t i = 0; i < scene.vertices.size(); i += 3) {
+                        renderer.SetState(scene.states[i / 3 / kTrianglesPerState % kStates]);
+                        renderer.DrawTriangle(scene.vertices[i], scene.vertices[i + 1], scene.vertices[i + 2]);
+                    }
+                    renderer.EndFrame();
+                }
+            });
+            const SWRenderer::DepthStats& depth = renderer.GetFrameDepthStats();
+            std::cout << "  " << scene.name << (hierarchical ? ", Hi-Z:  " : ", no Hi-Z: ")
+                      << seconds * 1e3 / kFrames << " ms/frame";
+            if (hierarchical) {
+                std::cout << " (" << depth.rejected << " of " << depth.tested << " blocks rejected per frame)";
+            }
+            std::cout << "\n";
 
-    ~SDLWrapper() {
-        Cleanup();
+            std::vector<uint32_t> image(static_cast<size_t>(kEFBWidth) * kEFBHeight), depth_image;
+            renderer.ResolveToFramebuffer(image.data(), kEFBWidth, kEFBHeight);
+            depth_image.reserve(image.size());
+            for (int y = 0; y < kEFBHeight; ++y) {
+                for (int x = 0; x < kEFBWidth; ++x) depth_image.push_back(renderer.PeekDepth(x, y));
+            }
+            if (reference.empty()) {
+                reference = std::move(image);
+                reference_depth = std::move(depth_image);
+            } else if (image != reference || depth_image != reference_depth) {
+                std::cerr << "Hi-Z benchmark: " << scene.name << " differs without Hi-Z\n";
+            }
+        }
     }
+}
 
-    void Initialize(const char* title, int width, int height) {
-        if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS) < 0) {
-            throw std::runtime_error("SDL could not initialize! SDL_Error: " + std::string(SDL_GetError()));
+// Display copies of a rendered 640x480 EFB and VI scanout of the XFB they
+// produce, per kernel against the scalar reference. The second filter sums
+// past 64 so the clamp is exercised, with gamma 2.2.
+void BenchmarkXFB() {
+    constexpr int kWidth = 640, kHeight = 480, kRepeats = 100;
+    constexpr size_t kStride = kWidth * 2;
+    SWRenderer renderer(1);
+    std::vector<GXVertex> soup = MakeTriangleSoup(5000, 64.0f, 17);
+    renderer.Clear(0x204060FF, kGXMaxDepth);
+    for (size_t i = 0; i < soup.size(); i += 3) renderer.DrawTriangle(soup[i], soup[i + 1], soup[i + 2]);
+    renderer.Flush();
+    std::cout << "xfb: " << kWidth << "x" << kHeight << " display copies and scanouts, 1 thread\n";
+
+    GXCopyFilter filters[2];
+    filters[0].weights[0] = 14;     // 7, 7 | 12, 12, 12 | 7, 7: the usual deflicker filter
+    filters[0].weights[1] = 36;
+    filters[0].weights[2] = 14;
+    filters[1].weights[0] = 40;
+    filters[1].weights[1] = 120;
+    filters[1].weights[2] = 40;
+    filters[1].gamma = 2;
+    filters[1].clamp_top = filters[1].clamp_bottom = false;
+    SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kSSSE3, SimdLevel::kAVX2};
+    std::vector<uint8_t> xfb;
+    for (const GXCopyFilter& filter : filters) {
+        std::vector<uint8_t> reference;
+        for (SimdLevel level : levels) {
+            if (level > HostSimdLevel()) continue;
+            renderer.SetSimdLevel(level);
+            std::vector<uint8_t> copy(kStride * kHeight);
+            double seconds = MeasureSeconds([&] {
+                for (int i = 0; i < kRepeats; ++i) {
+                    renderer.CopyToXFB(0, 0, kWidth, kHeight, filter, copy.data(), kStride);
+                }
+            });
+            std::cout << "  copy (gamma " << (filter.gamma ? "2.2" : "1.0") << "), " << SimdLevelName(level) << ": "
+                      << static_cast<double>(kWidth) * kHeight * kRepeats / seconds / 1e6 << " Mpix/s\n";
+            if (reference.empty()) {
+                reference = std::move(copy);
+            } else if (copy != reference) {
+                std::cerr << "XFB benchmark: " << SimdLevelName(level) << " copy differs from scalar\n";
+            }
         }
+        xfb = std::move(reference);
+    }
 
-        window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                                  width, height, SDL_WINDOW_SHOWN);
-        if (!window) {
-            throw std::runtime_error("Window could not be created! SDL_Error: " + std::string(SDL_GetError()));
+    std::vector<uint32_t> reference;
+    for (SimdLevel level : levels) {
+        if (level > HostSimdLevel()) continue;
+        XFBDecodeKernel decode = XFBDecodeKernelFor(level);
+        std::vector<uint32_t> image(static_cast<size_t>(kWidth) * kHeight);
+        double seconds = MeasureSeconds([&] {
+            for (int i = 0; i < kRepeats; ++i) {
+                for (int y = 0; y < kHeight; ++y) {
+                    decode(xfb.data() + y * kStride, kWidth / 2, image.data() + y * kWidth);
+                }
+            }
+        });
+        std::cout << "  scanout, " << SimdLevelName(level) << ": "
+                  << static_cast<double>(kWidth) * kHeight * kRepeats / seconds / 1e6 << " Mpix/s\n";
+        if (reference.empty()) {
+            reference = std::move(image);
+        } else if (image != reference) {
+            std::cerr << "XFB benchmark: " << SimdLevelName(level) << " scanout differs from scalar\n";
         }
+    }
 
-        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-        if (!renderer) {
-            throw std::runtime_error("Renderer could not be created! SDL_Error: " + std::string(SDL_GetError()));
+    // Handing a frame to the presenter: decode to RGBA8888 on the emulation
+    // thread and upload a copy of that, against passing the YUYV rows and
+    // decoding them into the (here simulated) locked texture
+    XFBDecodeKernel decode = XFBDecodeKernelFor(HostSimdLevel());
+    std::vector<uint32_t> rgba(static_cast<size_t>(kWidth) * kHeight), texture[2];
+    texture[0].resize(rgba.size());
+    texture[1].resize(rgba.size());
+    ScanoutFrame frame;
+    double upload = MeasureSeconds([&] {
+        for (int i = 0; i < kRepeats; ++i) {
+            ScanoutYUYV(xfb.data(), kStride, kWidth, kHeight, reinterpret_cast<uint8_t*>(rgba.data()),
+                        kWidth * sizeof(uint32_t), kWidth, kHeight, decode);
+            std::memcpy(texture[0].data(), rgba.data(), rgba.size() * sizeof(uint32_t));
         }
+    });
+    double direct = MeasureSeconds([&] {
+        for (int i = 0; i < kRepeats; ++i) {
+            frame.pixels.resize(kStride * kHeight);
+            for (int y = 0; y < kHeight; ++y) {
+                std::memcpy(frame.pixels.data() + y * kStride, xfb.data() + y * kStride, kStride);
+            }
+            ScanoutYUYV(frame.pixels.data(), kStride, kWidth, kHeight, reinterpret_cast<uint8_t*>(texture[1].data()),
+                        kWidth * sizeof(uint32_t), kWidth, kHeight, decode);
+        }
+    });
+    std::cout << "  present, RGBA8888 upload: " << upload * 1e3 / kRepeats << " ms/frame, YUYV into the texture: "
+              << direct * 1e3 / kRepeats << " ms/frame (" << upload / direct << "x)\n";
+    if (texture[0] != texture[1]) {
+        std::cerr << "XFB benchmark: presented frames differ\n";
+    }
+}
 
-        framebuffer_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
-                                               SDL_TEXTUREACCESS_STREAMING, width, height);
-        if (!framebuffer_texture) {
-            throw std::runtime_error("Framebuffer texture could not be created! SDL_Error: " + std::string(SDL_GetError()));
+// VI timing over one emulated second in each video mode, with a display
+// interrupt on line 200, then the triple buffer under a producer that
+// publishes far faster than the consumer takes: every acquired frame must
+// be whole and newer than the last
+void BenchmarkVideoInterface() {
+    struct Mode {
+        const char* name;
+        uint16_t dcr;
+    };
+    const Mode modes[] = {{"NTSC 480i", 1}, {"NTSC 480p", 1 | 4}, {"PAL 576i", 1 | 1u << 8}};
+    std::cout << "vi: scanout timing over one emulated second\n";
+    for (const Mode& mode : modes) {
+        VideoInterface vi;
+        vi.regs[VideoInterface::kDCR] = mode.dcr;
+        vi.regs[VideoInterface::kDisplayInt0] = VideoInterface::kDIEnable | 200;
+        uint64_t cycles = 0, frames = 0, interrupts = 0;
+        while (cycles < kCpuClockHz) {
+            if (vi.AdvanceLine() && !vi.IsBottomField()) ++frames;
+            if (vi.IsInterruptPending()) {
+                ++interrupts;
+                vi.regs[VideoInterface::kDisplayInt0] &= ~VideoInterface::kDIStatus;
+            }
+            cycles += vi.GetCyclesPerLine();
         }
+        std::cout << "  " << mode.name << ": " << vi.fields << " fields, " << frames << " frames ("
+                  << vi.GetFrameRate() << " Hz), " << interrupts << " display interrupts\n";
     }
 
-    void Render(const CPUState& state) {
-        // Placeholder: Clear screen and draw a simple line based on PC
-        if (SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255) != 0) {
-            std::cerr << "SDL_SetRenderDrawColor Error: " << SDL_GetError() << "\n";
-            return;
+    constexpr size_t kPixels = 640 * 480;
+    constexpr uint32_t kFrames = 20000;
+    TripleBuffer<std::vector<uint32_t>> frames;
+    std::atomic<bool> done{false};
+    uint64_t acquired = 0, torn = 0, stale = 0;
+    std::thread consumer([&] {
+        uint32_t last = 0;
+        while (!done.load(std::memory_order_acquire) || last != kFrames) {
+            const std::vector<uint32_t>* pixels = frames.Acquire();
+            if (!pixels) {
+                std::this_thread::yield();
+                continue;
+            }
+            const uint32_t* frame = pixels->data();
+            ++acquired;
+            torn += std::any_of(frame, frame + kPixels, [&](uint32_t pixel) { return pixel != frame[0]; });
+            stale += frame[0] <= last;
+            last = frame[0];
         }
-        if (SDL_RenderClear(renderer) != 0) {
-            std::cerr << "SDL_RenderClear Error: " << SDL_GetError() << "\n";
-            return;
+    });
+    double seconds = MeasureSeconds([&] {
+        for (uint32_t i = 1; i <= kFrames; ++i) {
+            frames.GetBack().assign(kPixels, i);
+            frames.Publish();
         }
+        done.store(true, std::memory_order_release);
+        consumer.join();
+    });
+    std::cout << "  triple buffer: " << kFrames / seconds << " frames/s published, " << acquired << " of " << kFrames
+              << " acquired\n";
+    if (torn || stale) {
+        std::cerr << "VI benchmark: " << torn << " torn and " << stale << " stale frames acquired\n";
+    }
+}
 
-        // Example: Draw a moving line based on PC value
-        int x = (state.pc / 4) % kScreenWidth;
-        int y = (state.pc / 4) % kScreenHeight;
-        if (SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255) != 0) {
-            std::cerr << "SDL_SetRenderDrawColor Error: " << SDL_GetError() << "\n";
-            return;
+// Pacing 59.94 Hz frames at 300% speed under uneven per-frame work: a
+// relative whole-millisecond delay (the old SDL_Delay loop) against the
+// absolute-deadline pacer. Drift is how far the last frame lands from
+// where the schedule puts it.
+void BenchmarkFramePacer() {
+    constexpr int kFrames = 120;
+    constexpr int kSpeed = 300;
+    const double frame_rate = 60000.0 / 1001.0;
+    const int64_t period = static_cast<int64_t>(1e9 / frame_rate * 100 / kSpeed);
+    uint32_t seed = 5;
+    std::vector<int64_t> work(kFrames);
+    for (int64_t& ns : work) ns = ((seed = seed * 1664525u + 1013904223u) >> 8) % (period / 2);
+    auto busy = [](int64_t ns) {
+        int64_t until = FramePacer::Now() + ns;
+        while (FramePacer::Now() < until) {
         }
-        if (SDL_RenderDrawLine(renderer, kScreenWidth / 2, kScreenHeight / 2, x, y) != 0) {
-            std::cerr << "SDL_RenderDrawLine Error: " << SDL_GetError() << "\n";
-            return;
+    };
+    std::cout << "pacer: " << kFrames << " frames of " << period / 1000 << " us with 0-" << period / 2000
+              << " us of work each\n";
+
+    auto report = [&](const char* name, int64_t start, const std::vector<int64_t>& ends) {
+        double total = 0, worst = 0;
+        for (int i = 1; i < kFrames; ++i) {
+            double jitter = std::abs(static_cast<double>(ends[i] - ends[i - 1] - period)) / 1000;
+            total += jitter;
+            worst = std::max(worst, jitter);
         }
+        double drift = static_cast<double>(ends.back() - start - period * kFrames) / 1000;
+        std::cout << "  " << name << ": mean jitter " << total / (kFrames - 1) << " us, max " << worst
+                  << " us, drift " << drift << " us\n";
+    };
 
-        SDL_RenderPresent(renderer);
+    std::vector<int64_t> ends(kFrames);
+    int64_t start = FramePacer::Now();
+    for (int i = 0; i < kFrames; ++i) {
+        int64_t frame_start = FramePacer::Now();
+        busy(work[i]);
+        int64_t elapsed_ms = (FramePacer::Now() - frame_start) / 1000000;
+        int64_t delay_ms = period / 1000000 - elapsed_ms;
+        if (delay_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        ends[i] = FramePacer::Now();
     }
+    report("relative ms delay", start, ends);
 
-    void HandleEvents(bool& running) {
-        SDL_Event e;
-        while (SDL_PollEvent(&e) != 0) {
-            if (e.type == SDL_QUIT) {
-                running = false;
+    FramePacer pacer(kSpeed);
+    pacer.Pace(frame_rate);     // Starts the schedule
+    start = FramePacer::Now();
+    for (int i = 0; i < kFrames; ++i) {
+        busy(work[i]);
+        pacer.Pace(frame_rate);
+        ends[i] = FramePacer::Now();
+    }
+    report("absolute deadline", start, ends);
+    pacer.DumpJitter(std::cout);
+}
+
+// A title's first frame with empty pipeline and vertex loader caches, then
+// after loading the cache file the first run saved and precompiling it
+void BenchmarkShaderCache() {
+    std::vector<GXRasterState> states = MakeRandomTevStates(512, 11);
+    std::vector<GXVertex> soup = MakeTriangleSoup(states.size() * 4, 32.0f, 5);
+    std::vector<GXVertexLoaderKey> formats;
+    for (uint32_t position = 0; position < 10; ++position) {
+        for (uint32_t color = 0; color < 6; ++color) {
+            uint32_t vat_a = (position & 1) | (position / 2) << 1 | 4 << 4 | color << 14;
+            formats.push_back(GXVertexLoaderKey{{1u << 9 | 1u << 13, 0, vat_a, 0, 0}});
+        }
+    }
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "emuwii-bench.gxcache";
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    std::cout << "shadercache: first frame of " << states.size() << " TEV setups and " << formats.size()
+              << " vertex formats\n";
+
+    for (bool warm : {false, true}) {
+        SWRenderer renderer(1);
+        GXVertexLoaderCache loaders;
+        GXShaderCache cache(path);
+        size_t loaded = 0;
+        double precompile = MeasureSeconds([&] {
+            if (!warm) return;
+            loaded = cache.Load();
+            cache.Precompile(renderer.GetPipelineCache(), loaders);
+            cache.Wait();
+        });
+        GXPixelPipelineCache::Stats before = renderer.GetPipelineStats();
+        double frame = MeasureSeconds([&] {
+            for (const GXVertexLoaderKey& key : formats) loaders.Get(key);
+            for (size_t i = 0; i < states.size(); ++i) {
+                renderer.SetState(states[i]);
+                for (size_t v = i * 12; v < i * 12 + 12; v += 3) renderer.DrawTriangle(soup[v], soup[v + 1], soup[v + 2]);
             }
-            // Handle other input events here
+            renderer.Flush();
+        });
+        GXVertexLoaderCache::Stats loader_stats = loaders.GetStats();
+        std::cout << "  " << (warm ? "warm" : "cold") << ": ";
+        if (warm) std::cout << loaded << " keys precompiled in " << precompile * 1e3 << " ms; ";
+        std::cout << "first frame " << frame * 1e3 << " ms, built "
+                  << renderer.GetPipelineStats().compiled - before.compiled << " pipelines and "
+                  << loader_stats.loaders - loader_stats.precompiled << " loaders during it\n";
+        if (!warm && cache.Save(renderer.GetPipelineCache(), loaders) == 0) {
+            std::cerr << "Shader cache benchmark: could not write " << path << "\n";
         }
     }
+    std::filesystem::remove(path, error);
+}
 
-    void Cleanup() {
-        if (framebuffer_texture) {
-            SDL_DestroyTexture(framebuffer_texture);
-            framebuffer_texture = nullptr;
+// Per-format decode throughput of a 512x512 texture at each SIMD level,
+// checked against the scalar decode
+void BenchmarkTextureDecode() {
+    constexpr int kSize = 512;
+    constexpr int kRepeats = 50;
+    const uint8_t formats[] = {kTexI4, kTexI8, kTexIA4, kTexIA8, kTexRGB565, kTexRGB5A3,
+                               kTexRGBA8, kTexC4, kTexC8, kTexC14X2, kTexCMPR};
+    std::vector<uint8_t> source(TextureEncodedSize(kTexRGBA8, kSize, kSize));
+    std::vector<uint8_t> tlut(16384 * 2);
+    uint32_t seed = 1;
+    for (uint8_t& byte : source) byte = static_cast<uint8_t>((seed = seed * 1664525u + 1013904223u) >> 24);
+    for (uint8_t& byte : tlut) byte = static_cast<uint8_t>((seed = seed * 1664525u + 1013904223u) >> 24);
+    std::vector<uint32_t> reference(kSize * kSize), pixels(kSize * kSize);
+
+    std::cout << "texture: " << kSize << "x" << kSize << " decode, Mpix/s"
+              << " (host: " << SimdLevelName(HostSimdLevel()) << ")\n";
+    for (uint8_t format : formats) {
+        std::cout << "  " << GetTextureFormatInfo(format)->name << ":";
+        DecodeTexture(reference.data(), source.data(), format, kSize, kSize, tlut.data(), kTlutRGB5A3,
+                      SimdLevel::kScalar);
+        SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kSSSE3, SimdLevel::kAVX2};
+        for (SimdLevel level : levels) {
+            if (level > HostSimdLevel()) continue;
+            double seconds = MeasureSeconds([&] {
+                for (int r = 0; r < kRepeats; ++r) {
+                    DecodeTexture(pixels.data(), source.data(), format, kSize, kSize, tlut.data(), kTlutRGB5A3, level);
+                }
+            });
+            std::cout << " " << SimdLevelName(level) << " " << static_cast<double>(kSize) * kSize * kRepeats / seconds / 1e6;
+            if (pixels != reference) {
+                std::cout << " (MISMATCH)";
+            }
         }
-        if (renderer) {
-            SDL_DestroyRenderer(renderer);
-            renderer = nullptr;
+        std::cout << "\n";
+    }
+}
+
+// Generated loaders against the template steps over a spread of vertex
+// formats (every index type, component and color format) from random
+// streams and arrays; outputs must match bit for bit
+void BenchmarkVertexLoader() {
+    constexpr uint32_t kVertices = 1 << 16;
+    constexpr int kRepeats = 50;
+    struct Case {
+        const char* name;
+        uint32_t vcd_lo, vcd_hi, vat_a;
+    };
+    const Case cases[] = {
+        {"f32 pos, rgba8", 1u << 9 | 1u << 13, 0, 1 | kCompF32 << 1 | 1u << 13 | kColorRGBA8888 << 14},
+        {"pmidx, s16 pos i16, rgb565 i8, u8 uv", 1 | 3u << 9 | 2u << 13, 1,
+         1 | kCompS16 << 1 | 8 << 4 | kColorRGB565 << 14 | 1u << 21 | kCompU8 << 22 | 7u << 25},
+        {"s8 pos, nrm, rgba4444, s16 uv i16", 1u << 9 | 1u << 11 | 1u << 13, 3,
+         1 | kCompS8 << 1 | 6 << 4 | kCompS8 << 10 | kColorRGBA4444 << 14 | 1u << 21 | kCompS16 << 22 | 10u << 25},
+        {"u16 xy i8, rgba6, col1, f32 uv", 2u << 9 | 1u << 13 | 1u << 15, 1,
+         kCompU16 << 1 | 4 << 4 | kColorRGBA6 << 14 | kColorRGB888x << 18 | 1u << 21 | kCompF32 << 22},
+        {"rgb888 i16 only", 3u << 13, 0, kColorRGB888 << 14},
+        {"s16 pos i8, s16 nrm i8, rgb888 i8", 2u << 9 | 2u << 11 | 2u << 13, 0,
+         1 | kCompS16 << 1 | 8 << 4 | kCompS16 << 10 | kColorRGB888 << 14},
+    };
+
+    uint32_t seed = 1;
+    auto random_bytes = [&seed](std::vector<uint8_t>& bytes) {
+        for (uint8_t& byte : bytes) byte = static_cast<uint8_t>((seed = seed * 1664525u + 1013904223u) >> 24);
+    };
+    std::vector<uint8_t> array_data[kLoaderArrays];
+    GXLoaderArrays arrays = {};
+    arrays.zero = kGXZeroAttribute;
+    for (int a = 0; a < kLoaderArrays; ++a) {
+        array_data[a].resize(64 * 1024);
+        random_bytes(array_data[a]);
+        arrays.base[a] = array_data[a].data();
+        arrays.stride[a] = 12;
+        arrays.limit[a] = static_cast<uint32_t>(array_data[a].size()) - 12 + 1;
+    }
+
+    std::cout << "vertexloader: " << kVertices << " vertices, Mvertices/s\n";
+    for (const Case& test : cases) {
+        GXVertexLoaderKey key = {{test.vcd_lo, test.vcd_hi, test.vat_a, 0, 0}};
+        GXVertexLoader steps(key, false), compiled(key, true);
+        std::vector<uint8_t> stream(kVertices * steps.GetFormat().stride);
+        random_bytes(stream);
+
+        GXVertexStreams results[2];
+        double rates[2];
+        const GXVertexLoader* loaders[2] = {&steps, &compiled};
+        for (int i = 0; i < 2; ++i) {
+            results[i].Resize(kVertices);
+            GXLoaderOutput out;
+            for (int c = 0; c < kVertexChannels; ++c) out.channel[c] = results[i].channel[c].data();
+            out.matrix = results[i].matrix.data();
+            double seconds = MeasureSeconds([&] {
+                for (int r = 0; r < kRepeats; ++r) loaders[i]->Load(stream.data(), kVertices, out, arrays);
+            });
+            rates[i] = static_cast<double>(kVertices) * kRepeats / seconds / 1e6;
         }
-        if (window) {
-            SDL_DestroyWindow(window);
-            window = nullptr;
+        bool match = results[0].matrix == results[1].matrix;
+        for (int c = 0; c < kVertexChannels; ++c) {
+            uint8_t flags = steps.GetFlags();
+            if (c >= kChannelColor && c < kChannelTexCoord && !(flags & GXVertexLoader::kHasColor)) continue;
+            if (c >= kChannelNormal && !(flags & GXVertexLoader::kHasNormal)) continue;
+            match = match && std::memcmp(results[0].channel[c].data(), results[1].channel[c].data(),
+                                         kVertices * sizeof(float)) == 0;
+        }
+        std::cout << "  " << test.name << ": steps " << rates[0];
+        if (compiled.IsCompiled()) {
+            std::cout << ", jit " << rates[1] << " (" << rates[1] / rates[0] << "x)";
+        } else {
+            std::cout << ", jit unavailable";
+        }
+        std::cout << (match ? "\n" : " (MISMATCH)\n");
+        if (!match) {
+            std::cerr << "Vertex loader benchmark: generated loader differs for " << test.name << "\n";
         }
-        SDL_Quit();
     }
+}
 
-private:
-    SDL_Window* window;
-    SDL_Renderer* renderer;
-    SDL_Texture* framebuffer_texture;
-};
+// XF transform throughput per SIMD level over vertices with per-vertex
+// matrix indices, unlit and with eight lights plus a texgen; every level must
+// match the scalar reference bit for bit
+void BenchmarkTransform() {
+    constexpr uint32_t kVertices = 16 * 1024;
+    constexpr int kRepeats = 160;
+    constexpr int kMatrices = 10;
+    uint32_t seed = 5;
+    auto random = [&seed](float low, float high) {
+        seed = seed * 1664525u + 1013904223u;
+        return low + (high - low) * static_cast<float>(seed >> 8) / 16777216.0f;
+    };
+    std::vector<uint32_t> xf_memory(kXFMemoryWords), xf_regs(kXFRegisterCount);
+    auto store = [](uint32_t* words, std::initializer_list<float> values) {
+        for (float value : values) std::memcpy(words++, &value, sizeof(value));
+    };
 
-// Kernel Function Table
-using SyscallHandler = void(*)(CPUState&);
-std::unordered_map<uint32_t, SyscallHandler> syscall_table;
+    // Scaled rotations pushed down -z, three rows per matrix as games pack them
+    for (int m = 0; m < kMatrices; ++m) {
+        float angle = random(0.0f, 6.2831853f), scale = random(0.5f, 2.0f);
+        float c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+        store(&xf_memory[m * 12], {c, -s, 0, random(-20, 20), s, c, 0, random(-20, 20), 0, 0, scale, random(-90, -60)});
+        store(&xf_memory[kXFNormalMatrices + m * 9], {c, -s, 0, s, c, 0, 0, 0, scale});
+    }
+    store(&xf_memory[kMatrices * 12], {0.02f, 0, 0, 0.5f, 0, 0.02f, 0, 0.5f, 0, 0, 0, 1});
+    for (int l = 0; l < kGXLights; ++l) {
+        uint32_t* words = &xf_memory[kXFLights + l * 16];
+        words[3] = static_cast<uint32_t>(random(0, 4294967040.0f));
+        float dx = random(-1, 1), dy = random(-1, 1), dz = random(-1, 1);
+        float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+        store(words + 4, {random(-1, 0), random(0, 2), random(0, 1), 1, random(0, 0.05f), random(0, 0.001f),
+                          random(-50, 50), random(-50, 50), random(-100, 0), dx / length, dy / length, dz / length});
+    }
+    store(&xf_regs[kXFViewport], {320, -240, 8388607, kGXScreenOffset + 320, kGXScreenOffset + 240, 8388607});
+    store(&xf_regs[kXFProjection], {1.5f, 0, 2.0f, 0, -1.0f, -0.1f});
 
-// Function Prototypes
-bool InitializeWiiSubsystems();
-bool LoadGame(const std::string& filename, CPUState& state, Memory& memory);
-void TriggerInterrupt(int interrupt_type, CPUState& state);
-bool HandleStarletCommand(CPUState& state, Memory& memory);
-void ExecuteInstruction(uint32_t instruction, CPUState& state, Memory& memory);
-uint32_t FetchInstruction(const CPUState& state, const Memory& memory);
-uint32_t GetInterruptVector(int interrupt_type);
-void HandleSystemCall(uint32_t syscall_number, CPUState& state);
-void InitializeKernelFunctions();
+    GXVertexStreams streams;
+    streams.Resize(kVertices);
+    for (uint32_t i = 0; i < kVertices; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            streams.channel[kChannelPosition + c][i] = random(-15, 15);
+            streams.channel[kChannelNormal + c][i] = random(-1, 1);
+        }
+        for (int c = 0; c < 4; ++c) streams.channel[kChannelColor + c][i] = std::floor(random(0, 256));
+        for (int c = 0; c < 2; ++c) streams.channel[kChannelTexCoord + c][i] = random(0, 1);
+        // Runs of six vertices per matrix: blocks both share and mix indices
+        streams.matrix[i] = static_cast<uint8_t>((i / 6) % kMatrices * 3);
+    }
 
-// Helper Functions
-void SyscallPrint(CPUState& state, const Memory& memory) {
-    uint32_t address = state.gpr[3]; // Assuming r3 holds the address of the string
-    std::string str;
-    try {
-        uint8_t* data = memory.GetData();
-        while (true) {
-            char c = data[address];
-            if (c == '\0') break;
-            str += c;
-            address++;
-            if (address >= kMemorySize) {
-                throw std::out_of_range("String read out of bounds.");
+    struct Case {
+        const char* name;
+        uint32_t num_colors, color_control, alpha_control, num_texgens, texgen;
+    };
+    const Case cases[] = {
+        {"unlit", 0, 0, 0, 0, 0},
+        // Color: vertex material, clamped diffuse, spot lights 0-7; alpha:
+        // signed diffuse, specular lights 0-1; texgen from the normal, STQ
+        {"8 lights + texgen", 1, 1 | 2 | 0xF << 2 | kDiffuseClamp << 7 | kAttenuationSpot << 9 | 0xFu << 11,
+         2 | 3 << 2 | kDiffuseSign << 7 | kAttenuationSpecular << 9, 1, 2 | 4 | 1 << 7},
+    };
+
+    std::cout << "xform: " << kVertices << " vertices, " << kMatrices << " matrices, Mvertices/s"
+              << " (host: " << SimdLevelName(HostSimdLevel()) << ")\n";
+    for (const Case& test : cases) {
+        xf_regs[kXFNumColors] = test.num_colors;
+        xf_regs[kXFAmbient0] = 0x20304050;
+        xf_regs[kXFMatColor0] = 0xC0A080FF;
+        xf_regs[kXFColor0Control] = test.color_control;
+        xf_regs[kXFAlpha0Control] = test.alpha_control;
+        xf_regs[kXFNumTexGens] = test.num_texgens;
+        xf_regs[kXFTexGen0] = test.texgen;
+        xf_regs[kXFMatrixIndexA] = kMatrices * 3 << 6;
+        GXTransformSetup setup = MakeTransformSetup(xf_memory.data(), xf_regs.data());
+        setup.flags = GXVertexLoader::kHasMatrix | GXVertexLoader::kHasColor | GXVertexLoader::kHasNormal;
+
+        std::vector<GXVertex> reference, vertices(kVertices);
+        std::vector<uint8_t> reference_visible, visible(kVertices);
+        double scalar_rate = 0;
+        std::cout << "  " << test.name << ":";
+        SimdLevel levels[] = {SimdLevel::kScalar, SimdLevel::kSSSE3, SimdLevel::kAVX2};
+        for (SimdLevel level : levels) {
+            if (level > HostSimdLevel()) continue;
+            GXTransformKernel kernel = GXTransformKernelFor(level);
+            double seconds = MeasureSeconds([&] {
+                for (int r = 0; r < kRepeats; ++r) kernel(setup, streams, 0, kVertices, vertices.data(), visible.data());
+            });
+            double rate = static_cast<double>(kVertices) * kRepeats / seconds / 1e6;
+            std::cout << (level == SimdLevel::kScalar ? " " : ", ") << SimdLevelName(level) << " " << rate;
+            if (level == SimdLevel::kScalar) {
+                scalar_rate = rate;
+                reference = vertices;
+                reference_visible = visible;
+                continue;
+            }
+            std::cout << " (" << rate / scalar_rate << "x)";
+            if (std::memcmp(vertices.data(), reference.data(), kVertices * sizeof(GXVertex)) != 0 ||
+                visible != reference_visible) {
+                std::cout << " (MISMATCH)";
+                std::cerr << "Transform benchmark: " << SimdLevelName(level) << " differs from scalar for "
+                          << test.name << "\n";
             }
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Syscall Print Error: " << e.what() << "\n";
-        state.running = false;
-        return;
+        std::cout << "\n";
     }
-    std::cout << "Syscall Print: " << str << "\n";
 }
 
-void SyscallExit(CPUState& state) {
-    std::cout << "Syscall Exit: Terminating Emulation.\n";
-    state.running = false;
+// One GX command stream for the display list and EFB copy benchmarks
+struct GXCommandWriter {
+    std::vector<uint8_t> bytes;
+
+    void U8(uint8_t value) { bytes.push_back(value); }
+    void U16(uint16_t value) { U8(static_cast<uint8_t>(value >> 8)); U8(static_cast<uint8_t>(value)); }
+    void U32(uint32_t value) { U16(static_cast<uint16_t>(value >> 16)); U16(static_cast<uint16_t>(value)); }
+    void F32(float value) { uint32_t bits; std::memcpy(&bits, &value, 4); U32(bits); }
+
+    void LoadCP(uint8_t reg, uint32_t value) { U8(kGXLoadCPReg); U8(reg); U32(value); }
+    void LoadBP(uint8_t reg, uint32_t value) { U8(kGXLoadBPReg); U32(static_cast<uint32_t>(reg) << 24 | value); }
+    void LoadXF(uint16_t address, const std::vector<float>& values) {
+        U8(kGXLoadXFReg);
+        U32(static_cast<uint32_t>(values.size() - 1) << 16 | address);
+        for (float value : values) F32(value);
+    }
+};
+
+// A static display list of small direct-format triangles (float position,
+// RGBA8 color) called once per frame, interpreted against replayed from the
+// cache; both must leave the same EFB
+void BenchmarkDisplayList() {
+    constexpr uint32_t kTriangles = 20000;
+    constexpr int kFrames = 20;
+    constexpr uint32_t kListAddress = 0x00100000;
+    std::vector<GXVertex> soup = MakeTriangleSoup(kTriangles, 16.0f, 7);
+
+    // Identity position matrix, pixel-space orthographic projection and viewport
+    GXCommandWriter setup;
+    setup.LoadXF(0, {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0});
+    setup.LoadXF(kXFRegisterBase + kXFViewport, {1, 1, 0, kGXScreenOffset, kGXScreenOffset, 0});
+    setup.LoadXF(kXFRegisterBase + kXFProjection, {1, 0, 1, 0, 0, 0, 1});
+    GXCommandWriter list;
+    list.LoadCP(kCPVCDLo, 1u << 9 | 1u << 13);
+    list.LoadCP(kCPVATA, 1 | kCompF32 << 1 | 1u << 13 | kColorRGBA8888 << 14);
+    list.U8(kGXDrawTriangles);
+    list.U16(static_cast<uint16_t>(std::min<size_t>(soup.size(), 0xFFFF)));
+    for (size_t i = 0; i < soup.size() && i < 0xFFFF; ++i) {
+        list.F32(soup[i].x);
+        list.F32(soup[i].y);
+        list.F32(soup[i].z * kGXMaxDepth);
+        for (int c = 0; c < 4; ++c) list.U8(static_cast<uint8_t>(soup[i].color[c]));
+    }
+    while (list.bytes.size() % 32) list.U8(kGXNop);
+    GXCommandWriter call;
+    call.U8(kGXCallDisplayList);
+    call.U32(kListAddress);
+    call.U32(static_cast<uint32_t>(list.bytes.size()));
+
+    Memory memory;
+    std::memcpy(memory.GetContiguousRange(kListAddress, static_cast<uint32_t>(list.bytes.size())), list.bytes.data(),
+                list.bytes.size());
+    memory.MarkDirty(kListAddress, static_cast<uint32_t>(list.bytes.size()));
+
+    std::cout << "displaylist: " << list.bytes.size() / 1024 << " KB list, " << kFrames << " calls\n";
+    std::vector<uint32_t> efb[2];
+    double seconds[2];
+    for (int cached = 0; cached < 2; ++cached) {
+        SWRenderer renderer(1);
+        GXPipeline pipeline(memory, renderer);
+        pipeline.SetDisplayListCacheEnabled(cached);
+        pipeline.Execute(setup.bytes.data(), setup.bytes.size());
+        seconds[cached] = MeasureSeconds([&] {
+            for (int frame = 0; frame < kFrames; ++frame) {
+                renderer.Clear(0x000000FF, kGXMaxDepth);
+                pipeline.Execute(call.bytes.data(), call.bytes.size());
+                renderer.Flush();
+            }
+        });
+        efb[cached].resize(kEFBWidth * kEFBHeight);
+        renderer.ResolveToFramebuffer(efb[cached].data(), kEFBWidth, kEFBHeight);
+        const GXPipeline::Stats& stats = pipeline.GetStats();
+        std::cout << "  " << (cached ? "replayed:    " : "interpreted: ") << seconds[cached] * 1e3 / kFrames
+                  << " ms/call, " << stats.display_list_replays << "/" << stats.display_lists << " replayed\n";
+    }
+    if (efb[0] != efb[1]) {
+        std::cerr << "Display list benchmark: replayed EFB differs\n";
+    }
+    std::cout << "  speedup: " << seconds[0] / seconds[1] << "x (rasterization included)\n";
 }
 
-// Initialize Kernel System Call Handlers
-void InitializeKernelFunctions() {
-    syscall_table[0x01] = [](CPUState& state) { 
-        // Lambda capturing by reference to access memory if needed
-        // This requires passing memory as well; consider redesign if needed
-        // For simplicity, assuming memory is accessible globally or via other means
-        // Here, we cannot capture memory, so refactor syscall_print
-        // Placeholder: Actual implementation would require better design
-        // For now, not implemented
+// Texture copies of a changing EFB sampled straight back, as render-to-
+// texture effects do: encoded into RAM and decoded by the texture cache (the
+// reference) against kept on the host. The sampled pixels must match, a
+// textured quad drawn through the pipeline must show the copy's texels,
+// served from the store when there is one, and a CPU read of a pending copy
+// must fault the same bytes into RAM.
+void BenchmarkEFBCopy() {
+    constexpr int kFrames = 60;
+    constexpr uint32_t kCopyAddress = 0x00400000;
+    struct CopyCase {
+        const char* name;
+        uint8_t copy_format;
+        bool half;
+        bool intensity;
     };
-    syscall_table[0x02] = SyscallExit;  // Syscall 2: Exit Emulator
-    // Add more syscalls as needed
-}
+    const CopyCase cases[] = {
+        {"RGBA8", kCopyRGBA8, false, false}, {"RGB565", kCopyRGB565, false, false},
+        {"RGB5A3 half", kCopyRGB5A3, true, false}, {"IA4 half", kCopyRA4, true, true},
+        {"I8 luma", kCopyR8Low, false, true}, {"A8", kCopyA8, false, false},
+    };
+    SWRenderer renderer(1);
+    std::vector<GXVertex> soup = MakeTriangleSoup(5000, 64.0f, 23);
+    renderer.Clear(0x20406080, kGXMaxDepth);
+    for (size_t i = 0; i < soup.size(); i += 3) renderer.DrawTriangle(soup[i], soup[i + 1], soup[i + 2]);
+    renderer.Flush();
+    std::cout << "efbcopy: " << kEFBWidth << "x" << kEFBHeight << " texture copies sampled back, " << kFrames
+              << " frames\n";
 
-// Main Function
-int main(int argc, char* argv[]) {
-    try {
-        // Initialize SDL
-        SDLWrapper sdl;
-        sdl.Initialize("Wii Emulator", kScreenWidth, kScreenHeight);
+    for (const CopyCase& copy : cases) {
+        uint8_t format = static_cast<uint8_t>(GXCopyTextureFormat(copy.copy_format));
+        const TextureFormatInfo* info = GetTextureFormatInfo(format);
+        int width = copy.half ? kEFBWidth / 2 : kEFBWidth, height = copy.half ? kEFBHeight / 2 : kEFBHeight;
+        uint32_t stride = (width + info->block_width - 1) / info->block_width * info->block_bytes;
+        uint32_t size = static_cast<uint32_t>(TextureEncodedSize(format, width, height));
+        uint32_t encoded = (copy.copy_format & 7u) << 1 | copy.copy_format >> 3;
+        GXCommandWriter commands;
+        commands.LoadBP(kBPCopySrcTL, 0);
+        commands.LoadBP(kBPCopySrcWH, (kEFBHeight - 1) << 10 | (kEFBWidth - 1));
+        commands.LoadBP(kBPCopyDstBase, kCopyAddress >> 5);
+        commands.LoadBP(kBPCopyDstStride, stride / 32);
+        commands.LoadBP(kBPCopyExecute, encoded << 3 | uint32_t{copy.half} << 9 | uint32_t{copy.intensity} << 15);
 
-        // Initialize Emulator Subsystems
-        if (!InitializeWiiSubsystems()) {
-            throw std::runtime_error("Failed to initialize Wii subsystems.");
+        // A kQuad-pixel square at the EFB origin, one unit in front of the eye
+        // (w = 1), showing the copy's top-left texels 1:1: texture map 0
+        // passed straight through TEV stage 0
+        constexpr int kQuad = 64;
+        GXCommandWriter draw;
+        draw.LoadXF(0, {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0});
+        draw.LoadXF(kXFRegisterBase + kXFViewport, {1, 1, 0, kGXScreenOffset, kGXScreenOffset, 0});
+        draw.LoadXF(kXFRegisterBase + kXFProjection, {1, 0, 1, 0, 0, 0, 1});
+        draw.LoadBP(kBPTevColorEnv, kTevTexC | kTevZeroC << 4 | kTevZeroC << 8 | kTevZeroC << 12 | 1u << 19);
+        draw.LoadBP(kBPTevColorEnv + 1, kTevTexAlpha << 4 | kTevZeroA << 7 | kTevZeroA << 10 | kTevZeroA << 13 |
+                                        1u << 19);
+        draw.LoadBP(kBPTevOrder, 1u << 6);
+        draw.LoadBP(kBPTexMode0, kWrapClamp);
+        draw.LoadBP(kBPTexImage0, static_cast<uint32_t>(width - 1) | static_cast<uint32_t>(height - 1) << 10 |
+                                  uint32_t{format} << 20);
+        draw.LoadBP(kBPTexImage3, kCopyAddress >> 5);
+        draw.LoadCP(kCPVCDLo, 1u << 9);
+        draw.LoadCP(kCPVCDHi, 1);
+        draw.LoadCP(kCPVATA, 1 | kCompF32 << 1 | 1u << 21 | kCompF32 << 22);
+        draw.U8(kGXDrawQuads);
+        draw.U16(4);
+        for (int corner : {0, 1, 3, 2}) {
+            float x = static_cast<float>(corner & 1 ? kQuad : 0), y = static_cast<float>(corner & 2 ? kQuad : 0);
+            for (float value : {x, y, -1.0f, x / static_cast<float>(width), y / static_cast<float>(height)}) {
+                draw.F32(value);
+            }
         }
 
-        // Initialize CPU and Memory
-        CPUState cpu_state;
-        Memory memory;
+        std::vector<uint32_t> sampled[2], faulted[2];
+        std::vector<uint8_t> ram[2];
+        double seconds[2] = {};
+        for (int host = 0; host < 2; ++host) {
+            Memory memory;
+            EFBCopyStore store(memory);
+            EFBCopyStore* copies = host ? &store : nullptr;
+            GXPipeline pipeline(memory, renderer);
+            pipeline.SetEFBCopyStore(copies);
+            TextureCache& cache = pipeline.GetTextureCache();
+            std::shared_ptr<const CachedTexture> texture;
+            for (int frame = 0; frame < kFrames; ++frame) {
+                renderer.PokeColor(frame * 7 % kEFBWidth, frame % kEFBHeight, 0x9E3779B1u * (frame + 1));
+                seconds[host] += MeasureSeconds([&] {
+                    pipeline.Execute(commands.bytes.data(), commands.bytes.size());
+                    if (copies) copies->ApplyProtection();
+                    texture = cache.Get(kCopyAddress, format, width, height);
+                });
+            }
+            if (texture) sampled[host] = texture->pixels;
 
-        // Initialize Kernel Functions
-        InitializeKernelFunctions();
+            std::vector<SWRenderer::EFBTile> efb;
+            renderer.SaveEFB(efb);
+            cache.EndFrame();
+            pipeline.Execute(draw.bytes.data(), draw.bytes.size());
+            cache.EndFrame();
+            bool shown = texture != nullptr && cache.GetFrameStats().efb_copy_hits == uint64_t{copies != nullptr};
+            renderer.Flush();
+            for (int y = 0; y < kQuad && shown; ++y) {
+                for (int x = 0; x < kQuad && shown; ++x) {
+                    shown = renderer.PeekColor(x, y) == texture->pixels[static_cast<size_t>(y) * width + x];
+                }
+            }
+            if (!shown) {
+                std::cerr << "EFB copy benchmark: " << copy.name << " copy drawn through the pipeline differs\n";
+            }
+            renderer.LoadEFB(efb);
 
-        // Load Game
-        std::string game_file = (argc > 1) ? argv[1] : "default_game.iso";
-        if (!LoadGame(game_file, cpu_state, memory)) {
-            throw std::runtime_error("Failed to load game: " + game_file);
+            // The CPU touches the copy: it must reach RAM, and sampling it again decodes those bytes
+            memory.Read<uint32_t>(kCopyAddress + size / 2);
+            const uint8_t* bytes = memory.GetContiguousRange(kCopyAddress, size);
+            ram[host].assign(bytes, bytes + size);
+            if ((texture = cache.Get(kCopyAddress, format, width, height))) faulted[host] = texture->pixels;
+            if (host && store.GetStats().written_back != 1) {
+                std::cerr << "EFB copy benchmark: " << copy.name << " was not written back on the CPU read\n";
+            }
+        }
+        std::cout << "  " << copy.name << ": through RAM " << seconds[0] * 1e3 / kFrames << " ms/frame, on the host "
+                  << seconds[1] * 1e3 / kFrames << " ms/frame (" << seconds[0] / seconds[1] << "x)\n";
+        if (sampled[0].empty() || sampled[0] != sampled[1]) {
+            std::cerr << "EFB copy benchmark: " << copy.name << " host copy differs from the RAM round trip\n";
         }
+        if (ram[0] != ram[1] || faulted[0] != faulted[1] || faulted[1] != sampled[1]) {
+            std::cerr << "EFB copy benchmark: " << copy.name << " written-back copy differs\n";
+        }
+    }
+}
 
-        // Set PC to entry point (placeholder address)
-        cpu_state.pc = 0x80000000; // Example entry point
+// Run-ahead's capture and restore against copying all of RAM, with a frame
+// dirtying kDirtyPages scattered pages, CPU registers and the EFB, and
+// leaving an EFB copy pending in MEM2. After each restore RAM, the EFB, the
+// CPU and the scheduler must match the capture, the copies made ahead must be
+// gone and the captured frame's copy must still fault back into RAM.
+void BenchmarkSavestate() {
+    constexpr int kFrames = 30;
+    constexpr uint32_t kDirtyPages = 512;
+    constexpr uint32_t kCopyBase = 0x90100000;
+    constexpr int kCopySize = 16;   // RGBA8, so 4 blocks of 64 bytes a row
+    CPUState cpu;
+    Memory memory;
+    Hardware hardware(memory);
+    Scheduler scheduler;
+    EmulatorContext context{cpu, memory, hardware, scheduler};
+    SWRenderer renderer(1);
+    EFBCopyStore efb_copies(memory);
+    GXCommandProcessor gx(hardware, renderer, false, true, &efb_copies);
+    GatherPipe gather_pipe;
+    Savestate savestate(context, gx, renderer, gather_pipe, &efb_copies);
+    int tick_event = scheduler.RegisterEvent("Tick", [&](uint64_t, int64_t) {
+        scheduler.ScheduleEvent(1000, tick_event);
+    });
+    scheduler.ScheduleEvent(1000, tick_event);
+    std::vector<GXVertex> soup = MakeTriangleSoup(300, 48.0f, 31);
+    auto copy_address = [&](int frame) { return kCopyBase + static_cast<uint32_t>(frame % 8) * kPageSize; };
 
-        // Main Emulation Loop
-        while (cpu_state.running) {
-            // Handle SDL Events
-            sdl.HandleEvents(cpu_state.running);
+    uint32_t seed = 0x2545F491;
+    auto run_frame = [&](int frame) {
+        for (uint32_t i = 0; i < kDirtyPages; ++i) {
+            seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+            memory.Write<uint32_t>(0x80000000 + seed % (kMem1Size / kPageSize) * kPageSize + (seed & 0xFFC), seed);
+        }
+        for (uint32_t& gpr : cpu.gpr) gpr += seed;
+        cpu.pc += 4 * frame;
+        for (size_t i = 0; i < soup.size(); i += 3) {
+            GXVertex v[3] = {soup[i], soup[i + 1], soup[i + 2]};
+            for (GXVertex& vertex : v) vertex.x += static_cast<float>(frame * 3 % kEFBWidth);
+            renderer.DrawTriangle(v[0], v[1], v[2]);
+        }
+        renderer.Flush();
+        std::vector<uint32_t> texels(kCopySize * kCopySize, MakeRGBA(static_cast<uint32_t>(frame), 0x40, 0x80, 0xFF));
+        efb_copies.Add(copy_address(frame), kTexRGBA8, kCopySize * 16, kCopySize, kCopySize, std::move(texels));
+        scheduler.Advance(kCpuClockHz / 60);
+    };
 
-            // Fetch, Decode, and Execute Instruction
-            uint32_t instruction = FetchInstruction(cpu_state, memory);
-            ExecuteInstruction(instruction, cpu_state, memory);
+    std::vector<uint8_t> full(kMemorySize);
+    std::vector<uint8_t> ram(kMemorySize);
+    std::vector<SWRenderer::EFBTile> efb, restored_efb;
+    double full_seconds = 0, capture_seconds = 0, restore_seconds = 0;
+    bool mismatch = false;
+    double first_capture = MeasureSeconds([&] { savestate.Capture(); });
+    for (int frame = 0; frame < kFrames; ++frame) {
+        run_frame(frame);
+        capture_seconds += MeasureSeconds([&] { savestate.Capture(); });
+        full_seconds += MeasureSeconds([&] { std::memcpy(full.data(), memory.GetRam(), kMemorySize); });
+        CPUState saved_cpu = cpu;
+        uint64_t saved_ticks = scheduler.GetTicks();
+        size_t saved_copies = efb_copies.GetPendingCount();
+        renderer.SaveEFB(efb);
+        for (int ahead = 1; ahead <= 2; ++ahead) run_frame(frame + ahead);
+        restore_seconds += MeasureSeconds([&] { savestate.Restore(); });
+        renderer.SaveEFB(restored_efb);
+        std::memcpy(ram.data(), memory.GetRam(), kMemorySize);
+        mismatch |= ram != full || restored_efb.size() != efb.size() ||
+                    std::memcmp(restored_efb.data(), efb.data(), efb.size() * sizeof(SWRenderer::EFBTile)) != 0 ||
+                    std::memcmp(cpu.gpr, saved_cpu.gpr, sizeof(cpu.gpr)) != 0 || cpu.pc != saved_cpu.pc ||
+                    scheduler.GetTicks() != saved_ticks || scheduler.GetCyclesUntilNextEvent() > 1000;
+        // The first word of an RGBA8 block holds AR of its first two texels
+        uint32_t frame_bits = static_cast<uint32_t>(frame);
+        mismatch |= efb_copies.GetPendingCount() != saved_copies ||
+                    memory.Read<uint32_t>(copy_address(frame)) != (0xFF00FF00u | frame_bits << 16 | frame_bits);
+    }
+    const Savestate::Stats& stats = savestate.GetStats();
+    std::cout << "savestate: " << kMemorySize / (1024 * 1024) << " MB RAM, " << kDirtyPages
+              << " pages dirtied per frame, " << kFrames << " frames run 2 ahead\n";
+    std::cout << "  first capture: " << first_capture * 1e3 << " ms\n";
+    std::cout << "  full RAM copy: " << full_seconds * 1e3 / kFrames << " ms\n";
+    std::cout << "  capture:       " << capture_seconds * 1e3 / kFrames << " ms ("
+              << (stats.pages_saved - kRamPages) / kFrames << " pages)\n";
+    std::cout << "  restore:       " << restore_seconds * 1e3 / kFrames << " ms ("
+              << stats.pages_restored / kFrames << " pages)\n";
+    std::cout << "  capture + restore: " << full_seconds / (capture_seconds + restore_seconds)
+              << "x faster than one full copy\n";
+    if (mismatch) {
+        std::cerr << "Savestate benchmark: restored state differs from the capture\n";
+    }
+}
 
-            // Handle Starlet Commands
-            if (HandleStarletCommand(cpu_state, memory)) {
-                // Processed Starlet command
-            }
+// Run-ahead over a program whose Print syscall sits halfway through the
+// second frame. The speculation after the first frame must stop before the
+// sc without printing; the real second frame then prints once, and the
+// speculations after it, past the sc, must not print again.
+void BenchmarkRunAhead() {
+    constexpr int kFrames = 6;
+    constexpr int kAhead = 2;
+    constexpr uint32_t kFrameCycles = 5000;
+    constexpr uint32_t kSyscallAt = kFrameCycles * 3 / 2;   // Instruction index of the sc
+    constexpr uint32_t kMessage = 0x80100000;
+    CPUState cpu;
+    Memory memory;
+    Hardware hardware(memory);
+    Scheduler scheduler;
+    EmulatorContext context{cpu, memory, hardware, scheduler};
+    SWRenderer renderer(1);
+    GXCommandProcessor gx(hardware, renderer, false);
+    GatherPipe gather_pipe;
+    Savestate savestate(context, gx, renderer, gather_pipe);
+    DiscReader disc;
+    IOSKernel ios(memory, hardware.dma, scheduler, disc, std::filesystem::temp_directory_path() / "emuwii-bench-nand",
+                  0);
+    bool frame_done = false;
+    int frame_event = scheduler.RegisterEvent("Frame", [&](uint64_t, int64_t) {
+        frame_done = true;
+        scheduler.ScheduleEvent(kFrameCycles, frame_event);
+    });
+    scheduler.ScheduleEvent(kFrameCycles, frame_event);
 
-            // Render Frame
-            sdl.Render(cpu_state);
+    // ADD r5, r5, r5 up to the sc, then branch to self
+    constexpr uint32_t kAdd = 0x60000000 | 5u << 21 | 5u << 16 | 5u << 11;
+    for (uint32_t i = 0; i < kSyscallAt; ++i) memory.Write<uint32_t>(0x80000000 + i * 4, kAdd);
+    memory.Write<uint32_t>(0x80000000 + kSyscallAt * 4, 0x44000002);
+    memory.Write<uint32_t>(0x80000000 + kSyscallAt * 4 + 4, 0x48000000);
+    const char message[] = "run-ahead";
+    for (uint32_t i = 0; i < sizeof(message); ++i) {
+        memory.Write<uint8_t>(kMessage + i, static_cast<uint8_t>(message[i]));
+    }
+    cpu.pc = 0x80000000;
+    cpu.gpr[0] = 0x01;      // Print
+    cpu.gpr[3] = kMessage;
 
-            // Delay to control emulation speed (placeholder)
-            SDL_Delay(1);
+    FrameRunner runner(context, ios, frame_done, &savestate, kAhead);
+    const uint64_t prints_before = syscall_stats[0x01].calls;
+    std::vector<uint64_t> prints;
+    std::vector<uint32_t> presented_pc;
+    double seconds = MeasureSeconds([&] {
+        for (int frame = 0; frame < kFrames; ++frame) {
+            runner.Step([&] { gx.Sync(); }, [&] { presented_pc.push_back(cpu.pc); });
+            prints.push_back(syscall_stats[0x01].calls - prints_before);
         }
-
-        // Cleanup is handled by SDLWrapper destructor
-    } catch (const std::exception& e) {
-        std::cerr << "Emulator Error: " << e.what() << "\n";
-        return EXIT_FAILURE;
+    });
+    const FrameRunner::Stats& stats = runner.GetStats();
+    std::cout << "runahead: " << kFrames << " frames run " << kAhead << " ahead, Print at instruction " << kSyscallAt
+              << ": " << seconds * 1e3 / kFrames << " ms/frame, " << stats.ahead << " shown ahead, " << stats.aborted
+              << " cut short, Print ran " << prints.back() << " time(s)\n";
+    // Frame 0's speculation reaches the sc; frame 1 runs it for real
+    if (prints[0] != 0 || prints.back() != 1 || stats.aborted != 1 || stats.ahead != kFrames - 1 ||
+        presented_pc[0] != 0x80000000 + kFrameCycles * 4) {
+        std::cerr << "Run-ahead benchmark: a speculative frame ran the syscall, or it was replayed\n";
     }
+}
 
-    return EXIT_SUCCESS;
+struct BenchmarkEntry {
+    const char* name;
+    void (*run)();
+};
+
+constexpr BenchmarkEntry kBenchmarks[] = {
+    {"memory", BenchmarkMemoryAccess},
+    {"dma", BenchmarkDMA},
+    {"gatherpipe", BenchmarkGatherPipe},
+    {"vertexloader", BenchmarkVertexLoader},
+    {"xform", BenchmarkTransform},
+    {"displaylist", BenchmarkDisplayList},
+    {"swrender", BenchmarkSoftwareRenderer},
+    {"raster", BenchmarkRasterizer},
+    {"tev", BenchmarkTevPipelines},
+    {"hiz", BenchmarkHierarchicalZ},
+    {"xfb", BenchmarkXFB},
+    {"vi", BenchmarkVideoInterface},
+    {"pacer", BenchmarkFramePacer},
+    {"savestate", BenchmarkSavestate},
+    {"runahead", BenchmarkRunAhead},
+    {"efbcopy", BenchmarkEFBCopy},
+    {"shadercache", BenchmarkShaderCache},
+    {"texture", BenchmarkTextureDecode},
+};
+
+bool RunBenchmarks(const std::string& name) {
+    bool found = false;
+    for (const BenchmarkEntry& entry : kBenchmarks) {
+        if (name == "all" || name == entry.name) {
+            entry.run();
+            found = true;
+        }
+    }
+    if (!found) {
+        std::cerr << "Unknown benchmark: " << name << " (available:";
+        for (const BenchmarkEntry& entry : kBenchmarks) std::cerr << " " << entry.name;
+        std::cerr << ", all)\n";
+    }
+    return found;
 }
 
 // Initialize Wii Subsystems: Kernel, Graphics, Audio, Input
@@ -324,8 +11347,25 @@ bool LoadGame(const std::string& filename, CPUState& state, Memory& memory) {
     }
 
     try {
-        file.read(reinterpret_cast<char*>(memory.GetData()), kMemorySize);
-        if (!file) {
+        // Images are loaded at the start of MEM1 (0x80000000 through the BAT
+        // mirror). A disc image (Wii or GameCube magic in its header) only
+        // has its start loaded, as the rest is read through /dev/di; a raw
+        // executable that does not fit is refused rather than run cut short.
+        uint8_t header[0x20] = {};
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        bool disc = LoadBigEndian<uint32_t>(header + 0x18) == kWiiDiscMagic ||
+                    LoadBigEndian<uint32_t>(header + 0x1C) == kGameCubeDiscMagic;
+        file.clear();
+        file.seekg(0, std::ios::end);
+        std::streamoff size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        if (size < 0 || (!disc && size > static_cast<std::streamoff>(kMem1Size))) {
+            std::cerr << "Game image is " << size << " bytes, larger than the " << kMem1Size
+                      << " bytes of MEM1 it is loaded into: " << filename << "\n";
+            return false;
+        }
+        file.read(reinterpret_cast<char*>(memory.GetMem1()), std::min<std::streamoff>(size, kMem1Size));
+        if (file.gcount() == 0) {
             std::cerr << "Failed to load game data into memory.\n";
             return false;
         }
@@ -350,34 +11390,60 @@ void TriggerInterrupt(int interrupt_type, CPUState& state) {
     }
 }
 
+// Disc game IDs map to disc-based titles: 00010000-<4-character ID>
+uint64_t TitleIDFromGameID(const std::string& game_id) {
+    uint32_t low = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        low = (low << 8) | (i < game_id.size() ? static_cast<uint8_t>(game_id[i]) : 0);
+    }
+    return 0x0001000000000000ull | low;
+}
+
 // Handle Starlet Coprocessor Commands
-bool HandleStarletCommand(CPUState& state, Memory& memory) {
-    if (starlet_memory.command != 0) {
-        // Process command
-        switch (starlet_memory.command) {
-            case 0x01: // Example command: Initialize
-                std::cout << "Starlet: Initialize Command Received.\n";
-                starlet_memory.response = 0x00; // Success
-                break;
-            // Add more Starlet command handlers here
-            default:
-                std::cerr << "Starlet: Unknown Command Received: 0x" 
-                          << std::hex << starlet_memory.command << "\n";
-                starlet_memory.response = 0xFF; // Error
-                break;
+// The PPC posts the physical address of an IOS request in HW_IPC_PPCMSG and
+// sets X1 in HW_IPC_PPCCTRL. Starlet acknowledges with Y2 straight away and
+// later returns the finished request through HW_IPC_ARMMSG with Y1, one reply
+// at a time; each raises the IPC interrupt if the PPC enabled it.
+bool HandleStarletCommand(CPUState& state, Hardware& hardware, IOSKernel& ios) {
+    IPCInterface& ipc = hardware.ipc;
+    bool handled = false;
+    if (ipc.ppcctrl & IPCInterface::kCtrlX1) {
+        ipc.ppcctrl = (ipc.ppcctrl & ~IPCInterface::kCtrlX1) | IPCInterface::kCtrlY2;
+        ios.Submit(ipc.ppcmsg);
+        if (ipc.ppcctrl & IPCInterface::kCtrlIY2) {
+            ipc.irq_flag |= IPCInterface::kIrqIPC;
         }
-        // Reset command after handling
-        starlet_memory.command = 0;
+        handled = true;
+    }
 
-        // Optionally trigger an interrupt to notify the CPU
-        TriggerInterrupt(1, state); // Assuming 1 is the Starlet interrupt
-        return true;
+    uint32_t reply = 0;
+    if (!(ipc.ppcctrl & IPCInterface::kCtrlY1) && ios.PopReply(reply)) {
+        ipc.armmsg = reply;
+        ipc.ppcctrl |= IPCInterface::kCtrlY1;
+        if (ipc.ppcctrl & IPCInterface::kCtrlIY1) {
+            ipc.irq_flag |= IPCInterface::kIrqIPC;
+        }
+        handled = true;
     }
-    return false;
+
+    if (handled) {
+        hardware.pi.SetInterrupt(ProcessorInterface::kIntIPC, (ipc.irq_flag & ipc.irq_mask) != 0);
+        if (hardware.pi.HasPendingInterrupt()) {
+            TriggerInterrupt(1, state); // Assuming 1 is the Starlet interrupt
+        }
+    }
+    return handled;
+}
+
+// Whether ExecuteInstruction hands the instruction to HandleSystemCall: sc,
+// primary opcode 17
+bool IsSystemCall(uint32_t instruction) {
+    return (instruction >> 26) == 0x11;
 }
 
 // Execute a Single PowerPC Instruction
-void ExecuteInstruction(uint32_t instruction, CPUState& state, Memory& memory) {
+void ExecuteInstruction(uint32_t instruction, EmulatorContext& context) {
+    CPUState& state = context.cpu;
     uint32_t opcode = (instruction >> 26) & 0x3F; // Top 6 bits
 
     try {
@@ -407,10 +11473,12 @@ void ExecuteInstruction(uint32_t instruction, CPUState& state, Memory& memory) {
                 state.pc += 4;
                 break;
             }
-            case 0x7C: { // System Call (SYSCALL)
-                // Example: Using a custom opcode to trigger system calls
-                uint32_t syscall_number = state.gpr[3]; // Assuming r3 holds syscall number
-                HandleSystemCall(syscall_number, state);
+            case 0x11: { // System Call (sc)
+                // The syscall number is in r0 and its arguments from r3 on;
+                // execution resumes after the sc
+                uint32_t syscall_number = state.gpr[0];
+                state.pc += 4;
+                HandleSystemCall(syscall_number, context);
                 break;
             }
             // Implement additional opcodes here
@@ -450,12 +11518,11 @@ uint32_t GetInterruptVector(int interrupt_type) {
 }
 
 // Handle System Calls
-void HandleSystemCall(uint32_t syscall_number, CPUState& state) {
-    auto it = syscall_table.find(syscall_number);
-    if (it != syscall_table.end()) {
-        it->second(state);
+void HandleSystemCall(uint32_t syscall_number, EmulatorContext& context) {
+    if (syscall_number < kSyscallTableSize && syscall_table[syscall_number].handler) {
+        CallKernelFunction(syscall_table[syscall_number], syscall_stats[syscall_number], context);
     } else {
-        std::cerr << "Unknown syscall number: 0x" << std::hex << syscall_number << "\n";
-        state.running = false;
+        std::cerr << "Unknown syscall number: 0x" << std::hex << syscall_number << std::dec << "\n";
+        context.cpu.running = false;
     }
 }